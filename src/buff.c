@@ -2,14 +2,107 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <pthread.h>
 
 #include "errno.h"
 #include "proto.h"
 #include "buff.h"
+#include "csum.h"
+#include "slab.h"
+#include "pool.h"
+#include "tstamp.h"
+
+static struct slab_cache *msg_cache;
+static struct pool *msg_pool;
+static pthread_once_t msg_cache_once = PTHREAD_ONCE_INIT;
+static uint16_t msg_room_head;          // default room of msg_buff_alloc()
+static uint16_t msg_room_tail;
+
+static void msg_cache_setup(void)
+{
+    msg_cache = slab_cache_init(MSG_BUFF_OBJ_SIZE);
+    msg_pool = pool_init();
+}
+
+/* data lives behind a slab msg_buff, it is released with the msg_buff only */
+static inline int msg_data_src_is_inline(const void *data)
+{
+    return msg_cache != NULL && slab_owns(msg_cache, data);
+}
+
+/*
+ * Payload memory comes from the size class pool. Room in front of and
+ * behind the data only exists in pool memory, the heap is the fallback
+ * when none is asked for.
+ */
+static struct data_src *msg_data_src_alloc_room(uint32_t size, uint16_t headroom, uint16_t tailroom)
+{
+    uint8_t *buf;
+
+    pthread_once(&msg_cache_once, msg_cache_setup);
+
+    buf = (uint8_t *)pool_alloc(msg_pool, headroom + size + tailroom);
+    if (buf != NULL) {
+        return (struct data_src *)(buf + headroom);
+    }
+
+    if (headroom || tailroom) {
+        return NULL;
+    }
+
+    return (struct data_src *)malloc(size);
+}
+
+static struct data_src *msg_data_src_alloc(uint32_t size)
+{
+    return msg_data_src_alloc_room(size, 0, 0);
+}
+
+/* Bounds of the slab or pool object data lives in, 0 for heap memory. */
+static int msg_data_src_bounds(const void *data, uint8_t **head, uint8_t **end)
+{
+    uint8_t *base;
+
+    if (msg_data_src_is_inline(data)) {
+        base = (uint8_t *)((uintptr_t)data & ~(uintptr_t)(MSG_BUFF_OBJ_SIZE - 1));
+        *head = base + sizeof(struct msg_buff);
+        *end = base + MSG_BUFF_OBJ_SIZE;
+        return 1;
+    }
+
+    base = (uint8_t *)pool_obj_base(msg_pool, data);
+    if (base == NULL) {
+        return 0;
+    }
+
+    *head = base;
+    *end = base + pool_obj_size(msg_pool, base);
+
+    return 1;
+}
+
+/* Move *data into a buffer of size bytes, the first len bytes are kept. */
+static int msg_data_src_move(struct data_src **data, uint32_t len, uint32_t size)
+{
+    struct data_src *new_data = msg_data_src_alloc(size);
+    if (new_data == NULL) {
+        return -ERR_NO_MEM;
+    }
+
+    memcpy(new_data, *data, len);
+    msg_data_src_deinit(*data);
+    *data = new_data;
+
+    return ERR_SUCCESS;
+}
 
 void msg_data_src_deinit(struct data_src *data)
 {
-    if (data == NULL) {
+    if (data == NULL || msg_data_src_is_inline(data)) {
+        return;
+    }
+
+    if (msg_pool != NULL && pool_free(msg_pool, data) == ERR_SUCCESS) {
         return;
     }
     
@@ -29,7 +122,7 @@ struct data_src *msg_data_src_init(uint16_t size, void *usr_data)
         return NULL;
     }
 
-    data = (struct data_src *)malloc(size);
+    data = msg_data_src_alloc(size);
     if (data == NULL) {
         return NULL; 
     }
@@ -43,6 +136,36 @@ struct data_src *msg_data_src_init(uint16_t size, void *usr_data)
     return data;
 }
 
+static uint32_t msg_data_src_compact_end(struct data_src *data, int *complete)
+{
+    struct proto_block_ref ref;
+    uint32_t off = 0;
+    int n;
+
+    while ((n = proto_block_next(PROTO_HEADER_CFG_COMPACT, (uint8_t *)data->blocks + off,
+                                 data->header.len - sizeof(struct data_src) - off, &ref)) > 0) {
+        off += n;
+    }
+
+    if (complete != NULL) {
+        *complete = (n == 0 && off == data->header.len - sizeof(struct data_src));
+    }
+
+    return off;
+}
+
+static int msg_data_src_fill_compact(struct data_src *data, struct proto_block *usr_block)
+{
+    uint32_t off;
+    int ret;
+
+    off = msg_data_src_compact_end(data, NULL);
+    ret = proto_block_put_compact((uint8_t *)data->blocks + off, data->header.len - sizeof(struct data_src) - off,
+                                  usr_block->type, usr_block->data, usr_block->len);
+
+    return (ret < 0) ? ret : ERR_SUCCESS;
+}
+
 int msg_data_src_fill(struct data_src *data, struct proto_block *usr_block)
 {
     struct proto_block *block;
@@ -57,6 +180,10 @@ int msg_data_src_fill(struct data_src *data, struct proto_block *usr_block)
         return -ERR_OUT_OF_RANGE;
     }
 
+    if (data->header.cfg_hdr == PROTO_HEADER_CFG_COMPACT) {
+        return msg_data_src_fill_compact(data, usr_block);
+    }
+
     data_p = (uint8_t *)(data->blocks);
     block = (struct proto_block *)data_p;
     while (block->len > 0) {
@@ -78,17 +205,31 @@ int msg_data_src_fill(struct data_src *data, struct proto_block *usr_block)
 
 int msg_data_src_expand(struct data_src **data, uint16_t size)
 {
+    uint8_t *head, *end;
     int ret;
 
     if (data == NULL || !size) {
         return -ERR_INVALID_ARG; 
     }
 
-    *data = (struct data_src *)realloc(*data, (*data)->header.len + size);
-    if (*data == NULL) {
-        return -ERR_NO_MEM;
+    /* inline and pool payloads grow in place up to the end of their object */
+    if (msg_data_src_bounds(*data, &head, &end)) {
+        if ((*data)->header.len + size > end - (uint8_t *)*data) {
+            ret = msg_data_src_move(data, (*data)->header.len, (*data)->header.len + size);
+            if (ret != ERR_SUCCESS) {
+                return ret;
+            }
+        }
+    } else {
+        *data = (struct data_src *)realloc(*data, (*data)->header.len + size);
+        if (*data == NULL) {
+            return -ERR_NO_MEM;
+        }
     }
 
+    /* recycled pool memory is not zeroed, the walkers stop at a zero length block */
+    memset((uint8_t *)*data + (*data)->header.len, 0, size);
+
     // (*data)->header.len += size;
     ret = proto_header_set_len(&(*data)->header, (*data)->header.len + size);
     if (ret!= ERR_SUCCESS) {
@@ -120,6 +261,11 @@ int msg_data_src_truncate(struct data_src **data, uint16_t size)
         return -ERR_OUT_OF_RANGE;
     }
 
+    /* inline and pool payloads shrink in place */
+    if (msg_data_src_is_inline(*data) || pool_obj_base(msg_pool, *data) != NULL) {
+        return ERR_SUCCESS;
+    }
+
     (*data) = (struct data_src *)realloc(*data, (*data)->header.len);
     if (*data == NULL) {
         return -ERR_NO_MEM; 
@@ -139,12 +285,26 @@ int msg_data_src_get_blk_cnt(struct data_src *data)
         return -ERR_INVALID_ARG; 
     }
 
+    if (data->header.cfg_hdr == PROTO_HEADER_CFG_COMPACT) {
+        struct proto_block_ref ref;
+        uint32_t off = 0;
+        int n;
+
+        cnt = 0;
+        while ((n = proto_block_next(PROTO_HEADER_CFG_COMPACT, (uint8_t *)data->blocks + off,
+                                     data->header.len - sizeof(struct data_src) - off, &ref)) > 0) {
+            off += n;
+            cnt++;
+        }
+        return cnt;
+    }
+
     size = data->header.len - sizeof(struct proto_header);
     data_p = (uint8_t *)(data->blocks);
     block = (struct proto_block *)data_p;
     cnt = 0;
-    while (size > 0) {
-        if (block->len == 0)
+    while (size >= sizeof(struct proto_block)) {
+        if (block->len == 0 || block->len + sizeof(struct proto_block) > size)
             break;
         size -= block->len + sizeof(struct proto_block);
         data_p += block->len + sizeof(struct proto_block);
@@ -175,6 +335,29 @@ void msg_data_blk_dump_hex(struct proto_block *block)
     return;
 }
 
+static void msg_data_dump_compact(struct data_src *data)
+{
+    struct proto_block_ref ref;
+    uint32_t off = 0;
+    int n;
+
+    while ((n = proto_block_next(PROTO_HEADER_CFG_COMPACT, (uint8_t *)data->blocks + off,
+                                 data->header.len - sizeof(struct data_src) - off, &ref)) > 0) {
+        printf("block->type: %d\n", ref.type);
+        printf("block->len: %d\n", ref.len);
+        for (int i = 0; i < ref.len; i++) {
+            printf("%02x ", ref.data[i]);
+            if ((i + 1) % 16 == 0) {
+                printf("\n");
+            }
+        }
+        if (ref.len % 16 != 0) {
+            printf("\n");
+        }
+        off += n;
+    }
+}
+
 void msg_data_dump(struct data_src *data)
 {
     struct proto_block *block;
@@ -187,6 +370,11 @@ void msg_data_dump(struct data_src *data)
 
     size = data->header.len - sizeof(struct proto_header);
     proto_header_dump(&data->header);
+    if (data->header.cfg_hdr == PROTO_HEADER_CFG_COMPACT) {
+        msg_data_dump_compact(data);
+        return;
+    }
+
     data_p = (uint8_t *)(data->blocks);
     block = (struct proto_block *)data_p;
     while (size > 0) {
@@ -212,6 +400,15 @@ struct proto_block *msg_data_blk_get_tail(struct data_src *data)
         return NULL;
     }
 
+    /* compact blocks have no struct layout, the tail is only an append position */
+    if (data->header.cfg_hdr == PROTO_HEADER_CFG_COMPACT) {
+        uint32_t off;
+        int complete;
+
+        off = msg_data_src_compact_end(data, &complete);
+        return complete ? (struct proto_block *)((uint8_t *)data->blocks + off) : NULL;
+    }
+
     size = sizeof(struct data_src);
     data_p = (uint8_t *)(data->blocks);
     block = (struct proto_block *)data_p;
@@ -226,281 +423,2344 @@ struct proto_block *msg_data_blk_get_tail(struct data_src *data)
     return block;
 }
 
-void msg_buff_deinit(struct msg_buff *msg_buff)
+/* Checksum of the wire frame data encodes to, the header is in host order here. */
+static uint16_t msg_data_src_calc_checksum(const struct data_src *data, uint8_t csum_type)
 {
-    if (msg_buff == NULL) {
-        return;
-    }
-    
-    if (msg_buff->data != NULL) {
-        free(msg_buff->data);
-    }
-
-    free(msg_buff);
+    return proto_header_calc_checksum(&data->header, data->blocks, data->header.len - sizeof(struct proto_header),
+                                      csum_type);
 }
 
-
-struct msg_buff *msg_buff_init(void)
+/* The checksum is the one the encoded frame carries, see proto_frame_check_checksum(). */
+int msg_data_src_set_checksum(struct data_src *data, uint8_t csum_type)
 {
-    struct msg_buff *msg_buff = (struct msg_buff *)malloc(sizeof(struct msg_buff));
-    if (msg_buff == NULL) {
-        return NULL;
+    if (data == NULL || csum_type >= CSUM_TYPE_MAX || data->header.len < sizeof(struct proto_header)) {
+        return -ERR_INVALID_ARG;
     }
 
-    msg_buff->next = NULL;
-    msg_buff->prev = NULL;
-
-    msg_buff->data = NULL;
+    data->header.checksum = msg_data_src_calc_checksum(data, csum_type);
 
-    return msg_buff;
+    return ERR_SUCCESS;
 }
 
-int msg_buff_set_id(struct msg_buff *msg_buff, uint32_t id)
+int msg_data_src_check_checksum(struct data_src *data, uint8_t csum_type)
 {
-    if (msg_buff == NULL) {
+    if (data == NULL || csum_type >= CSUM_TYPE_MAX || data->header.len < sizeof(struct proto_header)) {
         return -ERR_INVALID_ARG;
     }
 
-    msg_buff->id = id;
+    if (csum_type == CSUM_TYPE_AUTO || csum_type == CSUM_TYPE_NONE) {
+        return ERR_SUCCESS;
+    }
 
-    return ERR_SUCCESS; 
+    if (msg_data_src_calc_checksum(data, csum_type) != data->header.checksum) {
+        return -ERR_FAIL;
+    }
+
+    return ERR_SUCCESS;
 }
 
-int msg_buff_set_blk_cnt(struct msg_buff *msg_buff, uint8_t cnt)
+/* The checksum is patched, not recomputed, see proto_header_dec_hop_limit(). */
+int msg_data_src_dec_hop_limit(struct data_src *data, uint8_t csum_type)
 {
-    if (msg_buff == NULL) {
+    if (data == NULL || data->header.len < sizeof(struct proto_header)) {
         return -ERR_INVALID_ARG;
     }
 
-    msg_buff->blk_cnt = cnt;
-
-    return ERR_SUCCESS; 
+    return proto_header_dec_hop_limit(&data->header, csum_type);
 }
 
-int msg_buff_set_time(struct msg_buff *msg_buff, time_t time) 
+/*
+ * Transcode the blocks of *data to cfg (PROTO_HEADER_CFG_STD or
+ * PROTO_HEADER_CFG_COMPACT), *data is reallocated to the new length.
+ * The checksum is not recomputed.
+ */
+int msg_data_src_set_encoding(struct data_src **data, uint8_t cfg)
 {
-    if (msg_buff == NULL) {
+    struct data_src *new_data;
+    uint32_t in_len;
+    int len;
+
+    if (data == NULL || *data == NULL || (*data)->header.len < sizeof(struct data_src)) {
+        return -ERR_INVALID_ARG;
+    }
+
+    if (cfg != PROTO_HEADER_CFG_STD && cfg != PROTO_HEADER_CFG_COMPACT) {
         return -ERR_INVALID_ARG;
     }
 
-    msg_buff->timestamp = time;
+    if ((*data)->header.cfg_hdr == cfg) {
+        return ERR_SUCCESS;
+    }
 
-    return ERR_SUCCESS;
-}
+    in_len = (*data)->header.len - sizeof(struct data_src);
+    if (cfg == PROTO_HEADER_CFG_COMPACT) {
+        len = proto_blocks_compact_encode((uint8_t *)(*data)->blocks, in_len, NULL, 0);
+    } else {
+        len = proto_blocks_compact_decode((uint8_t *)(*data)->blocks, in_len, NULL, 0);
+    }
+    if (len < 0) {
+        return len;
+    }
 
-int msg_buff_set_time_now(struct msg_buff *msg_buff)
-{
-    if (msg_buff == NULL) {
-        return -ERR_INVALID_ARG;
+    if (sizeof(struct data_src) + len > PROTO_HEADER_LEN_MAX) {
+        return -ERR_OUT_OF_RANGE;
     }
 
-    msg_buff->timestamp = time(NULL);
+    new_data = msg_data_src_alloc(sizeof(struct data_src) + len);
+    if (new_data == NULL) {
+        return -ERR_NO_MEM;
+    }
 
-    return ERR_SUCCESS; 
+    if (cfg == PROTO_HEADER_CFG_COMPACT) {
+        len = proto_blocks_compact_encode((uint8_t *)(*data)->blocks, in_len, (uint8_t *)new_data->blocks, len);
+    } else {
+        len = proto_blocks_compact_decode((uint8_t *)(*data)->blocks, in_len, (uint8_t *)new_data->blocks, len);
+    }
+
+    new_data->header = (*data)->header;
+    new_data->header.cfg_hdr = cfg;
+    new_data->header.len = sizeof(struct data_src) + len;
+    msg_data_src_deinit(*data);
+    *data = new_data;
+
+    return ERR_SUCCESS;
 }
 
-int msg_buff_bind_data(struct msg_buff *msg_buff, void *data, uint8_t cnt) 
+static void msg_builder_reset(struct msg_builder *bld, void *buf, uint16_t cap, uint8_t owned)
 {
-    int ret;
+    bld->data = (struct data_src *)buf;
+    bld->cap = cap;
+    bld->tail = sizeof(struct data_src);
+    bld->blk_cnt = 0;
+    bld->reserved = 0;
+    bld->owned = owned;
+    proto_header_reset(&bld->data->header);
+}
 
-    if (msg_buff == NULL || data == NULL) {
+int msg_builder_init(struct msg_builder *bld, uint16_t cap)
+{
+    void *buf;
+
+    if (bld == NULL) {
         return -ERR_INVALID_ARG;
     }
-    
-    ret = msg_buff_set_time_now(msg_buff);
-    if (ret!= ERR_SUCCESS) {
-        return ret;
+
+    if (cap == 0) {
+        cap = MSG_BUILDER_CAP_DEFAULT;
     }
-    ret = msg_buff_set_blk_cnt(msg_buff, cnt);
-    if (ret!= ERR_SUCCESS) {
-        return ret; 
+
+    if (cap < sizeof(struct data_src)) {
+        return -ERR_OUT_OF_RANGE;
     }
 
-    msg_buff->data = data;
+    buf = malloc(cap);
+    if (buf == NULL) {
+        return -ERR_NO_MEM;
+    }
+
+    msg_builder_reset(bld, buf, cap, 1);
 
     return ERR_SUCCESS;
 }
 
-int msg_buff_reset_data(struct msg_buff *msg_buff, void *data, uint8_t cnt)
+/* Build into caller (e.g. driver or pool) memory, the builder never grows it. */
+int msg_builder_attach(struct msg_builder *bld, void *buf, uint16_t cap)
 {
-    int ret;
-
-    if (msg_buff == NULL) {
+    if (bld == NULL || buf == NULL) {
         return -ERR_INVALID_ARG;
     }
 
-    ret = msg_buff_set_blk_cnt(msg_buff, cnt);
-    if (ret!= ERR_SUCCESS) {
-        return ret;
-    }
-
-    ret = msg_buff_set_time_now(msg_buff);
-    if (ret!= ERR_SUCCESS) {
-        return ret;
+    if (cap < sizeof(struct data_src)) {
+        return -ERR_OUT_OF_RANGE;
     }
 
-    msg_buff->data = data;
+    msg_builder_reset(bld, buf, cap, 0);
 
     return ERR_SUCCESS;
 }
 
-void msg_buff_unbind_data(struct msg_buff *msg_buff)
+struct proto_header *msg_builder_get_header(struct msg_builder *bld)
 {
-    if (msg_buff == NULL) {
-        return; 
+    if (bld == NULL || bld->data == NULL) {
+        return NULL;
     }
 
-    msg_buff->id = 0;
-    msg_buff->blk_cnt = 0;
-    msg_buff->timestamp = 0;
-    msg_buff->data = NULL;
-
-    return;
+    return &bld->data->header;
 }
 
-uint8_t msg_buff_select_queue(struct msg_buff *msg_buff, uint8_t q_cnt)
+/*
+ * Returns where size payload bytes of a new block may be written. The
+ * pointer stays valid until the next reserve, the block only becomes part
+ * of the message with msg_builder_commit().
+ */
+uint8_t *msg_builder_reserve(struct msg_builder *bld, uint16_t type, uint16_t size)
 {
+    struct proto_block *block;
     struct data_src *data;
+    uint32_t need, cap;
 
-    if (msg_buff == NULL) {
-        return 0;
+    if (bld == NULL || bld->data == NULL || size == 0) {
+        return NULL;
     }
 
-    if (q_cnt == 0) {
-        return 0;
+    if (bld->reserved) {
+        return NULL;
     }
 
-    data = (struct data_src *)msg_buff->data;
-    if (data == NULL) {
-        return 0;
+    need = (uint32_t)bld->tail + sizeof(struct proto_block) + size;
+    if (need > PROTO_HEADER_LEN_MAX) {
+        return NULL;
     }
 
-    return (data->header.priority > q_cnt) ? q_cnt : data->header.priority;
-}
-
-void msg_queue_deinit(struct msg_queue *msg_queue)
-{
-    if (msg_queue == NULL) {
-        return;
+    if (need > bld->cap) {
+        if (!bld->owned) {
+            return NULL;
+        }
+
+        cap = (uint32_t)bld->cap * 2;
+        if (cap < need) {
+            cap = need;
+        }
+        if (cap > PROTO_HEADER_LEN_MAX) {
+            cap = PROTO_HEADER_LEN_MAX;
+        }
+
+        data = (struct data_src *)realloc(bld->data, cap);
+        if (data == NULL) {
+            return NULL;
+        }
+        bld->data = data;
+        bld->cap = cap;
     }
 
-    while (msg_queue->head != NULL) {
-        msg_buff_deinit(msg_queue->head);
-        msg_queue->head = msg_queue->head->next;
-    } 
+    block = (struct proto_block *)((uint8_t *)bld->data + bld->tail);
+    block->type = type;
+    block->len = size;
+    bld->reserved = size;
+
+    return block->data;
 }
 
-struct msg_queue *msg_queue_init(uint8_t id)
+/* len may be less than what was reserved, the rest is given back. */
+int msg_builder_commit(struct msg_builder *bld, uint16_t len)
 {
-    struct msg_queue *msg_queue = (struct msg_queue *)malloc(sizeof(struct msg_queue));
-    if (msg_queue == NULL) {
-        return NULL;
+    struct proto_block *block;
+
+    if (bld == NULL || bld->data == NULL || !bld->reserved) {
+        return -ERR_INVALID_ARG;
+    }
+
+    if (len == 0 || len > bld->reserved) {
+        return -ERR_OUT_OF_RANGE;
     }
 
-    msg_queue->cfg.qid = id;
-    msg_queue->cfg.rx_type = MSG_QUEUE_RX_HALF;
-    msg_queue->stats.count = 0;
-    msg_queue->stats.bytes = 0;
-    msg_queue->head = NULL;
-    msg_queue->tail = NULL;
+    block = (struct proto_block *)((uint8_t *)bld->data + bld->tail);
+    block->len = len;
+    bld->tail += sizeof(struct proto_block) + len;
+    bld->blk_cnt++;
+    bld->reserved = 0;
 
-    return msg_queue;
+    return ERR_SUCCESS;
 }
 
-int msg_queue_enqueue(struct msg_queue *msg_queue, struct msg_buff *msg_buff)
+int msg_builder_append(struct msg_builder *bld, uint16_t type, const void *buf, uint16_t len)
 {
-    struct data_src *data;
+    uint8_t *p;
 
-    if (msg_queue == NULL || msg_buff == NULL) {
+    if (buf == NULL) {
         return -ERR_INVALID_ARG;
     }
-    
-    data = (struct data_src *)msg_buff->data;
-    if (data == NULL) {
-        return -ERR_EMPTY; 
-    }
-    if (data->header.len + msg_queue->stats.bytes > MSG_QUEUE_BYTES_MAX
-        || msg_queue->stats.count == MSG_QUEUE_CNT_MAX) {
-        return -ERR_OUT_OF_RANGE;   
-    }
 
-    if (msg_queue->stats.count == 0) {
-        msg_queue->head = msg_buff;
-        msg_queue->tail = msg_buff;
-    } else {
-        msg_queue->tail->next = msg_buff;
-        msg_buff->prev = msg_queue->tail;
-        msg_queue->tail = msg_buff;
+    p = msg_builder_reserve(bld, type, len);
+    if (p == NULL) {
+        return -ERR_NO_MEM;
     }
 
-    msg_queue->stats.count++;
-    // msg_queue->stats.bytes += data->header.len;
+    memcpy(p, buf, len);
 
-    return ERR_SUCCESS;
+    return msg_builder_commit(bld, len);
 }
 
-struct msg_buff *msg_queue_dequeue(struct msg_queue *msg_queue)
+/*
+ * Fix up header.len and hand the data_src over to the caller. A pending
+ * reservation is dropped. The builder is empty afterwards.
+ */
+struct data_src *msg_builder_finalize(struct msg_builder *bld)
 {
-    struct msg_buff *msg_buff;
-    if (msg_queue == NULL) {
+    struct data_src *data;
+
+    if (bld == NULL || bld->data == NULL) {
         return NULL;
     }
-    
-    if (msg_queue->stats.count == 0) {
-        return NULL; 
+
+    data = bld->data;
+    if (proto_header_set_len(&data->header, bld->tail) != ERR_SUCCESS) {
+        return NULL;
     }
 
-    msg_buff = msg_queue->head;
-    msg_queue->head = msg_queue->head->next;
-    msg_queue->stats.count--;
-    msg_queue->stats.bytes += ((struct data_src *)msg_buff->data)->header.len;
+    bld->data = NULL;
+    bld->cap = 0;
+    bld->reserved = 0;
 
-    return msg_buff;
+    return data;
 }
 
-struct msg_buff *msg_queue_peek(struct msg_queue *msg_queue)
+void msg_builder_abort(struct msg_builder *bld)
 {
-    if (msg_queue == NULL) {
-        return NULL;
+    if (bld == NULL) {
+        return;
     }
 
-    if (msg_queue->stats.count == 0) {
-        return NULL;
+    if (bld->owned && bld->data != NULL) {
+        free(bld->data);
     }
-    
-    return msg_queue->head;
+
+    bld->data = NULL;
+    bld->cap = 0;
+    bld->reserved = 0;
 }
 
-struct msg_buff *msg_queue_get_tail(struct msg_queue *msg_queue)
+void msg_sg_deinit(struct msg_sg *sg)
 {
-    if (msg_queue == NULL) {
-        return NULL;
+    if (sg == NULL) {
+        return;
     }
 
-    if (msg_queue->stats.count == 0) {
-        return NULL;
+    for (uint8_t i = 0; i < sg->seg_cnt; i++) {
+        if (sg->seg[i].release != NULL) {
+            sg->seg[i].release(sg->seg[i].base);
+        }
     }
 
-    return msg_queue->tail;
+    free(sg);
 }
 
-int msg_queue_get_count(struct msg_queue *msg_queue)
+struct msg_sg *msg_sg_init(void)
 {
-    if (msg_queue == NULL) {
-        return -ERR_INVALID_ARG;
-   
+    struct msg_sg *sg = (struct msg_sg *)malloc(sizeof(struct msg_sg));
+    if (sg == NULL) {
+        return NULL;
     }
 
-    return msg_queue->stats.count; 
+    proto_header_reset(&sg->header);
+    sg->header.len = sizeof(struct proto_header);
+    sg->seg_cnt = 0;
+
+    return sg;
 }
 
-int msg_queue_get_data_size(struct msg_queue *msg_queue)
+/* O(1), the segment memory is referenced, not copied. */
+int msg_sg_add_seg(struct msg_sg *sg, const void *base, uint16_t len, void (*release)(const void *base))
+{
+    if (sg == NULL || base == NULL || len == 0) {
+        return -ERR_INVALID_ARG;
+    }
+
+    if (sg->seg_cnt == MSG_SG_SEG_MAX) {
+        return -ERR_BUSY;
+    }
+
+    if ((uint32_t)sg->header.len + len > PROTO_HEADER_LEN_MAX) {
+        return -ERR_OUT_OF_RANGE;
+    }
+
+    sg->seg[sg->seg_cnt].base = base;
+    sg->seg[sg->seg_cnt].len = len;
+    sg->seg[sg->seg_cnt].release = release;
+    sg->seg_cnt++;
+    sg->header.len += len;
+
+    return ERR_SUCCESS;
+}
+
+int msg_sg_add_blk(struct msg_sg *sg, const struct proto_block *block)
+{
+    if (block == NULL) {
+        return -ERR_INVALID_ARG;
+    }
+
+    return msg_sg_add_seg(sg, block, sizeof(struct proto_block) + block->len, NULL);
+}
+
+/* References the blocks of data, its header is ignored. */
+int msg_sg_add_data_src(struct msg_sg *sg, const struct data_src *data)
+{
+    if (data == NULL || data->header.len <= sizeof(struct data_src)) {
+        return -ERR_INVALID_ARG;
+    }
+
+    return msg_sg_add_seg(sg, data->blocks, data->header.len - sizeof(struct data_src), NULL);
+}
+
+/*
+ * Describe the frame for writev()/sendmsg(): the header is encoded into
+ * hdr_buf (PROTO_HEADER_WIRE_SIZE bytes) as iov[0], segments follow.
+ * Returns the number of iovec entries used.
+ */
+int msg_sg_fill_iovec(struct msg_sg *sg, uint8_t *hdr_buf, struct iovec *iov, int iov_cnt)
+{
+    int ret;
+
+    if (sg == NULL || hdr_buf == NULL || iov == NULL) {
+        return -ERR_INVALID_ARG;
+    }
+
+    if (iov_cnt < sg->seg_cnt + 1) {
+        return -ERR_OUT_OF_RANGE;
+    }
+
+    ret = proto_header_encode(&sg->header, hdr_buf, PROTO_HEADER_WIRE_SIZE);
+    if (ret != ERR_SUCCESS) {
+        return ret;
+    }
+
+    iov[0].iov_base = hdr_buf;
+    iov[0].iov_len = PROTO_HEADER_WIRE_SIZE;
+    for (uint8_t i = 0; i < sg->seg_cnt; i++) {
+        iov[i + 1].iov_base = (void *)sg->seg[i].base;
+        iov[i + 1].iov_len = sg->seg[i].len;
+    }
+
+    return sg->seg_cnt + 1;
+}
+
+/* Fallback for drivers without xmit_sg: one allocation, one copy per segment. */
+struct data_src *msg_sg_flatten(struct msg_sg *sg)
+{
+    struct data_src *data;
+    uint8_t *data_p;
+
+    if (sg == NULL) {
+        return NULL;
+    }
+
+    data = msg_data_src_alloc(sg->header.len);
+    if (data == NULL) {
+        return NULL;
+    }
+
+    data->header = sg->header;
+    data_p = (uint8_t *)data->blocks;
+    for (uint8_t i = 0; i < sg->seg_cnt; i++) {
+        memcpy(data_p, sg->seg[i].base, sg->seg[i].len);
+        data_p += sg->seg[i].len;
+    }
+
+    return data;
+}
+
+static struct msg_share *msg_share_init(void)
+{
+    struct msg_share *share;
+
+    pthread_once(&msg_cache_once, msg_cache_setup);
+
+    share = (struct msg_share *)pool_alloc(msg_pool, sizeof(struct msg_share));
+    if (share == NULL) {
+        share = (struct msg_share *)malloc(sizeof(struct msg_share));
+    }
+    if (share == NULL) {
+        return NULL;
+    }
+
+    share->ref = 1;
+
+    return share;
+}
+
+static void msg_share_deinit(struct msg_share *share)
+{
+    if (msg_pool != NULL && pool_free(msg_pool, share) == ERR_SUCCESS) {
+        return;
+    }
+
+    free(share);
+}
+
+/* Drop the hold on a shared payload, returns 1 when msg_buff was the last holder. */
+static int msg_buff_share_put(struct msg_buff *msg_buff)
+{
+    struct msg_share *share = msg_buff->share;
+
+    if (share == NULL) {
+        return 1;
+    }
+
+    msg_buff->share = NULL;
+    if (__atomic_sub_fetch(&share->ref, 1, __ATOMIC_ACQ_REL) != 0) {
+        return 0;
+    }
+
+    msg_share_deinit(share);
+
+    return 1;
+}
+
+static void msg_buff_release_data(struct msg_buff *msg_buff)
+{
+    if (msg_buff->flags & MSG_BUFF_F_SG) {
+        msg_sg_deinit((struct msg_sg *)msg_buff->data);
+    } else if (msg_buff->data != NULL) {
+        msg_data_src_deinit((struct data_src *)msg_buff->data);
+    }
+}
+
+void msg_buff_deinit(struct msg_buff *msg_buff)
+{
+    if (msg_buff == NULL) {
+        return;
+    }
+    
+    if (msg_buff_share_put(msg_buff)) {
+        msg_buff_release_data(msg_buff);
+    }
+
+    if (msg_buff->blk_idx != NULL) {
+        free(msg_buff->blk_idx);
+    }
+
+    if (msg_buff->flags & MSG_BUFF_F_SLAB) {
+        slab_free(msg_cache, msg_buff);
+    } else {
+        free(msg_buff);
+    }
+}
+
+
+struct msg_buff *msg_buff_init(void)
+{
+    struct msg_buff *msg_buff;
+    uint8_t flags = MSG_BUFF_F_SLAB;
+
+    pthread_once(&msg_cache_once, msg_cache_setup);
+
+    msg_buff = (struct msg_buff *)slab_alloc(msg_cache);
+    if (msg_buff == NULL) {
+        /* the cache is full, fall back to the heap */
+        msg_buff = (struct msg_buff *)malloc(sizeof(struct msg_buff));
+        flags = 0;
+    }
+    if (msg_buff == NULL) {
+        return NULL;
+    }
+
+    msg_buff->next = NULL;
+    msg_buff->prev = NULL;
+
+    msg_buff->flags = flags;
+    msg_buff->push_len = 0;
+    msg_buff->data = NULL;
+    msg_buff->blk_idx = NULL;
+    msg_buff->share = NULL;
+
+    return msg_buff;
+}
+
+/*
+ * msg_buff with a zeroed data_src of size bytes bound to it, like
+ * msg_data_src_init(), and headroom/tailroom around it. Payloads that
+ * fit in MSG_BUFF_INLINE_MAX with their room share the msg_buff
+ * allocation.
+ */
+struct msg_buff *msg_buff_alloc_room(uint16_t size, uint16_t headroom, uint16_t tailroom)
+{
+    struct msg_buff *msg_buff;
+    struct data_src *data;
+    int ret;
+
+    if (size < sizeof(struct data_src)) {
+        return NULL;
+    }
+
+    msg_buff = msg_buff_init();
+    if (msg_buff == NULL) {
+        return NULL;
+    }
+
+    if ((msg_buff->flags & MSG_BUFF_F_SLAB) && (uint32_t)headroom + size + tailroom <= MSG_BUFF_INLINE_MAX) {
+        data = (struct data_src *)((uint8_t *)(msg_buff + 1) + headroom);
+    } else {
+        if ((uint32_t)headroom + size + tailroom > POOL_OBJ_MAX) {
+            headroom = 0;
+            tailroom = 0;
+        }
+        data = msg_data_src_alloc_room(size, headroom, tailroom);
+        if (data == NULL) {
+            msg_buff_deinit(msg_buff);
+            return NULL;
+        }
+    }
+
+    memset(data, 0, size);
+    proto_header_set_len(&data->header, size);
+
+    ret = msg_buff_bind_data(msg_buff, data, 0);
+    if (ret != ERR_SUCCESS) {
+        msg_data_src_deinit(data);
+        msg_buff_deinit(msg_buff);
+        return NULL;
+    }
+
+    return msg_buff;
+}
+
+/* Room as asked for by msg_buff_need_room(). */
+struct msg_buff *msg_buff_alloc(uint16_t size)
+{
+    return msg_buff_alloc_room(size, msg_room_head, msg_room_tail);
+}
+
+/*
+ * Raise the room msg_buff_alloc() leaves around payloads, interfaces
+ * declare what their drivers write in front of and behind a frame. It
+ * never shrinks, call it before traffic starts.
+ */
+void msg_buff_need_room(uint16_t headroom, uint16_t tailroom)
+{
+    if (headroom > msg_room_head) {
+        msg_room_head = headroom;
+    }
+    if (tailroom > msg_room_tail) {
+        msg_room_tail = tailroom;
+    }
+}
+
+static void msg_buff_get_room(struct msg_buff *msg_buff, uint32_t *headroom, uint32_t *tailroom)
+{
+    struct data_src *data = (struct data_src *)msg_buff->data;
+    uint8_t *head, *end;
+
+    if (!msg_data_src_bounds(data, &head, &end)) {
+        *headroom = 0;
+        *tailroom = 0;
+        return;
+    }
+
+    *headroom = (uint8_t *)data - msg_buff->push_len - head;
+    *tailroom = end - ((uint8_t *)data + data->header.len);
+}
+
+int msg_buff_get_headroom(struct msg_buff *msg_buff)
+{
+    uint32_t headroom, tailroom;
+
+    if (msg_buff == NULL || msg_buff->data == NULL || (msg_buff->flags & MSG_BUFF_F_SG)) {
+        return -ERR_INVALID_ARG;
+    }
+
+    msg_buff_get_room(msg_buff, &headroom, &tailroom);
+
+    return headroom;
+}
+
+int msg_buff_get_tailroom(struct msg_buff *msg_buff)
+{
+    uint32_t headroom, tailroom;
+
+    if (msg_buff == NULL || msg_buff->data == NULL || (msg_buff->flags & MSG_BUFF_F_SG)) {
+        return -ERR_INVALID_ARG;
+    }
+
+    msg_buff_get_room(msg_buff, &headroom, &tailroom);
+
+    return tailroom;
+}
+
+/*
+ * Bytes data may fill, up to the end of the slab or pool object it lives in.
+ * Unlike the tailroom this does not trust header.len, so it bounds a frame a
+ * driver just wrote. -ERR_NOT_FOUND for heap payloads of unknown size.
+ */
+int msg_buff_get_data_room(struct msg_buff *msg_buff)
+{
+    uint8_t *head, *end;
+
+    if (msg_buff == NULL || msg_buff->data == NULL || (msg_buff->flags & MSG_BUFF_F_SG)) {
+        return -ERR_INVALID_ARG;
+    }
+
+    if (!msg_data_src_bounds(msg_buff->data, &head, &end)) {
+        return -ERR_NOT_FOUND;
+    }
+
+    return end - (uint8_t *)msg_buff->data;
+}
+
+/*
+ * Move the frame, pushed bytes and data, into a private pool object with
+ * headroom/tailroom around it and drop the hold on the old payload.
+ */
+static int msg_buff_move_data(struct msg_buff *msg_buff, uint32_t headroom, uint32_t tailroom)
+{
+    struct data_src *data = (struct data_src *)msg_buff->data;
+    uint16_t push_len = msg_buff->push_len;
+    uint16_t len = data->header.len;
+    struct data_src *new_data;
+
+    if (headroom + push_len + len + tailroom > POOL_OBJ_MAX) {
+        return -ERR_OUT_OF_RANGE;
+    }
+
+    new_data = msg_data_src_alloc_room(len, headroom + push_len, tailroom);
+    if (new_data == NULL) {
+        return -ERR_NO_MEM;
+    }
+
+    memcpy((uint8_t *)new_data - push_len, (uint8_t *)data - push_len, push_len + len);
+
+    if (msg_buff_share_put(msg_buff)) {
+        msg_buff_release_data(msg_buff);
+    }
+    msg_buff->data = new_data;
+
+    return ERR_SUCCESS;
+}
+
+/*
+ * Make sure of headroom/tailroom in front of the frame and behind data,
+ * and of a private payload. The payload is moved only when short, with
+ * MSG_BUFF_ROOM_PAD extra so a few more pushes fit.
+ */
+int msg_buff_reserve(struct msg_buff *msg_buff, uint16_t headroom, uint16_t tailroom)
+{
+    uint32_t cur_head, cur_tail;
+
+    if (msg_buff == NULL || msg_buff->data == NULL || (msg_buff->flags & MSG_BUFF_F_SG)) {
+        return -ERR_INVALID_ARG;
+    }
+
+    msg_buff_get_room(msg_buff, &cur_head, &cur_tail);
+    if (cur_head >= headroom && cur_tail >= tailroom && !msg_buff_is_shared(msg_buff)) {
+        return ERR_SUCCESS;
+    }
+
+    if (cur_head < headroom) {
+        cur_head = headroom + MSG_BUFF_ROOM_PAD;
+    }
+    if (cur_tail < tailroom) {
+        cur_tail = tailroom + MSG_BUFF_ROOM_PAD;
+    }
+
+    return msg_buff_move_data(msg_buff, cur_head, cur_tail);
+}
+
+/* Prepend len bytes to the frame, returns the new frame start or NULL. */
+uint8_t *msg_buff_push(struct msg_buff *msg_buff, uint16_t len)
+{
+    if (msg_buff_reserve(msg_buff, len, 0) != ERR_SUCCESS) {
+        return NULL;
+    }
+
+    msg_buff->push_len += len;
+
+    return (uint8_t *)msg_buff->data - msg_buff->push_len;
+}
+
+/* Strip len pushed bytes, returns the new frame start or NULL. */
+uint8_t *msg_buff_pull(struct msg_buff *msg_buff, uint16_t len)
+{
+    if (msg_buff == NULL || msg_buff->data == NULL || len > msg_buff->push_len) {
+        return NULL;
+    }
+
+    msg_buff->push_len -= len;
+
+    return (uint8_t *)msg_buff->data - msg_buff->push_len;
+}
+
+/* Append len zeroed bytes to data, returns where they start or NULL. */
+uint8_t *msg_buff_put(struct msg_buff *msg_buff, uint16_t len)
+{
+    struct data_src *data;
+    uint8_t *tail;
+
+    if (msg_buff == NULL || msg_buff->data == NULL || (msg_buff->flags & MSG_BUFF_F_SG)) {
+        return NULL;
+    }
+
+    data = (struct data_src *)msg_buff->data;
+    if ((uint32_t)data->header.len + len > PROTO_HEADER_LEN_MAX) {
+        return NULL;
+    }
+
+    if (msg_buff_reserve(msg_buff, 0, len) != ERR_SUCCESS) {
+        return NULL;
+    }
+
+    data = (struct data_src *)msg_buff->data;
+    tail = (uint8_t *)data + data->header.len;
+    memset(tail, 0, len);
+    proto_header_set_len(&data->header, data->header.len + len);
+    msg_buff->flags &= ~MSG_BUFF_F_CSUM_MASK;
+
+    return tail;
+}
+
+/* Cut data down to len bytes, the tail becomes tailroom. */
+int msg_buff_trim(struct msg_buff *msg_buff, uint16_t len)
+{
+    struct data_src *data;
+    int ret;
+
+    if (msg_buff == NULL || msg_buff->data == NULL || (msg_buff->flags & MSG_BUFF_F_SG)
+        || len < sizeof(struct data_src)) {
+        return -ERR_INVALID_ARG;
+    }
+
+    if (len > ((struct data_src *)msg_buff->data)->header.len) {
+        return -ERR_OUT_OF_RANGE;
+    }
+
+    ret = msg_buff_make_writable(msg_buff);
+    if (ret != ERR_SUCCESS) {
+        return ret;
+    }
+
+    data = (struct data_src *)msg_buff->data;
+    proto_header_set_len(&data->header, len);
+    msg_buff->flags &= ~MSG_BUFF_F_CSUM_MASK;
+    msg_buff_invalidate_blk_index(msg_buff);
+
+    return ERR_SUCCESS;
+}
+
+/* Start of the pushed bytes, data itself when nothing was pushed. */
+uint8_t *msg_buff_get_frame(struct msg_buff *msg_buff)
+{
+    if (msg_buff == NULL || msg_buff->data == NULL || (msg_buff->flags & MSG_BUFF_F_SG)) {
+        return NULL;
+    }
+
+    return (uint8_t *)msg_buff->data - msg_buff->push_len;
+}
+
+/*
+ * New msg_buff sharing the payload of msg_buff, nothing is copied. An
+ * inline payload is moved out of its slab object once, the clones may
+ * outlive it. Holders mutate only after msg_buff_make_writable().
+ */
+struct msg_buff *msg_buff_clone(struct msg_buff *msg_buff)
+{
+    uint32_t headroom, tailroom;
+    struct msg_buff *clone;
+
+    if (msg_buff == NULL || msg_buff->data == NULL) {
+        return NULL;
+    }
+
+    if (!(msg_buff->flags & MSG_BUFF_F_SG) && msg_data_src_is_inline(msg_buff->data)) {
+        msg_buff_get_room(msg_buff, &headroom, &tailroom);
+        if (msg_buff_move_data(msg_buff, headroom, tailroom) != ERR_SUCCESS) {
+            return NULL;
+        }
+    }
+
+    if (msg_buff->share == NULL) {
+        msg_buff->share = msg_share_init();
+        if (msg_buff->share == NULL) {
+            return NULL;
+        }
+    }
+
+    clone = msg_buff_init();
+    if (clone == NULL) {
+        return NULL;
+    }
+
+    clone->id = msg_buff->id;
+    clone->blk_cnt = msg_buff->blk_cnt;
+    clone->timestamp = msg_buff->timestamp;
+    clone->flags |= msg_buff->flags & (MSG_BUFF_F_SG | MSG_BUFF_F_CSUM_MASK);
+    clone->push_len = msg_buff->push_len;
+    clone->data = msg_buff->data;
+    clone->share = msg_buff->share;
+    __atomic_add_fetch(&clone->share->ref, 1, __ATOMIC_RELAXED);
+
+    return clone;
+}
+
+int msg_buff_is_shared(struct msg_buff *msg_buff)
+{
+    if (msg_buff == NULL || msg_buff->share == NULL) {
+        return 0;
+    }
+
+    return __atomic_load_n(&msg_buff->share->ref, __ATOMIC_ACQUIRE) > 1;
+}
+
+/*
+ * Copy on write: give msg_buff a private copy of a shared payload, a
+ * segmented one is flattened. Room and pushed bytes come along. Nothing
+ * is copied once the other holders are gone. Block index offsets stay
+ * valid.
+ */
+int msg_buff_make_writable(struct msg_buff *msg_buff)
+{
+    uint32_t headroom, tailroom;
+    struct data_src *data;
+
+    if (msg_buff == NULL || msg_buff->data == NULL) {
+        return -ERR_INVALID_ARG;
+    }
+
+    if (!msg_buff_is_shared(msg_buff)) {
+        return ERR_SUCCESS;
+    }
+
+    if (!(msg_buff->flags & MSG_BUFF_F_SG)) {
+        msg_buff_get_room(msg_buff, &headroom, &tailroom);
+        return msg_buff_move_data(msg_buff, headroom, tailroom);
+    }
+
+    data = msg_sg_flatten((struct msg_sg *)msg_buff->data);
+    if (data == NULL) {
+        return -ERR_NO_MEM;
+    }
+
+    /* the other holders may have let go meanwhile */
+    if (msg_buff_share_put(msg_buff)) {
+        msg_buff_release_data(msg_buff);
+    }
+
+    msg_buff->flags &= ~MSG_BUFF_F_SG;
+    msg_buff->data = data;
+
+    return ERR_SUCCESS;
+}
+
+/*
+ * Forwarding a clone, the hop limit is written to a private copy. A checksum
+ * of csum_type received with the frame is patched, any other is summed again.
+ */
+int msg_buff_dec_hop_limit(struct msg_buff *msg_buff, uint8_t csum_type)
+{
+    struct data_src *data;
+    int ret;
+
+    ret = msg_buff_make_writable(msg_buff);
+    if (ret != ERR_SUCCESS) {
+        return ret;
+    }
+
+    data = (struct data_src *)msg_buff->data;
+    if (csum_type == CSUM_TYPE_AUTO || csum_type == CSUM_TYPE_NONE) {
+        msg_buff->flags &= ~MSG_BUFF_F_CSUM_MASK;
+        return msg_data_src_dec_hop_limit(data, CSUM_TYPE_NONE);
+    }
+
+    if (msg_buff_get_csum_type(msg_buff) == csum_type) {
+        return msg_data_src_dec_hop_limit(data, csum_type);
+    }
+
+    ret = msg_data_src_dec_hop_limit(data, CSUM_TYPE_NONE);
+    if (ret != ERR_SUCCESS) {
+        return ret;
+    }
+
+    ret = msg_data_src_set_checksum(data, csum_type);
+    if (ret != ERR_SUCCESS) {
+        return ret;
+    }
+
+    return msg_buff_set_csum_type(msg_buff, csum_type);
+}
+
+int msg_buff_get_slab_stats(struct slab_stats *stats)
+{
+    if (stats == NULL) {
+        return -ERR_INVALID_ARG;
+    }
+
+    pthread_once(&msg_cache_once, msg_cache_setup);
+
+    return slab_get_stats(msg_cache, stats);
+}
+
+int msg_data_src_get_pool_stats(struct pool_stats *stats)
+{
+    if (stats == NULL) {
+        return -ERR_INVALID_ARG;
+    }
+
+    pthread_once(&msg_cache_once, msg_cache_setup);
+
+    return pool_get_stats(msg_pool, stats);
+}
+
+int msg_buff_set_id(struct msg_buff *msg_buff, uint32_t id)
+{
+    if (msg_buff == NULL) {
+        return -ERR_INVALID_ARG;
+    }
+
+    msg_buff->id = id;
+
+    return ERR_SUCCESS; 
+}
+
+int msg_buff_set_blk_cnt(struct msg_buff *msg_buff, uint8_t cnt)
+{
+    if (msg_buff == NULL) {
+        return -ERR_INVALID_ARG;
+    }
+
+    msg_buff->blk_cnt = cnt;
+
+    return ERR_SUCCESS; 
+}
+
+int msg_buff_set_time(struct msg_buff *msg_buff, uint64_t ns) 
+{
+    if (msg_buff == NULL) {
+        return -ERR_INVALID_ARG;
+    }
+
+    msg_buff->timestamp = ns;
+
+    return ERR_SUCCESS;
+}
+
+int msg_buff_set_time_now(struct msg_buff *msg_buff)
+{
+    if (msg_buff == NULL) {
+        return -ERR_INVALID_ARG;
+    }
+
+    /* the poll loop refreshes the cached clock once per batch */
+    msg_buff->timestamp = tstamp_cached_ns();
+
+    return ERR_SUCCESS; 
+}
+
+int msg_buff_set_csum_type(struct msg_buff *msg_buff, uint8_t csum_type)
+{
+    if (msg_buff == NULL || csum_type >= CSUM_TYPE_MAX) {
+        return -ERR_INVALID_ARG;
+    }
+
+    msg_buff->flags &= ~MSG_BUFF_F_CSUM_MASK;
+    msg_buff->flags |= (csum_type << MSG_BUFF_F_CSUM_SHIFT) & MSG_BUFF_F_CSUM_MASK;
+
+    return ERR_SUCCESS;
+}
+
+uint8_t msg_buff_get_csum_type(struct msg_buff *msg_buff)
+{
+    if (msg_buff == NULL) {
+        return CSUM_TYPE_AUTO;
+    }
+
+    return (msg_buff->flags & MSG_BUFF_F_CSUM_MASK) >> MSG_BUFF_F_CSUM_SHIFT;
+}
+
+int msg_buff_bind_data(struct msg_buff *msg_buff, void *data, uint8_t cnt) 
+{
+    int ret;
+
+    if (msg_buff == NULL || data == NULL) {
+        return -ERR_INVALID_ARG;
+    }
+    
+    ret = msg_buff_set_time_now(msg_buff);
+    if (ret!= ERR_SUCCESS) {
+        return ret;
+    }
+    ret = msg_buff_set_blk_cnt(msg_buff, cnt);
+    if (ret!= ERR_SUCCESS) {
+        return ret; 
+    }
+
+    msg_buff_share_put(msg_buff);
+    msg_buff->flags &= ~(MSG_BUFF_F_SG | MSG_BUFF_F_CSUM_MASK);
+    msg_buff->push_len = 0;
+    msg_buff->data = data;
+    msg_buff_invalidate_blk_index(msg_buff);
+
+    return ERR_SUCCESS;
+}
+
+int msg_buff_reset_data(struct msg_buff *msg_buff, void *data, uint8_t cnt)
+{
+    int ret;
+
+    if (msg_buff == NULL) {
+        return -ERR_INVALID_ARG;
+    }
+
+    ret = msg_buff_set_blk_cnt(msg_buff, cnt);
+    if (ret!= ERR_SUCCESS) {
+        return ret;
+    }
+
+    ret = msg_buff_set_time_now(msg_buff);
+    if (ret!= ERR_SUCCESS) {
+        return ret;
+    }
+
+    msg_buff_share_put(msg_buff);
+    msg_buff->flags &= ~(MSG_BUFF_F_SG | MSG_BUFF_F_CSUM_MASK);
+    msg_buff->push_len = 0;
+    msg_buff->data = data;
+    msg_buff_invalidate_blk_index(msg_buff);
+
+    return ERR_SUCCESS;
+}
+
+int msg_buff_bind_sg(struct msg_buff *msg_buff, struct msg_sg *sg)
+{
+    int ret;
+
+    if (msg_buff == NULL || sg == NULL) {
+        return -ERR_INVALID_ARG;
+    }
+
+    ret = msg_buff_bind_data(msg_buff, sg, 0);
+    if (ret != ERR_SUCCESS) {
+        return ret;
+    }
+
+    msg_buff->flags |= MSG_BUFF_F_SG;
+
+    return ERR_SUCCESS;
+}
+
+void msg_buff_unbind_data(struct msg_buff *msg_buff)
+{
+    if (msg_buff == NULL) {
+        return; 
+    }
+
+    msg_buff_share_put(msg_buff);
+    msg_buff->id = 0;
+    msg_buff->blk_cnt = 0;
+    msg_buff->timestamp = 0;
+    msg_buff->flags &= ~(MSG_BUFF_F_SG | MSG_BUFF_F_CSUM_MASK);
+    msg_buff->push_len = 0;
+    msg_buff->data = NULL;
+    msg_buff_invalidate_blk_index(msg_buff);
+
+    return;
+}
+
+/* Queue index for the message priority, priorities past the last queue share it. */
+uint8_t msg_buff_select_queue(struct msg_buff *msg_buff, uint8_t q_cnt)
+{
+    struct data_src *data;
+
+    if (msg_buff == NULL) {
+        return 0;
+    }
+
+    if (q_cnt == 0) {
+        return 0;
+    }
+
+    data = (struct data_src *)msg_buff->data;
+    if (data == NULL) {
+        return 0;
+    }
+
+    return (data->header.priority >= q_cnt) ? q_cnt - 1 : data->header.priority;
+}
+
+/*
+ * Walk the block chain once and record every block offset and type, so the
+ * accessors below are O(1). Either encoding is indexed in place, the payload
+ * is never touched. The walk is bounded by header.len and stops at the first
+ * zero-length block like the other data_src walkers. Rebuild after the
+ * payload changes, or call msg_buff_invalidate_blk_index().
+ */
+int msg_buff_build_blk_index(struct msg_buff *msg_buff)
+{
+    struct msg_blk_index *idx;
+    struct data_src *data;
+    struct proto_block_ref ref;
+    uint32_t off;
+    uint16_t cap;
+    int n;
+
+    if (msg_buff == NULL) {
+        return -ERR_INVALID_ARG;
+    }
+
+    data = (struct data_src *)msg_buff->data;
+    if (data == NULL) {
+        return -ERR_EMPTY;
+    }
+
+    if (msg_buff->flags & MSG_BUFF_F_SG) {
+        return -ERR_INVALID_ARG;
+    }
+
+    idx = msg_buff->blk_idx;
+    if (idx == NULL) {
+        idx = malloc(sizeof(struct msg_blk_index) + MSG_BLK_INDEX_CAP_DEFAULT * sizeof(struct msg_blk_entry));
+        if (idx == NULL) {
+            return -ERR_NO_MEM;
+        }
+        idx->cap = MSG_BLK_INDEX_CAP_DEFAULT;
+        msg_buff->blk_idx = idx;
+    }
+
+    idx->cnt = 0;
+    off = sizeof(struct data_src);
+    while (off < data->header.len
+           && (n = proto_block_next(data->header.cfg_hdr, (uint8_t *)data + off, data->header.len - off, &ref)) > 0) {
+        if (idx->cnt == idx->cap) {
+            cap = idx->cap * 2;
+            idx = realloc(idx, sizeof(struct msg_blk_index) + cap * sizeof(struct msg_blk_entry));
+            if (idx == NULL) {
+                free(msg_buff->blk_idx);
+                msg_buff->blk_idx = NULL;
+                return -ERR_NO_MEM;
+            }
+            idx->cap = cap;
+            msg_buff->blk_idx = idx;
+        }
+
+        idx->entry[idx->cnt].off = off;
+        idx->entry[idx->cnt].type = ref.type;
+        idx->cnt++;
+        off += n;
+    }
+
+    msg_buff->blk_cnt = idx->cnt > UINT8_MAX ? UINT8_MAX : idx->cnt;
+
+    return idx->cnt;
+}
+
+/* Keeps the allocation for the next build, an empty index is rebuilt on demand. */
+void msg_buff_invalidate_blk_index(struct msg_buff *msg_buff)
+{
+    if (msg_buff == NULL || msg_buff->blk_idx == NULL) {
+        return;
+    }
+
+    msg_buff->blk_idx->cnt = 0;
+}
+
+static struct msg_blk_index *msg_buff_get_blk_index(struct msg_buff *msg_buff)
+{
+    if (msg_buff->blk_idx == NULL || msg_buff->blk_idx->cnt == 0) {
+        if (msg_buff_build_blk_index(msg_buff) < 0) {
+            return NULL;
+        }
+    }
+
+    return msg_buff->blk_idx;
+}
+
+int msg_buff_get_blk_cnt(struct msg_buff *msg_buff)
+{
+    struct msg_blk_index *idx;
+
+    if (msg_buff == NULL) {
+        return -ERR_INVALID_ARG;
+    }
+
+    idx = msg_buff_get_blk_index(msg_buff);
+    if (idx == NULL) {
+        return -ERR_EMPTY;
+    }
+
+    return idx->cnt;
+}
+
+/* NULL on a compact payload, which has no proto_block layout, see msg_buff_get_blk_ref(). */
+struct proto_block *msg_buff_get_blk(struct msg_buff *msg_buff, uint16_t idx)
+{
+    struct msg_blk_index *blk_idx;
+
+    if (msg_buff == NULL) {
+        return NULL;
+    }
+
+    blk_idx = msg_buff_get_blk_index(msg_buff);
+    if (blk_idx == NULL || idx >= blk_idx->cnt
+        || ((struct data_src *)msg_buff->data)->header.cfg_hdr == PROTO_HEADER_CFG_COMPACT) {
+        return NULL;
+    }
+
+    return (struct proto_block *)((uint8_t *)msg_buff->data + blk_idx->entry[idx].off);
+}
+
+/* Decoded view of block idx in either encoding, pointing into the payload. */
+int msg_buff_get_blk_ref(struct msg_buff *msg_buff, uint16_t idx, struct proto_block_ref *ref)
+{
+    struct msg_blk_index *blk_idx;
+    struct data_src *data;
+    uint16_t off;
+
+    if (msg_buff == NULL || ref == NULL) {
+        return -ERR_INVALID_ARG;
+    }
+
+    blk_idx = msg_buff_get_blk_index(msg_buff);
+    if (blk_idx == NULL) {
+        return -ERR_EMPTY;
+    }
+
+    if (idx >= blk_idx->cnt) {
+        return -ERR_OUT_OF_RANGE;
+    }
+
+    data = (struct data_src *)msg_buff->data;
+    off = blk_idx->entry[idx].off;
+    if (proto_block_next(data->header.cfg_hdr, (uint8_t *)data + off, data->header.len - off, ref) <= 0) {
+        return -ERR_INVALID_ARG;
+    }
+
+    return ERR_SUCCESS;
+}
+
+/* Index of the first block of type at or after start, -ERR_NOT_FOUND if none. */
+int msg_buff_find_blk_idx(struct msg_buff *msg_buff, uint16_t type, uint16_t start)
+{
+    struct msg_blk_index *idx;
+
+    if (msg_buff == NULL) {
+        return -ERR_INVALID_ARG;
+    }
+
+    idx = msg_buff_get_blk_index(msg_buff);
+    if (idx == NULL) {
+        return -ERR_EMPTY;
+    }
+
+    for (uint16_t i = start; i < idx->cnt; i++) {
+        if (idx->entry[i].type == type) {
+            return i;
+        }
+    }
+
+    return -ERR_NOT_FOUND;
+}
+
+struct proto_block *msg_buff_find_blk(struct msg_buff *msg_buff, uint16_t type)
+{
+    int i;
+
+    i = msg_buff_find_blk_idx(msg_buff, type, 0);
+    if (i < 0) {
+        return NULL;
+    }
+
+    return msg_buff_get_blk(msg_buff, i);
+}
+
+void msg_chain_init(struct msg_chain *chain)
+{
+    if (chain == NULL) {
+        return;
+    }
+
+    chain->head = NULL;
+    chain->tail = NULL;
+    chain->count = 0;
+    chain->bytes = 0;
+}
+
+int msg_chain_add(struct msg_chain *chain, struct msg_buff *msg_buff)
+{
+    if (chain == NULL || msg_buff == NULL) {
+        return -ERR_INVALID_ARG;
+    }
+
+    if (msg_buff->data == NULL) {
+        return -ERR_EMPTY;
+    }
+
+    if (chain->count == MSG_QUEUE_CNT_MAX) {
+        return -ERR_OUT_OF_RANGE;
+    }
+
+    msg_buff->enq_ns = tstamp_cached_ns();
+    msg_buff->next = NULL;
+    msg_buff->prev = chain->tail;
+    if (chain->tail == NULL) {
+        chain->head = msg_buff;
+    } else {
+        chain->tail->next = msg_buff;
+    }
+    chain->tail = msg_buff;
+    chain->count++;
+    chain->bytes += ((struct data_src *)msg_buff->data)->header.len;
+
+    return ERR_SUCCESS;
+}
+
+/* A linked run goes in with one exchange, first..last already point at each other. */
+static void msg_queue_mpsc_push_chain(struct msg_queue_mpsc *mpsc, struct msg_buff *first, struct msg_buff *last)
+{
+    struct msg_buff *prev;
+
+    __atomic_store_n(&last->next, NULL, __ATOMIC_RELAXED);
+    prev = __atomic_exchange_n(&mpsc->tail, last, __ATOMIC_ACQ_REL);
+    __atomic_store_n(&prev->next, first, __ATOMIC_RELEASE);
+}
+
+static void msg_queue_mpsc_push(struct msg_queue_mpsc *mpsc, struct msg_buff *msg_buff)
+{
+    msg_queue_mpsc_push_chain(mpsc, msg_buff, msg_buff);
+}
+
+/* Consumer side, NULL when empty or while a producer is linking in. */
+static struct msg_buff *msg_queue_mpsc_pop(struct msg_queue_mpsc *mpsc)
+{
+    struct msg_buff *head = mpsc->head;
+    struct msg_buff *next = __atomic_load_n(&head->next, __ATOMIC_ACQUIRE);
+
+    if (head == &mpsc->stub) {
+        if (next == NULL) {
+            return NULL;
+        }
+        mpsc->head = next;
+        head = next;
+        next = __atomic_load_n(&next->next, __ATOMIC_ACQUIRE);
+    }
+
+    if (next == NULL) {
+        /* head is the last one, put the stub behind it before taking it */
+        if (head != __atomic_load_n(&mpsc->tail, __ATOMIC_ACQUIRE)) {
+            return NULL;
+        }
+        msg_queue_mpsc_push(mpsc, &mpsc->stub);
+        next = __atomic_load_n(&head->next, __ATOMIC_ACQUIRE);
+        if (next == NULL) {
+            return NULL;
+        }
+    }
+
+    mpsc->head = next;
+    head->next = NULL;
+
+    return head;
+}
+
+static struct msg_buff *msg_queue_mpsc_peek(struct msg_queue_mpsc *mpsc)
+{
+    struct msg_buff *head = mpsc->head;
+
+    if (head == &mpsc->stub) {
+        return __atomic_load_n(&head->next, __ATOMIC_ACQUIRE);
+    }
+
+    return head;
+}
+
+/* Producer side, returns how many of msg_buff[] went in, all published at once. */
+static int msg_queue_ring_push(struct msg_queue_ring *ring, struct msg_buff **msg_buff, int cnt)
+{
+    uint32_t tail = ring->tail;
+    uint32_t bytes = 0;
+    uint32_t room;
+    int i;
+
+    room = ring->mask + 1 - (tail - ring->head_cache);
+    if (room < (uint32_t)cnt) {
+        ring->head_cache = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+        room = ring->mask + 1 - (tail - ring->head_cache);
+        if (room < (uint32_t)cnt) {
+            cnt = room;
+        }
+    }
+
+    for (i = 0; i < cnt; i++) {
+        ring->slot[(tail + i) & ring->mask] = msg_buff[i];
+        bytes += ((struct data_src *)msg_buff[i]->data)->header.len;
+    }
+
+    if (cnt > 0) {
+        __atomic_store_n(&ring->tail_bytes, ring->tail_bytes + bytes, __ATOMIC_RELAXED);
+        __atomic_store_n(&ring->tail, tail + cnt, __ATOMIC_RELEASE);
+    }
+
+    return cnt;
+}
+
+/* Producer side, the whole chain or nothing, published at once. */
+static int msg_queue_ring_push_chain(struct msg_queue_ring *ring, struct msg_chain *chain)
+{
+    struct msg_buff *msg_buff = chain->head;
+    uint32_t tail = ring->tail;
+
+    if (ring->mask + 1 - (tail - ring->head_cache) < chain->count) {
+        ring->head_cache = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+        if (ring->mask + 1 - (tail - ring->head_cache) < chain->count) {
+            return -ERR_OUT_OF_RANGE;
+        }
+    }
+
+    for (uint16_t i = 0; i < chain->count; i++) {
+        ring->slot[tail++ & ring->mask] = msg_buff;
+        msg_buff = msg_buff->next;
+    }
+
+    __atomic_store_n(&ring->tail_bytes, ring->tail_bytes + chain->bytes, __ATOMIC_RELAXED);
+    __atomic_store_n(&ring->tail, tail, __ATOMIC_RELEASE);
+
+    return ERR_SUCCESS;
+}
+
+/* Consumer side, returns how many were taken into msg_buff[], all released at once. */
+static int msg_queue_ring_pop(struct msg_queue_ring *ring, struct msg_buff **msg_buff, int cnt)
+{
+    uint32_t head = ring->head;
+    uint32_t bytes = 0;
+    uint32_t avail;
+    int i;
+
+    avail = ring->tail_cache - head;
+    if (avail < (uint32_t)cnt) {
+        ring->tail_cache = __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+        avail = ring->tail_cache - head;
+        if (avail < (uint32_t)cnt) {
+            cnt = avail;
+        }
+    }
+
+    for (i = 0; i < cnt; i++) {
+        msg_buff[i] = ring->slot[(head + i) & ring->mask];
+        bytes += ((struct data_src *)msg_buff[i]->data)->header.len;
+    }
+
+    if (cnt > 0) {
+        __atomic_store_n(&ring->head_bytes, ring->head_bytes + bytes, __ATOMIC_RELAXED);
+        __atomic_store_n(&ring->head, head + cnt, __ATOMIC_RELEASE);
+    }
+
+    return cnt;
+}
+
+static struct msg_buff *msg_queue_ring_peek(struct msg_queue_ring *ring)
+{
+    if (ring->tail_cache == ring->head) {
+        ring->tail_cache = __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+        if (ring->tail_cache == ring->head) {
+            return NULL;
+        }
+    }
+
+    return ring->slot[ring->head & ring->mask];
+}
+
+static inline int msg_edf_before(const struct msg_edf_node *a, const struct msg_edf_node *b)
+{
+    if (a->deadline_ns != b->deadline_ns) {
+        return a->deadline_ns < b->deadline_ns;
+    }
+
+    return (int32_t)(a->seq - b->seq) < 0;
+}
+
+static uint64_t msg_edf_deadline(struct msg_buff *msg_buff)
+{
+    uint16_t heart_rate = ((struct data_src *)msg_buff->data)->header.heart_rate;
+    uint64_t base = msg_buff->timestamp ? msg_buff->timestamp : msg_buff->enq_ns;
+
+    if (heart_rate == 0) {
+        return MSG_EDF_NEVER;
+    }
+
+    return base + heart_rate * 1000000000ULL;
+}
+
+/* Room for cnt more nodes. */
+static int msg_queue_edf_reserve(struct msg_queue_edf *edf, uint32_t cnt)
+{
+    struct msg_edf_node *node;
+    uint32_t cap = edf->cap;
+
+    while (cap < edf->cnt + cnt) {
+        cap <<= 1;
+    }
+
+    if (cap == edf->cap) {
+        return ERR_SUCCESS;
+    }
+
+    node = (struct msg_edf_node *)realloc(edf->node, cap * sizeof(struct msg_edf_node));
+    if (node == NULL) {
+        return -ERR_NO_MEM;
+    }
+    edf->node = node;
+    edf->cap = cap;
+
+    return ERR_SUCCESS;
+}
+
+/* Room was reserved, the new node sifts up from the bottom. */
+static void msg_queue_edf_push(struct msg_queue_edf *edf, struct msg_buff *msg_buff)
+{
+    struct msg_edf_node node;
+    uint32_t i, parent;
+
+    node.deadline_ns = msg_edf_deadline(msg_buff);
+    node.seq = edf->seq++;
+    node.msg_buff = msg_buff;
+
+    for (i = edf->cnt++; i > 0; i = parent) {
+        parent = (i - 1) / MSG_EDF_ARITY;
+        if (!msg_edf_before(&node, &edf->node[parent])) {
+            break;
+        }
+        edf->node[i] = edf->node[parent];
+    }
+    edf->node[i] = node;
+}
+
+/* Take the top, the last node sinks from the root. The heap is not empty. */
+static struct msg_edf_node msg_queue_edf_pop(struct msg_queue_edf *edf)
+{
+    struct msg_edf_node top = edf->node[0];
+    struct msg_edf_node *last;
+    uint32_t i = 0, child, end, best;
+
+    last = &edf->node[--edf->cnt];
+    for (;;) {
+        child = i * MSG_EDF_ARITY + 1;
+        if (child >= edf->cnt) {
+            break;
+        }
+
+        end = (child + MSG_EDF_ARITY < edf->cnt) ? child + MSG_EDF_ARITY : edf->cnt;
+        best = child;
+        for (uint32_t c = child + 1; c < end; c++) {
+            if (msg_edf_before(&edf->node[c], &edf->node[best])) {
+                best = c;
+            }
+        }
+
+        if (!msg_edf_before(&edf->node[best], last)) {
+            break;
+        }
+        edf->node[i] = edf->node[best];
+        i = best;
+    }
+    edf->node[i] = *last;
+
+    return top;
+}
+
+/* Queued messages are freed with the queue, in MPSC and SPSC mode once the producers are gone. */
+void msg_queue_deinit(struct msg_queue *msg_queue)
+{
+    struct msg_buff *msg_buff;
+
+    if (msg_queue == NULL) {
+        return;
+    }
+
+    if (msg_queue->mpsc != NULL) {
+        while ((msg_buff = msg_queue_mpsc_pop(msg_queue->mpsc)) != NULL) {
+            msg_buff_deinit(msg_buff);
+        }
+        free(msg_queue->mpsc);
+    } else if (msg_queue->ring != NULL) {
+        while (msg_queue_ring_pop(msg_queue->ring, &msg_buff, 1) == 1) {
+            msg_buff_deinit(msg_buff);
+        }
+        free(msg_queue->ring);
+    } else if (msg_queue->edf != NULL) {
+        for (uint32_t i = 0; i < msg_queue->edf->cnt; i++) {
+            msg_buff_deinit(msg_queue->edf->node[i].msg_buff);
+        }
+        free(msg_queue->edf->node);
+        free(msg_queue->edf);
+    } else {
+        while (msg_queue->stats.count != 0) {
+            msg_buff = msg_queue->head;
+            msg_queue->head = msg_buff->next;
+            msg_queue->stats.count--;
+            msg_buff_deinit(msg_buff);
+        }
+    }
+
+    free(msg_queue);
+}
+
+struct msg_queue *msg_queue_init_cfg(const struct msg_queue_cfg *cfg)
+{
+    struct msg_queue *msg_queue;
+    uint32_t cap;
+    size_t size;
+    void *mem;
+
+    if (cfg == NULL || cfg->mode >= MSG_QUEUE_MODE_MAX || cfg->aqm >= MSG_QUEUE_AQM_MAX
+        || (cfg->high_wm != 0 && cfg->low_wm >= cfg->high_wm)) {
+        return NULL;
+    }
+
+    msg_queue = (struct msg_queue *)malloc(sizeof(struct msg_queue));
+    if (msg_queue == NULL) {
+        return NULL;
+    }
+
+    memset(msg_queue, 0, sizeof(struct msg_queue));
+    msg_queue->cfg = *cfg;
+
+    if (cfg->mode == MSG_QUEUE_MODE_MPSC) {
+        if (posix_memalign(&mem, MSG_CACHE_LINE, sizeof(struct msg_queue_mpsc)) != 0) {
+            free(msg_queue);
+            return NULL;
+        }
+        msg_queue->mpsc = (struct msg_queue_mpsc *)mem;
+        memset(msg_queue->mpsc, 0, sizeof(struct msg_queue_mpsc));
+        msg_queue->mpsc->head = &msg_queue->mpsc->stub;
+        msg_queue->mpsc->tail = &msg_queue->mpsc->stub;
+    } else if (cfg->mode == MSG_QUEUE_MODE_SPSC) {
+        cap = cfg->capacity ? cfg->capacity : MSG_QUEUE_RING_CAP_DEFAULT;
+        if (cap > MSG_QUEUE_RING_CAP_MAX) {
+            free(msg_queue);
+            return NULL;
+        }
+        cap = (cap > 1) ? 1U << (32 - __builtin_clz(cap - 1)) : 1;
+        size = sizeof(struct msg_queue_ring) + cap * sizeof(struct msg_buff *);
+        if (posix_memalign(&mem, MSG_CACHE_LINE, size) != 0) {
+            free(msg_queue);
+            return NULL;
+        }
+        msg_queue->ring = (struct msg_queue_ring *)mem;
+        memset(msg_queue->ring, 0, size);
+        msg_queue->ring->mask = cap - 1;
+        msg_queue->cfg.capacity = cap;
+    } else if (cfg->mode == MSG_QUEUE_MODE_EDF) {
+        cap = cfg->capacity ? cfg->capacity : MSG_QUEUE_EDF_CAP_DEFAULT;
+        if (cap > MSG_QUEUE_CNT_MAX) {
+            free(msg_queue);
+            return NULL;
+        }
+        msg_queue->edf = (struct msg_queue_edf *)malloc(sizeof(struct msg_queue_edf));
+        if (msg_queue->edf == NULL) {
+            free(msg_queue);
+            return NULL;
+        }
+        memset(msg_queue->edf, 0, sizeof(struct msg_queue_edf));
+        msg_queue->edf->node = (struct msg_edf_node *)malloc(cap * sizeof(struct msg_edf_node));
+        if (msg_queue->edf->node == NULL) {
+            free(msg_queue->edf);
+            free(msg_queue);
+            return NULL;
+        }
+        msg_queue->edf->cap = cap;
+        msg_queue->cfg.capacity = cap;
+    }
+
+    return msg_queue;
+}
+
+struct msg_queue *msg_queue_init(uint8_t id)
+{
+    struct msg_queue_cfg cfg;
+
+    memset(&cfg, 0, sizeof(struct msg_queue_cfg));
+    cfg.qid = id;
+    cfg.mode = MSG_QUEUE_MODE_LIST;
+    cfg.rx_type = MSG_QUEUE_RX_HALF;
+
+    return msg_queue_init_cfg(&cfg);
+}
+
+/* Producers race for the last slots, slots are claimed before the messages are linked. */
+static int msg_queue_mpsc_enqueue(struct msg_queue *msg_queue, struct msg_buff *first, struct msg_buff *last,
+                                  uint16_t cnt, uint32_t bytes)
+{
+    uint16_t count = __atomic_load_n(&msg_queue->stats.count, __ATOMIC_RELAXED);
+
+    do {
+        if (count + cnt > MSG_QUEUE_CNT_MAX) {
+            return -ERR_OUT_OF_RANGE;
+        }
+    } while (!__atomic_compare_exchange_n(&msg_queue->stats.count, &count, count + cnt, 1, __ATOMIC_RELAXED,
+                                          __ATOMIC_RELAXED));
+
+    __atomic_add_fetch(&msg_queue->stats.bytes, bytes, __ATOMIC_RELAXED);
+    msg_queue_mpsc_push_chain(msg_queue->mpsc, first, last);
+
+    return ERR_SUCCESS;
+}
+
+static uint32_t msg_queue_bytes(struct msg_queue *msg_queue)
+{
+    uint32_t head_bytes;
+
+    if (msg_queue->ring != NULL) {
+        head_bytes = __atomic_load_n(&msg_queue->ring->head_bytes, __ATOMIC_ACQUIRE);
+        return __atomic_load_n(&msg_queue->ring->tail_bytes, __ATOMIC_ACQUIRE) - head_bytes;
+    }
+
+    return __atomic_load_n(&msg_queue->stats.bytes, __ATOMIC_ACQUIRE);
+}
+
+static uint32_t msg_queue_codel_interval(struct msg_queue *msg_queue)
+{
+    return msg_queue->cfg.aqm_interval_ns ? msg_queue->cfg.aqm_interval_ns : MSG_CODEL_INTERVAL_NS;
+}
+
+static uint32_t msg_queue_low_wm(struct msg_queue *msg_queue)
+{
+    if (msg_queue->cfg.low_wm != 0) {
+        return msg_queue->cfg.low_wm;
+    }
+
+    switch (msg_queue->cfg.rx_type) {
+    case MSG_QUEUE_RX_HALF:
+        return msg_queue->cfg.high_wm / 2;
+    case MSG_QUEUE_RX_FULL:
+        return msg_queue->cfg.high_wm - 1;
+    default:
+        return 0;
+    }
+}
+
+/*
+ * Flip xoff when a mark was crossed, from either side. Producers and
+ * the consumer race in the lock-free modes, the level is read again
+ * after each flip so the state never sticks on a stale reading.
+ */
+static void msg_queue_wm_update(struct msg_queue *msg_queue)
+{
+    struct msg_queue_stats *stats = &msg_queue->stats;
+    uint32_t bytes;
+
+    if (msg_queue->cfg.high_wm == 0) {
+        return;
+    }
+
+    for (;;) {
+        bytes = msg_queue_bytes(msg_queue);
+        if (bytes >= msg_queue->cfg.high_wm) {
+            if (__atomic_load_n(&stats->xoff, __ATOMIC_ACQUIRE)
+                || __atomic_exchange_n(&stats->xoff, 1, __ATOMIC_ACQ_REL)) {
+                return;
+            }
+            __atomic_add_fetch(&stats->xoff_cnt, 1, __ATOMIC_RELAXED);
+            if (msg_queue->cfg.wm_fn != NULL) {
+                msg_queue->cfg.wm_fn(msg_queue, 1, msg_queue->cfg.wm_arg);
+            }
+        } else if (bytes <= msg_queue_low_wm(msg_queue)) {
+            if (!__atomic_load_n(&stats->xoff, __ATOMIC_ACQUIRE)
+                || !__atomic_exchange_n(&stats->xoff, 0, __ATOMIC_ACQ_REL)) {
+                return;
+            }
+            if (msg_queue->cfg.wm_fn != NULL) {
+                msg_queue->cfg.wm_fn(msg_queue, 0, msg_queue->cfg.wm_arg);
+            }
+        } else {
+            return;
+        }
+    }
+}
+
+/* Time spent queued, against the consumer's clock reading for the batch. */
+static void msg_queue_sojourn(struct msg_queue *msg_queue, struct msg_buff **msg_buff, int cnt)
+{
+    uint64_t now = tstamp_cached_ns();
+
+    for (int i = 0; i < cnt; i++) {
+        /* the producer may have read a newer clock than the consumer's cached one */
+        tstamp_sojourn_record(&msg_queue->stats.sojourn, (now > msg_buff[i]->enq_ns) ? now - msg_buff[i]->enq_ns : 0);
+    }
+}
+
+/* Link first..last behind the tail, O(1) whatever the length of the run. */
+static int msg_queue_list_enqueue(struct msg_queue *msg_queue, struct msg_buff *first, struct msg_buff *last,
+                                  uint16_t cnt, uint32_t bytes)
+{
+    if ((uint64_t)msg_queue->stats.bytes + bytes > MSG_QUEUE_BYTES_MAX
+        || msg_queue->stats.count + cnt > MSG_QUEUE_CNT_MAX) {
+        return -ERR_OUT_OF_RANGE;   
+    }
+
+    if (msg_queue->stats.count == 0) {
+        msg_queue->head = first;
+    } else {
+        msg_queue->tail->next = first;
+        first->prev = msg_queue->tail;
+    }
+    msg_queue->tail = last;
+
+    msg_queue->stats.count += cnt;
+    msg_queue->stats.bytes += bytes;
+
+    return ERR_SUCCESS;
+}
+
+/* Unlink up to cnt messages from the head, the stats are updated once. */
+static int msg_queue_list_pop(struct msg_queue *msg_queue, struct msg_buff **msg_buff, int cnt)
+{
+    struct msg_buff *head = msg_queue->head;
+    uint32_t bytes = 0;
+    int i;
+
+    if (cnt > msg_queue->stats.count) {
+        cnt = msg_queue->stats.count;
+    }
+
+    for (i = 0; i < cnt; i++) {
+        msg_buff[i] = head;
+        bytes += ((struct data_src *)head->data)->header.len;
+        head = head->next;
+    }
+
+    msg_queue->head = head;
+    msg_queue->stats.count -= cnt;
+    msg_queue->stats.bytes -= bytes;
+
+    return cnt;
+}
+
+/* cnt messages linked from first, room is reserved up front so they go in entirely or not at all. */
+static int msg_queue_edf_enqueue(struct msg_queue *msg_queue, struct msg_buff *first, uint16_t cnt, uint32_t bytes)
+{
+    struct msg_buff *next;
+
+    if ((uint64_t)msg_queue->stats.bytes + bytes > MSG_QUEUE_BYTES_MAX
+        || msg_queue->stats.count + cnt > MSG_QUEUE_CNT_MAX) {
+        return -ERR_OUT_OF_RANGE;
+    }
+
+    if (msg_queue_edf_reserve(msg_queue->edf, cnt) != ERR_SUCCESS) {
+        return -ERR_NO_MEM;
+    }
+
+    for (int i = 0; i < cnt; i++, first = next) {
+        next = first->next;
+        msg_queue_edf_push(msg_queue->edf, first);
+    }
+
+    msg_queue->stats.count += cnt;
+    msg_queue->stats.bytes += bytes;
+
+    return ERR_SUCCESS;
+}
+
+/* Earliest deadline first, expired messages met on the way are freed and counted. */
+static int msg_queue_edf_dequeue(struct msg_queue *msg_queue, struct msg_buff **msg_buff, int cnt)
+{
+    struct msg_queue_edf *edf = msg_queue->edf;
+    struct msg_edf_node node;
+    uint64_t now = tstamp_cached_ns();
+    uint32_t bytes = 0;
+    uint16_t removed = 0;
+    int i = 0;
+
+    while (i < cnt && edf->cnt > 0) {
+        node = msg_queue_edf_pop(edf);
+        bytes += ((struct data_src *)node.msg_buff->data)->header.len;
+        removed++;
+
+        if (node.deadline_ns <= now) {
+            msg_buff_deinit(node.msg_buff);
+            msg_queue->stats.drop_expired++;
+            continue;
+        }
+        msg_buff[i++] = node.msg_buff;
+    }
+
+    msg_queue->stats.count -= removed;
+    msg_queue->stats.bytes -= bytes;
+
+    /* the caller only updates the watermarks when something came out */
+    if (i == 0 && removed > 0) {
+        msg_queue_wm_update(msg_queue);
+    }
+
+    return i;
+}
+
+/* Take one drop owed by the consumer's CoDel state, 1 when the message is to be refused. */
+static int msg_queue_codel_tail_drop(struct msg_queue *msg_queue)
+{
+    uint32_t credit;
+
+    if (msg_queue->cfg.aqm != MSG_QUEUE_AQM_CODEL_TAIL) {
+        return 0;
+    }
+
+    credit = __atomic_load_n(&msg_queue->codel.tail_credit, __ATOMIC_ACQUIRE);
+    do {
+        if (credit == 0) {
+            return 0;
+        }
+    } while (!__atomic_compare_exchange_n(&msg_queue->codel.tail_credit, &credit, credit - 1, 1, __ATOMIC_ACQ_REL,
+                                          __ATOMIC_ACQUIRE));
+
+    __atomic_add_fetch(&msg_queue->stats.drop_tail, 1, __ATOMIC_RELAXED);
+
+    return 1;
+}
+
+/*
+ * Safe from any thread in MPSC mode, from the producer thread in SPSC mode.
+ * -ERR_BUSY when the AQM refuses the message, the caller keeps it either way.
+ */
+int msg_queue_enqueue(struct msg_queue *msg_queue, struct msg_buff *msg_buff)
+{
+    struct data_src *data;
+    int ret;
+
+    if (msg_queue == NULL || msg_buff == NULL) {
+        return -ERR_INVALID_ARG;
+    }
+    
+    data = (struct data_src *)msg_buff->data;
+    if (data == NULL) {
+        return -ERR_EMPTY; 
+    }
+
+    if (msg_queue_codel_tail_drop(msg_queue)) {
+        return -ERR_BUSY;
+    }
+
+    msg_buff->enq_ns = tstamp_cached_ns();
+    if (msg_queue->mpsc != NULL) {
+        ret = msg_queue_mpsc_enqueue(msg_queue, msg_buff, msg_buff, 1, data->header.len);
+    } else if (msg_queue->ring != NULL) {
+        ret = (msg_queue_ring_push(msg_queue->ring, &msg_buff, 1) == 1) ? ERR_SUCCESS : -ERR_OUT_OF_RANGE;
+    } else if (msg_queue->edf != NULL) {
+        ret = msg_queue_edf_enqueue(msg_queue, msg_buff, 1, data->header.len);
+    } else {
+        ret = msg_queue_list_enqueue(msg_queue, msg_buff, msg_buff, 1, data->header.len);
+    }
+
+    if (ret == ERR_SUCCESS) {
+        msg_queue_wm_update(msg_queue);
+    }
+
+    return ret;
+}
+
+/* Consumer thread only in MPSC and SPSC mode, never waits for a producer. */
+struct msg_buff *msg_queue_dequeue(struct msg_queue *msg_queue)
+{
+    struct msg_buff *msg_buff;
+
+    return (msg_queue_dequeue_bulk(msg_queue, &msg_buff, 1) == 1) ? msg_buff : NULL;
+}
+
+/* Unlink up to cnt messages in any mode, count and bytes are updated once. */
+static int msg_queue_pop(struct msg_queue *msg_queue, struct msg_buff **msg_buff, int cnt)
+{
+    uint32_t bytes = 0;
+    int i;
+
+    if (msg_queue->ring != NULL) {
+        return msg_queue_ring_pop(msg_queue->ring, msg_buff, cnt);
+    }
+
+    if (msg_queue->edf != NULL) {
+        return msg_queue_edf_dequeue(msg_queue, msg_buff, cnt);
+    }
+
+    if (msg_queue->mpsc == NULL) {
+        return msg_queue_list_pop(msg_queue, msg_buff, cnt);
+    }
+
+    for (i = 0; i < cnt; i++) {
+        msg_buff[i] = msg_queue_mpsc_pop(msg_queue->mpsc);
+        if (msg_buff[i] == NULL) {
+            break;
+        }
+        bytes += ((struct data_src *)msg_buff[i]->data)->header.len;
+    }
+
+    if (i > 0) {
+        __atomic_sub_fetch(&msg_queue->stats.count, i, __ATOMIC_RELAXED);
+        __atomic_sub_fetch(&msg_queue->stats.bytes, bytes, __ATOMIC_RELEASE);
+    }
+
+    return i;
+}
+
+static uint64_t msg_codel_isqrt(uint64_t v)
+{
+    uint64_t x = v, y = (v + 1) / 2;
+
+    while (y < x) {
+        x = y;
+        y = (x + v / x) / 2;
+    }
+
+    return x;
+}
+
+/* interval / sqrt(drop_cnt) after t, in 1/1024 steps so small counts still differ. */
+static uint64_t msg_codel_control_law(uint64_t t, uint32_t interval, uint32_t drop_cnt)
+{
+    return t + ((uint64_t)interval << 10) / msg_codel_isqrt((uint64_t)drop_cnt << 20);
+}
+
+/* Pop one and tell whether it has been above its target for a whole interval. */
+static struct msg_buff *msg_codel_pop(struct msg_queue *msg_queue, uint64_t now, int *ok_to_drop)
+{
+    struct msg_queue_codel *codel = &msg_queue->codel;
+    struct msg_buff *msg_buff;
+    uint64_t sojourn;
+    uint32_t target;
+    uint8_t prio;
+
+    *ok_to_drop = 0;
+    if (msg_queue_pop(msg_queue, &msg_buff, 1) != 1) {
+        codel->first_above_ns = 0;
+        return NULL;
+    }
+    msg_queue_sojourn(msg_queue, &msg_buff, 1);
+
+    prio = ((struct data_src *)msg_buff->data)->header.priority;
+    if (prio > PROTO_HEADER_PRIORITY_MAX) {
+        prio = PROTO_HEADER_PRIORITY_MAX;
+    }
+    target = msg_queue->cfg.aqm_target_ns[prio] ? msg_queue->cfg.aqm_target_ns[prio] : MSG_CODEL_TARGET_NS;
+    sojourn = (now > msg_buff->enq_ns) ? now - msg_buff->enq_ns : 0;
+
+    /* a lone message is no standing queue */
+    if (sojourn < target || msg_queue_get_count(msg_queue) == 0) {
+        codel->first_above_ns = 0;
+    } else if (codel->first_above_ns == 0) {
+        codel->first_above_ns = now + msg_queue_codel_interval(msg_queue);
+    } else if (now >= codel->first_above_ns) {
+        *ok_to_drop = 1;
+    }
+
+    return msg_buff;
+}
+
+/*
+ * Head mode frees msg_buff and pops the next one, tail mode lets it
+ * through and leaves the drop to the next producer. 0 once the queue
+ * is back below target.
+ */
+static int msg_codel_drop(struct msg_queue *msg_queue, struct msg_buff **msg_buff, uint64_t now)
+{
+    int ok_to_drop;
+
+    msg_queue->codel.drop_cnt++;
+    if (msg_queue->cfg.aqm == MSG_QUEUE_AQM_CODEL_TAIL) {
+        __atomic_add_fetch(&msg_queue->codel.tail_credit, 1, __ATOMIC_RELEASE);
+        return 1;
+    }
+
+    msg_buff_deinit(*msg_buff);
+    msg_queue->stats.drop_head++;
+    *msg_buff = msg_codel_pop(msg_queue, now, &ok_to_drop);
+
+    return ok_to_drop;
+}
+
+/* RFC 8289 dequeue, one message at a time. */
+static struct msg_buff *msg_codel_dequeue(struct msg_queue *msg_queue, uint64_t now)
+{
+    struct msg_queue_codel *codel = &msg_queue->codel;
+    uint32_t interval = msg_queue_codel_interval(msg_queue);
+    struct msg_buff *msg_buff;
+    uint32_t delta;
+    int ok_to_drop;
+
+    msg_buff = msg_codel_pop(msg_queue, now, &ok_to_drop);
+    if (msg_buff == NULL) {
+        codel->dropping = 0;
+        return NULL;
+    }
+
+    if (codel->dropping) {
+        if (!ok_to_drop) {
+            codel->dropping = 0;
+        }
+        /* tail mode hands out one drop per dequeue, the producers pay it */
+        while (codel->dropping && now >= codel->drop_next_ns) {
+            if (!msg_codel_drop(msg_queue, &msg_buff, now) || msg_buff == NULL) {
+                codel->dropping = 0;
+                break;
+            }
+            codel->drop_next_ns = msg_codel_control_law(codel->drop_next_ns, interval, codel->drop_cnt);
+            if (msg_queue->cfg.aqm == MSG_QUEUE_AQM_CODEL_TAIL) {
+                break;
+            }
+        }
+    } else if (ok_to_drop) {
+        /* back into dropping soon after leaving it, resume near the old rate */
+        delta = codel->drop_cnt - codel->last_cnt;
+        codel->drop_cnt = (delta > 1 && now - codel->drop_next_ns < 16ULL * interval) ? delta - 1 : 0;
+
+        msg_codel_drop(msg_queue, &msg_buff, now);
+        codel->dropping = 1;
+        codel->drop_next_ns = msg_codel_control_law(now, interval, codel->drop_cnt);
+        codel->last_cnt = codel->drop_cnt;
+    }
+
+    return msg_buff;
+}
+
+/* Up to cnt messages into msg_buff[], oldest first, returns how many were taken. */
+int msg_queue_dequeue_bulk(struct msg_queue *msg_queue, struct msg_buff **msg_buff, int cnt)
+{
+    uint64_t now;
+    int i;
+
+    if (msg_queue == NULL || msg_buff == NULL || cnt < 0) {
+        return -ERR_INVALID_ARG;
+    }
+
+    if (msg_queue->cfg.aqm != MSG_QUEUE_AQM_NONE) {
+        now = tstamp_cached_ns();
+        for (i = 0; i < cnt; i++) {
+            msg_buff[i] = msg_codel_dequeue(msg_queue, now);
+            if (msg_buff[i] == NULL) {
+                break;
+            }
+        }
+        msg_queue_wm_update(msg_queue);
+        return i;
+    }
+
+    i = msg_queue_pop(msg_queue, msg_buff, cnt);
+    if (i > 0) {
+        msg_queue_sojourn(msg_queue, msg_buff, i);
+        msg_queue_wm_update(msg_queue);
+    }
+
+    return i;
+}
+
+/*
+ * Queue a whole chain with one stats and watermark update. It goes in
+ * entirely or not at all, the chain is emptied on success.
+ */
+int msg_queue_enqueue_chain(struct msg_queue *msg_queue, struct msg_chain *chain)
+{
+    int ret;
+
+    if (msg_queue == NULL || chain == NULL) {
+        return -ERR_INVALID_ARG;
+    }
+
+    if (chain->count == 0) {
+        return ERR_SUCCESS;
+    }
+
+    if (msg_queue->mpsc != NULL) {
+        ret = msg_queue_mpsc_enqueue(msg_queue, chain->head, chain->tail, chain->count, chain->bytes);
+    } else if (msg_queue->ring != NULL) {
+        ret = msg_queue_ring_push_chain(msg_queue->ring, chain);
+    } else if (msg_queue->edf != NULL) {
+        ret = msg_queue_edf_enqueue(msg_queue, chain->head, chain->count, chain->bytes);
+    } else {
+        ret = msg_queue_list_enqueue(msg_queue, chain->head, chain->tail, chain->count, chain->bytes);
+    }
+
+    if (ret != ERR_SUCCESS) {
+        return ret;
+    }
+
+    msg_chain_init(chain);
+    msg_queue_wm_update(msg_queue);
+
+    return ERR_SUCCESS;
+}
+
+/*
+ * Move everything queued on src behind the tail of dst, in order. src is
+ * a list mode queue, it is unlinked in O(1). Lock-free queues are drained
+ * with msg_queue_dequeue_bulk() instead.
+ */
+int msg_queue_splice(struct msg_queue *dst, struct msg_queue *src)
+{
+    struct msg_chain chain;
+    int ret;
+
+    if (dst == NULL || src == NULL || dst == src || src->mpsc != NULL || src->ring != NULL || src->edf != NULL) {
+        return -ERR_INVALID_ARG;
+    }
+
+    if (src->stats.count == 0) {
+        return ERR_SUCCESS;
+    }
+
+    chain.head = src->head;
+    chain.tail = src->tail;
+    chain.count = src->stats.count;
+    chain.bytes = src->stats.bytes;
+    chain.tail->next = NULL;
+
+    ret = msg_queue_enqueue_chain(dst, &chain);
+    if (ret != ERR_SUCCESS) {
+        return ret;
+    }
+
+    src->head = NULL;
+    src->tail = NULL;
+    src->stats.count = 0;
+    src->stats.bytes = 0;
+    msg_queue_wm_update(src);
+
+    return ERR_SUCCESS;
+}
+
+struct msg_buff *msg_queue_peek(struct msg_queue *msg_queue)
+{
+    if (msg_queue == NULL) {
+        return NULL;
+    }
+
+    if (msg_queue->mpsc != NULL) {
+        return msg_queue_mpsc_peek(msg_queue->mpsc);
+    }
+
+    if (msg_queue->ring != NULL) {
+        return msg_queue_ring_peek(msg_queue->ring);
+    }
+
+    /* may be past its deadline, only dequeue drops */
+    if (msg_queue->edf != NULL) {
+        return (msg_queue->edf->cnt > 0) ? msg_queue->edf->node[0].msg_buff : NULL;
+    }
+
+    if (msg_queue->stats.count == 0) {
+        return NULL;
+    }
+    
+    return msg_queue->head;
+}
+
+/* The producer end of an MPSC or SPSC queue moves under the caller, an EDF queue has none, NULL there. */
+struct msg_buff *msg_queue_get_tail(struct msg_queue *msg_queue)
+{
+    if (msg_queue == NULL || msg_queue->mpsc != NULL || msg_queue->ring != NULL || msg_queue->edf != NULL) {
+        return NULL;
+    }
+
+    if (msg_queue->stats.count == 0) {
+        return NULL;
+    }
+
+    return msg_queue->tail;
+}
+
+int msg_queue_get_count(struct msg_queue *msg_queue)
+{
+    if (msg_queue == NULL) {
+        return -ERR_INVALID_ARG;
+   
+    }
+
+    /* head first, the tail read after it is never behind it */
+    if (msg_queue->ring != NULL) {
+        uint32_t head = __atomic_load_n(&msg_queue->ring->head, __ATOMIC_ACQUIRE);
+
+        return __atomic_load_n(&msg_queue->ring->tail, __ATOMIC_ACQUIRE) - head;
+    }
+
+    return __atomic_load_n(&msg_queue->stats.count, __ATOMIC_RELAXED); 
+}
+
+int msg_queue_get_data_size(struct msg_queue *msg_queue)
 {
     if (msg_queue == NULL) {
         return -ERR_INVALID_ARG;
     }
 
-    return msg_queue->stats.bytes; 
+    return msg_queue_bytes(msg_queue); 
 }
 
 int msg_queue_get_id(struct msg_queue *msg_queue)
@@ -518,7 +2778,7 @@ int msg_queue_set_rx_type(struct msg_queue *msg_queue, uint8_t rx_type)
         return -ERR_INVALID_ARG;
     }
 
-    if (rx_type > MSG_QUEUE_RX_TYPE_MAX) {
+    if (rx_type >= MSG_QUEUE_RX_TYPE_MAX) {
         return -ERR_INVALID_ARG;
     }
 
@@ -526,3 +2786,51 @@ int msg_queue_set_rx_type(struct msg_queue *msg_queue, uint8_t rx_type)
 
     return ERR_SUCCESS;
 }
+
+/* high_wm 0 turns the watermarks off, set them before traffic starts. */
+int msg_queue_set_watermark(struct msg_queue *msg_queue, uint32_t high_wm, uint32_t low_wm, msg_queue_wm_fn fn,
+                            void *arg)
+{
+    if (msg_queue == NULL || (high_wm != 0 && low_wm >= high_wm)) {
+        return -ERR_INVALID_ARG;
+    }
+
+    msg_queue->cfg.high_wm = high_wm;
+    msg_queue->cfg.low_wm = low_wm;
+    msg_queue->cfg.wm_fn = fn;
+    msg_queue->cfg.wm_arg = arg;
+    msg_queue->stats.xoff = 0;
+    msg_queue_wm_update(msg_queue);
+
+    return ERR_SUCCESS;
+}
+
+/*
+ * Turn CoDel on or off, target_ns holds PROTO_HEADER_PRIO_CNT targets by
+ * priority or is NULL for the defaults. Set it before traffic starts.
+ */
+int msg_queue_set_aqm(struct msg_queue *msg_queue, uint8_t aqm, const uint32_t *target_ns, uint32_t interval_ns)
+{
+    if (msg_queue == NULL || aqm >= MSG_QUEUE_AQM_MAX) {
+        return -ERR_INVALID_ARG;
+    }
+
+    for (int i = 0; i < PROTO_HEADER_PRIO_CNT; i++) {
+        msg_queue->cfg.aqm_target_ns[i] = (target_ns != NULL) ? target_ns[i] : 0;
+    }
+    msg_queue->cfg.aqm_interval_ns = interval_ns;
+    msg_queue->cfg.aqm = aqm;
+    memset(&msg_queue->codel, 0, sizeof(struct msg_queue_codel));
+
+    return ERR_SUCCESS;
+}
+
+/* 1 while producers should hold back. */
+int msg_queue_is_xoff(struct msg_queue *msg_queue)
+{
+    if (msg_queue == NULL) {
+        return 0;
+    }
+
+    return __atomic_load_n(&msg_queue->stats.xoff, __ATOMIC_ACQUIRE);
+}
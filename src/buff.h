@@ -3,10 +3,14 @@
 
 #include <stdint.h>
 #include <time.h>
+#include <sys/uio.h>
 
 #include "errno.h"
 #include "config.h"
 #include "proto.h"
+#include "slab.h"
+#include "pool.h"
+#include "tstamp.h"
 
 #define MSG_RXQ_CNT_DEFAULT 2
 #define MSG_TXQ_CNT_DEFAULT 2
@@ -19,15 +23,113 @@ struct data_src {
     struct proto_block blocks[];
 };
 
+#define MSG_SG_SEG_MAX 16
+
+struct msg_sg_seg {
+    const void *base;
+    uint16_t len;
+    void (*release)(const void *base);  // optional, called by msg_sg_deinit()
+};
+
+/*
+ * Segmented payload: the header plus a chain of segments referencing user
+ * or pool memory. header comes first, so code that only reads the header of
+ * a data_src also works on a msg_sg. header.len covers header and segments.
+ */
+struct msg_sg {
+    struct proto_header header;
+    uint8_t seg_cnt;
+    struct msg_sg_seg seg[MSG_SG_SEG_MAX];
+};
+
+#define MSG_BLK_INDEX_CAP_DEFAULT 16
+
+struct msg_blk_entry {
+    uint16_t off;           // from the start of data_src
+    uint16_t type;
+};
+
+/* Side array of block offsets, built once per payload by msg_buff_build_blk_index(). */
+struct msg_blk_index {
+    uint16_t cnt;
+    uint16_t cap;
+    struct msg_blk_entry entry[];
+};
+
+#define MSG_BUFF_F_SG 0x01          // data is a struct msg_sg
+#define MSG_BUFF_F_SLAB 0x02        // msg_buff came from the slab cache
+/*
+ * enum csum_type header.checksum is known to be valid for, CSUM_TYPE_AUTO
+ * when unknown. Set on rx so forwarding patches the checksum rather than
+ * summing the frame again, cleared when the payload is rebound or resized.
+ * Whoever edits the data directly clears it with msg_buff_set_csum_type().
+ */
+#define MSG_BUFF_F_CSUM_SHIFT 4
+#define MSG_BUFF_F_CSUM_MASK 0x70
+
+/*
+ * Reference count of a payload shared by msg_buff_clone(), created on the
+ * first clone. The last holder releases data in msg_buff_deinit(), so a
+ * shared payload must not be freed through msg_data_src_deinit().
+ */
+struct msg_share {
+    uint32_t ref;
+};
+
 struct msg_buff {
     struct msg_buff *next;
     struct msg_buff *prev;
 
     uint32_t id;
     uint8_t blk_cnt;
-    time_t timestamp;
+    uint8_t flags;
+    uint16_t push_len;              // bytes pushed in front of data
+    uint64_t timestamp;             // ns on the tstamp clock, set when data is bound
+    uint64_t enq_ns;                // last msg_queue enqueue, for sojourn times
 
     void *data;
+    struct msg_blk_index *blk_idx;
+    struct msg_share *share;
+};
+
+/*
+ slab object, one allocation per message:
+ +-----------------+--------------------MSG_BUFF_INLINE_MAX-----------------+
+ |    msg_buff     |  data_src, when it fits (data == msg_buff + 1)         |
+ +-----------------+--------------------------------------------------------+
+ inline data belongs to its msg_buff and goes away with it, larger
+ payloads are allocated apart as before. MSG_BUFF_OBJ_SIZE is a power of
+ two, slab objects are aligned to it.
+*/
+#define MSG_BUFF_OBJ_SIZE 256
+#define MSG_BUFF_INLINE_MAX (MSG_BUFF_OBJ_SIZE - sizeof(struct msg_buff))
+
+/*
+ room around the payload, inside the slab or pool object holding it:
+ +----------+----------+--------------------------+----------+
+ | headroom | pushed   | data_src                 | tailroom |
+ +----------+----------+--------------------------+----------+
+            ^ frame    ^ data                     ^ data + header.len
+ msg_buff_push() grows the frame in front of data for encapsulation,
+ msg_buff_pull() takes it off again, msg_buff_put() and msg_buff_trim()
+ move the end of data. Room is not stored, it is what is left of the
+ object, heap payloads have none. A payload short of room is moved once.
+*/
+#define MSG_BUFF_ROOM_PAD 32        // slack added when a payload is moved for room
+
+#define MSG_BUILDER_CAP_DEFAULT 256
+
+/*
+ * Reserve/commit builder, blocks are written in place at the tail of the
+ * data_src. The header len is only fixed up by msg_builder_finalize().
+ */
+struct msg_builder {
+    struct data_src *data;
+    uint16_t cap;
+    uint16_t tail;
+    uint16_t blk_cnt;
+    uint16_t reserved;      // payload bytes held by the pending block
+    uint8_t owned;          // data was allocated by the builder and may grow
 };
 
 enum msg_queue_rx_type {
@@ -37,15 +139,171 @@ enum msg_queue_rx_type {
     MSG_QUEUE_RX_TYPE_MAX = 3,
 };
 
+enum msg_queue_mode {
+    MSG_QUEUE_MODE_LIST = 0,        // doubly linked, one thread at a time
+    MSG_QUEUE_MODE_MPSC = 1,        // lock-free, any number of producers and one consumer
+    MSG_QUEUE_MODE_SPSC = 2,        // bounded ring, one producer and one consumer
+    MSG_QUEUE_MODE_EDF = 3,         // earliest deadline first, one thread at a time
+    MSG_QUEUE_MODE_MAX = 4,
+};
+
+#define MSG_QUEUE_RING_CAP_DEFAULT 1024
+#define MSG_QUEUE_RING_CAP_MAX (MSG_QUEUE_CNT_MAX + 1)
+
+struct msg_queue;
+
+/* Watermark crossed, xoff 1 once the queue reached high_wm, 0 once it drained to the low mark. */
+typedef void (*msg_queue_wm_fn)(struct msg_queue *msg_queue, int xoff, void *arg);
+
+/*
+ byte watermarks, producers throttle while the queue is xoff:
+   bytes >= high_wm            -> xoff
+   bytes <= low mark           -> xon
+ the low mark is low_wm, or follows rx_type when low_wm is 0:
+   MSG_QUEUE_RX_ZERO  drained empty
+   MSG_QUEUE_RX_HALF  high_wm / 2
+   MSG_QUEUE_RX_FULL  just below high_wm
+ the callback runs on the thread that crossed the mark.
+*/
 struct msg_queue_cfg {
     uint8_t qid;
+    uint8_t mode;                   // enum msg_queue_mode
+    uint32_t capacity;              // SPSC rounded up to a power of two, EDF initial, 0 for the default
 
     enum msg_queue_rx_type rx_type;
+
+    uint32_t high_wm;               // bytes, 0 for no watermarks
+    uint32_t low_wm;                // bytes, 0 to follow rx_type
+    msg_queue_wm_fn wm_fn;          // optional
+    void *wm_arg;
+
+    uint8_t aqm;                    // enum msg_queue_aqm
+    uint32_t aqm_interval_ns;       // 0 for MSG_CODEL_INTERVAL_NS
+    uint32_t aqm_target_ns[PROTO_HEADER_PRIO_CNT];  // by priority, 0 for MSG_CODEL_TARGET_NS
+};
+
+enum msg_queue_aqm {
+    MSG_QUEUE_AQM_NONE = 0,
+    MSG_QUEUE_AQM_CODEL_HEAD = 1,   // stale messages are dropped from the head by the consumer
+    MSG_QUEUE_AQM_CODEL_TAIL = 2,   // producers are refused new messages at the same rate
+    MSG_QUEUE_AQM_MAX = 3,
+};
+
+/*
+ CoDel on sojourn time, run by the consumer at dequeue:
+   sojourn of the head above its target for a whole interval -> drop,
+   then drop again every interval / sqrt(drops) while it stays above.
+ the target follows the priority of the head message, so high priority
+ traffic can be held to a tighter standing delay than bulk telemetry.
+*/
+#define MSG_CODEL_TARGET_NS 5000000         // 5 ms
+#define MSG_CODEL_INTERVAL_NS 100000000     // 100 ms
+
+struct msg_queue_codel {
+    uint64_t first_above_ns;        // head above target until then, 0 while below
+    uint64_t drop_next_ns;
+    uint32_t drop_cnt;              // drops in the current dropping state
+    uint32_t last_cnt;
+    uint8_t dropping;
+    uint32_t tail_credit;           // MSG_QUEUE_AQM_CODEL_TAIL, drops owed by producers
 };
 
 struct msg_queue_stats {
     uint16_t count;
     uint32_t bytes;
+    uint8_t xoff;                   // between the high and the low mark
+    uint32_t xoff_cnt;              // times the high mark was reached
+    struct tstamp_sojourn sojourn;  // enqueue to dequeue, recorded by the consumer
+    uint32_t drop_head;             // dropped by the AQM at dequeue
+    uint32_t drop_tail;             // refused by the AQM at enqueue
+    uint32_t drop_expired;          // past their deadline at dequeue, MSG_QUEUE_MODE_EDF
+};
+
+#define MSG_CACHE_LINE 64
+
+/*
+ intrusive MPSC queue (Vyukov), linked through msg_buff.next:
+  consumer                                         producers
+  head -> stub -> msg 1 -> msg 2 -> msg 3 <- tail  xchg(tail, msg)
+                                                   prev->next = msg
+ enqueue is one exchange and one store and never blocks. The consumer
+ owns head and the stub, which goes back in whenever the queue runs dry,
+ so no node is ever allocated. A producer between its exchange and its
+ store hides the messages behind it for a moment, dequeue returns NULL
+ then instead of waiting.
+*/
+struct msg_queue_mpsc {
+    struct msg_buff *tail __attribute__((aligned(MSG_CACHE_LINE)));
+    struct msg_buff *head __attribute__((aligned(MSG_CACHE_LINE)));
+    struct msg_buff stub;
+};
+
+/*
+ bounded SPSC ring of msg_buff pointers:
+ +--------------+--------------+----------+-----------------------------+
+ | producer     | consumer     | mask     | slot[0] ... slot[mask]      |
+ | tail         | head         |          |                             |
+ | head_cache   | tail_cache   |          |                             |
+ +--------------+--------------+----------+-----------------------------+
+   cache line     cache line
+ each side writes only its own line. The other side's index is cached
+ and reloaded only when the cached one says full or empty, a batch is
+ published with one release store. Indices run free and are masked on
+ access. Count and bytes are the differences of the two sides' running
+ totals, no counter is shared.
+*/
+struct msg_queue_ring {
+    uint32_t tail __attribute__((aligned(MSG_CACHE_LINE)));
+    uint32_t head_cache;
+    uint32_t tail_bytes;            // bytes ever enqueued
+
+    uint32_t head __attribute__((aligned(MSG_CACHE_LINE)));
+    uint32_t tail_cache;
+    uint32_t head_bytes;            // bytes ever dequeued
+
+    uint32_t mask __attribute__((aligned(MSG_CACHE_LINE)));
+    struct msg_buff *slot[];
+};
+
+/*
+ 4-ary min heap on deadline, the children of node i are 4i+1 .. 4i+4:
+                        [0]
+         +----------+----+-----+----------+
+        [1]        [2]        [3]        [4]
+   [5][6][7][8]  [9]...
+ siblings sit next to each other, one sift down step compares them in a
+ couple of cache lines and the heap is half as deep as a binary one.
+ deadline = timestamp (enq_ns when unset) + header.heart_rate seconds,
+ heart_rate 0 never expires. Expired messages are freed when they reach
+ the top at dequeue.
+*/
+#define MSG_EDF_ARITY 4
+#define MSG_QUEUE_EDF_CAP_DEFAULT 64
+#define MSG_EDF_NEVER UINT64_MAX
+
+struct msg_edf_node {
+    uint64_t deadline_ns;
+    uint32_t seq;                   // FIFO among equal deadlines
+    struct msg_buff *msg_buff;
+};
+
+struct msg_queue_edf {
+    uint32_t cnt;
+    uint32_t cap;                   // grows by doubling
+    uint32_t seq;
+    struct msg_edf_node *node;
+};
+
+/*
+ * Messages linked through next/prev by a producer before they are queued,
+ * e.g. one poll budget. msg_queue_enqueue_chain() hands the whole run
+ * over at once.
+ */
+struct msg_chain {
+    struct msg_buff *head;
+    struct msg_buff *tail;
+    uint16_t count;
+    uint32_t bytes;
 };
 
 struct msg_queue {
@@ -54,6 +312,11 @@ struct msg_queue {
 
     struct msg_queue_cfg cfg;
     struct msg_queue_stats stats;
+
+    struct msg_queue_mpsc *mpsc;    // MSG_QUEUE_MODE_MPSC only
+    struct msg_queue_ring *ring;    // MSG_QUEUE_MODE_SPSC only
+    struct msg_queue_edf *edf;      // MSG_QUEUE_MODE_EDF only
+    struct msg_queue_codel codel;   // consumer side, cfg.aqm only
 };
 
 void msg_data_src_deinit(struct data_src *data);
@@ -65,26 +328,86 @@ struct proto_block *msg_data_blk_get_tail(struct data_src *data);
 int msg_data_src_get_blk_cnt(struct data_src *data);
 void msg_data_blk_dump_hex(struct proto_block *block);
 void msg_data_dump(struct data_src *data);
+int msg_data_src_set_checksum(struct data_src *data, uint8_t csum_type);
+int msg_data_src_check_checksum(struct data_src *data, uint8_t csum_type);
+int msg_data_src_dec_hop_limit(struct data_src *data, uint8_t csum_type);
+int msg_data_src_set_encoding(struct data_src **data, uint8_t cfg);
+int msg_data_src_get_pool_stats(struct pool_stats *stats);
+
+int msg_builder_init(struct msg_builder *bld, uint16_t cap);
+int msg_builder_attach(struct msg_builder *bld, void *buf, uint16_t cap);
+struct proto_header *msg_builder_get_header(struct msg_builder *bld);
+uint8_t *msg_builder_reserve(struct msg_builder *bld, uint16_t type, uint16_t size);
+int msg_builder_commit(struct msg_builder *bld, uint16_t len);
+int msg_builder_append(struct msg_builder *bld, uint16_t type, const void *buf, uint16_t len);
+struct data_src *msg_builder_finalize(struct msg_builder *bld);
+void msg_builder_abort(struct msg_builder *bld);
+
+void msg_sg_deinit(struct msg_sg *sg);
+struct msg_sg *msg_sg_init(void);
+int msg_sg_add_seg(struct msg_sg *sg, const void *base, uint16_t len, void (*release)(const void *base));
+int msg_sg_add_blk(struct msg_sg *sg, const struct proto_block *block);
+int msg_sg_add_data_src(struct msg_sg *sg, const struct data_src *data);
+int msg_sg_fill_iovec(struct msg_sg *sg, uint8_t *hdr_buf, struct iovec *iov, int iov_cnt);
+struct data_src *msg_sg_flatten(struct msg_sg *sg);
 
 void msg_buff_deinit(struct msg_buff *msg_buff);
 struct msg_buff *msg_buff_init(void);
+struct msg_buff *msg_buff_alloc(uint16_t size);
+struct msg_buff *msg_buff_alloc_room(uint16_t size, uint16_t headroom, uint16_t tailroom);
+void msg_buff_need_room(uint16_t headroom, uint16_t tailroom);
+int msg_buff_get_headroom(struct msg_buff *msg_buff);
+int msg_buff_get_tailroom(struct msg_buff *msg_buff);
+int msg_buff_get_data_room(struct msg_buff *msg_buff);
+int msg_buff_reserve(struct msg_buff *msg_buff, uint16_t headroom, uint16_t tailroom);
+uint8_t *msg_buff_push(struct msg_buff *msg_buff, uint16_t len);
+uint8_t *msg_buff_pull(struct msg_buff *msg_buff, uint16_t len);
+uint8_t *msg_buff_put(struct msg_buff *msg_buff, uint16_t len);
+int msg_buff_trim(struct msg_buff *msg_buff, uint16_t len);
+uint8_t *msg_buff_get_frame(struct msg_buff *msg_buff);
+struct msg_buff *msg_buff_clone(struct msg_buff *msg_buff);
+int msg_buff_is_shared(struct msg_buff *msg_buff);
+int msg_buff_make_writable(struct msg_buff *msg_buff);
+int msg_buff_dec_hop_limit(struct msg_buff *msg_buff, uint8_t csum_type);
+int msg_buff_get_slab_stats(struct slab_stats *stats);
 int msg_buff_set_id(struct msg_buff *msg_buff, uint32_t id);
 int msg_buff_set_blk_cnt(struct msg_buff *msg_buff, uint8_t cnt);
-int msg_buff_set_time(struct msg_buff *msg_buff, time_t time);
+int msg_buff_set_time(struct msg_buff *msg_buff, uint64_t ns);
 int msg_buff_set_time_now(struct msg_buff *msg_buff);
+int msg_buff_set_csum_type(struct msg_buff *msg_buff, uint8_t csum_type);
+uint8_t msg_buff_get_csum_type(struct msg_buff *msg_buff);
 int msg_buff_bind_data(struct msg_buff *msg_buff, void *data, uint8_t cnt);
 int msg_buff_reset_data(struct msg_buff *msg_buff, void *data, uint8_t cnt);
+int msg_buff_bind_sg(struct msg_buff *msg_buff, struct msg_sg *sg);
 void msg_buff_unbind_data(struct msg_buff *msg_buff);
 uint8_t msg_buff_select_queue(struct msg_buff *msg_buff, uint8_t q_cnt);
+int msg_buff_build_blk_index(struct msg_buff *msg_buff);
+void msg_buff_invalidate_blk_index(struct msg_buff *msg_buff);
+int msg_buff_get_blk_cnt(struct msg_buff *msg_buff);
+struct proto_block *msg_buff_get_blk(struct msg_buff *msg_buff, uint16_t idx);
+int msg_buff_get_blk_ref(struct msg_buff *msg_buff, uint16_t idx, struct proto_block_ref *ref);
+int msg_buff_find_blk_idx(struct msg_buff *msg_buff, uint16_t type, uint16_t start);
+struct proto_block *msg_buff_find_blk(struct msg_buff *msg_buff, uint16_t type);
+
+void msg_chain_init(struct msg_chain *chain);
+int msg_chain_add(struct msg_chain *chain, struct msg_buff *msg_buff);
 
 void msg_queue_deinit(struct msg_queue *msg_queue);
 struct msg_queue *msg_queue_init(uint8_t id);
+struct msg_queue *msg_queue_init_cfg(const struct msg_queue_cfg *cfg);
 int msg_queue_enqueue(struct msg_queue *msg_queue, struct msg_buff *msg_buff);
 struct msg_buff *msg_queue_dequeue(struct msg_queue *msg_queue);
+int msg_queue_dequeue_bulk(struct msg_queue *msg_queue, struct msg_buff **msg_buff, int cnt);
+int msg_queue_enqueue_chain(struct msg_queue *msg_queue, struct msg_chain *chain);
+int msg_queue_splice(struct msg_queue *dst, struct msg_queue *src);
 struct msg_buff *msg_queue_peek(struct msg_queue *msg_queue);
 struct msg_buff *msg_queue_get_tail(struct msg_queue *msg_queue);
 int msg_queue_get_count(struct msg_queue *msg_queue);
 int msg_queue_get_data_size(struct msg_queue *msg_queue);
 int msg_queue_get_id(struct msg_queue *msg_queue);
 int msg_queue_set_rx_type(struct msg_queue *msg_queue, uint8_t rx_type);
+int msg_queue_set_watermark(struct msg_queue *msg_queue, uint32_t high_wm, uint32_t low_wm, msg_queue_wm_fn fn,
+                            void *arg);
+int msg_queue_is_xoff(struct msg_queue *msg_queue);
+int msg_queue_set_aqm(struct msg_queue *msg_queue, uint8_t aqm, const uint32_t *target_ns, uint32_t interval_ns);
 #endif // __BUFF_H__
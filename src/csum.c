@@ -0,0 +1,399 @@
+#include <stdint.h>
+#include <string.h>
+#include <pthread.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define CSUM_X86 1
+#endif
+
+#include "errno.h"
+#include "csum.h"
+
+#define CSUM_CRC16_POLY 0xA001        // reflected 0x8005
+#define CSUM_CRC16_INIT 0xFFFF
+#define CSUM_CRC32C_POLY 0x82F63B78   // reflected 0x1EDC6F41
+#define CSUM_CRC32C_INIT 0xFFFFFFFF
+
+#define CSUM_INET_ODD 0x10000         // stream position is odd
+
+typedef uint64_t (*csum_inet_fn)(const uint8_t *p, uint32_t len);
+typedef uint32_t (*csum_crc_fn)(uint32_t crc, const uint8_t *p, uint32_t len);
+
+static uint32_t csum_crc16_tbl[8][256];
+static uint32_t csum_crc32c_tbl[8][256];
+static uint32_t csum_crc16_x2n[32];       // x^(2^k) mod P, for csum_update_byte()
+static uint32_t csum_crc32c_x2n[32];
+static pthread_once_t csum_once = PTHREAD_ONCE_INIT;
+
+static uint64_t csum_inet_scalar(const uint8_t *p, uint32_t len);
+static uint32_t csum_crc32c_scalar(uint32_t crc, const uint8_t *p, uint32_t len);
+
+static csum_inet_fn csum_inet_kern = csum_inet_scalar;
+static csum_crc_fn csum_crc32c_kern = csum_crc32c_scalar;
+static const char *csum_inet_impl = "scalar";
+static const char *csum_crc32c_impl = "slice8";
+
+static uint16_t csum_fold16(uint64_t sum)
+{
+    sum = (sum & 0xFFFFFFFF) + (sum >> 32);
+    sum = (sum & 0xFFFF) + (sum >> 16);
+    sum = (sum & 0xFFFF) + (sum >> 16);
+    sum = (sum & 0xFFFF) + (sum >> 16);
+
+    return (uint16_t)sum;
+}
+
+static uint16_t csum_swap16(uint16_t val)
+{
+    return (uint16_t)((val << 8) | (val >> 8));
+}
+
+/* Sum of native-order 16-bit words, not folded. A trailing odd byte is padded with zero. */
+static uint64_t csum_inet_scalar(const uint8_t *p, uint32_t len)
+{
+    uint64_t sum = 0;
+    uint64_t w;
+    uint16_t tail = 0;
+
+    while (len >= 8) {
+        memcpy(&w, p, 8);
+        sum += (uint32_t)w;
+        sum += w >> 32;
+        p += 8;
+        len -= 8;
+    }
+
+    while (len >= 2) {
+        memcpy(&tail, p, 2);
+        sum += tail;
+        p += 2;
+        len -= 2;
+    }
+
+    if (len) {
+        tail = 0;
+        memcpy(&tail, p, 1);
+        sum += tail;
+    }
+
+    return sum;
+}
+
+static uint32_t csum_crc_slice8(const uint32_t tbl[8][256], uint32_t crc,
+                                const uint8_t *p, uint32_t len)
+{
+    uint32_t lo;
+
+    while (len >= 8) {
+        lo = crc ^ ((uint32_t)p[0] | (uint32_t)p[1] << 8
+                    | (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24);
+        crc = tbl[7][lo & 0xFF] ^ tbl[6][(lo >> 8) & 0xFF]
+            ^ tbl[5][(lo >> 16) & 0xFF] ^ tbl[4][lo >> 24]
+            ^ tbl[3][p[4]] ^ tbl[2][p[5]] ^ tbl[1][p[6]] ^ tbl[0][p[7]];
+        p += 8;
+        len -= 8;
+    }
+
+    while (len--) {
+        crc = (crc >> 8) ^ tbl[0][(crc ^ *p++) & 0xFF];
+    }
+
+    return crc;
+}
+
+static uint32_t csum_crc16_scalar(uint32_t crc, const uint8_t *p, uint32_t len)
+{
+    return csum_crc_slice8(csum_crc16_tbl, crc, p, len);
+}
+
+static uint32_t csum_crc32c_scalar(uint32_t crc, const uint8_t *p, uint32_t len)
+{
+    return csum_crc_slice8(csum_crc32c_tbl, crc, p, len);
+}
+
+#ifdef CSUM_X86
+/*
+ * Split every word into its low and high byte and let PSADBW add them up
+ * into 64-bit lanes, so the accumulators can never overflow.
+ */
+__attribute__((target("avx2")))
+static uint64_t csum_inet_avx2(const uint8_t *p, uint32_t len)
+{
+    __m256i mask = _mm256_set1_epi16(0x00FF);
+    __m256i zero = _mm256_setzero_si256();
+    __m256i acc_lo = zero;
+    __m256i acc_hi = zero;
+    __m256i v;
+    uint64_t lanes[4];
+    uint64_t sum;
+
+    while (len >= 32) {
+        v = _mm256_loadu_si256((const __m256i *)p);
+        acc_lo = _mm256_add_epi64(acc_lo, _mm256_sad_epu8(_mm256_and_si256(v, mask), zero));
+        acc_hi = _mm256_add_epi64(acc_hi, _mm256_sad_epu8(_mm256_srli_epi16(v, 8), zero));
+        p += 32;
+        len -= 32;
+    }
+
+    v = _mm256_add_epi64(acc_lo, _mm256_slli_epi64(acc_hi, 8));
+    _mm256_storeu_si256((__m256i *)lanes, v);
+    sum = lanes[0] + lanes[1] + lanes[2] + lanes[3];
+
+    return sum + csum_inet_scalar(p, len);
+}
+
+__attribute__((target("sse4.2")))
+static uint32_t csum_crc32c_sse42(uint32_t crc, const uint8_t *p, uint32_t len)
+{
+#if defined(__x86_64__)
+    uint64_t crc64 = crc;
+    uint64_t w;
+
+    while (len >= 8) {
+        memcpy(&w, p, 8);
+        crc64 = _mm_crc32_u64(crc64, w);
+        p += 8;
+        len -= 8;
+    }
+    crc = (uint32_t)crc64;
+#endif
+
+    while (len >= 4) {
+        uint32_t w32;
+        memcpy(&w32, p, 4);
+        crc = _mm_crc32_u32(crc, w32);
+        p += 4;
+        len -= 4;
+    }
+
+    while (len--) {
+        crc = _mm_crc32_u8(crc, *p++);
+    }
+
+    return crc;
+}
+#endif
+
+static void csum_crc_tbl_build(uint32_t tbl[8][256], uint32_t poly)
+{
+    uint32_t crc;
+    int i, j;
+
+    for (i = 0; i < 256; i++) {
+        crc = i;
+        for (j = 0; j < 8; j++) {
+            crc = (crc & 1) ? (crc >> 1) ^ poly : crc >> 1;
+        }
+        tbl[0][i] = crc;
+    }
+
+    for (i = 0; i < 256; i++) {
+        for (j = 1; j < 8; j++) {
+            tbl[j][i] = (tbl[j - 1][i] >> 8) ^ tbl[0][tbl[j - 1][i] & 0xFF];
+        }
+    }
+}
+
+/* a * b mod P, reflected: bit width - 1 is x^0 (zlib multmodp) */
+static uint32_t csum_crc_multmodp(uint32_t a, uint32_t b, uint32_t poly, int width)
+{
+    uint32_t m = 1U << (width - 1);
+    uint32_t p = 0;
+
+    for (;;) {
+        if (a & m) {
+            p ^= b;
+            if ((a & (m - 1)) == 0) {
+                break;
+            }
+        }
+        m >>= 1;
+        b = (b & 1) ? (b >> 1) ^ poly : b >> 1;
+    }
+
+    return p;
+}
+
+static void csum_crc_x2n_build(uint32_t x2n[32], uint32_t poly, int width)
+{
+    x2n[0] = 1U << (width - 2);
+    for (int k = 1; k < 32; k++) {
+        x2n[k] = csum_crc_multmodp(x2n[k - 1], x2n[k - 1], poly, width);
+    }
+}
+
+/* Register val pushed through n zero bytes, x^8n * val mod P in O(log n). */
+static uint32_t csum_crc_shift(const uint32_t x2n[32], uint32_t val, uint32_t n, uint32_t poly, int width)
+{
+    int k = 3;
+
+    while (n) {
+        if (n & 1) {
+            val = csum_crc_multmodp(x2n[k & 31], val, poly, width);
+        }
+        n >>= 1;
+        k++;
+    }
+
+    return val;
+}
+
+static void csum_setup(void)
+{
+    csum_crc_tbl_build(csum_crc16_tbl, CSUM_CRC16_POLY);
+    csum_crc_tbl_build(csum_crc32c_tbl, CSUM_CRC32C_POLY);
+    csum_crc_x2n_build(csum_crc16_x2n, CSUM_CRC16_POLY, 16);
+    csum_crc_x2n_build(csum_crc32c_x2n, CSUM_CRC32C_POLY, 32);
+
+#ifdef CSUM_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        csum_inet_kern = csum_inet_avx2;
+        csum_inet_impl = "avx2";
+    }
+    if (__builtin_cpu_supports("sse4.2")) {
+        csum_crc32c_kern = csum_crc32c_sse42;
+        csum_crc32c_impl = "sse4.2";
+    }
+#endif
+}
+
+int csum_init(void)
+{
+    if (pthread_once(&csum_once, csum_setup) != 0) {
+        return -ERR_FAIL;
+    }
+
+    return ERR_SUCCESS;
+}
+
+uint32_t csum_start(uint8_t type)
+{
+    csum_init();
+
+    switch (type) {
+    case CSUM_TYPE_CRC16:
+        return CSUM_CRC16_INIT;
+    case CSUM_TYPE_CRC32C:
+        return CSUM_CRC32C_INIT;
+    default:
+        return 0;
+    }
+}
+
+uint32_t csum_update(uint8_t type, uint32_t state, const void *buf, uint32_t len)
+{
+    const uint8_t *p = (const uint8_t *)buf;
+    uint16_t sum;
+
+    if (buf == NULL || len == 0) {
+        return state;
+    }
+
+    switch (type) {
+    case CSUM_TYPE_INET16:
+        sum = csum_fold16(csum_inet_kern(p, len));
+        if (state & CSUM_INET_ODD) {
+            sum = csum_swap16(sum);
+        }
+        sum = csum_fold16((uint64_t)(state & 0xFFFF) + sum);
+        return ((state ^ (len & 1) << 16) & CSUM_INET_ODD) | sum;
+    case CSUM_TYPE_CRC16:
+        return csum_crc16_scalar(state, p, len);
+    case CSUM_TYPE_CRC32C:
+        return csum_crc32c_kern(state, p, len);
+    default:
+        return state;
+    }
+}
+
+uint16_t csum_finish(uint8_t type, uint32_t state)
+{
+    uint16_t sum;
+
+    switch (type) {
+    case CSUM_TYPE_INET16:
+        sum = (uint16_t)~state;
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+        sum = csum_swap16(sum);
+#endif
+        return sum;
+    case CSUM_TYPE_CRC16:
+        return (uint16_t)state;
+    case CSUM_TYPE_CRC32C:
+        state = ~state;
+        return (uint16_t)(state ^ (state >> 16));
+    default:
+        return 0;
+    }
+}
+
+uint16_t csum_compute(uint8_t type, const void *buf, uint32_t len)
+{
+    return csum_finish(type, csum_update(type, csum_start(type), buf, len));
+}
+
+/* RFC1624 eqn. 3: HC' = ~(~HC + ~m + m') */
+uint16_t csum_inet16_update(uint16_t csum, uint16_t old_word, uint16_t new_word)
+{
+    uint64_t sum;
+
+    sum = (uint16_t)~csum;
+    sum += (uint16_t)~old_word;
+    sum += new_word;
+
+    return (uint16_t)~csum_fold16(sum);
+}
+
+/*
+ * csum of a len byte buffer after its byte at off went from old_byte to
+ * new_byte. The CRCs are linear, the change alone is run through the
+ * len - off - 1 bytes that follow it, in O(log len) rather than O(len).
+ */
+uint16_t csum_update_byte(uint8_t type, uint16_t csum, uint32_t off, uint32_t len, uint8_t old_byte,
+                          uint8_t new_byte)
+{
+    uint32_t delta;
+
+    if (off >= len || old_byte == new_byte) {
+        return csum;
+    }
+
+    csum_init();
+
+    switch (type) {
+    case CSUM_TYPE_INET16:
+        /* even offsets are the high byte of their big endian word */
+        if (off & 1) {
+            return csum_inet16_update(csum, old_byte, new_byte);
+        }
+        return csum_inet16_update(csum, (uint16_t)old_byte << 8, (uint16_t)new_byte << 8);
+    case CSUM_TYPE_CRC16:
+        delta = csum_crc_shift(csum_crc16_x2n, csum_crc16_tbl[0][old_byte ^ new_byte], len - off - 1,
+                               CSUM_CRC16_POLY, 16);
+        return csum ^ (uint16_t)delta;
+    case CSUM_TYPE_CRC32C:
+        delta = csum_crc_shift(csum_crc32c_x2n, csum_crc32c_tbl[0][old_byte ^ new_byte], len - off - 1,
+                               CSUM_CRC32C_POLY, 32);
+        return csum ^ (uint16_t)(delta ^ (delta >> 16));
+    default:
+        return csum;
+    }
+}
+
+const char *csum_get_impl_name(uint8_t type)
+{
+    csum_init();
+
+    switch (type) {
+    case CSUM_TYPE_INET16:
+        return csum_inet_impl;
+    case CSUM_TYPE_CRC16:
+        return "slice8";
+    case CSUM_TYPE_CRC32C:
+        return csum_crc32c_impl;
+    default:
+        return "none";
+    }
+}
@@ -0,0 +1,31 @@
+#ifndef __CSUM_H__
+#define __CSUM_H__
+
+#include <stdint.h>
+
+enum csum_type {
+    CSUM_TYPE_AUTO = 0,     // derived from the link hw_type
+    CSUM_TYPE_NONE,
+    CSUM_TYPE_INET16,       // 16-bit ones'-complement sum (RFC1071)
+    CSUM_TYPE_CRC16,        // CRC-16/MODBUS
+    CSUM_TYPE_CRC32C,       // CRC-32C (Castagnoli), folded to 16 bits
+    CSUM_TYPE_MAX,
+};
+
+/*
+ * Streaming state is opaque to callers: start with csum_start(), feed any
+ * number of chunks through csum_update(), finish with csum_finish().
+ * The INET16 result is in network-order arithmetic, so the same value is
+ * produced on little and big endian hosts.
+ */
+int csum_init(void);
+uint32_t csum_start(uint8_t type);
+uint32_t csum_update(uint8_t type, uint32_t state, const void *buf, uint32_t len);
+uint16_t csum_finish(uint8_t type, uint32_t state);
+uint16_t csum_compute(uint8_t type, const void *buf, uint32_t len);
+uint16_t csum_inet16_update(uint16_t csum, uint16_t old_word, uint16_t new_word);
+uint16_t csum_update_byte(uint8_t type, uint16_t csum, uint32_t off, uint32_t len, uint8_t old_byte,
+                          uint8_t new_byte);
+const char *csum_get_impl_name(uint8_t type);
+
+#endif // __CSUM_H__
@@ -0,0 +1,175 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "errno.h"
+#include "proto.h"
+#include "buff.h"
+#include "disp.h"
+
+static int disp_unknown(struct msg_buff *msg, const struct proto_block_ref *blk, void *arg)
+{
+    struct disp_table *tbl = (struct disp_table *)arg;
+
+    tbl->stats.unknown++;
+    if (tbl->dflt.fn == NULL) {
+        return ERR_SUCCESS;
+    }
+
+    return tbl->dflt.fn(msg, blk, tbl->dflt.arg);
+}
+
+static void disp_page_fill(struct disp_table *tbl, struct disp_page *page)
+{
+    page->cnt = 0;
+    for (int i = 0; i < DISP_PAGE_SIZE; i++) {
+        page->entry[i].fn = disp_unknown;
+        page->entry[i].arg = tbl;
+    }
+}
+
+void disp_table_deinit(struct disp_table *tbl)
+{
+    if (tbl == NULL) {
+        return;
+    }
+
+    for (int i = 0; i < DISP_DIR_SIZE; i++) {
+        if (tbl->dir[i] != tbl->empty) {
+            free(tbl->dir[i]);
+        }
+    }
+
+    free(tbl->empty);
+    free(tbl);
+}
+
+/* dflt sees every block of an unregistered type, it may be NULL. */
+struct disp_table *disp_table_init(disp_handler_fn dflt, void *arg)
+{
+    struct disp_table *tbl = (struct disp_table *)malloc(sizeof(struct disp_table));
+    if (tbl == NULL) {
+        return NULL;
+    }
+
+    memset(tbl, 0, sizeof(struct disp_table));
+    tbl->dflt.fn = dflt;
+    tbl->dflt.arg = arg;
+
+    tbl->empty = (struct disp_page *)malloc(sizeof(struct disp_page));
+    if (tbl->empty == NULL) {
+        free(tbl);
+        return NULL;
+    }
+
+    disp_page_fill(tbl, tbl->empty);
+    for (int i = 0; i < DISP_DIR_SIZE; i++) {
+        tbl->dir[i] = tbl->empty;
+    }
+
+    return tbl;
+}
+
+int disp_register(struct disp_table *tbl, uint16_t type, disp_handler_fn fn, void *arg)
+{
+    struct disp_page *page;
+    struct disp_entry *entry;
+
+    if (tbl == NULL || fn == NULL) {
+        return -ERR_INVALID_ARG;
+    }
+
+    page = tbl->dir[type >> DISP_PAGE_BITS];
+    if (page == tbl->empty) {
+        page = (struct disp_page *)malloc(sizeof(struct disp_page));
+        if (page == NULL) {
+            return -ERR_NO_MEM;
+        }
+        disp_page_fill(tbl, page);
+        tbl->dir[type >> DISP_PAGE_BITS] = page;
+        tbl->page_cnt++;
+    }
+
+    entry = &page->entry[type & DISP_PAGE_MASK];
+    if (entry->fn != disp_unknown) {
+        return -ERR_BUSY;
+    }
+
+    entry->fn = fn;
+    entry->arg = arg;
+    page->cnt++;
+
+    return ERR_SUCCESS;
+}
+
+int disp_unregister(struct disp_table *tbl, uint16_t type)
+{
+    struct disp_page *page;
+    struct disp_entry *entry;
+
+    if (tbl == NULL) {
+        return -ERR_INVALID_ARG;
+    }
+
+    page = tbl->dir[type >> DISP_PAGE_BITS];
+    entry = &page->entry[type & DISP_PAGE_MASK];
+    if (entry->fn == disp_unknown) {
+        return -ERR_NOT_FOUND;
+    }
+
+    entry->fn = disp_unknown;
+    entry->arg = tbl;
+    if (--page->cnt == 0) {
+        tbl->dir[type >> DISP_PAGE_BITS] = tbl->empty;
+        tbl->page_cnt--;
+        free(page);
+    }
+
+    return ERR_SUCCESS;
+}
+
+/*
+ * Hand every block of msg to its handler in one walk of the payload, either
+ * block encoding. Handler errors are counted and do not stop the walk.
+ * Returns the number of blocks dispatched.
+ */
+int disp_msg(struct disp_table *tbl, struct msg_buff *msg)
+{
+    struct proto_block_ref ref;
+    struct disp_entry *entry;
+    struct data_src *data;
+    const uint8_t *p;
+    uint32_t left;
+    uint8_t cfg;
+    int cnt = 0;
+    int n;
+
+    if (tbl == NULL || msg == NULL) {
+        return -ERR_INVALID_ARG;
+    }
+
+    if (msg->flags & MSG_BUFF_F_SG) {
+        return -ERR_INVALID_ARG;
+    }
+
+    data = (struct data_src *)msg->data;
+    if (data == NULL || data->header.len < sizeof(struct data_src)) {
+        return -ERR_EMPTY;
+    }
+
+    cfg = data->header.cfg_hdr;
+    p = (const uint8_t *)data->blocks;
+    left = data->header.len - sizeof(struct data_src);
+    while ((n = proto_block_next(cfg, p, left, &ref)) > 0) {
+        entry = &tbl->dir[ref.type >> DISP_PAGE_BITS]->entry[ref.type & DISP_PAGE_MASK];
+        tbl->stats.errors += entry->fn(msg, &ref, entry->arg) < 0;
+        p += n;
+        left -= n;
+        cnt++;
+    }
+
+    tbl->stats.msgs++;
+    tbl->stats.blocks += cnt;
+
+    return cnt;
+}
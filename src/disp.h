@@ -0,0 +1,58 @@
+#ifndef __DISP_H__
+#define __DISP_H__
+
+#include <stdint.h>
+
+#include "errno.h"
+#include "proto.h"
+#include "buff.h"
+
+/*
+ block type dispatch, two level table of pages:
+ +--------8bits--------+--------8bits--------+
+ |   dir index (high)  |  page index (low)   |  block type
+ +---------------------+---------------------+
+ dir[high] -> page, page->entry[low] -> handler. Directory slots without a
+ registered type share one page whose entries all call the default handler,
+ so a lookup never tests for unknown types.
+*/
+#define DISP_DIR_BITS 8
+#define DISP_PAGE_BITS 8
+#define DISP_DIR_SIZE (1 << DISP_DIR_BITS)
+#define DISP_PAGE_SIZE (1 << DISP_PAGE_BITS)
+#define DISP_PAGE_MASK (DISP_PAGE_SIZE - 1)
+
+typedef int (*disp_handler_fn)(struct msg_buff *msg, const struct proto_block_ref *blk, void *arg);
+
+struct disp_entry {
+    disp_handler_fn fn;
+    void *arg;
+};
+
+struct disp_page {
+    uint16_t cnt;                   // registered types, the page is freed at 0
+    struct disp_entry entry[DISP_PAGE_SIZE];
+};
+
+struct disp_stats {
+    uint32_t msgs;
+    uint32_t blocks;
+    uint32_t unknown;               // blocks that hit the default handler
+    uint32_t errors;                // handlers returning < 0
+};
+
+struct disp_table {
+    struct disp_page *dir[DISP_DIR_SIZE];
+    struct disp_page *empty;        // shared by every unused dir slot
+    struct disp_entry dflt;
+    uint16_t page_cnt;
+    struct disp_stats stats;
+};
+
+void disp_table_deinit(struct disp_table *tbl);
+struct disp_table *disp_table_init(disp_handler_fn dflt, void *arg);
+int disp_register(struct disp_table *tbl, uint16_t type, disp_handler_fn fn, void *arg);
+int disp_unregister(struct disp_table *tbl, uint16_t type);
+int disp_msg(struct disp_table *tbl, struct msg_buff *msg);
+
+#endif // __DISP_H__
@@ -0,0 +1,354 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "errno.h"
+#include "proto.h"
+#include "buff.h"
+#include "frag.h"
+
+#define FRAG_OFF_MSG_ID 0
+#define FRAG_OFF_TOTAL 4
+#define FRAG_OFF_OFFSET 8
+
+int frag_tx_init(struct frag_tx *tx, const struct proto_header *header, const void *payload,
+                 uint32_t len, uint16_t mtu, uint32_t msg_id)
+{
+    if (tx == NULL || header == NULL || payload == NULL || len == 0) {
+        return -ERR_INVALID_ARG;
+    }
+
+    /* the largest message a default reassembly holds, see FRAG_MEM_MAX_DEFAULT */
+    if (mtu < FRAG_MTU_MIN || sizeof(struct proto_header) + (uint64_t)len > FRAG_MEM_MAX_DEFAULT) {
+        return -ERR_OUT_OF_RANGE;
+    }
+
+    tx->header = *header;
+    tx->payload = (const uint8_t *)payload;
+    tx->len = len;
+    tx->off = 0;
+    tx->msg_id = msg_id;
+    tx->chunk = mtu - FRAG_OVERHEAD;
+
+    return ERR_SUCCESS;
+}
+
+/*
+ * Describe the next fragment in sg: one segment for the block and frag
+ * header kept inside tx, one referencing the chunk in the caller payload.
+ * sg must be sent before the next call. Returns -ERR_EMPTY when done.
+ */
+int frag_tx_next(struct frag_tx *tx, struct msg_sg *sg)
+{
+    struct proto_block block;
+    uint8_t *fh;
+    uint16_t chunk;
+    int ret;
+
+    if (tx == NULL || sg == NULL) {
+        return -ERR_INVALID_ARG;
+    }
+
+    if (tx->off >= tx->len) {
+        return -ERR_EMPTY;
+    }
+
+    chunk = (tx->len - tx->off > tx->chunk) ? tx->chunk : tx->len - tx->off;
+
+    block.type = PROTO_BLOCK_TYPE_FRAG;
+    block.len = FRAG_HDR_SIZE + chunk;
+    memcpy(tx->frag_hdr, &block, sizeof(block));
+    fh = tx->frag_hdr + sizeof(struct proto_block);
+    proto_put_be32(fh + FRAG_OFF_MSG_ID, tx->msg_id);
+    proto_put_be32(fh + FRAG_OFF_TOTAL, tx->len);
+    proto_put_be32(fh + FRAG_OFF_OFFSET, tx->off);
+
+    sg->header = tx->header;
+    sg->header.len = sizeof(struct proto_header);
+    sg->seg_cnt = 0;
+
+    ret = msg_sg_add_seg(sg, tx->frag_hdr, sizeof(tx->frag_hdr), NULL);
+    if (ret != ERR_SUCCESS) {
+        return ret;
+    }
+
+    ret = msg_sg_add_seg(sg, tx->payload + tx->off, chunk, NULL);
+    if (ret != ERR_SUCCESS) {
+        return ret;
+    }
+
+    tx->off += chunk;
+
+    return ERR_SUCCESS;
+}
+
+int frag_is_fragment(const struct data_src *data)
+{
+    if (data == NULL || data->header.len < sizeof(struct data_src) + sizeof(struct proto_block) + FRAG_HDR_SIZE) {
+        return 0;
+    }
+
+    return data->blocks[0].type == PROTO_BLOCK_TYPE_FRAG;
+}
+
+static uint32_t frag_hash(uint32_t src_id, uint32_t msg_id)
+{
+    return ((src_id * 0x9E3779B1u) ^ msg_id) & (FRAG_HASH_SIZE - 1);
+}
+
+static void frag_ctx_free(struct frag_reasm *reasm, struct frag_ctx *ctx)
+{
+    struct frag_ctx **pp;
+
+    pp = &reasm->bucket[frag_hash(ctx->src_id, ctx->msg_id)];
+    while (*pp != NULL && *pp != ctx) {
+        pp = &(*pp)->hnext;
+    }
+    if (*pp != NULL) {
+        *pp = ctx->hnext;
+    }
+
+    if (ctx->prev != NULL) {
+        ctx->prev->next = ctx->next;
+    } else {
+        reasm->head = ctx->next;
+    }
+    if (ctx->next != NULL) {
+        ctx->next->prev = ctx->prev;
+    } else {
+        reasm->tail = ctx->prev;
+    }
+
+    reasm->mem_used -= sizeof(struct proto_header) + ctx->total;
+    reasm->ctx_cnt--;
+    free(ctx->buf);
+    free(ctx);
+}
+
+static struct frag_ctx *frag_ctx_find(struct frag_reasm *reasm, uint32_t src_id, uint32_t msg_id)
+{
+    struct frag_ctx *ctx;
+
+    ctx = reasm->bucket[frag_hash(src_id, msg_id)];
+    while (ctx != NULL) {
+        if (ctx->src_id == src_id && ctx->msg_id == msg_id) {
+            return ctx;
+        }
+        ctx = ctx->hnext;
+    }
+
+    return NULL;
+}
+
+static struct frag_ctx *frag_ctx_create(struct frag_reasm *reasm, const struct proto_header *header,
+                                        uint32_t msg_id, uint32_t total, uint64_t now_ms)
+{
+    struct frag_ctx *ctx;
+    uint32_t need, h;
+
+    need = sizeof(struct proto_header) + total;
+    if (need > reasm->mem_max) {
+        return NULL;
+    }
+
+    /* bounded memory: the oldest reassemblies make room for new ones */
+    while (reasm->mem_used + need > reasm->mem_max && reasm->head != NULL) {
+        frag_ctx_free(reasm, reasm->head);
+        reasm->stats.evicted++;
+    }
+
+    ctx = (struct frag_ctx *)malloc(sizeof(struct frag_ctx));
+    if (ctx == NULL) {
+        return NULL;
+    }
+
+    ctx->buf = (uint8_t *)malloc(need);
+    if (ctx->buf == NULL) {
+        free(ctx);
+        return NULL;
+    }
+
+    memcpy(ctx->buf, header, sizeof(struct proto_header));
+    ctx->src_id = header->src_id;
+    ctx->msg_id = msg_id;
+    ctx->total = total;
+    ctx->start_ms = now_ms;
+    ctx->range_cnt = 0;
+
+    h = frag_hash(ctx->src_id, msg_id);
+    ctx->hnext = reasm->bucket[h];
+    reasm->bucket[h] = ctx;
+
+    ctx->next = NULL;
+    ctx->prev = reasm->tail;
+    if (reasm->tail != NULL) {
+        reasm->tail->next = ctx;
+    } else {
+        reasm->head = ctx;
+    }
+    reasm->tail = ctx;
+
+    reasm->mem_used += need;
+    reasm->ctx_cnt++;
+
+    return ctx;
+}
+
+/* Merge [start, end) into the sorted disjoint range list. */
+static int frag_ctx_add_range(struct frag_ctx *ctx, uint32_t start, uint32_t end)
+{
+    uint8_t i, j;
+
+    for (i = 0; i < ctx->range_cnt && ctx->range[i].end < start; i++) {
+    }
+
+    if (i < ctx->range_cnt && ctx->range[i].start <= end) {
+        /* overlaps or touches range i, absorb every following range it reaches */
+        if (start < ctx->range[i].start) {
+            ctx->range[i].start = start;
+        }
+        if (end > ctx->range[i].end) {
+            ctx->range[i].end = end;
+        }
+        for (j = i + 1; j < ctx->range_cnt && ctx->range[j].start <= ctx->range[i].end; j++) {
+            if (ctx->range[j].end > ctx->range[i].end) {
+                ctx->range[i].end = ctx->range[j].end;
+            }
+        }
+        memmove(&ctx->range[i + 1], &ctx->range[j], (ctx->range_cnt - j) * sizeof(struct frag_range));
+        ctx->range_cnt -= j - i - 1;
+        return ERR_SUCCESS;
+    }
+
+    if (ctx->range_cnt == FRAG_RANGE_MAX) {
+        return -ERR_OUT_OF_RANGE;
+    }
+
+    memmove(&ctx->range[i + 1], &ctx->range[i], (ctx->range_cnt - i) * sizeof(struct frag_range));
+    ctx->range[i].start = start;
+    ctx->range[i].end = end;
+    ctx->range_cnt++;
+
+    return ERR_SUCCESS;
+}
+
+void frag_reasm_deinit(struct frag_reasm *reasm)
+{
+    if (reasm == NULL) {
+        return;
+    }
+
+    while (reasm->head != NULL) {
+        frag_ctx_free(reasm, reasm->head);
+    }
+
+    free(reasm);
+}
+
+struct frag_reasm *frag_reasm_init(uint32_t mem_max, uint32_t timeout_ms)
+{
+    struct frag_reasm *reasm = (struct frag_reasm *)malloc(sizeof(struct frag_reasm));
+    if (reasm == NULL) {
+        return NULL;
+    }
+
+    memset(reasm, 0, sizeof(struct frag_reasm));
+    reasm->mem_max = mem_max ? mem_max : FRAG_MEM_MAX_DEFAULT;
+    reasm->timeout_ms = timeout_ms ? timeout_ms : FRAG_TIMEOUT_MS_DEFAULT;
+
+    return reasm;
+}
+
+/*
+ * Feed one fragment frame (host order header). Each chunk is copied once,
+ * straight to its final offset, so arrival order does not matter.
+ * Returns 1 and hands out *msg (proto_header + payload, free() it) once
+ * the message is complete, 0 while fragments are missing. header.len of
+ * *msg is only meaningful when *len fits PROTO_HEADER_LEN_MAX, else 0.
+ */
+int frag_reasm_input(struct frag_reasm *reasm, const struct data_src *data, uint64_t now_ms,
+                     uint8_t **msg, uint32_t *len)
+{
+    const struct proto_block *block;
+    struct proto_header *header;
+    struct frag_ctx *ctx;
+    const uint8_t *fh;
+    uint32_t msg_id, total, off, chunk;
+
+    if (reasm == NULL || msg == NULL || len == NULL || !frag_is_fragment(data)) {
+        return -ERR_INVALID_ARG;
+    }
+
+    block = &data->blocks[0];
+    if (sizeof(struct data_src) + sizeof(struct proto_block) + block->len > data->header.len) {
+        reasm->stats.dropped++;
+        return -ERR_OUT_OF_RANGE;
+    }
+
+    fh = block->data;
+    msg_id = proto_get_be32(fh + FRAG_OFF_MSG_ID);
+    total = proto_get_be32(fh + FRAG_OFF_TOTAL);
+    off = proto_get_be32(fh + FRAG_OFF_OFFSET);
+    chunk = block->len - FRAG_HDR_SIZE;
+    if (total == 0 || total > FRAG_MSG_LEN_MAX || off > total || chunk > total - off) {
+        reasm->stats.dropped++;
+        return -ERR_OUT_OF_RANGE;
+    }
+
+    ctx = frag_ctx_find(reasm, data->header.src_id, msg_id);
+    if (ctx != NULL && ctx->total != total) {
+        frag_ctx_free(reasm, ctx);
+        ctx = NULL;
+    }
+
+    if (ctx == NULL) {
+        ctx = frag_ctx_create(reasm, &data->header, msg_id, total, now_ms);
+        if (ctx == NULL) {
+            reasm->stats.dropped++;
+            return -ERR_NO_MEM;
+        }
+    }
+
+    if (chunk) {
+        if (frag_ctx_add_range(ctx, off, off + chunk) != ERR_SUCCESS) {
+            frag_ctx_free(reasm, ctx);
+            reasm->stats.dropped++;
+            return -ERR_OUT_OF_RANGE;
+        }
+        memcpy(ctx->buf + sizeof(struct proto_header) + off, fh + FRAG_HDR_SIZE, chunk);
+    }
+
+    if (ctx->range_cnt != 1 || ctx->range[0].start != 0 || ctx->range[0].end != total) {
+        return 0;
+    }
+
+    header = (struct proto_header *)ctx->buf;
+    *len = sizeof(struct proto_header) + total;
+    header->len = (*len > PROTO_HEADER_LEN_MAX) ? 0 : *len;
+    header->checksum = 0;
+    *msg = ctx->buf;
+
+    ctx->buf = NULL;
+    frag_ctx_free(reasm, ctx);
+    reasm->stats.completed++;
+
+    return 1;
+}
+
+/* Drop reassemblies older than the timeout, returns how many were dropped. */
+int frag_reasm_reap(struct frag_reasm *reasm, uint64_t now_ms)
+{
+    int cnt = 0;
+
+    if (reasm == NULL) {
+        return -ERR_INVALID_ARG;
+    }
+
+    while (reasm->head != NULL && now_ms - reasm->head->start_ms >= reasm->timeout_ms) {
+        frag_ctx_free(reasm, reasm->head);
+        reasm->stats.timeouts++;
+        cnt++;
+    }
+
+    return cnt;
+}
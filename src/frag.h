@@ -0,0 +1,102 @@
+#ifndef __FRAG_H__
+#define __FRAG_H__
+
+#include <stdint.h>
+
+#include "errno.h"
+#include "proto.h"
+#include "buff.h"
+
+#define PROTO_BLOCK_TYPE_FRAG 0xFFFF        // reserved block type
+
+#define FRAG_HDR_SIZE 12
+#define FRAG_OVERHEAD (PROTO_HEADER_WIRE_SIZE + sizeof(struct proto_block) + FRAG_HDR_SIZE)
+#define FRAG_MTU_MIN (FRAG_OVERHEAD + 8)
+#define FRAG_MSG_LEN_MAX 0x1000000          // 16 MB of payload
+
+#define FRAG_HASH_SIZE 64                   // power of two
+#define FRAG_RANGE_MAX 8                    // disjoint received ranges per message
+#define FRAG_TIMEOUT_MS_DEFAULT 3000
+#define FRAG_MEM_MAX_DEFAULT (FRAG_MSG_LEN_MAX + sizeof(struct proto_header))   // one largest message
+
+/*
+ fragment frame schematic, one block of type PROTO_BLOCK_TYPE_FRAG:
+ +-------8bits--------+-------8bits--------+-------8bits-------+--------8bits-------+
+ |                               proto_header (16 bytes)                            |
+ +-------8bits--------+-------8bits--------+-------8bits-------+--------8bits-------+
+ |            type (0xFFFF)                |                  len                   |
+ +-------8bits--------+-------8bits--------+-------8bits-------+--------8bits-------+
+ |                                      msg_id                                      |
+ +-------8bits--------+-------8bits--------+-------8bits-------+--------8bits-------+
+ |                             total payload len (bytes)                            |
+ +-------8bits--------+-------8bits--------+-------8bits-------+--------8bits-------+
+ |                                      offset                                      |
+ +-------8bits--------+-------8bits--------+-------8bits-------+--------8bits-------+
+ |                                      chunk...                                    |
+ +-------8bits--------+-------8bits--------+-------8bits-------+--------8bits-------+
+ frag header fields are big endian. The payload being split is everything
+ after the original proto_header.
+*/
+
+/* tx side, walks one message and describes each fragment as a msg_sg without copying. */
+struct frag_tx {
+    struct proto_header header;
+    const uint8_t *payload;
+    uint32_t len;
+    uint32_t off;
+    uint32_t msg_id;
+    uint16_t chunk;
+    uint8_t frag_hdr[sizeof(struct proto_block) + FRAG_HDR_SIZE];
+};
+
+struct frag_range {
+    uint32_t start;
+    uint32_t end;
+};
+
+struct frag_ctx {
+    struct frag_ctx *hnext;             // hash chain
+    struct frag_ctx *prev;              // age list, oldest first
+    struct frag_ctx *next;
+
+    uint32_t src_id;
+    uint32_t msg_id;
+    uint32_t total;
+    uint64_t start_ms;
+    uint8_t range_cnt;
+    struct frag_range range[FRAG_RANGE_MAX];
+
+    uint8_t *buf;                       // proto_header + payload
+};
+
+struct frag_reasm_stats {
+    uint32_t completed;
+    uint32_t timeouts;
+    uint32_t evicted;
+    uint32_t dropped;
+};
+
+struct frag_reasm {
+    struct frag_ctx *bucket[FRAG_HASH_SIZE];
+    struct frag_ctx *head;
+    struct frag_ctx *tail;
+
+    uint32_t mem_used;
+    uint32_t mem_max;
+    uint32_t timeout_ms;
+    uint16_t ctx_cnt;
+    struct frag_reasm_stats stats;
+};
+
+int frag_tx_init(struct frag_tx *tx, const struct proto_header *header, const void *payload,
+                 uint32_t len, uint16_t mtu, uint32_t msg_id);
+int frag_tx_next(struct frag_tx *tx, struct msg_sg *sg);
+
+int frag_is_fragment(const struct data_src *data);
+void frag_reasm_deinit(struct frag_reasm *reasm);
+struct frag_reasm *frag_reasm_init(uint32_t mem_max, uint32_t timeout_ms);
+int frag_reasm_input(struct frag_reasm *reasm, const struct data_src *data, uint64_t now_ms,
+                     uint8_t **msg, uint32_t *len);
+int frag_reasm_reap(struct frag_reasm *reasm, uint64_t now_ms);
+
+#endif // __FRAG_H__
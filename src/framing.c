@@ -0,0 +1,359 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define FRAMING_X86 1
+#endif
+
+#include "errno.h"
+#include "proto.h"
+#include "buff.h"
+#include "framing.h"
+
+/* Index of the first byte equal to a or b, len if there is none. */
+typedef uint32_t (*framing_scan_fn)(const uint8_t *buf, uint32_t len, uint8_t a, uint8_t b);
+
+static uint32_t framing_scan_scalar(const uint8_t *buf, uint32_t len, uint8_t a, uint8_t b);
+
+static framing_scan_fn framing_scan = framing_scan_scalar;
+static pthread_once_t framing_once = PTHREAD_ONCE_INIT;
+
+static uint32_t framing_scan_scalar(const uint8_t *buf, uint32_t len, uint8_t a, uint8_t b)
+{
+    uint32_t i;
+
+    for (i = 0; i < len; i++) {
+        if (buf[i] == a || buf[i] == b) {
+            break;
+        }
+    }
+
+    return i;
+}
+
+#ifdef FRAMING_X86
+static uint32_t framing_scan_sse2(const uint8_t *buf, uint32_t len, uint8_t a, uint8_t b)
+{
+    const __m128i va = _mm_set1_epi8(a);
+    const __m128i vb = _mm_set1_epi8(b);
+    __m128i v;
+    uint32_t bits, i;
+
+    for (i = 0; i + 16 <= len; i += 16) {
+        v = _mm_loadu_si128((const __m128i *)(buf + i));
+        bits = _mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(v, va), _mm_cmpeq_epi8(v, vb)));
+        if (bits) {
+            return i + __builtin_ctz(bits);
+        }
+    }
+
+    return i + framing_scan_scalar(buf + i, len - i, a, b);
+}
+
+__attribute__((target("avx2")))
+static uint32_t framing_scan_avx2(const uint8_t *buf, uint32_t len, uint8_t a, uint8_t b)
+{
+    const __m256i va = _mm256_set1_epi8(a);
+    const __m256i vb = _mm256_set1_epi8(b);
+    __m256i v;
+    uint32_t bits, i;
+
+    for (i = 0; i + 32 <= len; i += 32) {
+        v = _mm256_loadu_si256((const __m256i *)(buf + i));
+        bits = _mm256_movemask_epi8(_mm256_or_si256(_mm256_cmpeq_epi8(v, va), _mm256_cmpeq_epi8(v, vb)));
+        if (bits) {
+            return i + __builtin_ctz(bits);
+        }
+    }
+
+    return i + framing_scan_sse2(buf + i, len - i, a, b);
+}
+#endif
+
+static void framing_setup(void)
+{
+#ifdef FRAMING_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        framing_scan = framing_scan_avx2;
+    } else if (__builtin_cpu_supports("sse2")) {
+        framing_scan = framing_scan_sse2;
+    }
+#endif
+}
+
+static uint32_t framing_iov_len(const struct iovec *iov, int iov_cnt)
+{
+    uint32_t len = 0;
+
+    for (int i = 0; i < iov_cnt; i++) {
+        len += iov[i].iov_len;
+    }
+
+    return len;
+}
+
+/*
+ * COBS encode the concatenation of iov[] into dst, delimiter included.
+ * Runs of non-zero bytes are located by the vector scan and copied whole.
+ * Returns the encoded length.
+ */
+int cobs_encode_iov(const struct iovec *iov, int iov_cnt, uint8_t *dst, uint32_t size)
+{
+    const uint8_t *p;
+    uint32_t len, run, room;
+    uint32_t pos, code_pos;
+    uint8_t code;
+
+    if (iov == NULL || dst == NULL || iov_cnt < 0) {
+        return -ERR_INVALID_ARG;
+    }
+
+    len = framing_iov_len(iov, iov_cnt);
+    if (COBS_ENCODE_MAX(len) > size) {
+        return -ERR_OUT_OF_RANGE;
+    }
+
+    pthread_once(&framing_once, framing_setup);
+
+    code_pos = 0;
+    pos = 1;
+    code = 1;
+    for (int i = 0; i < iov_cnt; i++) {
+        p = (const uint8_t *)iov[i].iov_base;
+        len = iov[i].iov_len;
+        while (len > 0) {
+            room = COBS_BLOCK_MAX + 1 - code;
+            run = framing_scan(p, (len < room) ? len : room, COBS_DELIM, COBS_DELIM);
+            memcpy(dst + pos, p, run);
+            pos += run;
+            code += run;
+            p += run;
+            len -= run;
+
+            if (code == COBS_BLOCK_MAX + 1 || (len > 0 && *p == COBS_DELIM)) {
+                if (code != COBS_BLOCK_MAX + 1) {
+                    p++;
+                    len--;
+                }
+                dst[code_pos] = code;
+                code_pos = pos++;
+                code = 1;
+            }
+        }
+    }
+
+    dst[code_pos] = code;
+    dst[pos++] = COBS_DELIM;
+
+    return pos;
+}
+
+int cobs_encode(const uint8_t *src, uint32_t len, uint8_t *dst, uint32_t size)
+{
+    struct iovec iov = {(void *)src, len};
+
+    if (src == NULL && len) {
+        return -ERR_INVALID_ARG;
+    }
+
+    return cobs_encode_iov(&iov, 1, dst, size);
+}
+
+/*
+ * Decode one COBS frame, src excludes the delimiter. dst may be src.
+ * Returns the decoded length, -ERR_FAIL on a malformed frame.
+ */
+int cobs_decode(const uint8_t *src, uint32_t len, uint8_t *dst, uint32_t size)
+{
+    uint32_t i = 0, o = 0, n;
+    uint8_t code;
+
+    if (src == NULL || dst == NULL) {
+        return -ERR_INVALID_ARG;
+    }
+
+    pthread_once(&framing_once, framing_setup);
+
+    while (i < len) {
+        code = src[i++];
+        n = code - 1;
+        if (code == COBS_DELIM || n > len - i || framing_scan(src + i, n, COBS_DELIM, COBS_DELIM) != n) {
+            return -ERR_FAIL;
+        }
+
+        if (o + n > size) {
+            return -ERR_OUT_OF_RANGE;
+        }
+        memmove(dst + o, src + i, n);
+        o += n;
+        i += n;
+
+        if (code != COBS_BLOCK_MAX + 1 && i < len) {
+            if (o >= size) {
+                return -ERR_OUT_OF_RANGE;
+            }
+            dst[o++] = COBS_DELIM;
+        }
+    }
+
+    return o;
+}
+
+/* SLIP encode the concatenation of iov[] into dst, END included. Returns the encoded length. */
+int slip_encode_iov(const struct iovec *iov, int iov_cnt, uint8_t *dst, uint32_t size)
+{
+    const uint8_t *p;
+    uint32_t len, run, need;
+    uint32_t pos = 0;
+
+    if (iov == NULL || dst == NULL || iov_cnt < 0) {
+        return -ERR_INVALID_ARG;
+    }
+
+    pthread_once(&framing_once, framing_setup);
+
+    for (int i = 0; i < iov_cnt; i++) {
+        p = (const uint8_t *)iov[i].iov_base;
+        len = iov[i].iov_len;
+        while (len > 0) {
+            run = framing_scan(p, len, SLIP_END, SLIP_ESC);
+            need = run + (run < len ? 2 : 0);
+            if (pos + need + 1 > size) {
+                return -ERR_OUT_OF_RANGE;
+            }
+
+            memcpy(dst + pos, p, run);
+            pos += run;
+            p += run;
+            len -= run;
+
+            if (len > 0) {
+                dst[pos++] = SLIP_ESC;
+                dst[pos++] = (*p == SLIP_END) ? SLIP_ESC_END : SLIP_ESC_ESC;
+                p++;
+                len--;
+            }
+        }
+    }
+
+    dst[pos++] = SLIP_END;
+
+    return pos;
+}
+
+int slip_encode(const uint8_t *src, uint32_t len, uint8_t *dst, uint32_t size)
+{
+    struct iovec iov = {(void *)src, len};
+
+    if (src == NULL && len) {
+        return -ERR_INVALID_ARG;
+    }
+
+    return slip_encode_iov(&iov, 1, dst, size);
+}
+
+/* Decode one SLIP frame, src excludes END. dst may be src. Returns the decoded length. */
+int slip_decode(const uint8_t *src, uint32_t len, uint8_t *dst, uint32_t size)
+{
+    uint32_t i = 0, o = 0, run;
+
+    if (src == NULL || dst == NULL) {
+        return -ERR_INVALID_ARG;
+    }
+
+    pthread_once(&framing_once, framing_setup);
+
+    while (i < len) {
+        run = framing_scan(src + i, len - i, SLIP_END, SLIP_ESC);
+        if (o + run > size) {
+            return -ERR_OUT_OF_RANGE;
+        }
+        memmove(dst + o, src + i, run);
+        o += run;
+        i += run;
+
+        if (i == len) {
+            break;
+        }
+
+        if (src[i] == SLIP_END || i + 1 == len) {
+            return -ERR_FAIL;
+        }
+
+        if (o >= size) {
+            return -ERR_OUT_OF_RANGE;
+        }
+        switch (src[i + 1]) {
+        case SLIP_ESC_END:
+            dst[o++] = SLIP_END;
+            break;
+        case SLIP_ESC_ESC:
+            dst[o++] = SLIP_ESC;
+            break;
+        default:
+            return -ERR_FAIL;
+        }
+        i += 2;
+    }
+
+    return o;
+}
+
+/* Offset of the next frame delimiter in an rx buffer, -ERR_NOT_FOUND if none yet. */
+int framing_find_delim(const uint8_t *buf, uint32_t len, uint8_t mode)
+{
+    uint8_t delim = (mode == FRAMING_SLIP) ? SLIP_END : COBS_DELIM;
+    uint32_t off;
+
+    if (buf == NULL) {
+        return -ERR_INVALID_ARG;
+    }
+
+    pthread_once(&framing_once, framing_setup);
+
+    off = framing_scan(buf, len, delim, delim);
+
+    return (off < len) ? (int)off : -ERR_NOT_FOUND;
+}
+
+/*
+ * Encode data_src straight into the driver tx buffer: the wire header and
+ * checksum are produced on the stack and the blocks are stuffed from where
+ * they are, no flat copy of the frame is made.
+ */
+int framing_encode_data_src(const struct data_src *data, uint8_t mode, uint8_t csum_type,
+                            uint8_t *dst, uint32_t size)
+{
+    uint8_t hdr[PROTO_HEADER_WIRE_SIZE];
+    struct iovec iov[2];
+    int ret;
+
+    if (data == NULL || dst == NULL || data->header.len < sizeof(struct data_src)) {
+        return -ERR_INVALID_ARG;
+    }
+
+    ret = proto_header_encode(&data->header, hdr, sizeof(hdr));
+    if (ret != ERR_SUCCESS) {
+        return ret;
+    }
+
+    iov[0].iov_base = hdr;
+    iov[0].iov_len = sizeof(hdr);
+    iov[1].iov_base = (void *)data->blocks;
+    iov[1].iov_len = data->header.len - sizeof(struct data_src);
+
+    ret = proto_frame_set_checksum_iov(iov, 2, csum_type);
+    if (ret != ERR_SUCCESS) {
+        return ret;
+    }
+
+    if (mode == FRAMING_SLIP) {
+        return slip_encode_iov(iov, 2, dst, size);
+    }
+
+    return cobs_encode_iov(iov, 2, dst, size);
+}
@@ -0,0 +1,43 @@
+#ifndef __FRAMING_H__
+#define __FRAMING_H__
+
+#include <stdint.h>
+#include <sys/uio.h>
+
+#include "errno.h"
+#include "proto.h"
+#include "buff.h"
+
+/*
+ * Byte stuffing for serial links, every encoded frame ends with its
+ * delimiter so the driver can split the rx stream with framing_find_delim().
+ * COBS: 0x00 delimited, at most 1 byte of overhead per 254.
+ * SLIP (RFC 1055): 0xC0 delimited, 0xC0/0xDB escaped as 0xDB 0xDC/0xDD.
+ */
+enum framing_mode {
+    FRAMING_COBS = 0,
+    FRAMING_SLIP,
+};
+
+#define COBS_DELIM 0x00
+#define COBS_BLOCK_MAX 254
+#define COBS_ENCODE_MAX(len) ((len) + (len) / COBS_BLOCK_MAX + 2)
+
+#define SLIP_END 0xC0
+#define SLIP_ESC 0xDB
+#define SLIP_ESC_END 0xDC
+#define SLIP_ESC_ESC 0xDD
+#define SLIP_ENCODE_MAX(len) (2 * (len) + 1)
+
+int cobs_encode(const uint8_t *src, uint32_t len, uint8_t *dst, uint32_t size);
+int cobs_encode_iov(const struct iovec *iov, int iov_cnt, uint8_t *dst, uint32_t size);
+int cobs_decode(const uint8_t *src, uint32_t len, uint8_t *dst, uint32_t size);
+int slip_encode(const uint8_t *src, uint32_t len, uint8_t *dst, uint32_t size);
+int slip_encode_iov(const struct iovec *iov, int iov_cnt, uint8_t *dst, uint32_t size);
+int slip_decode(const uint8_t *src, uint32_t len, uint8_t *dst, uint32_t size);
+
+int framing_find_delim(const uint8_t *buf, uint32_t len, uint8_t mode);
+int framing_encode_data_src(const struct data_src *data, uint8_t mode, uint8_t csum_type,
+                            uint8_t *dst, uint32_t size);
+
+#endif // __FRAMING_H__
@@ -0,0 +1,188 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "errno.h"
+#include "proto.h"
+#include "hc.h"
+
+#define HC_FLOW_OFF PROTO_WIRE_OFF_SRC_ID
+#define HC_FLOW_LEN 8                       // src_id + dst_id
+
+static uint8_t hc_flow_cid(const uint8_t *wire_hdr)
+{
+    uint32_t src = proto_get_be32(wire_hdr + PROTO_WIRE_OFF_SRC_ID);
+    uint32_t dst = proto_get_be32(wire_hdr + PROTO_WIRE_OFF_DST_ID);
+
+    return ((src * 0x9E3779B1u) ^ (dst * 0x85EBCA6Bu)) >> 26;
+}
+
+void hc_link_deinit(struct hc_link *link)
+{
+    if (link == NULL) {
+        return;
+    }
+
+    free(link);
+}
+
+struct hc_link *hc_link_init(void)
+{
+    struct hc_link *link = (struct hc_link *)malloc(sizeof(struct hc_link));
+    if (link == NULL) {
+        return NULL;
+    }
+
+    memset(link, 0, sizeof(struct hc_link));
+
+    return link;
+}
+
+/* Call when the link resets, every flow starts over with an IR packet. */
+void hc_link_reset(struct hc_link *link)
+{
+    if (link == NULL) {
+        return;
+    }
+
+    memset(link->tx, 0, sizeof(link->tx));
+    memset(link->rx, 0, sizeof(link->rx));
+}
+
+/*
+ * Compress an encoded header into out. The context is picked by hashing
+ * the flow; a colliding flow simply takes the slot over with an IR.
+ * Returns the compressed header length.
+ */
+int hc_compress(struct hc_link *link, const uint8_t *wire_hdr, uint8_t *out, uint16_t size)
+{
+    struct hc_ctx *ctx;
+    uint8_t cid, mask;
+    uint8_t *p;
+
+    if (link == NULL || wire_hdr == NULL || out == NULL) {
+        return -ERR_INVALID_ARG;
+    }
+
+    if (size < HC_HDR_MAX) {
+        return -ERR_OUT_OF_RANGE;
+    }
+
+    cid = hc_flow_cid(wire_hdr);
+    ctx = &link->tx[cid];
+
+    if (!ctx->valid || ctx->since_ir >= HC_REFRESH_INTERVAL
+        || memcmp(ctx->ref + HC_FLOW_OFF, wire_hdr + HC_FLOW_OFF, HC_FLOW_LEN)) {
+        out[0] = HC_PKT_IR | cid;
+        memcpy(out + 1, wire_hdr, PROTO_HEADER_WIRE_SIZE);
+        memcpy(ctx->ref, wire_hdr, PROTO_HEADER_WIRE_SIZE);
+        ctx->valid = 1;
+        ctx->since_ir = 0;
+        link->stats.ir_tx++;
+        return 1 + PROTO_HEADER_WIRE_SIZE;
+    }
+
+    /* deltas are against the IR reference, so a lost CO packet costs nothing */
+    out[0] = HC_PKT_CO | cid;
+    p = out + 2;
+    mask = 0;
+    if (wire_hdr[PROTO_WIRE_OFF_HOP_LIMIT] != ctx->ref[PROTO_WIRE_OFF_HOP_LIMIT]) {
+        mask |= HC_F_HOP;
+        *p++ = wire_hdr[PROTO_WIRE_OFF_HOP_LIMIT];
+    }
+    if (wire_hdr[PROTO_WIRE_OFF_FLAGS] != ctx->ref[PROTO_WIRE_OFF_FLAGS]) {
+        mask |= HC_F_FLAGS;
+        *p++ = wire_hdr[PROTO_WIRE_OFF_FLAGS];
+    }
+    if (memcmp(wire_hdr + PROTO_WIRE_OFF_HEART_RATE, ctx->ref + PROTO_WIRE_OFF_HEART_RATE, 2)) {
+        mask |= HC_F_HEART_RATE;
+        memcpy(p, wire_hdr + PROTO_WIRE_OFF_HEART_RATE, 2);
+        p += 2;
+    }
+    if (wire_hdr[PROTO_WIRE_OFF_CHECKSUM] || wire_hdr[PROTO_WIRE_OFF_CHECKSUM + 1]) {
+        mask |= HC_F_CHECKSUM;
+        memcpy(p, wire_hdr + PROTO_WIRE_OFF_CHECKSUM, 2);
+        p += 2;
+    }
+    out[1] = mask;
+    ctx->since_ir++;
+    link->stats.co_tx++;
+
+    return p - out;
+}
+
+/*
+ * Rebuild the full wire frame (16 byte header + payload) from a received
+ * compressed frame of in_len bytes, frame must not overlap in. Returns
+ * the rebuilt frame length.
+ */
+int hc_decompress(struct hc_link *link, const uint8_t *in, uint16_t in_len, uint8_t *frame, uint16_t size)
+{
+    struct hc_ctx *ctx;
+    const uint8_t *p;
+    uint32_t frame_len;
+    uint8_t mask;
+
+    if (link == NULL || in == NULL || frame == NULL || in_len < 2) {
+        return -ERR_INVALID_ARG;
+    }
+
+    if (size < PROTO_HEADER_WIRE_SIZE) {
+        return -ERR_OUT_OF_RANGE;
+    }
+
+    ctx = &link->rx[in[0] & HC_CID_MASK];
+    switch (in[0] & HC_PKT_MASK) {
+    case HC_PKT_IR:
+        if (in_len < 1 + PROTO_HEADER_WIRE_SIZE) {
+            return -ERR_OUT_OF_RANGE;
+        }
+        memcpy(ctx->ref, in + 1, PROTO_HEADER_WIRE_SIZE);
+        ctx->valid = 1;
+        p = in + 1 + PROTO_HEADER_WIRE_SIZE;
+        memcpy(frame, ctx->ref, PROTO_HEADER_WIRE_SIZE);
+        break;
+    case HC_PKT_CO:
+        if (!ctx->valid) {
+            link->stats.rx_no_ctx++;
+            return -ERR_NOT_FOUND;
+        }
+        mask = in[1];
+        if (in_len < 2 + !!(mask & HC_F_HOP) + !!(mask & HC_F_FLAGS)
+                     + 2 * !!(mask & HC_F_HEART_RATE) + 2 * !!(mask & HC_F_CHECKSUM)) {
+            return -ERR_OUT_OF_RANGE;
+        }
+        p = in + 2;
+        memcpy(frame, ctx->ref, PROTO_HEADER_WIRE_SIZE);
+        frame[PROTO_WIRE_OFF_CHECKSUM] = 0;
+        frame[PROTO_WIRE_OFF_CHECKSUM + 1] = 0;
+        if (mask & HC_F_HOP) {
+            frame[PROTO_WIRE_OFF_HOP_LIMIT] = *p++;
+        }
+        if (mask & HC_F_FLAGS) {
+            frame[PROTO_WIRE_OFF_FLAGS] = *p++;
+        }
+        if (mask & HC_F_HEART_RATE) {
+            memcpy(frame + PROTO_WIRE_OFF_HEART_RATE, p, 2);
+            p += 2;
+        }
+        if (mask & HC_F_CHECKSUM) {
+            memcpy(frame + PROTO_WIRE_OFF_CHECKSUM, p, 2);
+            p += 2;
+        }
+        break;
+    default:
+        return -ERR_INVALID_ARG;
+    }
+
+    frame_len = PROTO_HEADER_WIRE_SIZE + (in + in_len - p);
+    if (frame_len > size || frame_len > PROTO_HEADER_LEN_MAX) {
+        return -ERR_OUT_OF_RANGE;
+    }
+
+    proto_put_be16(frame + PROTO_WIRE_OFF_LEN, frame_len);
+    memcpy(frame + PROTO_HEADER_WIRE_SIZE, p, in + in_len - p);
+    link->stats.rx++;
+
+    return frame_len;
+}
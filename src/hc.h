@@ -0,0 +1,61 @@
+#ifndef __HC_H__
+#define __HC_H__
+
+#include <stdint.h>
+
+#include "errno.h"
+#include "proto.h"
+
+#define HC_CTX_MAX 64                       // context ids fit in 6 bits
+#define HC_REFRESH_INTERVAL 32              // CO packets between two IR refreshes
+#define HC_HDR_MAX (2 + PROTO_HEADER_WIRE_SIZE)
+
+/*
+ compressed header schematic, it replaces the 16 byte wire header:
+ IR (init/refresh), carries the full header and (re)establishes context cid:
+ +--2bits--+----6bits----+---------16 bytes---------+
+ |   01    |     cid     |   proto_header (wire)    |
+ +---------+-------------+--------------------------+
+ CO (compressed), fields that differ from the last IR follow the mask byte:
+ +--2bits--+----6bits----+-------8bits-------+---------------------------------------+
+ |   10    |     cid     |       mask        | hop_limit | flags | heart_rate | csum |
+ +---------+-------------+-------------------+---------------------------------------+
+ src_id/dst_id are fixed per context, len is recovered from the frame length.
+*/
+#define HC_PKT_MASK 0xC0
+#define HC_PKT_IR 0x40
+#define HC_PKT_CO 0x80
+#define HC_CID_MASK 0x3F
+
+#define HC_F_HOP 0x01
+#define HC_F_FLAGS 0x02
+#define HC_F_HEART_RATE 0x04
+#define HC_F_CHECKSUM 0x08
+
+struct hc_ctx {
+    uint8_t valid;
+    uint8_t since_ir;
+    uint8_t ref[PROTO_HEADER_WIRE_SIZE];    // header of the last IR
+};
+
+struct hc_stats {
+    uint32_t ir_tx;
+    uint32_t co_tx;
+    uint32_t rx;
+    uint32_t rx_no_ctx;
+};
+
+/* One per link, both directions. */
+struct hc_link {
+    struct hc_ctx tx[HC_CTX_MAX];
+    struct hc_ctx rx[HC_CTX_MAX];
+    struct hc_stats stats;
+};
+
+void hc_link_deinit(struct hc_link *link);
+struct hc_link *hc_link_init(void);
+void hc_link_reset(struct hc_link *link);
+int hc_compress(struct hc_link *link, const uint8_t *wire_hdr, uint8_t *out, uint16_t size);
+int hc_decompress(struct hc_link *link, const uint8_t *in, uint16_t in_len, uint8_t *frame, uint16_t size);
+
+#endif // __HC_H__
@@ -1,11 +1,16 @@
 #include <stdint.h>
 #include <stdlib.h>
 #include <stdio.h>
+#include <time.h>
 
 #include "intf.h"
 #include "buff.h"
 #include "proto.h"
 #include "route.h"
+#include "csum.h"
+#include "frag.h"
+#include "hc.h"
+#include "lz.h"
 
 struct interface *intf_init(void)
 {
@@ -20,6 +25,12 @@ struct interface *intf_init(void)
     intf->config = NULL;
     intf->info = (struct interface_info){0};
     intf->ops = NULL;
+    intf->rcb = NULL;
+    intf->reasm = NULL;
+    intf->hc = NULL;
+    intf->lz = NULL;
+    intf->large_fn = NULL;
+    intf->large_arg = NULL;
 
     return intf;
 }
@@ -31,9 +42,29 @@ void intf_deinit(struct interface *intf)
         return;
     }
 
+    if (intf->rcb != NULL) {
+        route_ctrl_blk_deinit(intf->rcb);
+    }
+    frag_reasm_deinit(intf->reasm);
+    hc_link_deinit(intf->hc);
+    lz_ctx_deinit(intf->lz);
     free(intf);
 }
 
+static uint8_t intf_csum_type_by_hw(enum hw_type hw_type)
+{
+    switch (hw_type) {
+    case HW_TYPE_UART:
+    case HW_TYPE_IIC:
+        return CSUM_TYPE_CRC16;
+    case HW_TYPE_CAN:
+    case HW_TYPE_SPI:
+        return CSUM_TYPE_CRC32C;
+    default:
+        return CSUM_TYPE_INET16;
+    }
+}
+
 int intf_register(struct interface_ctrl_block *intf_ctrl_blk, struct interface_config *config, 
                   struct interface_ops *ops)
 {
@@ -55,6 +86,37 @@ int intf_register(struct interface_ctrl_block *intf_ctrl_blk, struct interface_c
     if (config != NULL && ops != NULL) {
         intf->config = config;
         intf->ops = ops;
+        if (config->csum_type == CSUM_TYPE_AUTO) {
+            config->csum_type = intf_csum_type_by_hw(config->hw_type);
+        }
+        msg_buff_need_room(config->headroom, 0);
+    }
+
+    if (csum_init() != 0) {
+        printf("intf_register error, csum_init() failed");
+        return -1;
+    }
+
+    intf->reasm = frag_reasm_init(config != NULL ? config->frag_mem_max : 0, 0);
+    if (intf->reasm == NULL) {
+        printf("intf_register error, frag_reasm_init() failed");
+        return -1;
+    }
+
+    if (config != NULL && config->hc_enable) {
+        intf->hc = hc_link_init();
+        if (intf->hc == NULL) {
+            printf("intf_register error, hc_link_init() failed");
+            return -1;
+        }
+    }
+
+    if (config != NULL && config->lz_enable) {
+        intf->lz = lz_ctx_init();
+        if (intf->lz == NULL) {
+            printf("intf_register error, lz_ctx_init() failed");
+            return -1;
+        }
     }
 
     if (intf_ctrl_blk->if_ctrl_head == NULL) {
@@ -144,10 +206,102 @@ int intf_unregister(struct interface_ctrl_block *intf_ctrl_blk, uint8_t intf_id)
     return 0;
 }
 
-int intf_xmit(struct interface *intf, struct msg_buff *msg)
+static uint64_t intf_now_ms(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static int intf_xmit_sg(struct interface *intf, struct msg_sg *sg, uint8_t csum_ok, void *hw_info);
+
+/* Split payload into fragments of at most mtu bytes, chunks are referenced, not copied. */
+static int intf_xmit_frag(struct interface *intf, const struct proto_header *header,
+                          const uint8_t *payload, uint32_t len, uint16_t mtu, void *hw_info)
+{
+    struct frag_tx tx;
+    struct msg_sg sg;
+    int ret;
+
+    ret = frag_tx_init(&tx, header, payload, len, mtu, intf->info.frag_id++);
+    if (ret != 0) {
+        printf("intf_xmit error, frag_tx_init() failed");
+        return -1;
+    }
+
+    while (frag_tx_next(&tx, &sg) == 0) {
+        ret = intf_xmit_sg(intf, &sg, 0, hw_info);
+        if (ret != 0) {
+            return ret;
+        }
+    }
+
+    return 0;
+}
+
+/* csum_ok: sg->header already carries the checksum of the egress csum_type. */
+static int intf_xmit_sg(struct interface *intf, struct msg_sg *sg, uint8_t csum_ok, void *hw_info)
+{
+    uint8_t hdr[PROTO_HEADER_WIRE_SIZE];
+    uint8_t hc_hdr[HC_HDR_MAX];
+    struct iovec iov[MSG_SG_SEG_MAX + 1];
+    struct data_src *data;
+    uint8_t *pkt;
+    int iov_cnt;
+    int ret;
+
+    if (intf->ops->xmit_sg != NULL) {
+        iov_cnt = msg_sg_fill_iovec(sg, hdr, iov, MSG_SG_SEG_MAX + 1);
+        if (iov_cnt < 0) {
+            printf("intf_xmit error, msg_sg_fill_iovec() failed");
+            return -1;
+        }
+
+        if (intf->config != NULL && !csum_ok) {
+            proto_frame_set_checksum_iov(iov, iov_cnt, intf->config->csum_type);
+        }
+
+        if (intf->hc != NULL) {
+            ret = hc_compress(intf->hc, hdr, hc_hdr, sizeof(hc_hdr));
+            if (ret < 0) {
+                printf("intf_xmit error, hc_compress() failed");
+                return -1;
+            }
+            iov[0].iov_base = hc_hdr;
+            iov[0].iov_len = ret;
+        }
+
+        return intf->ops->xmit_sg(intf, iov, iov_cnt, hw_info);
+    }
+
+    data = msg_sg_flatten(sg);
+    if (data == NULL) {
+        printf("intf_xmit error, msg_sg_flatten() failed");
+        return -1;
+    }
+
+    pkt = (uint8_t *)data;
+    proto_header_encode(&data->header, pkt, PROTO_HEADER_WIRE_SIZE);
+    if (intf->config != NULL && !csum_ok) {
+        proto_frame_set_checksum(pkt, proto_frame_get_len(pkt), intf->config->csum_type);
+    }
+
+    ret = intf->ops->xmit(intf, pkt, hw_info);
+    msg_data_src_deinit(data);
+
+    return ret;
+}
+
+static int intf_xmit_msg(struct interface *intf, struct msg_buff *msg)
 {
     struct route *route;
     struct proto_header *header;
+    uint8_t csum_ok;
+    uint8_t *pkt;
+    int ret;
+
     if (intf == NULL) {
         printf("intf_xmit error\n");
         return -1;
@@ -166,14 +320,185 @@ int intf_xmit(struct interface *intf, struct msg_buff *msg)
         return -1;
     }
 
-    return intf->ops->xmit(intf, (uint8_t *)msg->data, route->dst_hw_info);
+    /* the compressed copy goes out in a stand-in msg_buff, it may be moved for headroom */
+    if (intf->lz != NULL && !(msg->flags & MSG_BUFF_F_SG)) {
+        struct data_src *lz_data;
+
+        ret = lz_data_src_compress(intf->lz, (struct data_src *)msg->data, &lz_data);
+        if (ret == 1) {
+            struct msg_buff lz_msg = *msg;
+
+            lz_msg.flags = 0;
+            lz_msg.push_len = 0;
+            lz_msg.data = lz_data;
+            lz_msg.blk_idx = NULL;
+            lz_msg.share = NULL;
+            ret = intf_xmit_msg(intf, &lz_msg);
+            msg_data_src_deinit((struct data_src *)lz_msg.data);
+            return ret;
+        }
+    }
+
+    if (intf->config != NULL && intf->config->mtu && header->len > intf->config->mtu) {
+        struct data_src *data = (struct data_src *)msg->data;
+
+        if (msg->flags & MSG_BUFF_F_SG) {
+            data = msg_sg_flatten((struct msg_sg *)msg->data);
+            if (data == NULL) {
+                printf("intf_xmit error, msg_sg_flatten() failed");
+                return -1;
+            }
+        }
+
+        ret = intf_xmit_frag(intf, &data->header, (uint8_t *)data->blocks,
+                             data->header.len - sizeof(struct proto_header), intf->config->mtu,
+                             route->dst_hw_info);
+        if (msg->flags & MSG_BUFF_F_SG) {
+            msg_data_src_deinit(data);
+        }
+
+        return ret;
+    }
+
+    /* a forwarded frame keeps the checksum it came with, see msg_buff_dec_hop_limit() */
+    csum_ok = intf->config != NULL && msg_buff_get_csum_type(msg) == intf->config->csum_type;
+
+    if (msg->flags & MSG_BUFF_F_SG) {
+        return intf_xmit_sg(intf, (struct msg_sg *)msg->data, csum_ok, route->dst_hw_info);
+    }
+
+    /*
+     * compressed headers need the frame length, which only xmit_sg carries.
+     * A shared payload goes out the same way rather than being copied for
+     * the in place header encoding.
+     */
+    if ((intf->hc != NULL || msg_buff_is_shared(msg)) && intf->ops->xmit_sg != NULL) {
+        struct msg_sg sg;
+
+        sg.header = *header;
+        sg.header.len = sizeof(struct proto_header);
+        sg.seg_cnt = 0;
+        if (header->len > sizeof(struct proto_header)) {
+            msg_sg_add_data_src(&sg, (struct data_src *)msg->data);
+        }
+
+        return intf_xmit_sg(intf, &sg, csum_ok, route->dst_hw_info);
+    }
+
+    /* the driver writes its link header in front of pkt, a shared payload is copied first */
+    ret = msg_buff_reserve(msg, (intf->config != NULL) ? intf->config->headroom : 0, 0);
+    if (ret != 0) {
+        printf("intf_xmit error, msg_buff_reserve() failed");
+        return -1;
+    }
+    header = (struct proto_header *)msg->data;
+
+    /* header goes out in network byte order, restored to host order afterwards */
+    pkt = (uint8_t *)msg->data;
+    proto_header_encode(header, pkt, PROTO_HEADER_WIRE_SIZE);
+    if (intf->config != NULL && !csum_ok) {
+        proto_frame_set_checksum(pkt, proto_frame_get_len(pkt), intf->config->csum_type);
+    }
+
+    ret = intf->ops->xmit(intf, pkt, route->dst_hw_info);
+    proto_header_decode(header, pkt, PROTO_HEADER_WIRE_SIZE);
+    if (intf->config != NULL) {
+        msg_buff_set_csum_type(msg, intf->config->csum_type);
+    }
+
+    return ret;
 }
 
-int intf_recv(struct interface *intf, struct msg_buff *msg)
+/* The age of msg since it was stamped on the way in is recorded on the way out. */
+int intf_xmit(struct interface *intf, struct msg_buff *msg)
 {
+    uint64_t now;
+
+    if (intf == NULL || msg == NULL) {
+        printf("intf_xmit error\n");
+        return -1;
+    }
+
+    now = tstamp_cached_ns();
+    tstamp_sojourn_record(&intf->info.tx_sojourn, (now > msg->timestamp) ? now - msg->timestamp : 0);
+
+    return intf_xmit_msg(intf, msg);
+}
+
+/* Messages beyond PROTO_HEADER_LEN_MAX (e.g. firmware images) always go out fragmented. */
+int intf_xmit_large(struct interface *intf, const struct proto_header *header, const uint8_t *payload,
+                    uint32_t len)
+{
+    struct route *route;
+
+    if (intf == NULL || header == NULL || payload == NULL) {
+        printf("intf_xmit_large error\n");
+        return -1;
+    }
+
+    if (intf->ops == NULL || intf->config == NULL) {
+        printf("intf_xmit_large error, ops is NULL\n");
+        return -1;
+    }
+
+    /* peers share the link config, what would not fit our reassembly would not fit theirs */
+    if (intf->reasm != NULL && sizeof(struct proto_header) + (uint64_t)len > intf->reasm->mem_max) {
+        printf("intf_xmit_large error, message beyond frag_mem_max");
+        return -1;
+    }
+
+    route = route_ctrl_blk_get_route(intf->rcb, header->dst_id);
+    if (route == NULL) {
+        printf("intf_xmit_large error, route_ctrl_blk_get_route() failed");
+        return -1;
+    }
+
+    return intf_xmit_frag(intf, header, payload, len,
+                          intf->config->mtu ? intf->config->mtu : PROTO_HEADER_LEN_MAX, route->dst_hw_info);
+}
+
+/*
+ * For drivers of header compressed links: rebuild the full frame from the
+ * raw_len bytes received into pkt, before intf_recv() goes on with it.
+ */
+int intf_hc_expand(struct interface *intf, const uint8_t *raw, uint16_t raw_len, uint8_t *pkt, uint16_t size)
+{
+    int ret;
+
+    if (intf == NULL || intf->hc == NULL) {
+        printf("intf_hc_expand error\n");
+        return -1;
+    }
+
+    ret = hc_decompress(intf->hc, raw, raw_len, pkt, size);
+    if (ret < 0) {
+        printf("intf_hc_expand error, hc_decompress() failed");
+        return -1;
+    }
+
+    return ret;
+}
+
+/* Link reset, both ends renegotiate their header compression contexts. */
+void intf_hc_reset(struct interface *intf)
+{
+    if (intf == NULL) {
+        printf("intf_hc_reset error\n");
+        return;
+    }
+
+    hc_link_reset(intf->hc);
+}
+
+static int intf_recv_frame(struct interface *intf, struct msg_buff *msg)
+{
+    struct proto_frame_desc desc;
     struct proto_header *header;
     struct route *route;
-    void *hw_info;
+    uint64_t valid;
+    void *hw_info = NULL;
+    uint16_t len;
+    int room;
     int ret;
 
     if (intf == NULL) {
@@ -186,12 +511,51 @@ int intf_recv(struct interface *intf, struct msg_buff *msg)
         return -1;
     }
 
+    room = msg_buff_get_data_room(msg);
+    if (room < PROTO_HEADER_WIRE_SIZE) {
+        printf("intf_recv error, rx buffer size unknown or too small");
+        return -1;
+    }
+
+    /* an idle link is not an error, a poll loop sees this on every empty round */
     ret = intf->ops->recv(intf, (uint8_t *)msg->data, hw_info);
+    if (ret < 0) {
+        return 2;
+    }
+
+    /* nothing past the rx buffer is read, whatever the wire len claims */
+    len = proto_frame_get_len((uint8_t *)msg->data);
+    if (len > room || (ret > 0 && ret != len)) {
+        printf("intf_recv error, frame len past the received bytes");
+        return -1;
+    }
+
+    msg_buff_set_csum_type(msg, CSUM_TYPE_AUTO);
+    if (intf->config != NULL) {
+        ret = proto_frame_check_checksum((uint8_t *)msg->data, len, intf->config->csum_type);
+        if (ret != 0) {
+            printf("intf_recv error, bad checksum");
+            return -1;
+        }
+        msg_buff_set_csum_type(msg, intf->config->csum_type);
+    }
+
+    ret = proto_header_decode((struct proto_header *)msg->data, (uint8_t *)msg->data, PROTO_HEADER_WIRE_SIZE);
     if (ret != 0) {
-        printf("intf_recv error, recv() failed");
+        printf("intf_recv error, proto_header_decode() failed");
+        return -1;
+    }
+
+    /* decoding the header in place must not change the len checked above */
+    desc.header = *(struct proto_header *)msg->data;
+    desc.frame = (uint8_t *)msg->data;
+    desc.len = len;
+    if (proto_frame_validate_batch(&desc, 1, &valid) != 1) {
+        printf("intf_recv error, malformed frame");
         return -1;
     }
 
+    /* rx boundary, later boundaries measure from here */
     ret = msg_buff_set_time_now(msg);
     if (ret != 0) {
         printf("intf_recv error, msg_buff_set_time_now() failed");
@@ -222,9 +586,137 @@ int intf_recv(struct interface *intf, struct msg_buff *msg)
 
     route_set_state(route, ROUTE_STATE_ACTIVE);
 
+    if (intf->reasm != NULL) {
+        uint64_t now = intf_now_ms();
+        uint8_t *full;
+        uint32_t full_len;
+
+        frag_reasm_reap(intf->reasm, now);
+        if (frag_is_fragment((struct data_src *)msg->data)) {
+            ret = frag_reasm_input(intf->reasm, (struct data_src *)msg->data, now, &full, &full_len);
+            if (ret < 0) {
+                printf("intf_recv error, frag_reasm_input() failed");
+                return -1;
+            }
+            if (ret == 0) {
+                return 1;
+            }
+
+            if (full_len > PROTO_HEADER_LEN_MAX) {
+                if (intf->large_fn == NULL) {
+                    printf("intf_recv error, reassembled message too large for msg_buff");
+                    free(full);
+                    return -1;
+                }
+
+                ret = intf->large_fn(intf, full, full_len, intf->large_arg);
+                if (ret != 0) {
+                    printf("intf_recv error, large handler failed");
+                    return -1;
+                }
+                return 1;
+            }
+
+            /* the fragments were checked one by one, the message they make up was not */
+            desc.header = *(struct proto_header *)full;
+            desc.frame = full;
+            desc.len = full_len;
+            if (proto_frame_validate_batch(&desc, 1, &valid) != 1) {
+                printf("intf_recv error, malformed frame");
+                free(full);
+                return -1;
+            }
+
+            msg_data_src_deinit((struct data_src *)msg->data);
+            msg_buff_reset_data(msg, full, 0);
+        }
+    }
+
+    header = (struct proto_header *)msg->data;
+    if (header->earmark & PROTO_EARMARK_LZ) {
+        struct data_src *data = (struct data_src *)msg->data;
+
+        ret = lz_data_src_decompress(intf->lz, &data);
+        if (ret != 0) {
+            printf("intf_recv error, lz_data_src_decompress() failed");
+            return -1;
+        }
+        msg_buff_reset_data(msg, data, 0);
+
+        desc.header = data->header;
+        desc.frame = (uint8_t *)data;
+        desc.len = data->header.len;
+        if (proto_frame_validate_batch(&desc, 1, &valid) != 1) {
+            printf("intf_recv error, malformed frame");
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+/* Receiver of messages beyond PROTO_HEADER_LEN_MAX, without one intf_recv() drops them. */
+int intf_set_large_handler(struct interface *intf, intf_large_fn fn, void *arg)
+{
+    if (intf == NULL) {
+        printf("intf_set_large_handler error\n");
+        return -1;
+    }
+
+    intf->large_fn = fn;
+    intf->large_arg = arg;
+
     return 0;
 }
 
+/*
+ * Returns 0 when msg holds a message to deliver, 1 when there is nothing to
+ * deliver in msg: the frame was a fragment absorbed by reassembly, or it
+ * completed a message beyond PROTO_HEADER_LEN_MAX handed to the large handler.
+ * 2 when ops->recv() had no frame, -1 when the frame was dropped.
+ */
+int intf_recv(struct interface *intf, struct msg_buff *msg)
+{
+    int ret;
+
+    tstamp_refresh();
+    ret = intf_recv_frame(intf, msg);
+    tstamp_invalidate();
+
+    return ret;
+}
+
+/*
+ * Poll up to cnt frames, the clock is read once for all of them. Delivered
+ * messages are packed into msg[0..ret), every slot must hold a msg_buff.
+ * Dropped and absorbed frames use up a poll, the batch ends early once
+ * ops->recv() has no frame.
+ */
+int intf_recv_batch(struct interface *intf, struct msg_buff **msg, int cnt)
+{
+    int n = 0;
+    int ret;
+
+    if (intf == NULL || msg == NULL) {
+        printf("intf_recv_batch error\n");
+        return -1;
+    }
+
+    tstamp_refresh();
+    for (int i = 0; i < cnt; i++) {
+        ret = intf_recv_frame(intf, msg[n]);
+        if (ret == 2) {
+            break;
+        }
+        if (ret == 0) {
+            n++;
+        }
+    }
+    tstamp_invalidate();
+
+    return n;
+}
+
 struct interface_ctrl_block *intf_ctrl_blk_init(void)
 {
     struct interface_ctrl_block *intf_ctrl_blk = malloc(sizeof(struct interface_ctrl_block));
@@ -8,6 +8,12 @@
 #include "proto.h"
 #include "buff.h"
 #include "route.h"
+#include "csum.h"
+#include "frag.h"
+#include "hc.h"
+#include "lz.h"
+
+struct interface;
 
 enum hw_type {
     HW_TYPE_UNKNOWN = 0,
@@ -31,7 +37,8 @@ struct interface_ops {
     int (*init)(struct interface *intf);
     void (*deinit)(struct interface *intf);
     int (*xmit)(struct interface *intf, uint8_t *pkt, void *arg);
-    int (*recv)(struct interface *intf, uint8_t *pkt, void *arg); // must not blocking.
+    int (*xmit_sg)(struct interface *intf, const struct iovec *iov, int iov_cnt, void *arg); // optional, e.g. writev()
+    int (*recv)(struct interface *intf, uint8_t *pkt, void *arg); // must not blocking, bytes written or 0 if unknown, < 0 for no frame.
     int (*ioctl)(struct interface *intf, uint8_t cmd, void *arg);
     // int (*rx_handler)(struct msg_buff *msg);
 };
@@ -41,6 +48,12 @@ struct interface_config {
     enum hw_type hw_type;
 
     uint16_t budget;
+    uint8_t csum_type;      // enum csum_type, CSUM_TYPE_AUTO picks one by hw_type
+    uint16_t mtu;           // largest frame the link carries, 0 for no limit
+    uint8_t hc_enable;      // header compression, needs ops->xmit_sg and intf_hc_expand() in recv
+    uint8_t lz_enable;      // adaptive payload compression, both ends must enable it
+    uint16_t headroom;      // bytes ops->xmit() may write in front of pkt, link headers
+    uint32_t frag_mem_max;  // reassembly memory, also caps intf_xmit_large(), 0 for FRAG_MEM_MAX_DEFAULT
 
     /* pthread cond */
     pthread_cond_t cond;
@@ -52,11 +65,20 @@ struct interface_info {
     uint8_t intf_id;
     uint32_t rx_bytes;
     uint32_t tx_bytes;
+    uint32_t frag_id;
+    struct tstamp_sojourn tx_sojourn;   // msg_buff timestamp to intf_xmit()
     enum intf_status status;
     pthread_t thread;
     // ...
 };
 
+/*
+ * Takes a reassembled message too long for a msg_buff: msg is the host order
+ * proto_header, header.len 0, followed by len - sizeof(struct proto_header)
+ * payload bytes. The handler owns msg and releases it with free().
+ */
+typedef int (*intf_large_fn)(struct interface *intf, uint8_t *msg, uint32_t len, void *arg);
+
 struct interface {
     struct interface *next;
     struct interface *prev;
@@ -65,6 +87,11 @@ struct interface {
     struct interface_config *config;
     struct interface_ops *ops;
     struct route_ctrl_block *rcb;
+    struct frag_reasm *reasm;
+    struct hc_link *hc;
+    struct lz_ctx *lz;
+    intf_large_fn large_fn;
+    void *large_arg;
 };
 
 struct interface_ctrl_block {
@@ -74,4 +101,21 @@ struct interface_ctrl_block {
     uint8_t if_cnt;
 };
 
+struct interface *intf_init(void);
+void intf_deinit(struct interface *intf);
+int intf_register(struct interface_ctrl_block *intf_ctrl_blk, struct interface_config *config,
+                  struct interface_ops *ops);
+int intf_unregister(struct interface_ctrl_block *intf_ctrl_blk, uint8_t intf_id);
+int intf_xmit(struct interface *intf, struct msg_buff *msg);
+int intf_xmit_large(struct interface *intf, const struct proto_header *header, const uint8_t *payload,
+                    uint32_t len);
+int intf_hc_expand(struct interface *intf, const uint8_t *raw, uint16_t raw_len, uint8_t *pkt, uint16_t size);
+void intf_hc_reset(struct interface *intf);
+int intf_recv(struct interface *intf, struct msg_buff *msg);
+int intf_recv_batch(struct interface *intf, struct msg_buff **msg, int cnt);
+int intf_set_large_handler(struct interface *intf, intf_large_fn fn, void *arg);
+struct interface_ctrl_block *intf_ctrl_blk_init(void);
+void intf_ctrl_blk_deinit(struct interface_ctrl_block *intf_ctrl_blk);
+uint8_t intf_ctrl_blk_get_if_cnt(struct interface_ctrl_block *intf_ctrl_blk);
+
 #endif // __INTF_H__
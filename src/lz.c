@@ -0,0 +1,404 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "errno.h"
+#include "proto.h"
+#include "buff.h"
+#include "lz.h"
+
+static inline uint32_t lz_read32(const uint8_t *p)
+{
+    uint32_t v;
+
+    memcpy(&v, p, sizeof(v));
+
+    return v;
+}
+
+static inline uint32_t lz_hash(uint32_t v)
+{
+    return (v * 2654435761u) >> (32 - LZ_HASH_BITS);
+}
+
+static uint64_t lz_now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+void lz_ctx_deinit(struct lz_ctx *ctx)
+{
+    if (ctx == NULL) {
+        return;
+    }
+
+    free(ctx->scratch);
+    free(ctx);
+}
+
+struct lz_ctx *lz_ctx_init(void)
+{
+    struct lz_ctx *ctx = (struct lz_ctx *)malloc(sizeof(struct lz_ctx));
+    if (ctx == NULL) {
+        return NULL;
+    }
+
+    memset(ctx, 0, sizeof(struct lz_ctx));
+    ctx->min_len = LZ_MIN_LEN_DEFAULT;
+    ctx->ratio_pct = LZ_RATIO_PCT_DEFAULT;
+    ctx->cpu_pct = LZ_CPU_PCT_DEFAULT;
+
+    return ctx;
+}
+
+/* Slide sample into the dictionary, the most recent LZ_DICT_MAX bytes are kept. */
+int lz_dict_train(struct lz_ctx *ctx, const uint8_t *sample, uint32_t len)
+{
+    uint32_t keep;
+
+    if (ctx == NULL || sample == NULL) {
+        return -ERR_INVALID_ARG;
+    }
+
+    if (len >= LZ_DICT_MAX) {
+        memcpy(ctx->dict, sample + len - LZ_DICT_MAX, LZ_DICT_MAX);
+        ctx->dict_len = LZ_DICT_MAX;
+        return ERR_SUCCESS;
+    }
+
+    keep = (ctx->dict_len + len > LZ_DICT_MAX) ? LZ_DICT_MAX - len : ctx->dict_len;
+    memmove(ctx->dict, ctx->dict + ctx->dict_len - keep, keep);
+    memcpy(ctx->dict + keep, sample, len);
+    ctx->dict_len = keep + len;
+
+    return ERR_SUCCESS;
+}
+
+static inline uint8_t *lz_put_len(uint8_t *op, uint32_t len)
+{
+    while (len >= 255) {
+        *op++ = 255;
+        len -= 255;
+    }
+    *op++ = len;
+
+    return op;
+}
+
+/* Worst case bytes for one sequence, literal and match length extensions included. */
+static inline uint32_t lz_seq_max(uint32_t lit, uint32_t match)
+{
+    return 1 + lit / 255 + 1 + lit + 2 + match / 255 + 1;
+}
+
+/*
+ * Compress src into dst. Returns the compressed length, -ERR_OUT_OF_RANGE
+ * as soon as the output would exceed size, so pass size < len to give up
+ * early on data that does not shrink.
+ */
+int lz_compress(struct lz_ctx *ctx, const uint8_t *src, uint32_t len, uint8_t *dst, uint32_t size, int use_dict)
+{
+    const uint8_t *base, *anchor, *ip, *end, *ref;
+    uint8_t *op = dst, *op_end = dst + size, *token;
+    uint32_t start = 0, h, cand, step, misses = 0;
+    uint32_t lit, match;
+
+    if (ctx == NULL || (src == NULL && len) || dst == NULL || len > PROTO_HEADER_LEN_MAX) {
+        return -ERR_INVALID_ARG;
+    }
+
+    memset(ctx->hash, 0, sizeof(ctx->hash));
+    base = src;
+    if (use_dict && ctx->dict_len) {
+        if (ctx->scratch == NULL) {
+            ctx->scratch = (uint8_t *)malloc(LZ_DICT_MAX + PROTO_HEADER_LEN_MAX);
+            if (ctx->scratch == NULL) {
+                return -ERR_NO_MEM;
+            }
+        }
+        memcpy(ctx->scratch, ctx->dict, ctx->dict_len);
+        memcpy(ctx->scratch + ctx->dict_len, src, len);
+        base = ctx->scratch;
+        start = ctx->dict_len;
+        for (uint32_t i = 0; i + LZ_MIN_MATCH <= start; i++) {
+            ctx->hash[lz_hash(lz_read32(base + i))] = i + 1;
+        }
+    }
+
+    ip = anchor = base + start;
+    end = base + start + len;
+    while (ip + LZ_MIN_MATCH <= end) {
+        h = lz_hash(lz_read32(ip));
+        cand = ctx->hash[h];
+        ctx->hash[h] = ip - base + 1;
+        ref = base + cand - 1;
+        if (cand == 0 || ip - ref > LZ_WINDOW || lz_read32(ref) != lz_read32(ip)) {
+            /* skip faster through data that does not match */
+            step = 1 + (misses++ >> 5);
+            ip = ((uint32_t)(end - ip) > step) ? ip + step : end;
+            continue;
+        }
+        misses = 0;
+
+        match = LZ_MIN_MATCH;
+        while (ip + match < end && ref[match] == ip[match]) {
+            match++;
+        }
+
+        lit = ip - anchor;
+        if (op + lz_seq_max(lit, match) > op_end) {
+            return -ERR_OUT_OF_RANGE;
+        }
+
+        token = op++;
+        *token = ((lit < 15) ? lit : 15) << 4;
+        if (lit >= 15) {
+            op = lz_put_len(op, lit - 15);
+        }
+        memcpy(op, anchor, lit);
+        op += lit;
+        *op++ = (ip - ref) & 0xFF;
+        *op++ = (ip - ref) >> 8;
+        *token |= (match - LZ_MIN_MATCH < 15) ? match - LZ_MIN_MATCH : 15;
+        if (match - LZ_MIN_MATCH >= 15) {
+            op = lz_put_len(op, match - LZ_MIN_MATCH - 15);
+        }
+
+        ip += match;
+        anchor = ip;
+    }
+
+    lit = end - anchor;
+    if (op + 1 + lit / 255 + 1 + lit > op_end) {
+        return -ERR_OUT_OF_RANGE;
+    }
+    token = op++;
+    *token = ((lit < 15) ? lit : 15) << 4;
+    if (lit >= 15) {
+        op = lz_put_len(op, lit - 15);
+    }
+    memcpy(op, anchor, lit);
+    op += lit;
+
+    return op - dst;
+}
+
+static inline int lz_get_len(const uint8_t **ip, const uint8_t *end, uint32_t *len)
+{
+    uint8_t b;
+
+    do {
+        if (*ip >= end) {
+            return -ERR_FAIL;
+        }
+        b = *(*ip)++;
+        *len += b;
+    } while (b == 255);
+
+    return ERR_SUCCESS;
+}
+
+/* Returns the decompressed length, -ERR_FAIL on a malformed stream. */
+int lz_decompress(const struct lz_ctx *ctx, const uint8_t *src, uint32_t len, uint8_t *dst, uint32_t size,
+                  int use_dict)
+{
+    const uint8_t *ip = src, *end = src + len;
+    uint32_t op = 0, lit, match, off, dict_len;
+    uint8_t token;
+
+    if (src == NULL || dst == NULL || (use_dict && ctx == NULL)) {
+        return -ERR_INVALID_ARG;
+    }
+
+    dict_len = use_dict ? ctx->dict_len : 0;
+    while (ip < end) {
+        token = *ip++;
+        lit = token >> 4;
+        if (lit == 15 && lz_get_len(&ip, end, &lit) != ERR_SUCCESS) {
+            return -ERR_FAIL;
+        }
+        if (lit > (uint32_t)(end - ip) || lit > size - op) {
+            return -ERR_FAIL;
+        }
+        memcpy(dst + op, ip, lit);
+        ip += lit;
+        op += lit;
+
+        if (ip == end) {
+            break;
+        }
+
+        if (end - ip < 2) {
+            return -ERR_FAIL;
+        }
+        off = ip[0] | ip[1] << 8;
+        ip += 2;
+        match = token & 0xF;
+        if (match == 15 && lz_get_len(&ip, end, &match) != ERR_SUCCESS) {
+            return -ERR_FAIL;
+        }
+        match += LZ_MIN_MATCH;
+        if (off == 0 || off > op + dict_len || match > size - op) {
+            return -ERR_FAIL;
+        }
+
+        if (off > op) {
+            /* the match starts in the dictionary */
+            for (; match && off > op; match--, op++) {
+                dst[op] = ctx->dict[dict_len - (off - op)];
+            }
+        }
+        if (off >= match) {
+            memcpy(dst + op, dst + op - off, match);
+            op += match;
+        } else {
+            for (; match; match--, op++) {
+                dst[op] = dst[op - off];
+            }
+        }
+    }
+
+    return op;
+}
+
+/* Adaptive gate: small payloads, recent poor ratios and a busy CPU window all skip. */
+static int lz_should_compress(struct lz_ctx *ctx, uint32_t len, uint64_t now)
+{
+    if (len < ctx->min_len) {
+        ctx->stats.skip_small++;
+        return 0;
+    }
+
+    if (ctx->backoff) {
+        ctx->backoff--;
+        ctx->stats.skip_backoff++;
+        return 0;
+    }
+
+    if (now - ctx->win_start_ns >= LZ_CPU_WINDOW_NS) {
+        ctx->win_start_ns = now;
+        ctx->win_busy_ns = 0;
+    }
+
+    if (ctx->win_busy_ns * 100 > LZ_CPU_WINDOW_NS * ctx->cpu_pct) {
+        ctx->stats.skip_cpu++;
+        return 0;
+    }
+
+    return 1;
+}
+
+/*
+ * Compress the blocks of data into a new *out when it pays off, using the
+ * dictionary once one is trained. data is left untouched. Returns 1 when
+ * *out was produced, 0 when the message should go out as it is.
+ */
+int lz_data_src_compress(struct lz_ctx *ctx, const struct data_src *data, struct data_src **out)
+{
+    struct data_src *lz_data;
+    uint32_t len, limit;
+    uint64_t now;
+    int use_dict;
+    int ret;
+
+    if (ctx == NULL || data == NULL || out == NULL || data->header.len < sizeof(struct data_src)) {
+        return -ERR_INVALID_ARG;
+    }
+
+    if (data->header.earmark & PROTO_EARMARK_LZ) {
+        return 0;
+    }
+
+    len = data->header.len - sizeof(struct data_src);
+    now = lz_now_ns();
+    if (!lz_should_compress(ctx, len, now)) {
+        return 0;
+    }
+
+    limit = (uint64_t)len * ctx->ratio_pct / 100;
+    lz_data = (struct data_src *)malloc(sizeof(struct data_src) + LZ_HDR_SIZE + limit);
+    if (lz_data == NULL) {
+        return -ERR_NO_MEM;
+    }
+
+    use_dict = ctx->dict_len != 0;
+    ret = lz_compress(ctx, (const uint8_t *)data->blocks, len, (uint8_t *)lz_data->blocks + LZ_HDR_SIZE, limit,
+                      use_dict);
+    ctx->win_busy_ns += lz_now_ns() - now;
+    if (ret < 0) {
+        free(lz_data);
+        if (ret != -ERR_OUT_OF_RANGE) {
+            return ret;
+        }
+        ctx->stats.skip_poor++;
+        ctx->backoff = 1 << ctx->poor_streak;
+        if (ctx->poor_streak < LZ_BACKOFF_MAX) {
+            ctx->poor_streak++;
+        }
+        return 0;
+    }
+
+    ctx->poor_streak = 0;
+    lz_data->header = data->header;
+    lz_data->header.earmark |= PROTO_EARMARK_LZ | (use_dict ? PROTO_EARMARK_LZ_DICT : 0);
+    lz_data->header.len = sizeof(struct data_src) + LZ_HDR_SIZE + ret;
+    proto_put_be16((uint8_t *)lz_data->blocks, len);
+
+    ctx->stats.compressed++;
+    ctx->stats.bytes_in += len;
+    ctx->stats.bytes_out += LZ_HDR_SIZE + ret;
+    *out = lz_data;
+
+    return 1;
+}
+
+/* Restore a message flagged PROTO_EARMARK_LZ, others are left alone. ctx may be NULL without a dictionary. */
+int lz_data_src_decompress(const struct lz_ctx *ctx, struct data_src **data)
+{
+    struct data_src *out;
+    uint32_t clen, len;
+    int ret;
+
+    if (data == NULL || *data == NULL || (*data)->header.len < sizeof(struct data_src)) {
+        return -ERR_INVALID_ARG;
+    }
+
+    if (!((*data)->header.earmark & PROTO_EARMARK_LZ)) {
+        return ERR_SUCCESS;
+    }
+
+    clen = (*data)->header.len - sizeof(struct data_src);
+    if (clen < LZ_HDR_SIZE) {
+        return -ERR_FAIL;
+    }
+
+    len = proto_get_be16((uint8_t *)(*data)->blocks);
+    if (sizeof(struct data_src) + len > PROTO_HEADER_LEN_MAX) {
+        return -ERR_OUT_OF_RANGE;
+    }
+
+    out = (struct data_src *)malloc(sizeof(struct data_src) + len);
+    if (out == NULL) {
+        return -ERR_NO_MEM;
+    }
+
+    ret = lz_decompress(ctx, (uint8_t *)(*data)->blocks + LZ_HDR_SIZE, clen - LZ_HDR_SIZE, (uint8_t *)out->blocks,
+                        len, ((*data)->header.earmark & PROTO_EARMARK_LZ_DICT) != 0);
+    if (ret != (int)len) {
+        free(out);
+        return (ret < 0) ? ret : -ERR_FAIL;
+    }
+
+    out->header = (*data)->header;
+    out->header.earmark &= ~(PROTO_EARMARK_LZ | PROTO_EARMARK_LZ_DICT);
+    out->header.len = sizeof(struct data_src) + len;
+    msg_data_src_deinit(*data);
+    *data = out;
+
+    return ERR_SUCCESS;
+}
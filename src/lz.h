@@ -0,0 +1,72 @@
+#ifndef __LZ_H__
+#define __LZ_H__
+
+#include <stdint.h>
+
+#include "errno.h"
+#include "proto.h"
+#include "buff.h"
+
+/*
+ compressed message schematic, earmark has PROTO_EARMARK_LZ set:
+ +---------16 bytes---------+-------16bits-------+-----------------------+
+ |       proto_header       |  raw payload len   |  LZ sequences...      |
+ +--------------------------+--------------------+-----------------------+
+ sequence: token (literal len << 4 | match len - 4), literal len ext,
+ literals, match offset (16 bits LE), match len ext. A len nibble of 15
+ is continued by bytes of 255 up to one below 255. The last sequence has
+ literals only. With PROTO_EARMARK_LZ_DICT, offsets may reach back into
+ the link dictionary, which both ends must have trained alike.
+*/
+#define LZ_MIN_MATCH 4
+#define LZ_HASH_BITS 12
+#define LZ_HASH_SIZE (1 << LZ_HASH_BITS)
+#define LZ_WINDOW 0xFFFF
+#define LZ_DICT_MAX 4096
+#define LZ_HDR_SIZE 2
+
+#define LZ_MIN_LEN_DEFAULT 64           // smaller payloads are not worth it
+#define LZ_RATIO_PCT_DEFAULT 90         // keep only results below 90% of the input
+#define LZ_CPU_PCT_DEFAULT 50           // of LZ_CPU_WINDOW_NS spent compressing
+#define LZ_CPU_WINDOW_NS 100000000ULL
+#define LZ_BACKOFF_MAX 6                // skip up to 64 messages after poor ratios
+
+struct lz_stats {
+    uint32_t compressed;
+    uint32_t skip_small;
+    uint32_t skip_poor;
+    uint32_t skip_cpu;
+    uint32_t skip_backoff;
+    uint64_t bytes_in;
+    uint64_t bytes_out;
+};
+
+/* Per link compression state, one for each direction sharing the dictionary is fine. */
+struct lz_ctx {
+    uint16_t dict_len;
+    uint8_t dict[LZ_DICT_MAX];
+
+    uint8_t min_len;
+    uint8_t ratio_pct;
+    uint8_t cpu_pct;
+
+    uint8_t poor_streak;
+    uint16_t backoff;
+    uint64_t win_start_ns;
+    uint64_t win_busy_ns;
+
+    uint32_t hash[LZ_HASH_SIZE];
+    uint8_t *scratch;                   // dictionary + input when compressing with the dictionary
+    struct lz_stats stats;
+};
+
+void lz_ctx_deinit(struct lz_ctx *ctx);
+struct lz_ctx *lz_ctx_init(void);
+int lz_dict_train(struct lz_ctx *ctx, const uint8_t *sample, uint32_t len);
+int lz_compress(struct lz_ctx *ctx, const uint8_t *src, uint32_t len, uint8_t *dst, uint32_t size, int use_dict);
+int lz_decompress(const struct lz_ctx *ctx, const uint8_t *src, uint32_t len, uint8_t *dst, uint32_t size,
+                  int use_dict);
+int lz_data_src_compress(struct lz_ctx *ctx, const struct data_src *data, struct data_src **out);
+int lz_data_src_decompress(const struct lz_ctx *ctx, struct data_src **data);
+
+#endif // __LZ_H__
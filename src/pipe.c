@@ -1,4 +1,5 @@
 #include "stdlib.h"
+#include <string.h>
 
 #include "pipe.h"
 #include "buff.h"
@@ -12,28 +13,64 @@ struct pipe *pipe_create(struct pipe_ctrl_block *pcb)
         return NULL;
     }
 
+    memset(pipe, 0, sizeof(struct pipe));
     pipe->pcb = pcb;
+    pipe->disp = NULL;
+    pipe->rx_queue_cnt = PIPE_RXQ_CNT;
+    pipe->tx_queue_cnt = PIPE_TXQ_CNT;
+
+    for (int i = 0; i < pipe->rx_queue_cnt; i++) {
+        pipe->rx_queue[i] = msg_queue_init(i);
+        if (pipe->rx_queue[i] == NULL) {
+            pipe_deinit(pipe);
+            return NULL;
+        }
+    }
+
+    for (int i = 0; i < pipe->tx_queue_cnt; i++) {
+        pipe->tx_queue[i] = msg_queue_init(i);
+        if (pipe->tx_queue[i] == NULL) {
+            pipe_deinit(pipe);
+            return NULL;
+        }
+    }
+
+    pipe->tx_sched = sched_init(pipe->tx_queue, pipe->tx_queue_cnt, NULL);
+    if (pipe->tx_sched == NULL) {
+        pipe_deinit(pipe);
+        return NULL;
+    }
+
     ret = pipe_set_id(pcb, pipe);
     if (ret != 0) {
-        free(pipe);
+        pipe_deinit(pipe);
         return NULL;
     }
 
     ret = pipe_ctrl_blk_add(pcb, pipe);
     if (ret != 0) {
-        free(pipe);
+        pipe_deinit(pipe);
         return NULL;
     }
 
     return pipe;
 }
 
+/* Messages still queued are freed with their queues. */
 void pipe_deinit(struct pipe *pipe)
 {
     if (pipe == NULL) {
         return;
     }
 
+    sched_deinit(pipe->tx_sched);
+    for (int i = 0; i < pipe->rx_queue_cnt; i++) {
+        msg_queue_deinit(pipe->rx_queue[i]);
+    }
+    for (int i = 0; i < pipe->tx_queue_cnt; i++) {
+        msg_queue_deinit(pipe->tx_queue[i]);
+    }
+    disp_table_deinit(pipe->disp);
     free(pipe);
 }
 
@@ -43,7 +80,7 @@ int pipe_set_id(struct pipe_ctrl_block *pcb, struct pipe *pipe)
         return -1;
     }
 
-    pipe->id = pcb->tail->id + 1;
+    pipe->id = (pcb->tail != NULL) ? pcb->tail->id + 1 : 0;
     if (pipe->id > PIPE_ID_MAX) {
         return -1;
     }
@@ -71,7 +108,7 @@ int pipe_add_msg_buff(struct pipe *pipe, struct msg_buff *mb)
     q_cnt = pipe->rx_queue_cnt;
     q_idx = msg_buff_select_queue(mb, q_cnt);
 
-    ret = msg_queue_enqueue(&pipe->rx_queue[q_idx], mb);
+    ret = msg_queue_enqueue(pipe->rx_queue[q_idx], mb);
     if (ret != 0) {
         return -1;
     }
@@ -89,7 +126,7 @@ int pipe_get_msg_buff_by_qid(struct pipe *pipe, struct msg_buff **mb, uint8_t q_
         return -1;
     }
 
-    *mb = msg_queue_dequeue(&pipe->rx_queue[q_idx]);
+    *mb = msg_queue_dequeue(pipe->rx_queue[q_idx]);
     if (*mb == NULL) {
         return -1;
     }
@@ -97,6 +134,59 @@ int pipe_get_msg_buff_by_qid(struct pipe *pipe, struct msg_buff **mb, uint8_t q_
     return 0;
 }
 
+int pipe_tx_msg_buff(struct pipe *pipe, struct msg_buff *mb)
+{
+    if (pipe == NULL || mb == NULL) {
+        return -1;
+    }
+
+    if (sched_enqueue(pipe->tx_sched, mb) != 0) {
+        return -1;
+    }
+
+    return 0;
+}
+
+/* Highest priority first, the lower tx queues share what is left by DRR. */
+struct msg_buff *pipe_tx_next_msg_buff(struct pipe *pipe)
+{
+    if (pipe == NULL) {
+        return NULL;
+    }
+
+    return sched_dequeue(pipe->tx_sched);
+}
+
+int pipe_register_blk_handler(struct pipe *pipe, uint16_t type, disp_handler_fn fn, void *arg)
+{
+    if (pipe == NULL || fn == NULL) {
+        return -1;
+    }
+
+    if (pipe->disp == NULL) {
+        pipe->disp = disp_table_init(NULL, NULL);
+        if (pipe->disp == NULL) {
+            return -1;
+        }
+    }
+
+    if (disp_register(pipe->disp, type, fn, arg) != 0) {
+        return -1;
+    }
+
+    return 0;
+}
+
+/* Run the registered handlers over every block of mb, returns the block count. */
+int pipe_dispatch_msg_buff(struct pipe *pipe, struct msg_buff *mb)
+{
+    if (pipe == NULL || mb == NULL || pipe->disp == NULL) {
+        return -1;
+    }
+
+    return disp_msg(pipe->disp, mb);
+}
+
 struct pipe *pipe_ctrl_blk_find_pipe(struct pipe_ctrl_block *pcb, uint16_t id)
 {
     if (pcb == NULL) {
@@ -200,8 +290,9 @@ int pipe_ctrl_blk_remove_all(struct pipe_ctrl_block *pcb)
 
     struct pipe *pipe = pcb->head;
     while (pipe != NULL) {
-        pipe = pipe->next;
+        struct pipe *next = pipe->next;
         pipe_deinit(pipe);
+        pipe = next;
     }
 
     pcb->head = NULL;
@@ -6,9 +6,23 @@
 
 #include "config.h"
 #include "buff.h"
+#include "disp.h"
+#include "sched.h"
 
 #define PIPE_ID_MAX 0xFFF
 
+#if RX_QUEUE_CNT > 0 && RX_QUEUE_CNT <= PROTO_HEADER_PRIO_CNT
+#define PIPE_RXQ_CNT RX_QUEUE_CNT
+#else
+#define PIPE_RXQ_CNT MSG_RXQ_CNT_DEFAULT
+#endif
+
+#if TX_QUEUE_CNT > 0 && TX_QUEUE_CNT <= PROTO_HEADER_PRIO_CNT
+#define PIPE_TXQ_CNT TX_QUEUE_CNT
+#else
+#define PIPE_TXQ_CNT MSG_TXQ_CNT_DEFAULT
+#endif
+
 enum pipe_type {
     PIPE_SYS = 0,
     PIPE_USER,
@@ -21,22 +35,13 @@ struct pipe {
     uint16_t id;
     uint8_t type;
     struct pipe_ctrl_block *pcb;
+    struct disp_table *disp;            // block handlers, created on first registration
 
-#if RX_QUEUE_CNT > 0 && RX_QUEUE_CNT <= PROTO_HEADER_PRIO_CNT
-    uint8_t rx_queue_cnt = RX_QUEUE_CNT;
-    struct msg_queue rx_queue[RX_QUEUE_CNT];
-#else
-    uint8_t rx_queue_cnt = MSG_RXQ_CNT_DEFAULT;
-    struct msg_queue rx_queue[MSG_RXQ_CNT_DEFAULT];
-#endif
-
-#if TX_QUEUE_CNT > 0 && TX_QUEUE_CNT <= PROTO_HEADER_PRIO_CNT
-    uint8_t tx_queue_cnt = TX_QUEUE_CNT;
-    struct msg_queue tx_queue[TX_QUEUE_CNT];
-#else
-    uint8_t tx_queue_cnt = MSG_TXQ_CNT_DEFAULT;
-    struct msg_queue tx_queue[MSG_TXQ_CNT_DEFAULT];
-#endif
+    uint8_t rx_queue_cnt;               // PIPE_RXQ_CNT, set by pipe_create()
+    struct msg_queue *rx_queue[PIPE_RXQ_CNT];
+    uint8_t tx_queue_cnt;               // PIPE_TXQ_CNT
+    struct msg_queue *tx_queue[PIPE_TXQ_CNT];
+    struct sched *tx_sched;             // drains tx_queue in priority order
 };
 
 struct pipe_ctrl_block {
@@ -46,6 +51,22 @@ struct pipe_ctrl_block {
     uint8_t pipe_cnt;
 };
 
+struct pipe *pipe_create(struct pipe_ctrl_block *pcb);
+void pipe_deinit(struct pipe *pipe);
 int pipe_set_id(struct pipe_ctrl_block *pcb, struct pipe *pipe);
+int pipe_get_id(struct pipe_ctrl_block *pcb, struct pipe *pipe);
+int pipe_add_msg_buff(struct pipe *pipe, struct msg_buff *mb);
+int pipe_get_msg_buff_by_qid(struct pipe *pipe, struct msg_buff **mb, uint8_t q_idx);
+int pipe_register_blk_handler(struct pipe *pipe, uint16_t type, disp_handler_fn fn, void *arg);
+int pipe_dispatch_msg_buff(struct pipe *pipe, struct msg_buff *mb);
+int pipe_tx_msg_buff(struct pipe *pipe, struct msg_buff *mb);
+struct msg_buff *pipe_tx_next_msg_buff(struct pipe *pipe);
+
+struct pipe *pipe_ctrl_blk_find_pipe(struct pipe_ctrl_block *pcb, uint16_t id);
+struct pipe_ctrl_block *pipe_ctrl_block_init(void);
+void pipe_ctrl_block_deinit(struct pipe_ctrl_block *pcb);
 int pipe_ctrl_blk_add(struct pipe_ctrl_block *pcb, struct pipe *pipe);
+int pipe_ctrl_blk_remove(struct pipe_ctrl_block *pcb, uint16_t id);
+int pipe_ctrl_blk_remove_all(struct pipe_ctrl_block *pcb);
+
 #endif // __PIPE_H__
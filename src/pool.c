@@ -0,0 +1,274 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "errno.h"
+#include "slab.h"
+#include "pool.h"
+
+static inline int pool_class(uint32_t size)
+{
+    if (size <= (1 << POOL_CLASS_MIN_SHIFT)) {
+        return 0;
+    }
+
+    return (32 - __builtin_clz(size - 1)) - POOL_CLASS_MIN_SHIFT;
+}
+
+static void pool_tls_unlink(struct pool *pool, struct pool_tls *tls)
+{
+    if (tls->prev != NULL) {
+        tls->prev->next = tls->next;
+    } else {
+        pool->tls = tls->next;
+    }
+    if (tls->next != NULL) {
+        tls->next->prev = tls->prev;
+    }
+}
+
+/* Thread exit, the magazines go back to the depot. */
+static void pool_tls_release(void *arg)
+{
+    struct pool_tls *tls = (struct pool_tls *)arg;
+    struct pool *pool = tls->pool;
+
+    for (int c = 0; c < POOL_CLASS_CNT; c++) {
+        slab_free_batch(pool->cls[c], tls->mag[c].obj, tls->mag[c].cnt);
+    }
+
+    pthread_mutex_lock(&pool->lock);
+    pool_tls_unlink(pool, tls);
+    pthread_mutex_unlock(&pool->lock);
+
+    free(tls);
+}
+
+static struct pool_tls *pool_tls_get(struct pool *pool)
+{
+    struct pool_tls *tls = (struct pool_tls *)pthread_getspecific(pool->key);
+    if (tls != NULL) {
+        return tls;
+    }
+
+    tls = (struct pool_tls *)malloc(sizeof(struct pool_tls));
+    if (tls == NULL) {
+        return NULL;
+    }
+
+    memset(tls, 0, sizeof(struct pool_tls));
+    tls->pool = pool;
+    if (pthread_setspecific(pool->key, tls) != 0) {
+        free(tls);
+        return NULL;
+    }
+
+    pthread_mutex_lock(&pool->lock);
+    tls->next = pool->tls;
+    if (pool->tls != NULL) {
+        pool->tls->prev = tls;
+    }
+    pool->tls = tls;
+    pthread_mutex_unlock(&pool->lock);
+
+    return tls;
+}
+
+/* Objects still held by users or magazines of live threads are freed with their chunks. */
+void pool_deinit(struct pool *pool)
+{
+    struct pool_tls *tls;
+
+    if (pool == NULL) {
+        return;
+    }
+
+    pthread_key_delete(pool->key);
+    while (pool->tls != NULL) {
+        tls = pool->tls;
+        pool->tls = tls->next;
+        free(tls);
+    }
+
+    for (int c = 0; c < POOL_CLASS_CNT; c++) {
+        slab_cache_deinit(pool->cls[c]);
+    }
+    slab_reg_deinit(pool->reg);
+
+    pthread_mutex_destroy(&pool->lock);
+    free(pool);
+}
+
+struct pool *pool_init(void)
+{
+    struct pool *pool = (struct pool *)malloc(sizeof(struct pool));
+    if (pool == NULL) {
+        return NULL;
+    }
+
+    memset(pool, 0, sizeof(struct pool));
+    if (pthread_key_create(&pool->key, pool_tls_release) != 0) {
+        free(pool);
+        return NULL;
+    }
+    pthread_mutex_init(&pool->lock, NULL);
+
+    pool->reg = slab_reg_init();
+    if (pool->reg == NULL) {
+        pool_deinit(pool);
+        return NULL;
+    }
+
+    for (int c = 0; c < POOL_CLASS_CNT; c++) {
+        pool->cls[c] = slab_cache_init_shared(1 << (c + POOL_CLASS_MIN_SHIFT), pool->reg, c);
+        if (pool->cls[c] == NULL) {
+            pool_deinit(pool);
+            return NULL;
+        }
+    }
+
+    return pool;
+}
+
+/* Uninitialised object of at least size bytes, NULL above POOL_OBJ_MAX or out of memory. */
+void *pool_alloc(struct pool *pool, uint32_t size)
+{
+    struct pool_tls *tls;
+    struct pool_mag *mag;
+    uint32_t cnt;
+    int c;
+
+    if (pool == NULL || size > POOL_OBJ_MAX) {
+        return NULL;
+    }
+
+    tls = pool_tls_get(pool);
+    if (tls == NULL) {
+        return NULL;
+    }
+
+    c = pool_class(size);
+    mag = &tls->mag[c];
+    cnt = mag->cnt;
+    if (cnt == 0) {
+        cnt = slab_alloc_batch(pool->cls[c], mag->obj, POOL_MAG_BATCH);
+        if (cnt == 0) {
+            return NULL;
+        }
+    }
+
+    cnt--;
+    __atomic_store_n(&mag->cnt, cnt, __ATOMIC_RELAXED);
+
+    return mag->obj[cnt];
+}
+
+/* obj may point anywhere into its object. -ERR_NOT_FOUND when obj is not pool memory. */
+int pool_free(struct pool *pool, void *obj)
+{
+    struct pool_tls *tls;
+    struct pool_mag *mag;
+    uint32_t cnt;
+    int c;
+
+    if (pool == NULL || obj == NULL) {
+        return -ERR_INVALID_ARG;
+    }
+
+    c = slab_reg_lookup(pool->reg, obj);
+    if (c < 0) {
+        return -ERR_NOT_FOUND;
+    }
+
+    /* obj may point into the object, classes are powers of two in aligned chunks */
+    obj = (void *)((uintptr_t)obj & ~(uintptr_t)(pool->cls[c]->obj_size - 1));
+
+    tls = pool_tls_get(pool);
+    if (tls == NULL) {
+        slab_free(pool->cls[c], obj);
+        return ERR_SUCCESS;
+    }
+
+    mag = &tls->mag[c];
+    cnt = mag->cnt;
+    if (cnt == POOL_MAG_SIZE) {
+        cnt -= POOL_MAG_BATCH;
+        slab_free_batch(pool->cls[c], mag->obj + cnt, POOL_MAG_BATCH);
+    }
+
+    mag->obj[cnt++] = obj;
+    __atomic_store_n(&mag->cnt, cnt, __ATOMIC_RELAXED);
+
+    return ERR_SUCCESS;
+}
+
+/* Usable size of a pool object, 0 for other memory. */
+uint32_t pool_obj_size(const struct pool *pool, const void *obj)
+{
+    int c;
+
+    if (pool == NULL) {
+        return 0;
+    }
+
+    c = slab_reg_lookup(pool->reg, obj);
+
+    return (c < 0) ? 0 : pool->cls[c]->obj_size;
+}
+
+/* Start of the object ptr points into, NULL for other memory. */
+void *pool_obj_base(const struct pool *pool, const void *ptr)
+{
+    int c;
+
+    if (pool == NULL) {
+        return NULL;
+    }
+
+    c = slab_reg_lookup(pool->reg, ptr);
+    if (c < 0) {
+        return NULL;
+    }
+
+    return (void *)((uintptr_t)ptr & ~(uintptr_t)(pool->cls[c]->obj_size - 1));
+}
+
+/* Snapshot for occupancy monitoring, magazine counts of running threads are approximate. */
+int pool_get_stats(struct pool *pool, struct pool_stats *stats)
+{
+    struct pool_class_stats *cs;
+    struct slab_stats ss;
+    struct pool_tls *tls;
+
+    if (pool == NULL || stats == NULL) {
+        return -ERR_INVALID_ARG;
+    }
+
+    memset(stats, 0, sizeof(struct pool_stats));
+
+    pthread_mutex_lock(&pool->lock);
+    for (tls = pool->tls; tls != NULL; tls = tls->next) {
+        stats->threads++;
+        for (int c = 0; c < POOL_CLASS_CNT; c++) {
+            stats->cls[c].cached += __atomic_load_n(&tls->mag[c].cnt, __ATOMIC_RELAXED);
+        }
+    }
+    pthread_mutex_unlock(&pool->lock);
+
+    for (int c = 0; c < POOL_CLASS_CNT; c++) {
+        cs = &stats->cls[c];
+        slab_get_stats(pool->cls[c], &ss);
+        cs->size = pool->cls[c]->obj_size;
+        cs->chunks = ss.chunks;
+        cs->capacity = ss.chunks * pool->cls[c]->obj_per_chunk;
+        cs->in_use = (ss.in_use > cs->cached) ? ss.in_use - cs->cached : 0;
+        cs->refills = ss.allocs;
+        cs->flushes = ss.frees;
+
+        stats->bytes_in_use += (uint64_t)cs->in_use * cs->size;
+        stats->bytes_reserved += (uint64_t)ss.chunks * SLAB_CHUNK_SIZE;
+    }
+
+    return ERR_SUCCESS;
+}
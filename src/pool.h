@@ -0,0 +1,75 @@
+#ifndef __POOL_H__
+#define __POOL_H__
+
+#include <stdint.h>
+#include <pthread.h>
+
+#include "errno.h"
+#include "slab.h"
+
+/*
+ power of two size classes, each backed by a slab cache (the depot):
+   thread A                 depot                 thread B
+ +-----------+   refill   +-------+   flush    +-----------+
+ | magazines | <--------- | class | <--------- | magazines |
+ +-----------+  batches   +-------+  batches   +-----------+
+ alloc and free only touch the calling thread's magazine. An empty
+ magazine is refilled and a full one flushed POOL_MAG_BATCH objects at a
+ time, so a thread freeing what another one allocated takes the depot
+ lock once per batch. Magazines go back to the depot when their thread
+ exits.
+*/
+#define POOL_CLASS_MIN_SHIFT 5              // 32 bytes
+#define POOL_CLASS_MAX_SHIFT 16             // 64 KiB
+#define POOL_CLASS_CNT (POOL_CLASS_MAX_SHIFT - POOL_CLASS_MIN_SHIFT + 1)
+#define POOL_OBJ_MAX (1 << POOL_CLASS_MAX_SHIFT)
+#define POOL_MAG_SIZE 32
+#define POOL_MAG_BATCH 16
+
+struct pool_mag {
+    uint32_t cnt;
+    void *obj[POOL_MAG_SIZE];
+};
+
+/* Magazines of one thread, linked into the pool so stats and deinit can find them. */
+struct pool_tls {
+    struct pool_tls *next;
+    struct pool_tls *prev;
+    struct pool *pool;
+    struct pool_mag mag[POOL_CLASS_CNT];
+};
+
+struct pool_class_stats {
+    uint32_t size;
+    uint32_t chunks;
+    uint32_t capacity;              // objects in all chunks
+    uint32_t in_use;                // held by users
+    uint32_t cached;                // sitting in thread magazines
+    uint64_t refills;               // objects moved depot -> magazines
+    uint64_t flushes;               // objects moved magazines -> depot
+};
+
+struct pool_stats {
+    uint32_t threads;
+    uint64_t bytes_in_use;
+    uint64_t bytes_reserved;
+    struct pool_class_stats cls[POOL_CLASS_CNT];
+};
+
+struct pool {
+    pthread_key_t key;
+    pthread_mutex_t lock;           // tls list only
+    struct pool_tls *tls;
+    struct slab_reg *reg;
+    struct slab_cache *cls[POOL_CLASS_CNT];
+};
+
+void pool_deinit(struct pool *pool);
+struct pool *pool_init(void);
+void *pool_alloc(struct pool *pool, uint32_t size);
+int pool_free(struct pool *pool, void *obj);
+uint32_t pool_obj_size(const struct pool *pool, const void *obj);
+void *pool_obj_base(const struct pool *pool, const void *ptr);
+int pool_get_stats(struct pool *pool, struct pool_stats *stats);
+
+#endif // __POOL_H__
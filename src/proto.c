@@ -2,9 +2,169 @@
 #include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
+#include <stddef.h>
+#include <pthread.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define PROTO_X86 1
+#endif
 
 #include "proto.h"
 #include "errno.h"
+#include "csum.h"
+
+_Static_assert(sizeof(struct proto_header) == PROTO_HEADER_WIRE_SIZE,
+               "proto_header must match the wire size");
+_Static_assert(offsetof(struct proto_header, checksum) == PROTO_WIRE_OFF_CHECKSUM,
+               "checksum offset must match the wire layout");
+
+typedef void (*proto_decode_fn)(struct proto_header *header, const uint8_t *buf);
+
+static void proto_header_decode_scalar(struct proto_header *header, const uint8_t *buf);
+
+typedef uint64_t (*proto_validate_fn)(const struct proto_frame_desc *desc, uint16_t cnt);
+
+static uint64_t proto_validate_hdr_scalar(const struct proto_frame_desc *desc, uint16_t cnt);
+
+static proto_decode_fn proto_decode_kern = proto_header_decode_scalar;
+static proto_validate_fn proto_validate_kern = proto_validate_hdr_scalar;
+static pthread_once_t proto_once = PTHREAD_ONCE_INIT;
+
+static inline void proto_header_decode_flags(struct proto_header *header, uint8_t flags)
+{
+    header->earmark = (flags & PROTO_HEADER_EARMARK_MASK) >> PROTO_HEADER_EARMARK_SHIFT;
+    header->cfg_hdr = (flags & PROTO_HEADER_CFG_MASK) >> PROTO_HEADER_CFG_SHIFT;
+    header->priority = flags & PROTO_HEADER_PRIORITY_MASK;
+}
+
+static void proto_header_decode_scalar(struct proto_header *header, const uint8_t *buf)
+{
+    header->hop_limit = buf[0];
+    proto_header_decode_flags(header, buf[PROTO_WIRE_OFF_FLAGS]);
+    header->heart_rate = proto_get_be16(buf + PROTO_WIRE_OFF_HEART_RATE);
+    header->src_id = proto_get_be32(buf + PROTO_WIRE_OFF_SRC_ID);
+    header->dst_id = proto_get_be32(buf + PROTO_WIRE_OFF_DST_ID);
+    header->len = proto_get_be16(buf + PROTO_WIRE_OFF_LEN);
+    header->checksum = proto_get_be16(buf + PROTO_WIRE_OFF_CHECKSUM);
+}
+
+#ifdef PROTO_X86
+/*
+ * The wire fields sit at the same offsets as in struct proto_header, so one
+ * PSHUFB swaps every multi-byte field at once; only the flags byte needs
+ * unpacking into the bitfields afterwards.
+ */
+__attribute__((target("ssse3")))
+static void proto_header_decode_ssse3(struct proto_header *header, const uint8_t *buf)
+{
+    const __m128i swap = _mm_setr_epi8(0, 1, 3, 2, 7, 6, 5, 4, 11, 10, 9, 8, 13, 12, 15, 14);
+    __m128i v;
+
+    v = _mm_loadu_si128((const __m128i *)buf);
+    _mm_storeu_si128((__m128i *)header, _mm_shuffle_epi8(v, swap));
+    proto_header_decode_flags(header, buf[PROTO_WIRE_OFF_FLAGS]);
+}
+#endif
+
+/* Header checks of proto_frame_validate_batch(), one bit per frame of up to 64. */
+static uint64_t proto_validate_hdr_scalar(const struct proto_frame_desc *desc, uint16_t cnt)
+{
+    const struct proto_header *h;
+    uint64_t mask = 0;
+
+    for (uint16_t i = 0; i < cnt; i++) {
+        h = &desc[i].header;
+        mask |= (uint64_t)(h->len == desc[i].len && h->len >= PROTO_HEADER_WIRE_SIZE
+                           && h->hop_limit <= PROTO_HEADER_HOP_LIMIT_MAX
+                           && h->priority <= PROTO_HEADER_PRIORITY_MAX
+                           && h->cfg_hdr <= PROTO_HEADER_CFG_COMPACT) << i;
+    }
+
+    return mask;
+}
+
+#ifdef PROTO_X86
+/* Bit positions of the flags bitfields in the first header word, checked in proto_setup(). */
+#define PROTO_W0_CFG_SHIFT 11
+#define PROTO_W0_PRIO_SHIFT 13
+
+/*
+ * Eight descriptors per step: the header words and the received length are
+ * gathered straight out of the desc[] array, every bound is checked in all
+ * lanes at once and the lane results come back as one movemask byte.
+ */
+__attribute__((target("avx2")))
+static uint64_t proto_validate_hdr_avx2(const struct proto_frame_desc *desc, uint16_t cnt)
+{
+    const __m256i stride = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+    const __m256i u16 = _mm256_set1_epi32(0xFFFF);
+    const __m256i hop_max = _mm256_set1_epi32(PROTO_HEADER_HOP_LIMIT_MAX);
+    const __m256i prio_max = _mm256_set1_epi32(PROTO_HEADER_PRIORITY_MAX);
+    const __m256i cfg_max = _mm256_set1_epi32(PROTO_HEADER_CFG_COMPACT);
+    const __m256i len_min = _mm256_set1_epi32(PROTO_HEADER_WIRE_SIZE);
+    const __m256i off = _mm256_mullo_epi32(stride, _mm256_set1_epi32(sizeof(struct proto_frame_desc)));
+    __m256i w0, hlen, blen, v, ok;
+    uint64_t mask = 0;
+    uint16_t i;
+
+    for (i = 0; i + 8 <= cnt; i += 8) {
+        const int *base = (const int *)&desc[i];
+
+        w0 = _mm256_i32gather_epi32(base, _mm256_add_epi32(off,
+                 _mm256_set1_epi32(offsetof(struct proto_frame_desc, header))), 1);
+        hlen = _mm256_i32gather_epi32(base, _mm256_add_epi32(off,
+                 _mm256_set1_epi32(offsetof(struct proto_frame_desc, header.len))), 1);
+        blen = _mm256_i32gather_epi32(base, _mm256_add_epi32(off,
+                 _mm256_set1_epi32(offsetof(struct proto_frame_desc, len))), 1);
+        hlen = _mm256_and_si256(hlen, u16);
+        blen = _mm256_and_si256(blen, u16);
+
+        ok = _mm256_cmpeq_epi32(hlen, blen);
+        ok = _mm256_and_si256(ok, _mm256_cmpeq_epi32(_mm256_max_epu32(hlen, len_min), hlen));
+        v = _mm256_and_si256(w0, _mm256_set1_epi32(0xFF));
+        ok = _mm256_and_si256(ok, _mm256_cmpeq_epi32(_mm256_min_epu32(v, hop_max), v));
+        v = _mm256_and_si256(_mm256_srli_epi32(w0, PROTO_W0_PRIO_SHIFT), _mm256_set1_epi32(0x7));
+        ok = _mm256_and_si256(ok, _mm256_cmpeq_epi32(_mm256_min_epu32(v, prio_max), v));
+        v = _mm256_and_si256(_mm256_srli_epi32(w0, PROTO_W0_CFG_SHIFT), _mm256_set1_epi32(0x3));
+        ok = _mm256_and_si256(ok, _mm256_cmpeq_epi32(_mm256_min_epu32(v, cfg_max), v));
+
+        mask |= (uint64_t)(uint8_t)_mm256_movemask_ps(_mm256_castsi256_ps(ok)) << i;
+    }
+
+    if (i < cnt) {
+        mask |= proto_validate_hdr_scalar(desc + i, cnt - i) << i;
+    }
+
+    return mask;
+}
+
+static int proto_bitfield_probe(void)
+{
+    struct proto_header h;
+    uint32_t w0;
+
+    memset(&h, 0, sizeof(h));
+    h.priority = 0x7;
+    h.cfg_hdr = 0x1;
+    memcpy(&w0, &h, sizeof(w0));
+
+    return w0 == (0x7u << PROTO_W0_PRIO_SHIFT | 0x1u << PROTO_W0_CFG_SHIFT);
+}
+#endif
+
+static void proto_setup(void)
+{
+#if defined(PROTO_X86) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("ssse3")) {
+        proto_decode_kern = proto_header_decode_ssse3;
+    }
+    if (__builtin_cpu_supports("avx2") && proto_bitfield_probe()) {
+        proto_validate_kern = proto_validate_hdr_avx2;
+    }
+#endif
+}
 
 void proto_header_deinit(struct proto_header *header)
 {
@@ -18,12 +178,71 @@ struct proto_header *proto_header_init(void)
     if (header == NULL) {
         return NULL; 
     }
-    header->hop_limit = 0;
-    header->heart_rate = PROTO_HEADER_HEART_RATE_DEFAULT;
+    proto_header_reset(header);
     
     return header;
 }
 
+/* Same defaults as proto_header_init(), for headers living in caller memory. */
+void proto_header_reset(struct proto_header *header)
+{
+    if (header == NULL) {
+        return;
+    }
+
+    memset(header, 0, sizeof(struct proto_header));
+    header->heart_rate = PROTO_HEADER_HEART_RATE_DEFAULT;
+}
+
+/*
+ * Encode into network byte order as drawn in proto.h. buf may alias the
+ * header itself, every field is read before it is overwritten.
+ */
+int proto_header_encode(const struct proto_header *header, uint8_t *buf, uint32_t size)
+{
+    struct proto_header tmp;
+
+    if (header == NULL || buf == NULL) {
+        return -ERR_INVALID_ARG;
+    }
+
+    if (size < PROTO_HEADER_WIRE_SIZE) {
+        return -ERR_OUT_OF_RANGE;
+    }
+
+    tmp = *header;
+    buf[0] = tmp.hop_limit;
+    buf[PROTO_WIRE_OFF_FLAGS] = (tmp.earmark << PROTO_HEADER_EARMARK_SHIFT)
+                                | (tmp.cfg_hdr << PROTO_HEADER_CFG_SHIFT)
+                                | (tmp.priority & PROTO_HEADER_PRIORITY_MASK);
+    proto_put_be16(buf + PROTO_WIRE_OFF_HEART_RATE, tmp.heart_rate);
+    proto_put_be32(buf + PROTO_WIRE_OFF_SRC_ID, tmp.src_id);
+    proto_put_be32(buf + PROTO_WIRE_OFF_DST_ID, tmp.dst_id);
+    proto_put_be16(buf + PROTO_WIRE_OFF_LEN, tmp.len);
+    proto_put_be16(buf + PROTO_WIRE_OFF_CHECKSUM, tmp.checksum);
+
+    return ERR_SUCCESS;
+}
+
+/* buf may alias the header, decoding in place is allowed. */
+int proto_header_decode(struct proto_header *header, const uint8_t *buf, uint32_t size)
+{
+    uint8_t tmp[PROTO_HEADER_WIRE_SIZE];
+
+    if (header == NULL || buf == NULL) {
+        return -ERR_INVALID_ARG;
+    }
+
+    if (size < PROTO_HEADER_WIRE_SIZE) {
+        return -ERR_OUT_OF_RANGE;
+    }
+
+    memcpy(tmp, buf, PROTO_HEADER_WIRE_SIZE);
+    proto_header_decode_scalar(header, tmp);
+
+    return ERR_SUCCESS;
+}
+
 int proto_header_set_hop_limit(struct proto_header *header, uint8_t hop_limit)
 {
     if (header == NULL) {
@@ -128,6 +347,238 @@ int proto_header_set_checksum(struct proto_header *header, uint16_t checksum)
     return ERR_SUCCESS;
 }
 
+/*
+ * Forwarding helper, the checksum is patched for the one byte that changed
+ * so the payload is not summed again. It must have been valid before.
+ */
+int proto_header_dec_hop_limit(struct proto_header *header, uint8_t csum_type)
+{
+    if (header == NULL || csum_type >= CSUM_TYPE_MAX) {
+        return -ERR_INVALID_ARG;
+    }
+
+    if (header->hop_limit == 0) {
+        return -ERR_OUT_OF_RANGE;
+    }
+
+    if (csum_type != CSUM_TYPE_AUTO && csum_type != CSUM_TYPE_NONE) {
+        header->checksum = csum_update_byte(csum_type, header->checksum, PROTO_WIRE_OFF_HOP_LIMIT, header->len,
+                                            header->hop_limit, header->hop_limit - 1);
+    }
+    header->hop_limit--;
+
+    return ERR_SUCCESS;
+}
+
+/* Checksum over a whole frame, the checksum field itself is taken as zero. */
+uint16_t proto_frame_calc_checksum(const uint8_t *frame, uint16_t len, uint8_t csum_type)
+{
+    static const uint8_t zero[sizeof(uint16_t)] = {0};
+    const uint16_t off = offsetof(struct proto_header, checksum);
+    uint32_t state;
+
+    if (frame == NULL || len < sizeof(struct proto_header)) {
+        return 0;
+    }
+
+    state = csum_start(csum_type);
+    state = csum_update(csum_type, state, frame, off);
+    state = csum_update(csum_type, state, zero, sizeof(zero));
+    state = csum_update(csum_type, state, frame + off + sizeof(zero),
+                        len - off - sizeof(zero));
+
+    return csum_finish(csum_type, state);
+}
+
+/*
+ * Checksum the frame will carry once header is encoded in front of payload,
+ * for frames still held with a host order header.
+ */
+uint16_t proto_header_calc_checksum(const struct proto_header *header, const void *payload, uint16_t payload_len,
+                                    uint8_t csum_type)
+{
+    uint8_t hdr[PROTO_HEADER_WIRE_SIZE];
+    uint32_t state;
+
+    if (header == NULL || (payload == NULL && payload_len != 0)) {
+        return 0;
+    }
+
+    proto_header_encode(header, hdr, sizeof(hdr));
+    proto_put_be16(hdr + PROTO_WIRE_OFF_CHECKSUM, 0);
+
+    state = csum_start(csum_type);
+    state = csum_update(csum_type, state, hdr, sizeof(hdr));
+    state = csum_update(csum_type, state, payload, payload_len);
+
+    return csum_finish(csum_type, state);
+}
+
+uint16_t proto_frame_get_len(const uint8_t *frame)
+{
+    if (frame == NULL) {
+        return 0;
+    }
+
+    return proto_get_be16(frame + PROTO_WIRE_OFF_LEN);
+}
+
+/* Wire frame variant, the checksum is stored big endian. */
+int proto_frame_set_checksum(uint8_t *frame, uint16_t len, uint8_t csum_type)
+{
+    if (frame == NULL || len < PROTO_HEADER_WIRE_SIZE) {
+        return -ERR_INVALID_ARG;
+    }
+
+    proto_put_be16(frame + PROTO_WIRE_OFF_CHECKSUM, proto_frame_calc_checksum(frame, len, csum_type));
+
+    return ERR_SUCCESS;
+}
+
+/* iov[0] must hold the whole wire header, the checksum is written into it. */
+int proto_frame_set_checksum_iov(const struct iovec *iov, int iov_cnt, uint8_t csum_type)
+{
+    uint8_t *hdr;
+    uint32_t state;
+
+    if (iov == NULL || iov_cnt < 1 || iov[0].iov_len < PROTO_HEADER_WIRE_SIZE) {
+        return -ERR_INVALID_ARG;
+    }
+
+    hdr = (uint8_t *)iov[0].iov_base;
+    proto_put_be16(hdr + PROTO_WIRE_OFF_CHECKSUM, 0);
+
+    state = csum_start(csum_type);
+    for (int i = 0; i < iov_cnt; i++) {
+        state = csum_update(csum_type, state, iov[i].iov_base, iov[i].iov_len);
+    }
+
+    proto_put_be16(hdr + PROTO_WIRE_OFF_CHECKSUM, csum_finish(csum_type, state));
+
+    return ERR_SUCCESS;
+}
+
+int proto_frame_check_checksum(const uint8_t *frame, uint16_t len, uint8_t csum_type)
+{
+    if (frame == NULL || len < PROTO_HEADER_WIRE_SIZE) {
+        return -ERR_INVALID_ARG;
+    }
+
+    if (csum_type == CSUM_TYPE_AUTO || csum_type == CSUM_TYPE_NONE) {
+        return ERR_SUCCESS;
+    }
+
+    if (proto_get_be16(frame + PROTO_WIRE_OFF_CHECKSUM) != proto_frame_calc_checksum(frame, len, csum_type)) {
+        return -ERR_FAIL;
+    }
+
+    return ERR_SUCCESS;
+}
+
+/*
+ * Walk back-to-back wire frames in one rx buffer and decode their headers
+ * into desc[]. Stops at the first truncated or malformed frame; *used gets
+ * the number of bytes consumed so the caller can keep the remainder.
+ * Returns the number of frames decoded.
+ */
+int proto_frame_decode_batch(const uint8_t *buf, uint32_t size, struct proto_frame_desc *desc,
+                             uint16_t desc_cnt, uint32_t *used)
+{
+    uint32_t off = 0;
+    uint16_t len;
+    int cnt = 0;
+
+    if (buf == NULL || desc == NULL) {
+        return -ERR_INVALID_ARG;
+    }
+
+    pthread_once(&proto_once, proto_setup);
+
+    while (cnt < desc_cnt && size - off >= PROTO_HEADER_WIRE_SIZE) {
+        len = proto_get_be16(buf + off + PROTO_WIRE_OFF_LEN);
+        if (len < PROTO_HEADER_WIRE_SIZE || len > size - off) {
+            break;
+        }
+
+        proto_decode_kern(&desc[cnt].header, buf + off);
+        desc[cnt].frame = buf + off;
+        desc[cnt].len = len;
+        off += len;
+        cnt++;
+    }
+
+    if (used != NULL) {
+        *used = off;
+    }
+
+    return cnt;
+}
+
+/* Blocks must cover the payload exactly, a zero len block only fits an empty tail. */
+static int proto_frame_blocks_tile(const struct proto_frame_desc *desc)
+{
+    struct proto_block_ref ref;
+    const uint8_t *p;
+    uint32_t left;
+    int n;
+
+    if (desc->frame == NULL) {
+        return 0;
+    }
+
+    /* compressed blocks are opaque until lz_data_src_decompress() */
+    if (desc->header.earmark & PROTO_EARMARK_LZ) {
+        return desc->len >= PROTO_HEADER_WIRE_SIZE + sizeof(uint16_t);
+    }
+
+    p = desc->frame + PROTO_HEADER_WIRE_SIZE;
+    left = desc->len - PROTO_HEADER_WIRE_SIZE;
+    while ((n = proto_block_next(desc->header.cfg_hdr, p, left, &ref)) > 0) {
+        p += n;
+        left -= n;
+    }
+
+    return n == 0 && left == 0;
+}
+
+/*
+ * Validate cnt received frames, desc[i].len being the byte count actually
+ * received and desc[i].header the decoded header. Checks header len against
+ * it, hop_limit/priority/cfg bounds and that the blocks tile the payload.
+ * Bit i of mask[i / 64] is set when frame i passes. Returns the pass count.
+ */
+int proto_frame_validate_batch(const struct proto_frame_desc *desc, uint16_t cnt, uint64_t *mask)
+{
+    uint64_t bits, ok;
+    int pass = 0;
+
+    if (desc == NULL || mask == NULL) {
+        return -ERR_INVALID_ARG;
+    }
+
+    pthread_once(&proto_once, proto_setup);
+
+    for (uint16_t i = 0; i < cnt; i += 64) {
+        bits = proto_validate_kern(desc + i, (cnt - i > 64) ? 64 : cnt - i);
+
+        /* the TLV walk is serial, only frames with a sane header get one */
+        ok = bits;
+        while (bits) {
+            int b = __builtin_ctzll(bits);
+
+            bits &= bits - 1;
+            if (!proto_frame_blocks_tile(&desc[i + b])) {
+                ok &= ~(1ULL << b);
+            }
+        }
+
+        mask[i / 64] = ok;
+        pass += __builtin_popcountll(ok);
+    }
+
+    return pass;
+}
+
 int proto_header_dump(struct proto_header *header)
 {
     if (header == NULL) {
@@ -207,3 +658,189 @@ int proto_block_reset_data(struct proto_block **block, uint8_t *data, uint16_t s
 
     return ERR_SUCCESS;
 }
+
+static const uint8_t proto_varint_size[4] = {1, 1, 2, 3};
+
+static inline int proto_varint_put(uint8_t *p, uint16_t val)
+{
+    if (val < 0x80) {
+        p[0] = val;
+        return 1;
+    }
+
+    if (val < 0x4000) {
+        p[0] = 0x80 | (val >> 8);
+        p[1] = val & 0xFF;
+        return 2;
+    }
+
+    p[0] = 0xC0;
+    p[1] = val >> 8;
+    p[2] = val & 0xFF;
+    return 3;
+}
+
+/* Returns the varint size, 0 when it runs past avail. */
+static inline int proto_varint_get(const uint8_t *p, uint32_t avail, uint16_t *val)
+{
+    uint8_t n;
+
+    if (avail == 0) {
+        return 0;
+    }
+
+    n = proto_varint_size[p[0] >> 6];
+    if (n > avail) {
+        return 0;
+    }
+
+    switch (n) {
+    case 1:
+        *val = p[0];
+        break;
+    case 2:
+        *val = (uint16_t)((p[0] & 0x3F) << 8 | p[1]);
+        break;
+    default:
+        *val = proto_get_be16(p + 1);
+        break;
+    }
+
+    return n;
+}
+
+static inline uint32_t proto_varint_len(uint16_t val)
+{
+    return (val < 0x80) ? 1 : (val < 0x4000) ? 2 : 3;
+}
+
+/*
+ * Decode the block at buf in either encoding. Returns the bytes it takes,
+ * 0 at the end of the chain (zero len block or no room for a block header)
+ * and -ERR_OUT_OF_RANGE when the block runs past size.
+ */
+int proto_block_next(uint8_t cfg, const uint8_t *buf, uint32_t size, struct proto_block_ref *ref)
+{
+    const struct proto_block *block;
+    uint32_t hdr;
+    int n;
+
+    if (buf == NULL || ref == NULL) {
+        return -ERR_INVALID_ARG;
+    }
+
+    if (cfg == PROTO_HEADER_CFG_COMPACT) {
+        n = proto_varint_get(buf, size, &ref->type);
+        if (n == 0) {
+            return 0;
+        }
+        hdr = n;
+        n = proto_varint_get(buf + hdr, size - hdr, &ref->len);
+        if (n == 0) {
+            return 0;
+        }
+        hdr += n;
+    } else {
+        if (size < sizeof(struct proto_block)) {
+            return 0;
+        }
+        block = (const struct proto_block *)buf;
+        ref->type = block->type;
+        ref->len = block->len;
+        hdr = sizeof(struct proto_block);
+    }
+
+    if (ref->len == 0) {
+        return 0;
+    }
+
+    if (hdr + ref->len > size) {
+        return -ERR_OUT_OF_RANGE;
+    }
+
+    ref->data = buf + hdr;
+
+    return hdr + ref->len;
+}
+
+/* Write one compact block, returns the bytes written. */
+int proto_block_put_compact(uint8_t *buf, uint32_t size, uint16_t type, const void *data, uint16_t len)
+{
+    uint32_t need;
+    int n;
+
+    if (buf == NULL || (data == NULL && len)) {
+        return -ERR_INVALID_ARG;
+    }
+
+    need = proto_varint_len(type) + proto_varint_len(len) + len;
+    if (need > size) {
+        return -ERR_OUT_OF_RANGE;
+    }
+
+    n = proto_varint_put(buf, type);
+    n += proto_varint_put(buf + n, len);
+    memcpy(buf + n, data, len);
+
+    return need;
+}
+
+/*
+ * Transcode a proto_block chain to compact blocks. out == NULL only sizes
+ * the result. The chain ends at a zero len block or at in_len, like the
+ * other block walkers. Returns the compact length.
+ */
+int proto_blocks_compact_encode(const uint8_t *in, uint32_t in_len, uint8_t *out, uint32_t size)
+{
+    struct proto_block_ref ref;
+    uint32_t off = 0, pos = 0;
+    int n;
+
+    if (in == NULL) {
+        return -ERR_INVALID_ARG;
+    }
+
+    while ((n = proto_block_next(PROTO_HEADER_CFG_STD, in + off, in_len - off, &ref)) > 0) {
+        if (out == NULL) {
+            pos += proto_varint_len(ref.type) + proto_varint_len(ref.len) + ref.len;
+        } else {
+            n = proto_block_put_compact(out + pos, size - pos, ref.type, ref.data, ref.len);
+            if (n < 0) {
+                return n;
+            }
+            pos += n;
+        }
+        off += sizeof(struct proto_block) + ref.len;
+    }
+
+    return (n < 0) ? n : (int)pos;
+}
+
+/* The reverse of proto_blocks_compact_encode(), out == NULL only sizes the result. */
+int proto_blocks_compact_decode(const uint8_t *in, uint32_t in_len, uint8_t *out, uint32_t size)
+{
+    struct proto_block_ref ref;
+    struct proto_block block;
+    uint32_t off = 0, pos = 0;
+    int n;
+
+    if (in == NULL) {
+        return -ERR_INVALID_ARG;
+    }
+
+    while ((n = proto_block_next(PROTO_HEADER_CFG_COMPACT, in + off, in_len - off, &ref)) > 0) {
+        if (out != NULL) {
+            if (pos + sizeof(struct proto_block) + ref.len > size) {
+                return -ERR_OUT_OF_RANGE;
+            }
+            block.type = ref.type;
+            block.len = ref.len;
+            memcpy(out + pos, &block, sizeof(block));
+            memcpy(out + pos + sizeof(block), ref.data, ref.len);
+        }
+        pos += sizeof(struct proto_block) + ref.len;
+        off += n;
+    }
+
+    return (n < 0) ? n : (int)pos;
+}
@@ -3,12 +3,31 @@
 
 #include <stdint.h>
 #include <time.h>
+#include <sys/uio.h>
 
 #define PROTO_HEADER_SIZE 8
+#define PROTO_HEADER_WIRE_SIZE 16          // encoded header, network byte order
+
+#define PROTO_WIRE_OFF_HOP_LIMIT 0
+#define PROTO_WIRE_OFF_FLAGS 1
+#define PROTO_WIRE_OFF_HEART_RATE 2
+#define PROTO_WIRE_OFF_SRC_ID 4
+#define PROTO_WIRE_OFF_DST_ID 8
+#define PROTO_WIRE_OFF_LEN 12
+#define PROTO_WIRE_OFF_CHECKSUM 14
 #define PROTO_HEADER_HOP_LIMIT_MAX 0x80    // 128 hops
 
+#define PROTO_HEADER_EARMARK_MAX 7
+#define PROTO_HEADER_EARMARK_MASK 0xE0
+#define PROTO_HEADER_EARMARK_SHIFT 5
+#define PROTO_EARMARK_LZ 0x1               // payload is LZ compressed, see lz.h
+#define PROTO_EARMARK_LZ_DICT 0x2          // compressed against the link dictionary
+
 #define PROTO_HEADER_CFG_MAX 3
 #define PROTO_HEADER_CFG_MASK 0x18
+#define PROTO_HEADER_CFG_SHIFT 3
+#define PROTO_HEADER_CFG_STD 0             // proto_block TLVs
+#define PROTO_HEADER_CFG_COMPACT 1         // varint TLVs, see proto_blocks_compact_encode()
 
 #define PROTO_HEADER_PRIO_CNT 5
 #define PROTO_HEADER_PRIORITY_MAX 4
@@ -45,6 +64,26 @@ struct proto_block {
     uint8_t data[];
 };
 
+/*
+ compact block schematic (cfg_hdr == PROTO_HEADER_CFG_COMPACT), type and len
+ are prefix varints whose first byte tells the size:
+ +------------+----------------+-----------------+
+ | varint type|   varint len   |     data...     |
+ +------------+----------------+-----------------+
+ 0xxxxxxx                    -> 0 .. 0x7F
+ 10xxxxxx xxxxxxxx           -> 0 .. 0x3FFF
+ 11000000 xxxxxxxx xxxxxxxx  -> 0 .. 0xFFFF
+ a one byte flag costs 3 bytes instead of 5.
+*/
+#define PROTO_VARINT_SIZE_MAX 3
+
+/* Decoded view of one block, valid for either encoding. */
+struct proto_block_ref {
+    uint16_t type;
+    uint16_t len;
+    const uint8_t *data;
+};
+
 /*
  protocol header schematic:
  32 bits                                   16 bits                                  0 bits
@@ -57,6 +96,7 @@ struct proto_block {
  +-------8bits--------+-------8bits--------+-------8bits-------+--------8bits-------+
  |                   len                   |    check_sum(h)   |    check_sum(l)    |
  +-------8bits--------+-------8bits--------+-------8bits-------+--------8bits-------+
+ on the wire every field is big endian, see proto_header_encode()/proto_header_decode().
 */
 struct proto_header {
     uint8_t hop_limit;
@@ -72,14 +112,53 @@ struct proto_header {
     uint16_t checksum;
 };
 
+/* One frame found by proto_frame_decode_batch(), header already in host order. */
+struct proto_frame_desc {
+    struct proto_header header;
+    const uint8_t *frame;
+    uint16_t len;
+};
+
+/* Big endian accessors for wire data. */
+static inline uint16_t proto_get_be16(const uint8_t *p)
+{
+    return (uint16_t)(p[0] << 8 | p[1]);
+}
+
+static inline uint32_t proto_get_be32(const uint8_t *p)
+{
+    return (uint32_t)p[0] << 24 | (uint32_t)p[1] << 16 | (uint32_t)p[2] << 8 | p[3];
+}
+
+static inline void proto_put_be16(uint8_t *p, uint16_t val)
+{
+    p[0] = val >> 8;
+    p[1] = val & 0xFF;
+}
+
+static inline void proto_put_be32(uint8_t *p, uint32_t val)
+{
+    p[0] = val >> 24;
+    p[1] = (val >> 16) & 0xFF;
+    p[2] = (val >> 8) & 0xFF;
+    p[3] = val & 0xFF;
+}
+
 void proto_block_deinit(struct proto_block *block);
 struct proto_block *proto_block_init(uint16_t type, uint16_t size);
 int proto_block_set_type(struct proto_block *block, uint16_t type);
 int proto_block_reset_data(struct proto_block **block, uint8_t *data, uint16_t size);
+int proto_block_next(uint8_t cfg, const uint8_t *buf, uint32_t size, struct proto_block_ref *ref);
+int proto_block_put_compact(uint8_t *buf, uint32_t size, uint16_t type, const void *data, uint16_t len);
+int proto_blocks_compact_encode(const uint8_t *in, uint32_t in_len, uint8_t *out, uint32_t size);
+int proto_blocks_compact_decode(const uint8_t *in, uint32_t in_len, uint8_t *out, uint32_t size);
 
 int proto_header_dump(struct proto_header *header);
 void proto_header_deinit(struct proto_header *header);
 struct proto_header *proto_header_init(void);
+void proto_header_reset(struct proto_header *header);
+int proto_header_encode(const struct proto_header *header, uint8_t *buf, uint32_t size);
+int proto_header_decode(struct proto_header *header, const uint8_t *buf, uint32_t size);
 int proto_header_set_hop_limit(struct proto_header *header, uint8_t hop_limit);
 int proto_header_set_cfg(struct proto_header *header, uint8_t cfg);
 int proto_header_set_priority(struct proto_header *header, uint8_t priority);
@@ -88,5 +167,17 @@ int proto_header_set_src_id(struct proto_header *header, uint32_t src_id);
 int proto_header_set_dst_id(struct proto_header *header, uint32_t dst_id);
 int proto_header_set_len(struct proto_header *header, uint16_t len);
 int proto_header_set_checksum(struct proto_header *header, uint16_t checksum);
+int proto_header_dec_hop_limit(struct proto_header *header, uint8_t csum_type);
+
+uint16_t proto_header_calc_checksum(const struct proto_header *header, const void *payload, uint16_t payload_len,
+                                    uint8_t csum_type);
+uint16_t proto_frame_calc_checksum(const uint8_t *frame, uint16_t len, uint8_t csum_type);
+int proto_frame_set_checksum(uint8_t *frame, uint16_t len, uint8_t csum_type);
+int proto_frame_check_checksum(const uint8_t *frame, uint16_t len, uint8_t csum_type);
+int proto_frame_set_checksum_iov(const struct iovec *iov, int iov_cnt, uint8_t csum_type);
+uint16_t proto_frame_get_len(const uint8_t *frame);
+int proto_frame_decode_batch(const uint8_t *buf, uint32_t size, struct proto_frame_desc *desc,
+                             uint16_t desc_cnt, uint32_t *used);
+int proto_frame_validate_batch(const struct proto_frame_desc *desc, uint16_t cnt, uint64_t *mask);
 
 #endif /* __PROTO_H__ */
@@ -1,4 +1,4 @@
-#include <cstdint>
+#include <stdint.h>
 #include <stdlib.h>
 #include <stdio.h>
 
@@ -0,0 +1,205 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "errno.h"
+#include "buff.h"
+#include "sched.h"
+
+static inline uint8_t sched_top(uint32_t mask)
+{
+    return 31 - __builtin_clz(mask);
+}
+
+/* Next DRR level below cur, wrapping to the top, mask is not 0. */
+static inline uint8_t sched_next(uint32_t mask, uint8_t cur)
+{
+    uint32_t below = (cur == SCHED_LEVEL_NONE) ? 0 : mask & ((1U << cur) - 1);
+
+    return sched_top(below ? below : mask);
+}
+
+/* The queue looked empty, a producer racing the clear sets the bit again after its enqueue. */
+static void sched_idle(struct sched *sched, uint8_t level)
+{
+    __atomic_and_fetch(&sched->active, ~(1U << level), __ATOMIC_SEQ_CST);
+    if (msg_queue_get_count(sched->queue[level]) > 0) {
+        __atomic_or_fetch(&sched->active, 1U << level, __ATOMIC_SEQ_CST);
+        return;
+    }
+
+    sched->deficit[level] = 0;
+}
+
+static void sched_account(struct sched *sched, uint8_t level, struct msg_buff *msg_buff)
+{
+    sched->stats.tx_cnt[level]++;
+    sched->stats.tx_bytes[level] += ((struct data_src *)msg_buff->data)->header.len;
+    if (msg_queue_peek(sched->queue[level]) == NULL) {
+        sched_idle(sched, level);
+    }
+}
+
+void sched_deinit(struct sched *sched)
+{
+    if (sched == NULL) {
+        return;
+    }
+
+    free(sched);
+}
+
+/*
+ * queue[i] serves level i, the queues stay owned by the caller. A NULL cfg
+ * makes the top level strict and gives the rest SCHED_QUANTUM_DEFAULT.
+ */
+struct sched *sched_init(struct msg_queue **queue, uint8_t cnt, const struct sched_cfg *cfg)
+{
+    struct sched *sched;
+    uint8_t strict_cnt;
+
+    if (queue == NULL || cnt == 0 || cnt > SCHED_LEVEL_MAX) {
+        return NULL;
+    }
+
+    strict_cnt = (cfg != NULL) ? cfg->strict_cnt : 1;
+    if (strict_cnt > cnt) {
+        return NULL;
+    }
+
+    for (int i = 0; i < cnt; i++) {
+        if (queue[i] == NULL) {
+            return NULL;
+        }
+    }
+
+    sched = (struct sched *)malloc(sizeof(struct sched));
+    if (sched == NULL) {
+        return NULL;
+    }
+
+    memset(sched, 0, sizeof(struct sched));
+    sched->cnt = cnt;
+    sched->cur = SCHED_LEVEL_NONE;
+    for (int i = 0; i < cnt; i++) {
+        sched->queue[i] = queue[i];
+        sched->quantum[i] = (cfg != NULL && cfg->quantum[i] != 0) ? cfg->quantum[i] : SCHED_QUANTUM_DEFAULT;
+        if (i >= cnt - strict_cnt) {
+            sched->strict_mask |= 1U << i;
+        }
+        if (msg_queue_get_count(queue[i]) > 0) {
+            sched->active |= 1U << i;
+        }
+    }
+
+    return sched;
+}
+
+/* Queue msg_buff by its priority, the caller keeps it unless ERR_SUCCESS. */
+int sched_enqueue(struct sched *sched, struct msg_buff *msg_buff)
+{
+    uint8_t level;
+    int ret;
+
+    if (sched == NULL || msg_buff == NULL) {
+        return -ERR_INVALID_ARG;
+    }
+
+    level = msg_buff_select_queue(msg_buff, sched->cnt);
+    ret = msg_queue_enqueue(sched->queue[level], msg_buff);
+    if (ret != ERR_SUCCESS) {
+        return ret;
+    }
+
+    __atomic_or_fetch(&sched->active, 1U << level, __ATOMIC_SEQ_CST);
+
+    return ERR_SUCCESS;
+}
+
+/* For producers queueing on sched->queue[level] directly, call after the enqueue. */
+int sched_notify(struct sched *sched, uint8_t level)
+{
+    if (sched == NULL || level >= sched->cnt) {
+        return -ERR_INVALID_ARG;
+    }
+
+    __atomic_or_fetch(&sched->active, 1U << level, __ATOMIC_SEQ_CST);
+
+    return ERR_SUCCESS;
+}
+
+/* Consumer only, NULL when every level is empty. */
+struct msg_buff *sched_dequeue(struct sched *sched)
+{
+    struct msg_buff *msg_buff;
+    uint32_t active, mask;
+    uint16_t len;
+    uint8_t level;
+
+    if (sched == NULL) {
+        return NULL;
+    }
+
+    while ((active = __atomic_load_n(&sched->active, __ATOMIC_ACQUIRE)) != 0) {
+        mask = active & sched->strict_mask;
+        if (mask != 0) {
+            level = sched_top(mask);
+            msg_buff = msg_queue_dequeue(sched->queue[level]);
+            if (msg_buff == NULL) {
+                sched_idle(sched, level);
+                continue;
+            }
+            sched_account(sched, level, msg_buff);
+            return msg_buff;
+        }
+
+        /* a level that drained since its turn started gives the turn up */
+        mask = active & ~sched->strict_mask;
+        if (sched->cur == SCHED_LEVEL_NONE || (mask & (1U << sched->cur)) == 0) {
+            sched->cur = sched_next(mask, sched->cur);
+            sched->deficit[sched->cur] += sched->quantum[sched->cur];
+            sched->stats.rounds++;
+        }
+
+        level = sched->cur;
+        msg_buff = msg_queue_peek(sched->queue[level]);
+        if (msg_buff == NULL) {
+            sched_idle(sched, level);
+            continue;
+        }
+
+        len = ((struct data_src *)msg_buff->data)->header.len;
+        if (len > sched->deficit[level]) {
+            /* the credit carries over to the next round */
+            sched->cur = sched_next(mask, level);
+            sched->deficit[sched->cur] += sched->quantum[sched->cur];
+            sched->stats.rounds++;
+            continue;
+        }
+
+        /* an AQM may drop the peeked head and hand out the one behind it */
+        msg_buff = msg_queue_dequeue(sched->queue[level]);
+        if (msg_buff == NULL) {
+            sched_idle(sched, level);
+            continue;
+        }
+        len = ((struct data_src *)msg_buff->data)->header.len;
+        sched->deficit[level] = (len < sched->deficit[level]) ? sched->deficit[level] - len : 0;
+        sched_account(sched, level, msg_buff);
+        return msg_buff;
+    }
+
+    return NULL;
+}
+
+/* Bytes per round for a DRR level, takes effect from its next turn. */
+int sched_set_quantum(struct sched *sched, uint8_t level, uint32_t quantum)
+{
+    if (sched == NULL || level >= sched->cnt || quantum == 0) {
+        return -ERR_INVALID_ARG;
+    }
+
+    sched->quantum[level] = quantum;
+
+    return ERR_SUCCESS;
+}
@@ -0,0 +1,52 @@
+#ifndef __SCHED_H__
+#define __SCHED_H__
+
+#include <stdint.h>
+
+#include "errno.h"
+#include "buff.h"
+
+/*
+ priority scheduler over one msg_queue per level, level = queue index:
+   active  | 0 | 1 | 0 | 1 | 1 |   bit set while the level may hold messages
+   level     4   3   2   1   0
+           |strict |     DRR   |
+ the highest active strict level is served first, found with one clz.
+ Below the strict levels the active ones share the link by deficit round
+ robin, each gets quantum bytes per round so none of them starves.
+ Producers set bits, the single consumer clears them when a queue drains.
+*/
+#define SCHED_LEVEL_MAX 32
+#define SCHED_QUANTUM_DEFAULT 1024          // bytes per DRR round
+#define SCHED_LEVEL_NONE 0xFF
+
+struct sched_cfg {
+    uint8_t strict_cnt;                     // top levels served in strict priority
+    uint32_t quantum[SCHED_LEVEL_MAX];      // DRR levels, 0 for SCHED_QUANTUM_DEFAULT
+};
+
+struct sched_stats {
+    uint32_t tx_cnt[SCHED_LEVEL_MAX];
+    uint64_t tx_bytes[SCHED_LEVEL_MAX];
+    uint32_t rounds;                        // DRR turns handed out
+};
+
+struct sched {
+    uint32_t active;
+    uint32_t strict_mask;
+    uint8_t cnt;
+    uint8_t cur;                            // DRR level in service
+    uint32_t deficit[SCHED_LEVEL_MAX];
+    uint32_t quantum[SCHED_LEVEL_MAX];
+    struct msg_queue *queue[SCHED_LEVEL_MAX];
+    struct sched_stats stats;
+};
+
+void sched_deinit(struct sched *sched);
+struct sched *sched_init(struct msg_queue **queue, uint8_t cnt, const struct sched_cfg *cfg);
+int sched_enqueue(struct sched *sched, struct msg_buff *msg_buff);
+int sched_notify(struct sched *sched, uint8_t level);
+struct msg_buff *sched_dequeue(struct sched *sched);
+int sched_set_quantum(struct sched *sched, uint8_t level, uint32_t quantum);
+
+#endif // __SCHED_H__
@@ -0,0 +1,260 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "errno.h"
+#include "slab.h"
+
+static inline uint32_t slab_reg_hash(uintptr_t base)
+{
+    return (uint32_t)(((uint64_t)(base >> SLAB_CHUNK_SHIFT) * 0x9E3779B97F4A7C15ULL) >> (64 - SLAB_REG_BITS));
+}
+
+void slab_reg_deinit(struct slab_reg *reg)
+{
+    if (reg == NULL) {
+        return;
+    }
+
+    free(reg);
+}
+
+struct slab_reg *slab_reg_init(void)
+{
+    struct slab_reg *reg = (struct slab_reg *)malloc(sizeof(struct slab_reg));
+    if (reg == NULL) {
+        return NULL;
+    }
+
+    memset(reg, 0, sizeof(struct slab_reg));
+
+    return reg;
+}
+
+/* Caches sharing reg grow concurrently, slots are claimed with a CAS. */
+static int slab_reg_add(struct slab_reg *reg, uintptr_t base, uint16_t tag)
+{
+    uintptr_t empty;
+    uint32_t i;
+
+    if (__atomic_fetch_add(&reg->cnt, 1, __ATOMIC_RELAXED) >= SLAB_CHUNK_MAX) {
+        __atomic_fetch_sub(&reg->cnt, 1, __ATOMIC_RELAXED);
+        return -ERR_NO_MEM;
+    }
+
+    for (i = slab_reg_hash(base);; i = (i + 1) & (SLAB_REG_SIZE - 1)) {
+        empty = 0;
+        if (__atomic_compare_exchange_n(&reg->entry[i], &empty, base | tag, 0, __ATOMIC_RELEASE,
+                                        __ATOMIC_RELAXED)) {
+            return ERR_SUCCESS;
+        }
+    }
+}
+
+/* Tag of the cache owning the chunk ptr points into, -ERR_NOT_FOUND for other memory. */
+int slab_reg_lookup(const struct slab_reg *reg, const void *ptr)
+{
+    uintptr_t base = (uintptr_t)ptr & ~(uintptr_t)SLAB_TAG_MASK;
+    uintptr_t entry;
+    uint32_t i;
+
+    if (reg == NULL || ptr == NULL) {
+        return -ERR_NOT_FOUND;
+    }
+
+    for (i = slab_reg_hash(base);; i = (i + 1) & (SLAB_REG_SIZE - 1)) {
+        entry = __atomic_load_n(&reg->entry[i], __ATOMIC_ACQUIRE);
+        if (entry == 0) {
+            return -ERR_NOT_FOUND;
+        }
+        if ((entry & ~(uintptr_t)SLAB_TAG_MASK) == base) {
+            return entry & SLAB_TAG_MASK;
+        }
+    }
+}
+
+/* Carve a new chunk onto the free list, called with the lock held. */
+static int slab_grow(struct slab_cache *cache)
+{
+    uint8_t *chunk;
+    void *mem;
+
+    if (posix_memalign(&mem, SLAB_CHUNK_SIZE, SLAB_CHUNK_SIZE) != 0) {
+        return -ERR_NO_MEM;
+    }
+
+    if (slab_reg_add(cache->reg, (uintptr_t)mem, cache->tag) != ERR_SUCCESS) {
+        free(mem);
+        return -ERR_NO_MEM;
+    }
+
+    chunk = (uint8_t *)mem;
+    for (uint32_t i = cache->obj_per_chunk; i > 0; i--) {
+        void *obj = chunk + (i - 1) * cache->obj_size;
+
+        *(void **)obj = cache->free;
+        cache->free = obj;
+    }
+    cache->stats.chunks++;
+
+    return ERR_SUCCESS;
+}
+
+/*
+ * Frees every chunk of the cache, objects still in use go with them.
+ * Caches on a shared registry leave their entries behind, deinit them
+ * together and the registry last.
+ */
+void slab_cache_deinit(struct slab_cache *cache)
+{
+    uintptr_t entry;
+
+    if (cache == NULL) {
+        return;
+    }
+
+    for (int i = 0; i < SLAB_REG_SIZE; i++) {
+        entry = cache->reg->entry[i];
+        if (entry != 0 && (entry & SLAB_TAG_MASK) == cache->tag) {
+            free((void *)(entry & ~(uintptr_t)SLAB_TAG_MASK));
+        }
+    }
+
+    if (cache->reg_owned) {
+        slab_reg_deinit(cache->reg);
+    }
+
+    pthread_mutex_destroy(&cache->lock);
+    free(cache);
+}
+
+/* Chunks of the cache are registered in reg under tag, tags are unique per registry. */
+struct slab_cache *slab_cache_init_shared(uint32_t obj_size, struct slab_reg *reg, uint16_t tag)
+{
+    struct slab_cache *cache;
+
+    if (reg == NULL || obj_size < sizeof(void *) || obj_size > SLAB_CHUNK_SIZE) {
+        return NULL;
+    }
+
+    cache = (struct slab_cache *)malloc(sizeof(struct slab_cache));
+    if (cache == NULL) {
+        return NULL;
+    }
+
+    memset(cache, 0, sizeof(struct slab_cache));
+    if (pthread_mutex_init(&cache->lock, NULL) != 0) {
+        free(cache);
+        return NULL;
+    }
+
+    cache->obj_size = (obj_size + SLAB_OBJ_ALIGN - 1) & ~(SLAB_OBJ_ALIGN - 1);
+    cache->obj_per_chunk = SLAB_CHUNK_SIZE / cache->obj_size;
+    cache->tag = tag;
+    cache->reg = reg;
+
+    return cache;
+}
+
+struct slab_cache *slab_cache_init(uint32_t obj_size)
+{
+    struct slab_cache *cache;
+    struct slab_reg *reg;
+
+    reg = slab_reg_init();
+    if (reg == NULL) {
+        return NULL;
+    }
+
+    cache = slab_cache_init_shared(obj_size, reg, 0);
+    if (cache == NULL) {
+        slab_reg_deinit(reg);
+        return NULL;
+    }
+    cache->reg_owned = 1;
+
+    return cache;
+}
+
+/* Returns an uninitialised object, NULL once the cache can not grow. */
+void *slab_alloc(struct slab_cache *cache)
+{
+    void *obj;
+
+    return (slab_alloc_batch(cache, &obj, 1) == 1) ? obj : NULL;
+}
+
+void slab_free(struct slab_cache *cache, void *obj)
+{
+    if (obj == NULL) {
+        return;
+    }
+
+    slab_free_batch(cache, &obj, 1);
+}
+
+/* Take up to cnt objects under one lock, returns how many were taken. */
+int slab_alloc_batch(struct slab_cache *cache, void **obj, int cnt)
+{
+    int i;
+
+    if (cache == NULL || obj == NULL) {
+        return 0;
+    }
+
+    pthread_mutex_lock(&cache->lock);
+    for (i = 0; i < cnt; i++) {
+        if (cache->free == NULL && slab_grow(cache) != ERR_SUCCESS) {
+            cache->stats.fails++;
+            break;
+        }
+
+        obj[i] = cache->free;
+        cache->free = *(void **)obj[i];
+    }
+    cache->stats.in_use += i;
+    cache->stats.allocs += i;
+    pthread_mutex_unlock(&cache->lock);
+
+    return i;
+}
+
+void slab_free_batch(struct slab_cache *cache, void **obj, int cnt)
+{
+    if (cache == NULL || obj == NULL || cnt <= 0) {
+        return;
+    }
+
+    pthread_mutex_lock(&cache->lock);
+    for (int i = 0; i < cnt; i++) {
+        *(void **)obj[i] = cache->free;
+        cache->free = obj[i];
+    }
+    cache->stats.in_use -= cnt;
+    cache->stats.frees += cnt;
+    pthread_mutex_unlock(&cache->lock);
+}
+
+/* 1 if ptr points anywhere inside a chunk of cache. */
+int slab_owns(const struct slab_cache *cache, const void *ptr)
+{
+    if (cache == NULL) {
+        return 0;
+    }
+
+    return slab_reg_lookup(cache->reg, ptr) == cache->tag;
+}
+
+int slab_get_stats(struct slab_cache *cache, struct slab_stats *stats)
+{
+    if (cache == NULL || stats == NULL) {
+        return -ERR_INVALID_ARG;
+    }
+
+    pthread_mutex_lock(&cache->lock);
+    *stats = cache->stats;
+    pthread_mutex_unlock(&cache->lock);
+
+    return ERR_SUCCESS;
+}
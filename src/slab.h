@@ -0,0 +1,66 @@
+#ifndef __SLAB_H__
+#define __SLAB_H__
+
+#include <stdint.h>
+#include <pthread.h>
+
+#include "errno.h"
+
+/*
+ fixed size object cache, chunks are aligned to their size:
+ +----------------------SLAB_CHUNK_SIZE, aligned-----------------------+
+ |  obj 0  |  obj 1  |  obj 2  |  ...                    |  obj n - 1  |
+ +---------------------------------------------------------------------+
+ free objects are linked through their first word. Chunk bases are kept
+ in an open addressed registry that is only ever added to, so a lookup
+ can tell cache memory from heap memory without a lock. Several caches
+ may share one registry, each entry carries the tag of its cache in the
+ low bits of the chunk base.
+*/
+#define SLAB_CHUNK_SHIFT 16
+#define SLAB_CHUNK_SIZE (1 << SLAB_CHUNK_SHIFT)
+#define SLAB_CHUNK_MAX 4096                 // 256 MiB per registry
+#define SLAB_REG_BITS 13
+#define SLAB_REG_SIZE (1 << SLAB_REG_BITS)  // twice SLAB_CHUNK_MAX, probes stay short
+#define SLAB_TAG_MASK (SLAB_CHUNK_SIZE - 1)
+#define SLAB_OBJ_ALIGN 16
+
+struct slab_reg {
+    uint32_t cnt;
+    uintptr_t entry[SLAB_REG_SIZE];
+};
+
+struct slab_stats {
+    uint32_t chunks;
+    uint32_t in_use;                // objects out of the cache
+    uint64_t allocs;
+    uint64_t frees;
+    uint32_t fails;                 // chunk limit reached or no memory
+};
+
+struct slab_cache {
+    pthread_mutex_t lock;
+    uint32_t obj_size;
+    uint32_t obj_per_chunk;
+    uint16_t tag;
+    uint8_t reg_owned;
+    void *free;
+    struct slab_reg *reg;
+    struct slab_stats stats;
+};
+
+void slab_reg_deinit(struct slab_reg *reg);
+struct slab_reg *slab_reg_init(void);
+int slab_reg_lookup(const struct slab_reg *reg, const void *ptr);
+
+void slab_cache_deinit(struct slab_cache *cache);
+struct slab_cache *slab_cache_init(uint32_t obj_size);
+struct slab_cache *slab_cache_init_shared(uint32_t obj_size, struct slab_reg *reg, uint16_t tag);
+void *slab_alloc(struct slab_cache *cache);
+void slab_free(struct slab_cache *cache, void *obj);
+int slab_alloc_batch(struct slab_cache *cache, void **obj, int cnt);
+void slab_free_batch(struct slab_cache *cache, void **obj, int cnt);
+int slab_owns(const struct slab_cache *cache, const void *ptr);
+int slab_get_stats(struct slab_cache *cache, struct slab_stats *stats);
+
+#endif // __SLAB_H__
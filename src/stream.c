@@ -0,0 +1,322 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define STREAM_X86 1
+#endif
+
+#include "errno.h"
+#include "proto.h"
+#include "stream.h"
+
+typedef int (*stream_scan_fn)(const uint8_t *buf, uint32_t size, uint16_t max_len);
+
+static int stream_scan_scalar(const uint8_t *buf, uint32_t size, uint16_t max_len);
+
+static stream_scan_fn stream_scan_kern = stream_scan_scalar;
+static pthread_once_t stream_once = PTHREAD_ONCE_INIT;
+
+/* Cheap plausibility test of a wire header, the checksum decides later. */
+static inline int stream_header_ok(const uint8_t *h, uint16_t max_len)
+{
+    uint16_t len = proto_get_be16(h + PROTO_WIRE_OFF_LEN);
+
+    return h[PROTO_WIRE_OFF_HOP_LIMIT] <= PROTO_HEADER_HOP_LIMIT_MAX
+           && (h[PROTO_WIRE_OFF_FLAGS] & PROTO_HEADER_PRIORITY_MASK) <= PROTO_HEADER_PRIORITY_MAX
+           && ((h[PROTO_WIRE_OFF_FLAGS] & PROTO_HEADER_CFG_MASK) >> PROTO_HEADER_CFG_SHIFT) <= PROTO_HEADER_CFG_COMPACT
+           && len >= PROTO_HEADER_WIRE_SIZE && len <= max_len;
+}
+
+static int stream_scan_scalar(const uint8_t *buf, uint32_t size, uint16_t max_len)
+{
+    for (uint32_t i = 0; i + PROTO_HEADER_WIRE_SIZE <= size; i++) {
+        if (stream_header_ok(buf + i, max_len)) {
+            return i;
+        }
+    }
+
+    return -ERR_NOT_FOUND;
+}
+
+#ifdef STREAM_X86
+/*
+ * 32 candidate offsets per step: the hop_limit, flags and len bytes of every
+ * offset are loaded as four shifted vectors and tested together. Offsets
+ * that pass the filter are confirmed with the scalar test.
+ */
+__attribute__((target("avx2")))
+static int stream_scan_avx2(const uint8_t *buf, uint32_t size, uint16_t max_len)
+{
+    const __m256i hop_max = _mm256_set1_epi8(PROTO_HEADER_HOP_LIMIT_MAX);
+    const __m256i prio_mask = _mm256_set1_epi8(PROTO_HEADER_PRIORITY_MASK);
+    const __m256i prio_max = _mm256_set1_epi8(PROTO_HEADER_PRIORITY_MAX);
+    const __m256i cfg_mask = _mm256_set1_epi8(PROTO_HEADER_CFG_MASK);
+    const __m256i cfg_max = _mm256_set1_epi8(PROTO_HEADER_CFG_COMPACT << PROTO_HEADER_CFG_SHIFT);
+    const __m256i len_min = _mm256_set1_epi8(PROTO_HEADER_WIRE_SIZE);
+    const __m256i zero = _mm256_setzero_si256();
+    __m256i hop, flags, len_h, len_l, v, ok;
+    uint32_t bits, i;
+    int b;
+
+    for (i = 0; i + 32 + PROTO_HEADER_WIRE_SIZE <= size; i += 32) {
+        hop = _mm256_loadu_si256((const __m256i *)(buf + i + PROTO_WIRE_OFF_HOP_LIMIT));
+        flags = _mm256_loadu_si256((const __m256i *)(buf + i + PROTO_WIRE_OFF_FLAGS));
+        len_h = _mm256_loadu_si256((const __m256i *)(buf + i + PROTO_WIRE_OFF_LEN));
+        len_l = _mm256_loadu_si256((const __m256i *)(buf + i + PROTO_WIRE_OFF_LEN + 1));
+
+        ok = _mm256_cmpeq_epi8(_mm256_min_epu8(hop, hop_max), hop);
+        v = _mm256_and_si256(flags, prio_mask);
+        ok = _mm256_and_si256(ok, _mm256_cmpeq_epi8(_mm256_min_epu8(v, prio_max), v));
+        v = _mm256_and_si256(flags, cfg_mask);
+        ok = _mm256_and_si256(ok, _mm256_cmpeq_epi8(_mm256_min_epu8(v, cfg_max), v));
+        /* len >= 16: high byte set or low byte >= 16 */
+        v = _mm256_or_si256(_mm256_xor_si256(_mm256_cmpeq_epi8(len_h, zero), _mm256_set1_epi8(-1)),
+                            _mm256_cmpeq_epi8(_mm256_max_epu8(len_l, len_min), len_l));
+        ok = _mm256_and_si256(ok, v);
+
+        bits = (uint32_t)_mm256_movemask_epi8(ok);
+        while (bits) {
+            b = __builtin_ctz(bits);
+            if (stream_header_ok(buf + i + b, max_len)) {
+                return i + b;
+            }
+            bits &= bits - 1;
+        }
+    }
+
+    b = stream_scan_scalar(buf + i, size - i, max_len);
+
+    return (b < 0) ? b : (int)(i + b);
+}
+#endif
+
+static void stream_setup(void)
+{
+#ifdef STREAM_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        stream_scan_kern = stream_scan_avx2;
+    }
+#endif
+}
+
+/* Offset of the first plausible header in buf, -ERR_NOT_FOUND if none. */
+int stream_find_header(const uint8_t *buf, uint32_t size, uint16_t max_len)
+{
+    if (buf == NULL) {
+        return -ERR_INVALID_ARG;
+    }
+
+    pthread_once(&stream_once, stream_setup);
+
+    return stream_scan_kern(buf, size, max_len);
+}
+
+void stream_dec_deinit(struct stream_dec *dec)
+{
+    if (dec == NULL) {
+        return;
+    }
+
+    free(dec->buf);
+    free(dec);
+}
+
+/* max_len bounds the frames accepted on the link, 0 for PROTO_HEADER_LEN_MAX. */
+struct stream_dec *stream_dec_init(uint16_t max_len, uint8_t csum_type, stream_emit_fn emit, void *arg)
+{
+    struct stream_dec *dec;
+
+    if (emit == NULL || (max_len && max_len < PROTO_HEADER_WIRE_SIZE)) {
+        return NULL;
+    }
+
+    dec = (struct stream_dec *)malloc(sizeof(struct stream_dec));
+    if (dec == NULL) {
+        return NULL;
+    }
+
+    memset(dec, 0, sizeof(struct stream_dec));
+    dec->max_len = max_len ? max_len : PROTO_HEADER_LEN_MAX;
+    dec->buf = (uint8_t *)malloc(dec->max_len);
+    if (dec->buf == NULL) {
+        free(dec);
+        return NULL;
+    }
+
+    dec->csum_type = csum_type;
+    dec->emit = emit;
+    dec->arg = arg;
+
+    return dec;
+}
+
+void stream_dec_reset(struct stream_dec *dec)
+{
+    if (dec == NULL) {
+        return;
+    }
+
+    dec->fill = 0;
+    dec->synced = 0;
+}
+
+static int stream_frame_accept(struct stream_dec *dec, const uint8_t *frame, uint16_t len)
+{
+    struct proto_frame_desc desc;
+    uint64_t mask;
+
+    if (proto_frame_check_checksum(frame, len, dec->csum_type) != ERR_SUCCESS) {
+        return 0;
+    }
+
+    proto_header_decode(&desc.header, frame, len);
+    desc.frame = frame;
+    desc.len = len;
+
+    return proto_frame_validate_batch(&desc, 1, &mask) == 1;
+}
+
+static void stream_lost_sync(struct stream_dec *dec)
+{
+    if (dec->synced) {
+        dec->stats.resyncs++;
+        dec->synced = 0;
+    }
+}
+
+static void stream_buf_consume(struct stream_dec *dec, uint32_t len)
+{
+    memmove(dec->buf, dec->buf + len, dec->fill - len);
+    dec->fill -= len;
+}
+
+static void stream_buf_append(struct stream_dec *dec, const uint8_t *p, uint32_t len)
+{
+    memcpy(dec->buf + dec->fill, p, len);
+    dec->fill += len;
+    dec->stats.copied += len;
+}
+
+/* Skip to the next candidate inside buf, keeping a possible partial header. */
+static void stream_buf_resync(struct stream_dec *dec)
+{
+    uint32_t skip;
+    int k;
+
+    stream_lost_sync(dec);
+
+    k = stream_find_header(dec->buf + 1, dec->fill - 1, dec->max_len);
+    if (k >= 0) {
+        skip = k + 1;
+    } else {
+        skip = (dec->fill > PROTO_HEADER_WIRE_SIZE - 1) ? dec->fill - (PROTO_HEADER_WIRE_SIZE - 1) : 1;
+    }
+
+    dec->stats.dropped += skip;
+    stream_buf_consume(dec, skip);
+}
+
+/*
+ * Feed one chunk, emit() runs for every frame completed by it. Returns the
+ * number of frames emitted.
+ */
+int stream_dec_feed(struct stream_dec *dec, const uint8_t *chunk, uint32_t len)
+{
+    const uint8_t *p = chunk;
+    uint32_t n = len;
+    uint16_t flen;
+    uint32_t t;
+    int cnt = 0;
+    int k;
+
+    if (dec == NULL || (chunk == NULL && len)) {
+        return -ERR_INVALID_ARG;
+    }
+
+    /* finish the frame held in buf first */
+    while (dec->fill > 0) {
+        if (dec->fill < PROTO_HEADER_WIRE_SIZE) {
+            t = PROTO_HEADER_WIRE_SIZE - dec->fill;
+            t = (t < n) ? t : n;
+            stream_buf_append(dec, p, t);
+            p += t;
+            n -= t;
+            if (dec->fill < PROTO_HEADER_WIRE_SIZE) {
+                return cnt;
+            }
+        }
+
+        if (!stream_header_ok(dec->buf, dec->max_len)) {
+            stream_buf_resync(dec);
+            continue;
+        }
+
+        flen = proto_get_be16(dec->buf + PROTO_WIRE_OFF_LEN);
+        if (dec->fill < flen) {
+            t = flen - dec->fill;
+            t = (t < n) ? t : n;
+            stream_buf_append(dec, p, t);
+            p += t;
+            n -= t;
+            if (dec->fill < flen) {
+                return cnt;
+            }
+        }
+
+        if (stream_frame_accept(dec, dec->buf, flen)) {
+            dec->emit(dec->buf, flen, dec->arg);
+            dec->stats.frames++;
+            dec->synced = 1;
+            cnt++;
+            stream_buf_consume(dec, flen);
+        } else {
+            dec->stats.csum_errors++;
+            stream_buf_resync(dec);
+        }
+    }
+
+    /* frames wholly inside the chunk go out without a copy */
+    while (n >= PROTO_HEADER_WIRE_SIZE) {
+        k = stream_find_header(p, n, dec->max_len);
+        if (k < 0) {
+            k = n - (PROTO_HEADER_WIRE_SIZE - 1);
+        }
+        if (k > 0) {
+            stream_lost_sync(dec);
+            dec->stats.dropped += k;
+            p += k;
+            n -= k;
+            continue;
+        }
+
+        flen = proto_get_be16(p + PROTO_WIRE_OFF_LEN);
+        if (flen > n) {
+            break;
+        }
+
+        if (stream_frame_accept(dec, p, flen)) {
+            dec->emit(p, flen, dec->arg);
+            dec->stats.frames++;
+            dec->synced = 1;
+            cnt++;
+            p += flen;
+            n -= flen;
+        } else {
+            dec->stats.csum_errors++;
+            stream_lost_sync(dec);
+            dec->stats.dropped++;
+            p++;
+            n--;
+        }
+    }
+
+    if (n > 0) {
+        stream_buf_append(dec, p, n);
+    }
+
+    return cnt;
+}
@@ -0,0 +1,45 @@
+#ifndef __STREAM_H__
+#define __STREAM_H__
+
+#include <stdint.h>
+
+#include "errno.h"
+#include "proto.h"
+
+/*
+ * Frame decoder for byte-stream links (UART, SPI, USB-CDC). Chunks of any
+ * size go in, whole checksum-verified wire frames come out through emit().
+ * A frame that lies inside one chunk is handed out in place, the others are
+ * copied once into the decoder buffer. After corruption the decoder hunts
+ * for the next plausible header and only accepts it once the checksum of
+ * the whole frame matches.
+ */
+typedef int (*stream_emit_fn)(const uint8_t *frame, uint16_t len, void *arg);
+
+struct stream_stats {
+    uint32_t frames;
+    uint32_t resyncs;           // times the decoder lost sync
+    uint32_t csum_errors;       // candidates rejected by checksum or block layout
+    uint32_t dropped;           // bytes skipped while hunting
+    uint32_t copied;            // bytes that went through buf
+};
+
+struct stream_dec {
+    uint8_t *buf;               // partial frame, always starts at a header candidate
+    uint32_t fill;
+    uint16_t max_len;
+    uint8_t csum_type;
+    uint8_t synced;
+
+    stream_emit_fn emit;
+    void *arg;
+    struct stream_stats stats;
+};
+
+void stream_dec_deinit(struct stream_dec *dec);
+struct stream_dec *stream_dec_init(uint16_t max_len, uint8_t csum_type, stream_emit_fn emit, void *arg);
+void stream_dec_reset(struct stream_dec *dec);
+int stream_dec_feed(struct stream_dec *dec, const uint8_t *chunk, uint32_t len);
+int stream_find_header(const uint8_t *buf, uint32_t size, uint16_t max_len);
+
+#endif // __STREAM_H__
@@ -0,0 +1,87 @@
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+
+#include "errno.h"
+#include "tstamp.h"
+
+static __thread uint64_t tstamp_cache;
+
+uint64_t tstamp_now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/* Once per poll batch, the messages of the batch share the reading. */
+uint64_t tstamp_refresh(void)
+{
+    tstamp_cache = tstamp_now_ns();
+
+    return tstamp_cache;
+}
+
+/* End of the batch, tstamp_cached_ns() reads the clock again until the next refresh. */
+void tstamp_invalidate(void)
+{
+    tstamp_cache = 0;
+}
+
+uint64_t tstamp_cached_ns(void)
+{
+    if (tstamp_cache == 0) {
+        return tstamp_now_ns();
+    }
+
+    return tstamp_cache;
+}
+
+void tstamp_sojourn_reset(struct tstamp_sojourn *sojourn)
+{
+    if (sojourn == NULL) {
+        return;
+    }
+
+    memset(sojourn, 0, sizeof(struct tstamp_sojourn));
+}
+
+void tstamp_sojourn_record(struct tstamp_sojourn *sojourn, uint64_t ns)
+{
+    int b;
+
+    b = (ns < 2) ? 0 : 63 - __builtin_clzll(ns);
+    if (b >= TSTAMP_HIST_CNT) {
+        b = TSTAMP_HIST_CNT - 1;
+    }
+
+    sojourn->cnt++;
+    sojourn->sum_ns += ns;
+    sojourn->last_ns = ns;
+    if (ns > sojourn->max_ns) {
+        sojourn->max_ns = ns;
+    }
+    sojourn->hist[b]++;
+}
+
+/* Upper bound of the bucket holding the pct-th percentile, 0 with nothing recorded. */
+uint64_t tstamp_sojourn_percentile(const struct tstamp_sojourn *sojourn, uint32_t pct)
+{
+    uint64_t want, seen = 0;
+
+    if (sojourn == NULL || sojourn->cnt == 0 || pct > 100) {
+        return 0;
+    }
+
+    want = (sojourn->cnt * pct + 99) / 100;
+    for (int b = 0; b < TSTAMP_HIST_CNT - 1; b++) {
+        seen += sojourn->hist[b];
+        if (seen >= want && seen != 0) {
+            return 2ULL << b;
+        }
+    }
+
+    return sojourn->max_ns;
+}
@@ -0,0 +1,44 @@
+#ifndef __TSTAMP_H__
+#define __TSTAMP_H__
+
+#include <stdint.h>
+
+#include "errno.h"
+
+/*
+ monotonic nanosecond clock with a per thread cache:
+   poll loop                          per message
+   tstamp_refresh()  --- once --->    tstamp_cached_ns()  x budget
+   tstamp_invalidate()  at the end of the batch
+ the reading is frozen from refresh to invalidate, time spent in the batch
+ is not seen. Outside a batch, or in a thread that never refreshes, every
+ call reads the clock, so CoDel and EDF deadlines never run on a stale now.
+ CLOCK_MONOTONIC is served by the vDSO, no system call either way.
+*/
+uint64_t tstamp_now_ns(void);
+uint64_t tstamp_refresh(void);
+void tstamp_invalidate(void);
+uint64_t tstamp_cached_ns(void);
+
+/*
+ sojourn time histogram, power of two buckets:
+ +---------+---------+---------+-----+------------------------------+
+ | < 2 ns  | < 4 ns  | < 8 ns  | ... | >= 2^(TSTAMP_HIST_CNT-1) ns  |
+ +---------+---------+---------+-----+------------------------------+
+ percentiles come back as the upper bound of their bucket.
+*/
+#define TSTAMP_HIST_CNT 36                  // last bucket from ~34 s up
+
+struct tstamp_sojourn {
+    uint64_t cnt;
+    uint64_t sum_ns;
+    uint64_t max_ns;
+    uint64_t last_ns;
+    uint32_t hist[TSTAMP_HIST_CNT];
+};
+
+void tstamp_sojourn_reset(struct tstamp_sojourn *sojourn);
+void tstamp_sojourn_record(struct tstamp_sojourn *sojourn, uint64_t ns);
+uint64_t tstamp_sojourn_percentile(const struct tstamp_sojourn *sojourn, uint32_t pct);
+
+#endif // __TSTAMP_H__
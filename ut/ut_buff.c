@@ -1,10 +1,16 @@
 #include <stdint.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #include <time.h>
+#include <pthread.h>
+#include <sched.h>
 
 #include "../src/proto.h"
 #include "../src/errno.h"
 #include "../src/buff.h"
+#include "../src/csum.h"
+#include "../src/tstamp.h"
 
 #include "ut_common.h"
 
@@ -368,6 +374,11 @@ int msg_queue_case(void)
         return -6;
     }
 
+    if (ut_common_compile_uint32(msg_queue_get_data_size(queue), data->header.len)) {
+        printf("msg_queue_enqueue size failed\n");
+        return -6;
+    }
+
     buff2 = msg_queue_peek(queue);
     if (ut_common_compile_uint32(buff2->id, 1)) {
         printf("msg_queue_peek id failed\n");
@@ -396,7 +407,7 @@ int msg_queue_case(void)
         return -7;
     }
 
-    if (ut_common_compile_uint32(msg_queue_get_data_size(queue), data->header.len)) {
+    if (ut_common_compile_uint32(msg_queue_get_data_size(queue), 0)) {
         printf("msg_queue_get_data_size size failed\n");
         return -7;
     }
@@ -428,24 +439,1382 @@ int msg_queue_case(void)
     return 0;
 }
 
-int main(void) {
+int msg_blk_index_case(void)
+{
+    struct msg_buff *buff;
+    struct data_src *data;
+    struct proto_block *block;
     int ret;
-    ret = msg_data_src_case();
-    if (ret != 0) {
-        printf("buff_data_src_case failed\n");
+
+    data = msg_data_src_init(256 + sizeof(struct proto_header), NULL);
+    if (data == NULL) {
         return -1;
     }
 
-    ret = msg_buff_case();
-    if (ret != 0) {
-        printf("buff_msg_buff_case failed\n");
-        return -2; 
+    for (uint16_t i = 0; i < 20; i++) {
+        block = proto_block_init(i % 4 + 1, 1 + i % 3);
+        if (block == NULL) {
+            return -1;
+        }
+        memset(block->data, i, block->len);
+        ret = msg_data_src_fill(data, block);
+        proto_block_deinit(block);
+        if (ut_common_compile_ret(ret, ERR_SUCCESS)) {
+            printf("msg_data_src_fill ERR_SUCCESS failed\n");
+            return -1;
+        }
     }
 
-    ret = msg_queue_case();
-    if (ret != 0) {
-        printf("buff_msg_queue_case failed\n");
-        return -3; 
+    buff = msg_buff_init();
+    if (buff == NULL) {
+        return -1;
+    }
+    msg_buff_bind_data(buff, data, 0);
+
+    /* msg_buff_build_blk_index start */
+    ret = msg_buff_build_blk_index(buff);
+    if (ut_common_compile_ret(ret, 20)) {
+        printf("msg_buff_build_blk_index cnt failed\n");
+        return -2;
+    }
+
+    if (ut_common_compile_uint8(buff->blk_cnt, 20)) {
+        printf("msg_buff_build_blk_index blk_cnt failed\n");
+        return -2;
+    }
+
+    if (ut_common_compile_ret(msg_buff_get_blk_cnt(buff), msg_data_src_get_blk_cnt(data))) {
+        printf("msg_buff_get_blk_cnt failed\n");
+        return -2;
+    }
+    /* msg_buff_build_blk_index end */
+
+    /* msg_buff_get_blk start */
+    block = msg_buff_get_blk(buff, 13);
+    if (block == NULL || ut_common_compile_uint16(block->type, 2)
+        || ut_common_compile_uint16(block->len, 2) || ut_common_compile_uint8(block->data[0], 13)) {
+        printf("msg_buff_get_blk val failed\n");
+        return -3;
+    }
+
+    if (msg_buff_get_blk(buff, 20) != NULL) {
+        printf("msg_buff_get_blk out of range failed\n");
+        return -3;
+    }
+    /* msg_buff_get_blk end */
+
+    /* msg_buff_find_blk start */
+    block = msg_buff_find_blk(buff, 3);
+    if (block == NULL || ut_common_compile_uint8(block->data[0], 2)) {
+        printf("msg_buff_find_blk val failed\n");
+        return -4;
+    }
+
+    if (ut_common_compile_ret(msg_buff_find_blk_idx(buff, 3, 3), 6)) {
+        printf("msg_buff_find_blk_idx start failed\n");
+        return -4;
+    }
+
+    if (ut_common_compile_ret(msg_buff_find_blk_idx(buff, 9, 0), -ERR_NOT_FOUND)) {
+        printf("msg_buff_find_blk_idx -ERR_NOT_FOUND failed\n");
+        return -4;
+    }
+    /* msg_buff_find_blk end */
+
+    msg_buff_deinit(buff);
+
+    return 0;
+}
+
+int msg_builder_case(void)
+{
+    struct msg_builder bld;
+    struct msg_buff *buff;
+    struct data_src *data;
+    struct proto_block *block;
+    uint8_t stack_buf[32];
+    uint8_t *p;
+    int ret;
+
+    /* msg_builder_init start */
+    ret = msg_builder_init(&bld, 32);
+    if (ut_common_compile_ret(ret, ERR_SUCCESS)) {
+        printf("msg_builder_init ERR_SUCCESS failed\n");
+        return -1;
+    }
+    proto_header_set_priority(msg_builder_get_header(&bld), PROTO_PRIO_LEVEL2);
+    /* msg_builder_init end */
+
+    /* msg_builder_reserve/commit start */
+    p = msg_builder_reserve(&bld, 7, 64);
+    if (p == NULL) {
+        printf("msg_builder_reserve grow failed\n");
+        return -2;
+    }
+
+    if (msg_builder_reserve(&bld, 8, 1) != NULL) {
+        printf("msg_builder_reserve pending failed\n");
+        return -2;
+    }
+
+    memcpy(p, "sensor", 6);
+    ret = msg_builder_commit(&bld, 6);
+    if (ut_common_compile_ret(ret, ERR_SUCCESS)) {
+        printf("msg_builder_commit ERR_SUCCESS failed\n");
+        return -2;
+    }
+
+    ret = msg_builder_append(&bld, 8, "\x01", 1);
+    if (ut_common_compile_ret(ret, ERR_SUCCESS)) {
+        printf("msg_builder_append ERR_SUCCESS failed\n");
+        return -2;
+    }
+    /* msg_builder_reserve/commit end */
+
+    /* msg_builder_finalize start */
+    data = msg_builder_finalize(&bld);
+    if (data == NULL) {
+        printf("msg_builder_finalize failed\n");
+        return -3;
+    }
+
+    if (ut_common_compile_uint16(data->header.len, sizeof(struct data_src) + 2 * sizeof(struct proto_block) + 7)
+        || ut_common_compile_uint8(data->header.priority, PROTO_PRIO_LEVEL2)) {
+        printf("msg_builder_finalize header failed\n");
+        return -3;
+    }
+
+    buff = msg_buff_init();
+    if (buff == NULL) {
+        return -3;
+    }
+    msg_buff_bind_data(buff, data, bld.blk_cnt);
+
+    if (ut_common_compile_ret(msg_buff_get_blk_cnt(buff), 2)) {
+        printf("msg_builder_finalize blk_cnt failed\n");
+        return -3;
+    }
+
+    block = msg_buff_get_blk(buff, 1);
+    if (block == NULL || ut_common_compile_uint16(block->type, 8) || ut_common_compile_uint8(block->data[0], 1)) {
+        printf("msg_builder_finalize block failed\n");
+        return -3;
+    }
+    msg_buff_deinit(buff);
+    /* msg_builder_finalize end */
+
+    /* msg_builder_attach start */
+    ret = msg_builder_attach(&bld, stack_buf, sizeof(stack_buf));
+    if (ut_common_compile_ret(ret, ERR_SUCCESS)) {
+        printf("msg_builder_attach ERR_SUCCESS failed\n");
+        return -4;
+    }
+
+    ret = msg_builder_append(&bld, 1, "abcdefghijklmnop", 16);
+    if (ut_common_compile_ret(ret, -ERR_NO_MEM)) {
+        printf("msg_builder_attach -ERR_NO_MEM failed\n");
+        return -4;
+    }
+
+    ret = msg_builder_append(&bld, 1, "abcdefghijkl", 12);
+    if (ut_common_compile_ret(ret, ERR_SUCCESS)) {
+        printf("msg_builder_attach ERR_SUCCESS failed\n");
+        return -4;
+    }
+
+    if ((void *)msg_builder_finalize(&bld) != (void *)stack_buf) {
+        printf("msg_builder_attach finalize failed\n");
+        return -4;
+    }
+    /* msg_builder_attach end */
+
+    return 0;
+}
+
+static int msg_sg_release_cnt;
+
+static void msg_sg_release(const void *base)
+{
+    msg_sg_release_cnt++;
+}
+
+int msg_sg_case(void)
+{
+    struct iovec iov[MSG_SG_SEG_MAX + 1];
+    uint8_t hdr[PROTO_HEADER_WIRE_SIZE];
+    struct proto_block *block;
+    struct proto_block *block2;
+    struct msg_buff *buff;
+    struct data_src *data;
+    struct msg_sg *sg;
+    int ret;
+
+    sg = msg_sg_init();
+    if (sg == NULL) {
+        return -1;
+    }
+
+    block = proto_block_init(3, 100);
+    block2 = proto_block_init(4, 96);
+    if (block == NULL || block2 == NULL) {
+        return -1;
+    }
+    memset(block->data, 0x33, 100);
+    memset(block2->data, 0x44, 96);
+
+    /* msg_sg_add_seg start */
+    ret = msg_sg_add_blk(sg, block);
+    if (ut_common_compile_ret(ret, ERR_SUCCESS)) {
+        printf("msg_sg_add_blk ERR_SUCCESS failed\n");
+        return -2;
+    }
+
+    ret = msg_sg_add_seg(sg, block2, sizeof(struct proto_block) + 96, msg_sg_release);
+    if (ut_common_compile_ret(ret, ERR_SUCCESS)) {
+        printf("msg_sg_add_seg ERR_SUCCESS failed\n");
+        return -2;
+    }
+
+    if (ut_common_compile_uint16(sg->header.len, sizeof(struct proto_header) + 2 * sizeof(struct proto_block) + 196)) {
+        printf("msg_sg_add_seg len failed\n");
+        return -2;
+    }
+    /* msg_sg_add_seg end */
+
+    /* msg_sg_fill_iovec start */
+    ret = msg_sg_fill_iovec(sg, hdr, iov, MSG_SG_SEG_MAX + 1);
+    if (ut_common_compile_ret(ret, 3)) {
+        printf("msg_sg_fill_iovec cnt failed\n");
+        return -3;
+    }
+
+    if (iov[2].iov_base != block2 || ut_common_compile_uint16(proto_frame_get_len(hdr), sg->header.len)) {
+        printf("msg_sg_fill_iovec val failed\n");
+        return -3;
+    }
+
+    proto_frame_set_checksum_iov(iov, ret, CSUM_TYPE_CRC16);
+    /* msg_sg_fill_iovec end */
+
+    /* msg_sg_flatten start */
+    data = msg_sg_flatten(sg);
+    if (data == NULL) {
+        printf("msg_sg_flatten failed\n");
+        return -4;
+    }
+
+    if (ut_common_compile_ret(msg_data_src_get_blk_cnt(data), 2) || ut_common_compile_uint8(data->blocks[0].data[99], 0x33)
+        || ut_common_compile_uint8(((uint8_t *)data)[data->header.len - 1], 0x44)) {
+        printf("msg_sg_flatten val failed\n");
+        return -4;
+    }
+
+    /* same bytes as the iovec frame, so the checksum must verify */
+    memcpy(data, hdr, PROTO_HEADER_WIRE_SIZE);
+    ret = proto_frame_check_checksum((uint8_t *)data, proto_frame_get_len(hdr), CSUM_TYPE_CRC16);
+    if (ut_common_compile_ret(ret, ERR_SUCCESS)) {
+        printf("proto_frame_set_checksum_iov failed\n");
+        return -4;
+    }
+    msg_data_src_deinit(data);
+    /* msg_sg_flatten end */
+
+    /* msg_buff_bind_sg start */
+    buff = msg_buff_init();
+    if (buff == NULL) {
+        return -5;
+    }
+
+    ret = msg_buff_bind_sg(buff, sg);
+    if (ut_common_compile_ret(ret, ERR_SUCCESS) || ut_common_compile_uint8(buff->flags, MSG_BUFF_F_SG | MSG_BUFF_F_SLAB)) {
+        printf("msg_buff_bind_sg ERR_SUCCESS failed\n");
+        return -5;
+    }
+
+    msg_buff_deinit(buff);
+    if (ut_common_compile_ret(msg_sg_release_cnt, 1)) {
+        printf("msg_sg_deinit release failed\n");
+        return -5;
+    }
+    /* msg_buff_bind_sg end */
+
+    proto_block_deinit(block);
+    proto_block_deinit(block2);
+
+    return 0;
+}
+
+int msg_compact_case(void)
+{
+    struct msg_buff *buff;
+    struct data_src *data;
+    struct proto_block *block;
+    struct proto_block_ref ref;
+    uint16_t std_len, len;
+    int ret;
+
+    data = msg_data_src_init(512 + sizeof(struct proto_header), NULL);
+    if (data == NULL) {
+        return -1;
+    }
+
+    for (uint16_t i = 0; i < 10; i++) {
+        block = proto_block_init(i * 0x1000 + 1, (i == 9) ? 200 : 1 + i % 3);
+        if (block == NULL) {
+            return -1;
+        }
+        memset(block->data, i, block->len);
+        msg_data_src_fill(data, block);
+        proto_block_deinit(block);
+    }
+    std_len = sizeof(struct data_src) + 10 * sizeof(struct proto_block) + 218;
+
+    /* msg_data_src_set_encoding start */
+    ret = msg_data_src_set_encoding(&data, PROTO_HEADER_CFG_COMPACT);
+    if (ut_common_compile_ret(ret, ERR_SUCCESS) || ut_common_compile_uint8(data->header.cfg_hdr, PROTO_HEADER_CFG_COMPACT)) {
+        printf("msg_data_src_set_encoding compact failed\n");
+        return -1;
+    }
+
+    /* types: 1 + 3 * 2 + 6 * 3 bytes, lens: 9 * 1 + 2 bytes, data: 218 bytes */
+    if (ut_common_compile_uint16(data->header.len, sizeof(struct data_src) + 25 + 11 + 218)) {
+        printf("msg_data_src_set_encoding len failed\n");
+        return -1;
+    }
+    /* msg_data_src_set_encoding end */
+
+    /* accessors on compact blocks start */
+    if (ut_common_compile_ret(msg_data_src_get_blk_cnt(data), 10)) {
+        printf("msg_data_src_get_blk_cnt compact failed\n");
+        return -2;
+    }
+
+    if (msg_data_blk_get_tail(data) != (struct proto_block *)((uint8_t *)data + data->header.len)) {
+        printf("msg_data_blk_get_tail compact failed\n");
+        return -2;
+    }
+
+    ret = msg_data_src_expand(&data, 4);
+    block = proto_block_init(0x7F, 2);
+    memset(block->data, 0xAA, 2);
+    ret |= msg_data_src_fill(data, block);
+    proto_block_deinit(block);
+    if (ut_common_compile_ret(ret, ERR_SUCCESS) || ut_common_compile_ret(msg_data_src_get_blk_cnt(data), 11)) {
+        printf("msg_data_src_fill compact failed\n");
+        return -2;
+    }
+    msg_data_dump(data);
+    /* accessors on compact blocks end */
+
+    /* the block index reads compact blocks in place start */
+    buff = msg_buff_init();
+    if (buff == NULL) {
+        return -3;
+    }
+    msg_buff_bind_data(buff, data, 0);
+    msg_buff_set_csum_type(buff, CSUM_TYPE_CRC16);
+    len = data->header.len;
+
+    if (ut_common_compile_ret(msg_buff_get_blk_cnt(buff), 11)
+        || ut_common_compile_ret(msg_buff_find_blk_idx(buff, 0x7F, 0), 10)) {
+        printf("msg_buff_get_blk_cnt compact failed\n");
+        return -3;
+    }
+
+    if (buff->data != data || ut_common_compile_uint8(data->header.cfg_hdr, PROTO_HEADER_CFG_COMPACT)
+        || ut_common_compile_uint16(data->header.len, len)
+        || ut_common_compile_uint8(msg_buff_get_csum_type(buff), CSUM_TYPE_CRC16)) {
+        printf("msg_buff_get_blk_cnt compact untouched failed\n");
+        return -3;
+    }
+
+    if (msg_buff_get_blk(buff, 9) != NULL
+        || ut_common_compile_ret(msg_buff_get_blk_ref(buff, 9, &ref), ERR_SUCCESS)
+        || ut_common_compile_uint16(ref.type, 0x9001)
+        || ut_common_compile_uint16(ref.len, 200) || ut_common_compile_uint8(ref.data[199], 9)) {
+        printf("msg_buff_get_blk_ref compact failed\n");
+        return -3;
+    }
+
+    if (ut_common_compile_ret(msg_buff_get_blk_ref(buff, 10, &ref), ERR_SUCCESS)
+        || ut_common_compile_uint16(ref.type, 0x7F) || ut_common_compile_uint8(ref.data[1], 0xAA)
+        || ut_common_compile_ret(msg_buff_get_blk_ref(buff, 11, &ref), -ERR_OUT_OF_RANGE)) {
+        printf("msg_buff_get_blk_ref appended failed\n");
+        return -3;
+    }
+    /* the block index reads compact blocks in place end */
+
+    /* converting explicitly start */
+    ret = msg_data_src_set_encoding(&data, PROTO_HEADER_CFG_STD);
+    msg_buff_reset_data(buff, data, 0);
+    block = msg_buff_get_blk(buff, 10);
+    if (ut_common_compile_ret(ret, ERR_SUCCESS) || ut_common_compile_uint16(data->header.len, std_len + 6)
+        || block == NULL || ut_common_compile_uint16(block->type, 0x7F) || ut_common_compile_uint8(block->data[1], 0xAA)
+        || ut_common_compile_uint8(msg_buff_get_csum_type(buff), CSUM_TYPE_AUTO)) {
+        printf("msg_data_src_set_encoding std failed\n");
+        return -3;
+    }
+    msg_buff_deinit(buff);
+    /* converting explicitly end */
+
+    return 0;
+}
+
+int msg_slab_case(void)
+{
+    struct slab_stats before, stats;
+    struct msg_buff *small, *large, *again;
+    struct data_src *data;
+    int ret;
+
+    msg_buff_get_slab_stats(&before);
+
+    /* msg_buff_alloc start */
+    small = msg_buff_alloc(64);
+    large = msg_buff_alloc(1024);
+    if (small == NULL || large == NULL || !(small->flags & MSG_BUFF_F_SLAB)
+        || small->data != (void *)(small + 1) || large->data == (void *)(large + 1)
+        || ut_common_compile_uint16(((struct data_src *)small->data)->header.len, 64)) {
+        printf("msg_buff_alloc failed\n");
+        return -1;
+    }
+
+    msg_buff_get_slab_stats(&stats);
+    if (ut_common_compile_uint32(stats.in_use, before.in_use + 2)) {
+        printf("msg_buff_get_slab_stats failed\n");
+        return -1;
+    }
+    /* msg_buff_alloc end */
+
+    /* inline data start: released with its msg_buff, grows onto the heap */
+    data = (struct data_src *)small->data;
+    msg_data_src_deinit(data);
+    ret = msg_data_src_expand(&data, MSG_BUFF_INLINE_MAX - 64);
+    if (ut_common_compile_ret(ret, ERR_SUCCESS) || data != small->data) {
+        printf("msg_data_src_expand inline failed\n");
+        return -2;
+    }
+
+    ret = msg_data_src_expand(&data, 1);
+    if (ut_common_compile_ret(ret, ERR_SUCCESS) || data == small->data
+        || ut_common_compile_uint16(data->header.len, MSG_BUFF_INLINE_MAX + 1)) {
+        printf("msg_data_src_expand heap failed\n");
+        return -2;
+    }
+    msg_buff_reset_data(small, data, 0);
+    /* inline data end */
+
+    /* slab reuse start */
+    msg_buff_deinit(small);
+    again = msg_buff_init();
+    if (again != small) {
+        printf("msg_buff_init reuse failed\n");
+        return -3;
+    }
+
+    msg_buff_deinit(again);
+    msg_buff_deinit(large);
+    msg_buff_get_slab_stats(&stats);
+    if (ut_common_compile_uint32(stats.in_use, before.in_use)) {
+        printf("msg_buff_deinit slab failed\n");
+        return -3;
+    }
+    /* slab reuse end */
+
+    return 0;
+}
+
+#define UT_BUFF_CLONE_CNT 40
+
+int msg_clone_case(void)
+{
+    struct msg_buff *clone[UT_BUFF_CLONE_CNT];
+    struct pool_stats before, stats;
+    struct msg_buff *buff;
+    struct data_src *data;
+    struct msg_sg *sg;
+    uint8_t seg[8] = {0};
+    int ret;
+
+    msg_data_src_get_pool_stats(&before);
+
+    buff = msg_buff_alloc(64);
+    data = (struct data_src *)buff->data;
+    proto_header_set_hop_limit(&data->header, 5);
+    memset(data->blocks, 0x3C, data->header.len - sizeof(struct proto_header));
+
+    /* msg_buff_clone start: one payload, the inline one moved out once */
+    for (int i = 0; i < UT_BUFF_CLONE_CNT; i++) {
+        clone[i] = msg_buff_clone(buff);
+        if (clone[i] == NULL || clone[i]->data != buff->data) {
+            printf("msg_buff_clone failed\n");
+            return -1;
+        }
+    }
+
+    if (buff->data == (void *)(buff + 1) || !msg_buff_is_shared(buff)
+        || ut_common_compile_uint32(buff->share->ref, UT_BUFF_CLONE_CNT + 1)) {
+        printf("msg_buff_clone share failed\n");
+        return -1;
+    }
+    /* msg_buff_clone end */
+
+    /* copy on write start */
+    ret = msg_buff_dec_hop_limit(clone[0], CSUM_TYPE_CRC16);
+    data = (struct data_src *)clone[0]->data;
+    if (ut_common_compile_ret(ret, ERR_SUCCESS) || clone[0]->data == buff->data || msg_buff_is_shared(clone[0])
+        || ut_common_compile_uint8(data->header.hop_limit, 4)
+        || ut_common_compile_uint8(((struct data_src *)buff->data)->header.hop_limit, 5)) {
+        printf("msg_buff_dec_hop_limit failed\n");
+        return -2;
+    }
+
+    /* the private copy goes out with a checksum the receiver accepts */
+    for (int i = 0; i < 2; i++) {
+        const uint8_t type = i ? CSUM_TYPE_CRC32C : CSUM_TYPE_CRC16;
+        uint8_t frame[128];
+
+        msg_data_src_set_checksum((struct data_src *)buff->data, type);
+        ret = msg_buff_dec_hop_limit(clone[i + 1], type);
+        data = (struct data_src *)clone[i + 1]->data;
+        memcpy(frame, data, data->header.len);
+        proto_header_encode(&data->header, frame, PROTO_HEADER_WIRE_SIZE);
+        if (ut_common_compile_ret(ret, ERR_SUCCESS) || clone[i + 1]->data == buff->data
+            || ut_common_compile_ret(proto_frame_check_checksum(frame, data->header.len, type), ERR_SUCCESS)) {
+            printf("msg_buff_dec_hop_limit checksum type %d failed\n", type);
+            return -2;
+        }
+    }
+    msg_buff_deinit(clone[0]);
+
+    msg_buff_deinit(buff);
+    for (int i = 1; i < UT_BUFF_CLONE_CNT - 1; i++) {
+        msg_buff_deinit(clone[i]);
+    }
+
+    /* the last holder writes in place */
+    data = (struct data_src *)clone[UT_BUFF_CLONE_CNT - 1]->data;
+    ret = msg_buff_make_writable(clone[UT_BUFF_CLONE_CNT - 1]);
+    if (ut_common_compile_ret(ret, ERR_SUCCESS) || clone[UT_BUFF_CLONE_CNT - 1]->data != data
+        || ut_common_compile_uint8(data->header.hop_limit, 5)) {
+        printf("msg_buff_make_writable last holder failed\n");
+        return -2;
+    }
+    msg_buff_deinit(clone[UT_BUFF_CLONE_CNT - 1]);
+
+    msg_data_src_get_pool_stats(&stats);
+    if (ut_common_compile_uint32(stats.cls[0].in_use, before.cls[0].in_use)
+        || ut_common_compile_uint32(stats.cls[1].in_use, before.cls[1].in_use)) {
+        printf("msg_buff_deinit shared failed\n");
+        return -2;
+    }
+    /* copy on write end */
+
+    /* segmented start: released by the last holder only */
+    msg_sg_release_cnt = 0;
+    sg = msg_sg_init();
+    msg_sg_add_seg(sg, seg, sizeof(seg), msg_sg_release);
+    buff = msg_buff_init();
+    msg_buff_bind_sg(buff, sg);
+    clone[0] = msg_buff_clone(buff);
+    if (clone[0] == NULL || !(clone[0]->flags & MSG_BUFF_F_SG)) {
+        printf("msg_buff_clone sg failed\n");
+        return -3;
+    }
+
+    msg_buff_deinit(buff);
+    if (ut_common_compile_ret(msg_sg_release_cnt, 0)) {
+        printf("msg_buff_deinit sg shared failed\n");
+        return -3;
+    }
+
+    msg_buff_deinit(clone[0]);
+    if (ut_common_compile_ret(msg_sg_release_cnt, 1)) {
+        printf("msg_buff_deinit sg last failed\n");
+        return -3;
+    }
+    /* segmented end */
+
+    return 0;
+}
+
+int msg_room_case(void)
+{
+    struct msg_buff *buff, *clone;
+    struct data_src *data;
+    uint8_t *p;
+
+    /* msg_buff_alloc_room start: room around an inline payload */
+    buff = msg_buff_alloc_room(32, 16, 8);
+    data = (struct data_src *)buff->data;
+    if (buff == NULL || (uint8_t *)data != (uint8_t *)(buff + 1) + 16
+        || ut_common_compile_ret(msg_buff_get_headroom(buff), 16)
+        || ut_common_compile_ret(msg_buff_get_tailroom(buff), MSG_BUFF_INLINE_MAX - 48)) {
+        printf("msg_buff_alloc_room failed\n");
+        return -1;
+    }
+    /* msg_buff_alloc_room end */
+
+    /* msg_buff_push start */
+    p = msg_buff_push(buff, 8);
+    if (p != (uint8_t *)data - 8 || buff->data != data || msg_buff_get_frame(buff) != p
+        || ut_common_compile_ret(msg_buff_get_headroom(buff), 8)) {
+        printf("msg_buff_push failed\n");
+        return -2;
+    }
+    memset(p, 0xA5, 8);
+
+    p = msg_buff_pull(buff, 4);
+    if (p != (uint8_t *)data - 4 || msg_buff_pull(buff, 5) != NULL) {
+        printf("msg_buff_pull failed\n");
+        return -2;
+    }
+    /* msg_buff_push end */
+
+    /* msg_buff_put start: in place, then moved with the pushed bytes */
+    p = msg_buff_put(buff, 4);
+    if (p != (uint8_t *)data + 32 || buff->data != data || ut_common_compile_uint16(data->header.len, 36)) {
+        printf("msg_buff_put in place failed\n");
+        return -3;
+    }
+
+    p = msg_buff_put(buff, 200);
+    data = (struct data_src *)buff->data;
+    if (p == NULL || data == (void *)((uint8_t *)(buff + 1) + 16) || ut_common_compile_uint16(data->header.len, 236)
+        || ut_common_compile_uint8(((uint8_t *)data)[-1], 0xA5) || ut_common_compile_uint8(p[199], 0)
+        || msg_buff_get_headroom(buff) < 12 || msg_buff_get_tailroom(buff) < MSG_BUFF_ROOM_PAD) {
+        printf("msg_buff_put move failed\n");
+        return -3;
+    }
+    /* msg_buff_put end */
+
+    /* msg_buff_trim start */
+    int tailroom = msg_buff_get_tailroom(buff);
+    if (ut_common_compile_ret(msg_buff_trim(buff, 40), ERR_SUCCESS) || ut_common_compile_uint16(data->header.len, 40)
+        || ut_common_compile_ret(msg_buff_get_tailroom(buff), tailroom + 196)
+        || ut_common_compile_ret(msg_buff_trim(buff, 41), -ERR_OUT_OF_RANGE)) {
+        printf("msg_buff_trim failed\n");
+        return -4;
+    }
+    /* msg_buff_trim end */
+
+    /* copy on write start: pushing onto a clone leaves the original alone */
+    clone = msg_buff_clone(buff);
+    p = msg_buff_push(clone, 2);
+    if (p == NULL || clone->data == buff->data || msg_buff_is_shared(buff)
+        || ut_common_compile_uint8(p[2], 0xA5) || ut_common_compile_uint16(buff->push_len, 4)
+        || ut_common_compile_uint16(clone->push_len, 6)) {
+        printf("msg_buff_push clone failed\n");
+        return -5;
+    }
+    msg_buff_deinit(clone);
+    msg_buff_deinit(buff);
+    /* copy on write end */
+
+    /* msg_buff_need_room start */
+    msg_buff_need_room(24, 0);
+    buff = msg_buff_alloc(32);
+    if (buff == NULL || ut_common_compile_ret(msg_buff_get_headroom(buff), 24)) {
+        printf("msg_buff_need_room failed\n");
+        return -6;
+    }
+    msg_buff_deinit(buff);
+    /* msg_buff_need_room end */
+
+    return 0;
+}
+
+#define UT_BUFF_MPSC_PRODUCER_CNT 4
+#define UT_BUFF_MPSC_MSG_CNT 10000
+
+struct ut_buff_mpsc_arg {
+    struct msg_queue *queue;
+    uint32_t id;
+};
+
+static void *msg_mpsc_producer(void *arg)
+{
+    struct ut_buff_mpsc_arg *a = (struct ut_buff_mpsc_arg *)arg;
+    struct msg_buff *buff;
+
+    for (uint32_t i = 0; i < UT_BUFF_MPSC_MSG_CNT; i++) {
+        buff = msg_buff_alloc(32);
+        msg_buff_set_id(buff, (a->id << 16) | i);
+        while (msg_queue_enqueue(a->queue, buff) != ERR_SUCCESS) {
+            sched_yield();
+        }
+    }
+
+    return NULL;
+}
+
+int msg_mpsc_case(void)
+{
+    struct ut_buff_mpsc_arg arg[UT_BUFF_MPSC_PRODUCER_CNT];
+    pthread_t thread[UT_BUFF_MPSC_PRODUCER_CNT];
+    uint32_t next[UT_BUFF_MPSC_PRODUCER_CNT] = {0};
+    struct msg_buff *buff[64];
+    struct msg_queue_cfg cfg;
+    struct msg_queue *queue;
+    int total = 0;
+    int cnt;
+
+    memset(&cfg, 0, sizeof(struct msg_queue_cfg));
+    cfg.qid = 1;
+    cfg.mode = MSG_QUEUE_MODE_MPSC;
+    cfg.rx_type = MSG_QUEUE_RX_HALF;
+    queue = msg_queue_init_cfg(&cfg);
+    if (queue == NULL) {
+        printf("msg_queue_init_cfg mpsc failed\n");
+        return -1;
+    }
+
+    /* empty start */
+    if (msg_queue_dequeue(queue) != NULL || msg_queue_peek(queue) != NULL) {
+        printf("msg_queue_dequeue mpsc empty failed\n");
+        return -1;
+    }
+    /* empty end */
+
+    /* concurrent producers start: each producer's messages come out in order */
+    for (int i = 0; i < UT_BUFF_MPSC_PRODUCER_CNT; i++) {
+        arg[i].queue = queue;
+        arg[i].id = i;
+        pthread_create(&thread[i], NULL, msg_mpsc_producer, &arg[i]);
+    }
+
+    while (total < UT_BUFF_MPSC_PRODUCER_CNT * UT_BUFF_MPSC_MSG_CNT) {
+        cnt = msg_queue_dequeue_bulk(queue, buff, 64);
+        if (cnt == 0) {
+            sched_yield();
+        }
+        for (int i = 0; i < cnt; i++) {
+            uint32_t p = buff[i]->id >> 16;
+
+            if (p >= UT_BUFF_MPSC_PRODUCER_CNT || ut_common_compile_uint32(buff[i]->id & 0xFFFF, next[p])) {
+                printf("msg_queue_dequeue_bulk mpsc order failed\n");
+                return -2;
+            }
+            next[p]++;
+            msg_buff_deinit(buff[i]);
+        }
+        total += cnt;
+    }
+
+    for (int i = 0; i < UT_BUFF_MPSC_PRODUCER_CNT; i++) {
+        pthread_join(thread[i], NULL);
+    }
+
+    if (ut_common_compile_ret(msg_queue_get_count(queue), 0) || ut_common_compile_ret(msg_queue_get_data_size(queue), 0)
+        || msg_queue_dequeue(queue) != NULL) {
+        printf("msg_queue_get_count mpsc failed\n");
+        return -2;
+    }
+    /* concurrent producers end */
+
+    /* msg_queue_deinit start: frees what is still queued */
+    for (int i = 0; i < 3; i++) {
+        msg_queue_enqueue(queue, msg_buff_alloc(32));
+    }
+    if (ut_common_compile_ret(msg_queue_get_count(queue), 3) || ut_common_compile_ret(msg_queue_get_data_size(queue), 96)) {
+        printf("msg_queue_enqueue mpsc stats failed\n");
+        return -3;
+    }
+    msg_queue_deinit(queue);
+    /* msg_queue_deinit end */
+
+    return 0;
+}
+
+#define UT_BUFF_SPSC_MSG_CNT 100000
+
+static void *msg_spsc_producer(void *arg)
+{
+    struct msg_queue *queue = (struct msg_queue *)arg;
+    struct msg_buff *buff;
+
+    for (uint32_t i = 0; i < UT_BUFF_SPSC_MSG_CNT; i++) {
+        buff = msg_buff_alloc(32);
+        msg_buff_set_id(buff, i);
+        while (msg_queue_enqueue(queue, buff) != ERR_SUCCESS) {
+            sched_yield();
+        }
+    }
+
+    return NULL;
+}
+
+int msg_spsc_case(void)
+{
+    struct msg_buff *buff[16];
+    struct msg_queue_cfg cfg;
+    struct msg_queue *queue;
+    pthread_t thread;
+    uint32_t next = 0;
+    int cnt;
+
+    memset(&cfg, 0, sizeof(struct msg_queue_cfg));
+    cfg.qid = 2;
+    cfg.mode = MSG_QUEUE_MODE_SPSC;
+    cfg.capacity = 5;
+    cfg.rx_type = MSG_QUEUE_RX_HALF;
+    queue = msg_queue_init_cfg(&cfg);
+    if (queue == NULL || ut_common_compile_uint32(queue->cfg.capacity, 8)) {
+        printf("msg_queue_init_cfg spsc failed\n");
+        return -1;
+    }
+
+    /* bounded start: full at capacity, drained in one batch */
+    for (int i = 0; i < 8; i++) {
+        buff[i] = msg_buff_alloc(32);
+        if (ut_common_compile_ret(msg_queue_enqueue(queue, buff[i]), ERR_SUCCESS)) {
+            printf("msg_queue_enqueue spsc failed\n");
+            return -2;
+        }
+    }
+
+    buff[8] = msg_buff_alloc(32);
+    if (ut_common_compile_ret(msg_queue_enqueue(queue, buff[8]), -ERR_OUT_OF_RANGE)
+        || ut_common_compile_ret(msg_queue_get_count(queue), 8) || ut_common_compile_ret(msg_queue_get_data_size(queue), 256)
+        || msg_queue_peek(queue) != buff[0]) {
+        printf("msg_queue_enqueue spsc full failed\n");
+        return -2;
+    }
+    msg_buff_deinit(buff[8]);
+
+    cnt = msg_queue_dequeue_bulk(queue, buff, 16);
+    if (ut_common_compile_ret(cnt, 8) || ut_common_compile_ret(msg_queue_get_count(queue), 0)
+        || ut_common_compile_ret(msg_queue_get_data_size(queue), 0) || msg_queue_dequeue(queue) != NULL) {
+        printf("msg_queue_dequeue_bulk spsc failed\n");
+        return -2;
+    }
+    for (int i = 0; i < cnt; i++) {
+        msg_buff_deinit(buff[i]);
+    }
+    /* bounded end */
+
+    /* producer thread start: wraps the ring many times, order is kept */
+    pthread_create(&thread, NULL, msg_spsc_producer, queue);
+    while (next < UT_BUFF_SPSC_MSG_CNT) {
+        cnt = msg_queue_dequeue_bulk(queue, buff, 16);
+        if (cnt == 0) {
+            sched_yield();
+        }
+        for (int i = 0; i < cnt; i++) {
+            if (ut_common_compile_uint32(buff[i]->id, next)) {
+                printf("msg_queue_dequeue_bulk spsc order failed\n");
+                return -3;
+            }
+            next++;
+            msg_buff_deinit(buff[i]);
+        }
+    }
+    pthread_join(thread, NULL);
+    /* producer thread end */
+
+    msg_queue_deinit(queue);
+
+    return 0;
+}
+
+static int msg_wm_xoff;
+static int msg_wm_calls;
+
+static void msg_wm_cb(struct msg_queue *msg_queue, int xoff, void *arg)
+{
+    msg_wm_xoff = xoff;
+    msg_wm_calls += *(int *)arg;
+}
+
+int msg_wm_case(void)
+{
+    struct msg_buff *buff[4];
+    struct msg_queue_cfg cfg;
+    struct msg_queue *queue;
+    int one = 1;
+
+    queue = msg_queue_init(3);
+    if (ut_common_compile_ret(msg_queue_set_watermark(queue, 300, 300, msg_wm_cb, &one), -ERR_INVALID_ARG)
+        || ut_common_compile_ret(msg_queue_set_rx_type(queue, MSG_QUEUE_RX_TYPE_MAX), -ERR_INVALID_ARG)
+        || ut_common_compile_ret(msg_queue_set_watermark(queue, 300, 0, msg_wm_cb, &one), ERR_SUCCESS)) {
+        printf("msg_queue_set_watermark failed\n");
+        return -1;
+    }
+
+    /* high mark start: xoff once, at 300 bytes */
+    for (int i = 0; i < 4; i++) {
+        buff[i] = msg_buff_alloc(100);
+        msg_queue_enqueue(queue, buff[i]);
+        if (ut_common_compile_ret(msg_queue_is_xoff(queue), i >= 2) || ut_common_compile_ret(msg_wm_calls, i >= 2)) {
+            printf("msg_queue_enqueue xoff failed\n");
+            return -2;
+        }
+    }
+    /* high mark end */
+
+    /* low mark start: MSG_QUEUE_RX_HALF, xon at 150 bytes */
+    msg_buff_deinit(msg_queue_dequeue(queue));
+    msg_buff_deinit(msg_queue_dequeue(queue));
+    if (!msg_queue_is_xoff(queue) || ut_common_compile_ret(msg_queue_get_data_size(queue), 200)) {
+        printf("msg_queue_dequeue xoff failed\n");
+        return -3;
+    }
+
+    msg_buff_deinit(msg_queue_dequeue(queue));
+    if (msg_queue_is_xoff(queue) || msg_wm_xoff || ut_common_compile_ret(msg_wm_calls, 2)
+        || ut_common_compile_uint32(queue->stats.xoff_cnt, 1)) {
+        printf("msg_queue_dequeue xon failed\n");
+        return -3;
+    }
+    msg_queue_deinit(queue);
+    /* low mark end */
+
+    /* spsc start: MSG_QUEUE_RX_ZERO, xon once drained */
+    memset(&cfg, 0, sizeof(struct msg_queue_cfg));
+    cfg.mode = MSG_QUEUE_MODE_SPSC;
+    cfg.rx_type = MSG_QUEUE_RX_ZERO;
+    cfg.high_wm = 200;
+    queue = msg_queue_init_cfg(&cfg);
+    for (int i = 0; i < 2; i++) {
+        msg_queue_enqueue(queue, msg_buff_alloc(100));
+    }
+    msg_buff_deinit(msg_queue_dequeue(queue));
+    if (!msg_queue_is_xoff(queue)) {
+        printf("msg_queue_dequeue spsc xoff failed\n");
+        return -4;
+    }
+    msg_buff_deinit(msg_queue_dequeue(queue));
+    if (msg_queue_is_xoff(queue) || ut_common_compile_ret(msg_queue_get_data_size(queue), 0)) {
+        printf("msg_queue_dequeue spsc xon failed\n");
+        return -4;
+    }
+    msg_queue_deinit(queue);
+    /* spsc end */
+
+    return 0;
+}
+
+int msg_batch_case(void)
+{
+    struct msg_queue *queue, *queue2;
+    struct msg_buff *buff[8];
+    struct msg_queue_cfg cfg;
+    struct msg_chain chain;
+    int cnt;
+
+    /* msg_queue_enqueue_chain start: one run, one stats update */
+    queue = msg_queue_init(4);
+    msg_chain_init(&chain);
+    for (int i = 0; i < 6; i++) {
+        buff[i] = msg_buff_alloc(32);
+        msg_buff_set_id(buff[i], i);
+        msg_chain_add(&chain, buff[i]);
+    }
+
+    if (ut_common_compile_ret(msg_queue_enqueue_chain(queue, &chain), ERR_SUCCESS)
+        || ut_common_compile_ret(msg_queue_get_count(queue), 6) || ut_common_compile_ret(msg_queue_get_data_size(queue), 192)
+        || chain.head != NULL || msg_queue_get_tail(queue) != buff[5]) {
+        printf("msg_queue_enqueue_chain failed\n");
+        return -1;
+    }
+    /* msg_queue_enqueue_chain end */
+
+    /* msg_queue_dequeue_bulk start */
+    cnt = msg_queue_dequeue_bulk(queue, buff, 4);
+    if (ut_common_compile_ret(cnt, 4) || ut_common_compile_uint32(buff[3]->id, 3)
+        || ut_common_compile_ret(msg_queue_get_count(queue), 2) || ut_common_compile_ret(msg_queue_get_data_size(queue), 64)) {
+        printf("msg_queue_dequeue_bulk failed\n");
+        return -2;
+    }
+    for (int i = 0; i < cnt; i++) {
+        msg_buff_deinit(buff[i]);
+    }
+    /* msg_queue_dequeue_bulk end */
+
+    /* msg_queue_splice start: appended in order, the source left empty */
+    queue2 = msg_queue_init(5);
+    msg_queue_enqueue(queue2, msg_buff_alloc(32));
+    if (ut_common_compile_ret(msg_queue_splice(queue2, queue), ERR_SUCCESS)
+        || ut_common_compile_ret(msg_queue_get_count(queue), 0) || ut_common_compile_ret(msg_queue_get_data_size(queue), 0)
+        || ut_common_compile_ret(msg_queue_get_count(queue2), 3) || ut_common_compile_ret(msg_queue_get_data_size(queue2), 96)
+        || ut_common_compile_uint32(msg_queue_get_tail(queue2)->id, 5)) {
+        printf("msg_queue_splice failed\n");
+        return -3;
+    }
+    /* msg_queue_splice end */
+
+    /* lock-free start: a ring takes the whole chain or nothing */
+    memset(&cfg, 0, sizeof(struct msg_queue_cfg));
+    cfg.mode = MSG_QUEUE_MODE_SPSC;
+    cfg.capacity = 4;
+    msg_queue_deinit(queue);
+    queue = msg_queue_init_cfg(&cfg);
+    msg_queue_enqueue(queue, msg_buff_alloc(32));
+    msg_queue_enqueue(queue, msg_buff_alloc(32));
+    if (ut_common_compile_ret(msg_queue_splice(queue, queue2), -ERR_OUT_OF_RANGE)
+        || ut_common_compile_ret(msg_queue_get_count(queue2), 3) || ut_common_compile_ret(msg_queue_get_count(queue), 2)) {
+        printf("msg_queue_splice spsc full failed\n");
+        return -4;
+    }
+
+    msg_buff_deinit(msg_queue_dequeue(queue));
+    if (ut_common_compile_ret(msg_queue_splice(queue, queue2), ERR_SUCCESS)
+        || ut_common_compile_ret(msg_queue_get_count(queue), 4) || ut_common_compile_ret(msg_queue_get_data_size(queue), 128)) {
+        printf("msg_queue_splice spsc failed\n");
+        return -4;
+    }
+    msg_queue_deinit(queue);
+
+    cfg.mode = MSG_QUEUE_MODE_MPSC;
+    queue = msg_queue_init_cfg(&cfg);
+    msg_chain_init(&chain);
+    for (int i = 0; i < 3; i++) {
+        buff[i] = msg_buff_alloc(32);
+        msg_buff_set_id(buff[i], i);
+        msg_chain_add(&chain, buff[i]);
+    }
+    msg_queue_enqueue(queue, msg_buff_alloc(32));
+    msg_queue_enqueue_chain(queue, &chain);
+    cnt = msg_queue_dequeue_bulk(queue, buff, 8);
+    if (ut_common_compile_ret(cnt, 4) || ut_common_compile_uint32(buff[3]->id, 2)
+        || ut_common_compile_ret(msg_queue_get_count(queue), 0) || ut_common_compile_ret(msg_queue_get_data_size(queue), 0)) {
+        printf("msg_queue_enqueue_chain mpsc failed\n");
+        return -4;
+    }
+    for (int i = 0; i < cnt; i++) {
+        msg_buff_deinit(buff[i]);
+    }
+    /* lock-free end */
+
+    msg_queue_deinit(queue);
+    msg_queue_deinit(queue2);
+
+    return 0;
+}
+
+/* Fill queue with cnt messages that have sat for a second already. */
+static void msg_aqm_fill(struct msg_queue *queue, int cnt, uint8_t prio)
+{
+    struct msg_buff *buff;
+
+    for (int i = 0; i < cnt; i++) {
+        buff = msg_buff_alloc(32);
+        proto_header_set_priority(&((struct data_src *)buff->data)->header, prio);
+        msg_queue_enqueue(queue, buff);
+        buff->enq_ns -= 1000000000ULL;
+    }
+}
+
+/* Past one CoDel interval of 1 ms. */
+static void msg_aqm_wait(void)
+{
+    struct timespec ts = {0, 2000000};
+
+    nanosleep(&ts, NULL);
+    tstamp_refresh();
+}
+
+static void msg_aqm_drain(struct msg_queue *queue)
+{
+    struct msg_buff *buff;
+
+    while ((buff = msg_queue_dequeue(queue)) != NULL) {
+        msg_buff_deinit(buff);
+    }
+}
+
+int msg_aqm_case(void)
+{
+    uint32_t target[PROTO_HEADER_PRIO_CNT] = {0};
+    struct msg_queue *queue;
+    struct msg_queue_cfg cfg;
+    struct msg_buff *buff;
+
+    memset(&cfg, 0, sizeof(cfg));
+    cfg.qid = 6;
+    cfg.aqm = MSG_QUEUE_AQM_MAX;
+    if (msg_queue_init_cfg(&cfg) != NULL) {
+        printf("msg_queue_init_cfg aqm failed\n");
+        return -1;
+    }
+
+    /* head drop start: above target for an interval, the head is dropped */
+    cfg.aqm = MSG_QUEUE_AQM_CODEL_HEAD;
+    cfg.aqm_interval_ns = 1000000;
+    queue = msg_queue_init_cfg(&cfg);
+    tstamp_refresh();
+    msg_aqm_fill(queue, 10, PROTO_PRIO_LOW);
+
+    buff = msg_queue_dequeue(queue);
+    if (buff == NULL || ut_common_compile_uint32(queue->stats.drop_head, 0)) {
+        printf("msg_queue_dequeue codel first above failed\n");
+        return -2;
+    }
+    msg_buff_deinit(buff);
+
+    msg_aqm_wait();
+    buff = msg_queue_dequeue(queue);
+    if (buff == NULL || ut_common_compile_uint32(queue->stats.drop_head, 1)
+        || ut_common_compile_ret(msg_queue_get_count(queue), 7) || ut_common_compile_ret(msg_queue_get_data_size(queue), 224)) {
+        printf("msg_queue_dequeue codel head drop failed\n");
+        return -2;
+    }
+    msg_buff_deinit(buff);
+    msg_aqm_drain(queue);
+    msg_queue_deinit(queue);
+    /* head drop end */
+
+    /* per priority target start: a loose target for level1 keeps it off the drop path */
+    target[PROTO_PRIO_LEVEL1] = 2000000000;
+    queue = msg_queue_init_cfg(&cfg);
+    if (ut_common_compile_ret(msg_queue_set_aqm(queue, MSG_QUEUE_AQM_CODEL_HEAD, target, 1000000), ERR_SUCCESS)) {
+        printf("msg_queue_set_aqm failed\n");
+        return -3;
+    }
+    msg_aqm_fill(queue, 10, PROTO_PRIO_LEVEL1);
+    for (int i = 0; i < 3; i++) {
+        msg_buff_deinit(msg_queue_dequeue(queue));
+        msg_aqm_wait();
+    }
+    if (ut_common_compile_uint32(queue->stats.drop_head, 0) || ut_common_compile_ret(msg_queue_get_count(queue), 7)) {
+        printf("msg_queue_dequeue codel priority target failed\n");
+        return -3;
+    }
+    msg_aqm_drain(queue);
+    msg_queue_deinit(queue);
+    /* per priority target end */
+
+    /* tail drop start: the consumer keeps the head, the next producer is refused */
+    cfg.aqm = MSG_QUEUE_AQM_CODEL_TAIL;
+    queue = msg_queue_init_cfg(&cfg);
+    msg_aqm_fill(queue, 10, PROTO_PRIO_LOW);
+    msg_buff_deinit(msg_queue_dequeue(queue));
+    msg_aqm_wait();
+    msg_buff_deinit(msg_queue_dequeue(queue));
+
+    buff = msg_buff_alloc(32);
+    if (ut_common_compile_ret(msg_queue_get_count(queue), 8) || ut_common_compile_uint32(queue->stats.drop_head, 0)
+        || ut_common_compile_ret(msg_queue_enqueue(queue, buff), -ERR_BUSY)
+        || ut_common_compile_uint32(queue->stats.drop_tail, 1)
+        || ut_common_compile_ret(msg_queue_enqueue(queue, buff), ERR_SUCCESS)) {
+        printf("msg_queue_enqueue codel tail drop failed\n");
+        return -4;
+    }
+    msg_aqm_drain(queue);
+    msg_queue_deinit(queue);
+    /* tail drop end */
+
+    return 0;
+}
+
+static struct msg_buff *msg_edf_msg(uint32_t id, uint64_t ts, uint16_t heart_rate)
+{
+    struct msg_buff *buff = msg_buff_alloc(32);
+
+    msg_buff_set_id(buff, id);
+    msg_buff_set_time(buff, ts);
+    proto_header_set_heart_rate(&((struct data_src *)buff->data)->header, heart_rate);
+
+    return buff;
+}
+
+int msg_edf_case(void)
+{
+    const uint16_t heart_rate[] = {30, 10, 0, 20, 10};
+    const uint32_t order[] = {1, 4, 3, 0, 2};
+    struct msg_buff *buff[8];
+    struct msg_queue_cfg cfg;
+    struct msg_queue *queue;
+    struct msg_chain chain;
+    uint64_t now, last;
+    int cnt;
+
+    memset(&cfg, 0, sizeof(cfg));
+    cfg.qid = 7;
+    cfg.mode = MSG_QUEUE_MODE_EDF;
+    cfg.capacity = 2;
+    queue = msg_queue_init_cfg(&cfg);
+    if (queue == NULL) {
+        printf("msg_queue_init_cfg edf failed\n");
+        return -1;
+    }
+
+    /* deadline order start: heart_rate 0 never expires, equal deadlines stay FIFO */
+    now = tstamp_refresh();
+    for (int i = 0; i < 5; i++) {
+        buff[i] = msg_edf_msg(i, now, heart_rate[i]);
+        if (ut_common_compile_ret(msg_queue_enqueue(queue, buff[i]), ERR_SUCCESS)) {
+            printf("msg_queue_enqueue edf failed\n");
+            return -2;
+        }
+    }
+
+    if (msg_queue_peek(queue) != buff[1] || msg_queue_get_tail(queue) != NULL
+        || ut_common_compile_ret(msg_queue_get_count(queue), 5) || ut_common_compile_ret(msg_queue_get_data_size(queue), 160)) {
+        printf("msg_queue_peek edf failed\n");
+        return -2;
+    }
+
+    cnt = msg_queue_dequeue_bulk(queue, buff, 8);
+    for (int i = 0; i < cnt; i++) {
+        if (ut_common_compile_uint32(buff[i]->id, order[i])) {
+            printf("msg_queue_dequeue_bulk edf order failed\n");
+            return -2;
+        }
+        msg_buff_deinit(buff[i]);
+    }
+    if (ut_common_compile_ret(cnt, 5) || ut_common_compile_ret(msg_queue_get_count(queue), 0)) {
+        printf("msg_queue_dequeue_bulk edf failed\n");
+        return -2;
+    }
+    /* deadline order end */
+
+    /* expired start: dropped lazily at dequeue and counted */
+    msg_chain_init(&chain);
+    msg_chain_add(&chain, msg_edf_msg(0, now - 5000000000ULL, 1));
+    msg_chain_add(&chain, msg_edf_msg(1, now, 1));
+    msg_chain_add(&chain, msg_edf_msg(2, now - 3000000000ULL, 2));
+    if (ut_common_compile_ret(msg_queue_enqueue_chain(queue, &chain), ERR_SUCCESS)
+        || ut_common_compile_uint32(queue->stats.drop_expired, 0)) {
+        printf("msg_queue_enqueue_chain edf failed\n");
+        return -3;
+    }
+
+    buff[0] = msg_queue_dequeue(queue);
+    if (buff[0] == NULL || ut_common_compile_uint32(buff[0]->id, 1) || ut_common_compile_uint32(queue->stats.drop_expired, 2)
+        || ut_common_compile_ret(msg_queue_get_count(queue), 0) || ut_common_compile_ret(msg_queue_get_data_size(queue), 0)) {
+        printf("msg_queue_dequeue edf expired failed\n");
+        return -3;
+    }
+    msg_buff_deinit(buff[0]);
+    /* expired end */
+
+    /* heap start: many deadlines come out sorted */
+    srand(1);
+    for (int i = 0; i < 500; i++) {
+        msg_queue_enqueue(queue, msg_edf_msg(i, now + (uint64_t)(rand() % 1000000) * 1000, 1));
+    }
+
+    last = 0;
+    for (int i = 0; i < 500; i++) {
+        buff[0] = msg_queue_dequeue(queue);
+        if (buff[0] == NULL || buff[0]->timestamp < last) {
+            printf("msg_queue_dequeue edf heap failed\n");
+            return -4;
+        }
+        last = buff[0]->timestamp;
+        msg_buff_deinit(buff[0]);
+    }
+    if (ut_common_compile_uint32(queue->cfg.capacity, 2) || queue->edf->cap < 500) {
+        printf("msg_queue edf grow failed\n");
+        return -4;
+    }
+    /* heap end */
+
+    /* left behind start: freed with the queue */
+    msg_queue_enqueue(queue, msg_edf_msg(0, now, 1));
+    msg_queue_deinit(queue);
+    /* left behind end */
+
+    return 0;
+}
+
+int main(void) {
+    int ret;
+    ret = msg_data_src_case();
+    if (ret != 0) {
+        printf("buff_data_src_case failed\n");
+        return -1;
+    }
+
+    ret = msg_buff_case();
+    if (ret != 0) {
+        printf("buff_msg_buff_case failed\n");
+        return -2; 
+    }
+
+    ret = msg_queue_case();
+    if (ret != 0) {
+        printf("buff_msg_queue_case failed\n");
+        return -3; 
+    }
+
+    ret = msg_blk_index_case();
+    if (ret != 0) {
+        printf("buff_msg_blk_index_case failed\n");
+        return -4;
+    }
+
+    ret = msg_builder_case();
+    if (ret != 0) {
+        printf("buff_msg_builder_case failed\n");
+        return -5;
+    }
+
+    ret = msg_sg_case();
+    if (ret != 0) {
+        printf("buff_msg_sg_case failed\n");
+        return -6;
+    }
+
+    ret = msg_compact_case();
+    if (ret != 0) {
+        printf("buff_msg_compact_case failed\n");
+        return -7;
+    }
+
+    ret = msg_slab_case();
+    if (ret != 0) {
+        printf("buff_msg_slab_case failed\n");
+        return -8;
+    }
+
+    ret = msg_clone_case();
+    if (ret != 0) {
+        printf("buff_msg_clone_case failed\n");
+        return -9;
+    }
+
+    ret = msg_room_case();
+    if (ret != 0) {
+        printf("buff_msg_room_case failed\n");
+        return -10;
+    }
+
+    ret = msg_mpsc_case();
+    if (ret != 0) {
+        printf("buff_msg_mpsc_case failed\n");
+        return -11;
+    }
+
+    ret = msg_spsc_case();
+    if (ret != 0) {
+        printf("buff_msg_spsc_case failed\n");
+        return -12;
+    }
+
+    ret = msg_wm_case();
+    if (ret != 0) {
+        printf("buff_msg_wm_case failed\n");
+        return -13;
+    }
+
+    ret = msg_batch_case();
+    if (ret != 0) {
+        printf("buff_msg_batch_case failed\n");
+        return -14;
+    }
+
+    ret = msg_aqm_case();
+    if (ret != 0) {
+        printf("buff_msg_aqm_case failed\n");
+        return -15;
+    }
+
+    ret = msg_edf_case();
+    if (ret != 0) {
+        printf("buff_msg_edf_case failed\n");
+        return -16;
     }
 
     printf("buff_data_src_case passed\n");
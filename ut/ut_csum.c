@@ -0,0 +1,203 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "../src/csum.h"
+#include "../src/proto.h"
+#include "../src/errno.h"
+#include "../src/buff.h"
+
+#include "ut_common.h"
+
+static uint16_t csum_bytewise(uint8_t type, const uint8_t *buf, uint32_t len)
+{
+    uint32_t state = csum_start(type);
+
+    for (uint32_t i = 0; i < len; i++) {
+        state = csum_update(type, state, buf + i, 1);
+    }
+
+    return csum_finish(type, state);
+}
+
+int csum_vector_case(void)
+{
+    const uint8_t check[] = "123456789";
+    const uint8_t rfc1071[] = {0x00, 0x01, 0xf2, 0x03, 0xf4, 0xf5, 0xf6, 0xf7};
+    int ret;
+
+    ret = csum_init();
+    if (ut_common_compile_ret(ret, ERR_SUCCESS)) {
+        printf("csum_init ERR_SUCCESS failed\n");
+        return -1;
+    }
+
+    if (ut_common_compile_uint16(csum_compute(CSUM_TYPE_CRC16, check, 9), 0x4B37)) {
+        printf("csum_compute crc16 failed\n");
+        return -2;
+    }
+
+    /* 0xE3069283 folded */
+    if (ut_common_compile_uint16(csum_compute(CSUM_TYPE_CRC32C, check, 9), 0x7185)) {
+        printf("csum_compute crc32c failed\n");
+        return -2;
+    }
+
+    if (ut_common_compile_uint16(csum_compute(CSUM_TYPE_INET16, rfc1071, 8), 0x220D)) {
+        printf("csum_compute inet16 failed\n");
+        return -2;
+    }
+
+    printf("csum impl: inet16 %s, crc16 %s, crc32c %s\n", csum_get_impl_name(CSUM_TYPE_INET16),
+           csum_get_impl_name(CSUM_TYPE_CRC16), csum_get_impl_name(CSUM_TYPE_CRC32C));
+
+    return 0;
+}
+
+int csum_stream_case(void)
+{
+    const uint8_t types[] = {CSUM_TYPE_INET16, CSUM_TYPE_CRC16, CSUM_TYPE_CRC32C};
+    uint8_t buf[1001];
+    uint32_t state;
+    uint16_t whole;
+
+    for (uint32_t i = 0; i < sizeof(buf); i++) {
+        buf[i] = (uint8_t)(i * 7 + 3);
+    }
+
+    for (uint32_t t = 0; t < sizeof(types); t++) {
+        whole = csum_compute(types[t], buf, sizeof(buf));
+        if (ut_common_compile_uint16(csum_bytewise(types[t], buf, sizeof(buf)), whole)) {
+            printf("csum_update bytewise type %d failed\n", types[t]);
+            return -1;
+        }
+
+        state = csum_start(types[t]);
+        state = csum_update(types[t], state, buf, 333);
+        state = csum_update(types[t], state, buf + 333, 100);
+        state = csum_update(types[t], state, buf + 433, sizeof(buf) - 433);
+        if (ut_common_compile_uint16(csum_finish(types[t], state), whole)) {
+            printf("csum_update split type %d failed\n", types[t]);
+            return -1;
+        }
+
+        /* csum_update_byte start: patching one byte matches a full pass */
+        for (uint32_t off = 0; off < sizeof(buf); off += 111) {
+            uint8_t old_byte = buf[off];
+
+            buf[off] ^= 0x5A;
+            whole = csum_update_byte(types[t], whole, off, sizeof(buf), old_byte, buf[off]);
+            if (ut_common_compile_uint16(whole, csum_compute(types[t], buf, sizeof(buf)))) {
+                printf("csum_update_byte type %d off %u failed\n", types[t], off);
+                return -2;
+            }
+        }
+        /* csum_update_byte end */
+    }
+
+    return 0;
+}
+
+/* The frame intf_xmit() would put on the wire for data. */
+static int csum_wire_check(const struct data_src *data, uint8_t type)
+{
+    uint8_t frame[1024];
+
+    memcpy(frame, data, data->header.len);
+    proto_header_encode(&data->header, frame, PROTO_HEADER_WIRE_SIZE);
+
+    return proto_frame_check_checksum(frame, data->header.len, type);
+}
+
+int csum_data_src_case(void)
+{
+    const uint8_t types[] = {CSUM_TYPE_INET16, CSUM_TYPE_CRC16, CSUM_TYPE_CRC32C};
+    struct data_src *data;
+    uint16_t checksum;
+    int ret;
+
+    data = msg_data_src_init(512 + sizeof(struct proto_header), NULL);
+    if (data == NULL) {
+        return -1;
+    }
+    memset(data->blocks, 0x5A, 512);
+    proto_header_set_heart_rate(&data->header, 0x1234);
+    proto_header_set_src_id(&data->header, 0x01020304);
+    proto_header_set_dst_id(&data->header, 0x0A0B0C0D);
+
+    for (uint32_t t = 0; t < sizeof(types); t++) {
+        proto_header_set_hop_limit(&data->header, 16);
+
+        /* msg_data_src_set_checksum start: what the encoded frame checks against */
+        ret = msg_data_src_set_checksum(data, types[t]);
+        if (ut_common_compile_ret(ret, ERR_SUCCESS) || ut_common_compile_ret(csum_wire_check(data, types[t]), ERR_SUCCESS)
+            || ut_common_compile_ret(msg_data_src_check_checksum(data, types[t]), ERR_SUCCESS)) {
+            printf("msg_data_src_set_checksum type %d failed\n", types[t]);
+            return -2;
+        }
+        /* msg_data_src_set_checksum end */
+
+        /* msg_data_src_dec_hop_limit start: the frame still checks after forwarding */
+        checksum = data->header.checksum;
+        ret = msg_data_src_dec_hop_limit(data, types[t]);
+        if (ut_common_compile_ret(ret, ERR_SUCCESS) || ut_common_compile_uint8(data->header.hop_limit, 15)
+            || checksum == data->header.checksum
+            || ut_common_compile_ret(csum_wire_check(data, types[t]), ERR_SUCCESS)) {
+            printf("msg_data_src_dec_hop_limit type %d failed\n", types[t]);
+            return -3;
+        }
+        /* msg_data_src_dec_hop_limit end */
+
+        /* msg_data_src_check_checksum start: a flipped payload byte is caught */
+        data->blocks[0].type ^= 1;
+        if (ut_common_compile_ret(msg_data_src_check_checksum(data, types[t]), -ERR_FAIL)
+            || ut_common_compile_ret(csum_wire_check(data, types[t]), -ERR_FAIL)) {
+            printf("msg_data_src_check_checksum type %d -ERR_FAIL failed\n", types[t]);
+            return -4;
+        }
+        data->blocks[0].type ^= 1;
+        /* msg_data_src_check_checksum end */
+    }
+
+    proto_header_set_hop_limit(&data->header, 0);
+    if (ut_common_compile_ret(msg_data_src_dec_hop_limit(data, CSUM_TYPE_CRC16), -ERR_OUT_OF_RANGE)) {
+        printf("msg_data_src_dec_hop_limit -ERR_OUT_OF_RANGE failed\n");
+        return -5;
+    }
+
+    msg_data_src_deinit(data);
+
+    return 0;
+}
+
+int main()
+{
+    int ret;
+
+    ret = csum_vector_case();
+    if (ret) {
+        printf("csum_vector_case failed\n");
+        return -1;
+    } else {
+        printf("csum_vector_case success\n");
+    }
+
+    ret = csum_stream_case();
+    if (ret) {
+        printf("csum_stream_case failed\n");
+        return -1;
+    } else {
+        printf("csum_stream_case success\n");
+    }
+
+    ret = csum_data_src_case();
+    if (ret) {
+        printf("csum_data_src_case failed\n");
+        return -1;
+    } else {
+        printf("csum_data_src_case success\n");
+    }
+
+    return 0;
+}
@@ -0,0 +1,161 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "../src/disp.h"
+#include "../src/proto.h"
+#include "../src/errno.h"
+#include "../src/buff.h"
+
+#include "ut_common.h"
+
+#define UT_DISP_TYPE_CNT 300
+
+static uint32_t ut_disp_hits[UT_DISP_TYPE_CNT];
+static uint32_t ut_disp_dflt;
+
+static uint16_t ut_disp_type(int i)
+{
+    /* three clusters, like real type allocations */
+    return (i < 100) ? i : (i < 200) ? 0x1000 + i : 0xFF00 + i - 200;
+}
+
+static int ut_disp_handler(struct msg_buff *msg, const struct proto_block_ref *blk, void *arg)
+{
+    int i = (int)(intptr_t)arg;
+
+    if (blk->type != ut_disp_type(i) || blk->data[0] != (uint8_t)i) {
+        return -1;
+    }
+    ut_disp_hits[i]++;
+
+    return 0;
+}
+
+static int ut_disp_default(struct msg_buff *msg, const struct proto_block_ref *blk, void *arg)
+{
+    ut_disp_dflt++;
+
+    return 0;
+}
+
+int disp_table_case(void)
+{
+    struct disp_table *tbl;
+    struct msg_builder bld;
+    struct msg_buff *buff;
+    struct data_src *data;
+    uint8_t val;
+    int ret;
+
+    tbl = disp_table_init(ut_disp_default, NULL);
+    if (tbl == NULL) {
+        return -1;
+    }
+
+    /* disp_register start */
+    for (int i = 0; i < UT_DISP_TYPE_CNT; i++) {
+        ret = disp_register(tbl, ut_disp_type(i), ut_disp_handler, (void *)(intptr_t)i);
+        if (ut_common_compile_ret(ret, ERR_SUCCESS)) {
+            printf("disp_register ERR_SUCCESS failed\n");
+            return -1;
+        }
+    }
+
+    ret = disp_register(tbl, ut_disp_type(7), ut_disp_handler, NULL);
+    if (ut_common_compile_ret(ret, -ERR_BUSY)) {
+        printf("disp_register -ERR_BUSY failed\n");
+        return -1;
+    }
+
+    /* pages 0x00, 0x10 and 0xFF */
+    if (ut_common_compile_uint16(tbl->page_cnt, 3)) {
+        printf("disp_register page_cnt failed\n");
+        return -1;
+    }
+    /* disp_register end */
+
+    /* disp_msg start: every registered type plus two unknown ones */
+    ret = msg_builder_init(&bld, 0);
+    for (int i = 0; i < UT_DISP_TYPE_CNT; i++) {
+        val = (uint8_t)i;
+        ret |= msg_builder_append(&bld, ut_disp_type(i), &val, 1);
+    }
+    ret |= msg_builder_append(&bld, 0x8000, &val, 1);
+    ret |= msg_builder_append(&bld, 0x0FFF, &val, 1);
+    data = msg_builder_finalize(&bld);
+    if (ut_common_compile_ret(ret, ERR_SUCCESS) || data == NULL) {
+        printf("msg_builder_append failed\n");
+        return -2;
+    }
+
+    buff = msg_buff_init();
+    msg_buff_bind_data(buff, data, 0);
+    ret = disp_msg(tbl, buff);
+    if (ut_common_compile_ret(ret, UT_DISP_TYPE_CNT + 2)) {
+        printf("disp_msg cnt failed\n");
+        return -2;
+    }
+
+    for (int i = 0; i < UT_DISP_TYPE_CNT; i++) {
+        if (ut_common_compile_uint32(ut_disp_hits[i], 1)) {
+            printf("disp_msg handler %d failed\n", i);
+            return -2;
+        }
+    }
+
+    if (ut_common_compile_uint32(ut_disp_dflt, 2) || ut_common_compile_uint32(tbl->stats.unknown, 2)
+        || ut_common_compile_uint32(tbl->stats.errors, 0)) {
+        printf("disp_msg unknown failed\n");
+        return -2;
+    }
+
+    /* compact blocks go through the same table */
+    ret = msg_data_src_set_encoding(&data, PROTO_HEADER_CFG_COMPACT);
+    msg_buff_reset_data(buff, data, 0);
+    if (ut_common_compile_ret(ret, ERR_SUCCESS) || ut_common_compile_ret(disp_msg(tbl, buff), UT_DISP_TYPE_CNT + 2)
+        || ut_common_compile_uint32(ut_disp_hits[250], 2)) {
+        printf("disp_msg compact failed\n");
+        return -2;
+    }
+    /* disp_msg end */
+
+    /* disp_unregister start */
+    for (int i = 100; i < 200; i++) {
+        disp_unregister(tbl, ut_disp_type(i));
+    }
+
+    if (ut_common_compile_uint16(tbl->page_cnt, 2)
+        || ut_common_compile_ret(disp_unregister(tbl, ut_disp_type(150)), -ERR_NOT_FOUND)) {
+        printf("disp_unregister failed\n");
+        return -3;
+    }
+
+    disp_msg(tbl, buff);
+    if (ut_common_compile_uint32(ut_disp_hits[150], 2) || ut_common_compile_uint32(tbl->stats.unknown, 2 + 2 + 102)) {
+        printf("disp_unregister dispatch failed\n");
+        return -3;
+    }
+    /* disp_unregister end */
+
+    msg_buff_deinit(buff);
+    disp_table_deinit(tbl);
+
+    return 0;
+}
+
+int main()
+{
+    int ret;
+
+    ret = disp_table_case();
+    if (ret) {
+        printf("disp_table_case failed\n");
+        return -1;
+    } else {
+        printf("disp_table_case success\n");
+    }
+
+    return 0;
+}
@@ -0,0 +1,195 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "../src/frag.h"
+#include "../src/proto.h"
+#include "../src/errno.h"
+#include "../src/buff.h"
+
+#include "ut_common.h"
+
+#define UT_FRAG_LEN 200000
+#define UT_FRAG_MTU 1024
+#define UT_FRAG_CNT_MAX 256
+
+static int frag_split(struct proto_header *header, const uint8_t *payload, uint32_t len,
+                      uint32_t msg_id, struct data_src **frame)
+{
+    struct frag_tx tx;
+    struct msg_sg sg;
+    int cnt = 0;
+    int ret;
+
+    ret = frag_tx_init(&tx, header, payload, len, UT_FRAG_MTU, msg_id);
+    if (ret != ERR_SUCCESS) {
+        return ret;
+    }
+
+    while (cnt < UT_FRAG_CNT_MAX && frag_tx_next(&tx, &sg) == ERR_SUCCESS) {
+        frame[cnt] = msg_sg_flatten(&sg);
+        if (frame[cnt] == NULL || frame[cnt]->header.len > UT_FRAG_MTU) {
+            return -1;
+        }
+        cnt++;
+    }
+
+    return cnt;
+}
+
+int frag_reasm_case(void)
+{
+    static struct data_src *frame[UT_FRAG_CNT_MAX];
+    struct proto_header header;
+    struct frag_reasm *reasm;
+    struct data_src *first;
+    struct frag_tx tx;
+    struct msg_sg sg;
+    uint8_t *payload;
+    uint8_t *msg = NULL;
+    uint32_t len;
+    int cnt;
+    int ret;
+
+    payload = malloc(UT_FRAG_LEN);
+    if (payload == NULL) {
+        return -1;
+    }
+    for (uint32_t i = 0; i < UT_FRAG_LEN; i++) {
+        payload[i] = (uint8_t)(i * 31 + (i >> 8));
+    }
+
+    proto_header_reset(&header);
+    proto_header_set_src_id(&header, 0x42);
+
+    /* frag_tx_init start */
+    ret = frag_tx_init(&(struct frag_tx){0}, &header, payload, UT_FRAG_LEN, FRAG_MTU_MIN - 1, 1);
+    if (ut_common_compile_ret(ret, -ERR_OUT_OF_RANGE)) {
+        printf("frag_tx_init -ERR_OUT_OF_RANGE failed\n");
+        return -1;
+    }
+
+    cnt = frag_split(&header, payload, UT_FRAG_LEN, 7, frame);
+    if (cnt != (UT_FRAG_LEN + UT_FRAG_MTU - FRAG_OVERHEAD - 1) / (UT_FRAG_MTU - FRAG_OVERHEAD)) {
+        printf("frag_tx_next cnt failed\n");
+        return -1;
+    }
+    /* frag_tx_init end */
+
+    /* frag_reasm_input start: reverse order plus one duplicate */
+    reasm = frag_reasm_init(0, 0);
+    if (reasm == NULL) {
+        return -2;
+    }
+
+    ret = frag_reasm_input(reasm, frame[cnt - 1], 0, &msg, &len);
+    if (ut_common_compile_ret(ret, 0)) {
+        printf("frag_reasm_input pending failed\n");
+        return -2;
+    }
+
+    for (int i = cnt - 1; i >= 0; i--) {
+        ret = frag_reasm_input(reasm, frame[i], 0, &msg, &len);
+        if (ret < 0 || (ret == 1) != (i == 0)) {
+            printf("frag_reasm_input %d failed\n", i);
+            return -2;
+        }
+    }
+
+    if (ut_common_compile_uint32(len, sizeof(struct proto_header) + UT_FRAG_LEN)
+        || memcmp(msg + sizeof(struct proto_header), payload, UT_FRAG_LEN)) {
+        printf("frag_reasm_input payload failed\n");
+        return -2;
+    }
+
+    if (ut_common_compile_uint32(((struct proto_header *)msg)->src_id, 0x42)
+        || ut_common_compile_uint16(reasm->ctx_cnt, 0) || ut_common_compile_uint32(reasm->mem_used, 0)) {
+        printf("frag_reasm_input state failed\n");
+        return -2;
+    }
+    free(msg);
+    /* frag_reasm_input end */
+
+    /* frag_reasm_reap start */
+    ret = frag_reasm_input(reasm, frame[3], 100, &msg, &len);
+    if (ut_common_compile_ret(ret, 0)) {
+        printf("frag_reasm_input pending failed\n");
+        return -3;
+    }
+
+    if (ut_common_compile_ret(frag_reasm_reap(reasm, 100 + FRAG_TIMEOUT_MS_DEFAULT - 1), 0)
+        || ut_common_compile_ret(frag_reasm_reap(reasm, 100 + FRAG_TIMEOUT_MS_DEFAULT), 1)
+        || ut_common_compile_uint32(reasm->stats.timeouts, 1)) {
+        printf("frag_reasm_reap failed\n");
+        return -3;
+    }
+    frag_reasm_deinit(reasm);
+    /* frag_reasm_reap end */
+
+    /* bounded memory: a second message evicts the first one */
+    reasm = frag_reasm_init(UT_FRAG_LEN + 1024, 0);
+    if (reasm == NULL) {
+        return -4;
+    }
+
+    frag_reasm_input(reasm, frame[0], 0, &msg, &len);
+    proto_header_set_src_id(&frame[1]->header, 0x43);
+    frag_reasm_input(reasm, frame[1], 0, &msg, &len);
+    if (ut_common_compile_uint32(reasm->stats.evicted, 1) || ut_common_compile_uint16(reasm->ctx_cnt, 1)) {
+        printf("frag_reasm_input evict failed\n");
+        return -4;
+    }
+    frag_reasm_deinit(reasm);
+
+    /* largest message start: what frag_tx_init() lets out, a default reassembly takes in */
+    ret = frag_tx_init(&(struct frag_tx){0}, &header, payload, FRAG_MSG_LEN_MAX + 1, UT_FRAG_MTU, 1);
+    if (ut_common_compile_ret(ret, -ERR_OUT_OF_RANGE)) {
+        printf("frag_tx_init beyond FRAG_MSG_LEN_MAX failed\n");
+        return -5;
+    }
+
+    reasm = frag_reasm_init(0, 0);
+    if (reasm == NULL) {
+        return -5;
+    }
+
+    if (ut_common_compile_ret(frag_tx_init(&tx, &header, payload, FRAG_MSG_LEN_MAX, UT_FRAG_MTU, 9), 0)
+        || ut_common_compile_ret(frag_tx_next(&tx, &sg), 0)) {
+        printf("frag_tx_init FRAG_MSG_LEN_MAX failed\n");
+        return -5;
+    }
+
+    first = msg_sg_flatten(&sg);
+    ret = frag_reasm_input(reasm, first, 0, &msg, &len);
+    msg_data_src_deinit(first);
+    if (ut_common_compile_ret(ret, 0) || ut_common_compile_uint16(reasm->ctx_cnt, 1)
+        || ut_common_compile_uint32(reasm->mem_used, FRAG_MEM_MAX_DEFAULT)) {
+        printf("frag_reasm_input FRAG_MSG_LEN_MAX failed\n");
+        return -5;
+    }
+    frag_reasm_deinit(reasm);
+    /* largest message end */
+
+    for (int i = 0; i < cnt; i++) {
+        msg_data_src_deinit(frame[i]);
+    }
+    free(payload);
+
+    return 0;
+}
+
+int main()
+{
+    int ret;
+
+    ret = frag_reasm_case();
+    if (ret) {
+        printf("frag_reasm_case failed\n");
+        return -1;
+    } else {
+        printf("frag_reasm_case success\n");
+    }
+
+    return 0;
+}
@@ -0,0 +1,191 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "../src/framing.h"
+#include "../src/proto.h"
+#include "../src/errno.h"
+#include "../src/csum.h"
+#include "../src/buff.h"
+
+#include "ut_common.h"
+
+#define UT_FRAMING_LEN_MAX 1200
+
+int framing_vector_case(void)
+{
+    const uint8_t cobs_in[] = {0x11, 0x22, 0x00, 0x33};
+    const uint8_t cobs_out[] = {0x03, 0x11, 0x22, 0x02, 0x33, 0x00};
+    const uint8_t slip_in[] = {0xC0, 0xDB, 0x01};
+    const uint8_t slip_out[] = {0xDB, 0xDC, 0xDB, 0xDD, 0x01, 0xC0};
+    uint8_t buf[COBS_ENCODE_MAX(254)];
+    uint8_t run[254];
+    int ret;
+
+    /* cobs_encode start */
+    ret = cobs_encode(cobs_in, sizeof(cobs_in), buf, sizeof(buf));
+    if (ut_common_compile_ret(ret, sizeof(cobs_out)) || memcmp(buf, cobs_out, sizeof(cobs_out))) {
+        printf("cobs_encode vector failed\n");
+        return -1;
+    }
+
+    memset(run, 0x5A, sizeof(run));
+    ret = cobs_encode(run, sizeof(run), buf, sizeof(buf));
+    if (ut_common_compile_ret(ret, 257) || ut_common_compile_uint8(buf[0], 0xFF)
+        || ut_common_compile_uint8(buf[255], 0x01) || ut_common_compile_uint8(buf[256], 0x00)) {
+        printf("cobs_encode full block failed\n");
+        return -1;
+    }
+
+    ret = cobs_encode(run, sizeof(run), buf, COBS_ENCODE_MAX(254) - 1);
+    if (ut_common_compile_ret(ret, -ERR_OUT_OF_RANGE)) {
+        printf("cobs_encode -ERR_OUT_OF_RANGE failed\n");
+        return -1;
+    }
+    /* cobs_encode end */
+
+    /* cobs_decode start: zero inside a run is corruption */
+    ret = cobs_decode(cobs_out, sizeof(cobs_out) - 1, buf, sizeof(buf));
+    if (ut_common_compile_ret(ret, sizeof(cobs_in)) || memcmp(buf, cobs_in, sizeof(cobs_in))) {
+        printf("cobs_decode vector failed\n");
+        return -2;
+    }
+
+    memcpy(buf, cobs_out, sizeof(cobs_out));
+    buf[2] = 0x00;
+    ret = cobs_decode(buf, sizeof(cobs_out) - 1, buf, sizeof(buf));
+    if (ut_common_compile_ret(ret, -ERR_FAIL)) {
+        printf("cobs_decode -ERR_FAIL failed\n");
+        return -2;
+    }
+    /* cobs_decode end */
+
+    /* slip start */
+    ret = slip_encode(slip_in, sizeof(slip_in), buf, sizeof(buf));
+    if (ut_common_compile_ret(ret, sizeof(slip_out)) || memcmp(buf, slip_out, sizeof(slip_out))) {
+        printf("slip_encode vector failed\n");
+        return -3;
+    }
+
+    ret = slip_decode(slip_out, sizeof(slip_out) - 1, buf, sizeof(buf));
+    if (ut_common_compile_ret(ret, sizeof(slip_in)) || memcmp(buf, slip_in, sizeof(slip_in))) {
+        printf("slip_decode vector failed\n");
+        return -3;
+    }
+
+    buf[0] = SLIP_ESC;
+    buf[1] = 0x00;
+    if (ut_common_compile_ret(slip_decode(buf, 2, buf, sizeof(buf)), -ERR_FAIL)) {
+        printf("slip_decode -ERR_FAIL failed\n");
+        return -3;
+    }
+    /* slip end */
+
+    return 0;
+}
+
+int framing_roundtrip_case(void)
+{
+    static uint8_t src[UT_FRAMING_LEN_MAX];
+    static uint8_t enc[SLIP_ENCODE_MAX(UT_FRAMING_LEN_MAX)];
+    static uint8_t dec[UT_FRAMING_LEN_MAX];
+    const uint32_t lens[] = {0, 1, 31, 253, 254, 255, 508, 509, 777, UT_FRAMING_LEN_MAX};
+    int ret, delim;
+
+    srand(3);
+    for (unsigned int l = 0; l < sizeof(lens) / sizeof(lens[0]); l++) {
+        for (int density = 0; density < 3; density++) {
+            for (uint32_t i = 0; i < lens[l]; i++) {
+                src[i] = (density == 0) ? 1 + rand() % 255 : (density == 1) ? rand() : rand() % 3 + 0xBF;
+            }
+
+            for (uint8_t mode = FRAMING_COBS; mode <= FRAMING_SLIP; mode++) {
+                ret = (mode == FRAMING_COBS) ? cobs_encode(src, lens[l], enc, sizeof(enc))
+                                             : slip_encode(src, lens[l], enc, sizeof(enc));
+                delim = framing_find_delim(enc, ret, mode);
+                if (ret < 0 || ut_common_compile_ret(delim, ret - 1)) {
+                    printf("framing encode %u/%d/%d failed\n", lens[l], density, mode);
+                    return -1;
+                }
+
+                ret = (mode == FRAMING_COBS) ? cobs_decode(enc, delim, dec, sizeof(dec))
+                                             : slip_decode(enc, delim, dec, sizeof(dec));
+                if (ut_common_compile_ret(ret, lens[l]) || memcmp(src, dec, lens[l])) {
+                    printf("framing decode %u/%d/%d failed\n", lens[l], density, mode);
+                    return -1;
+                }
+            }
+        }
+    }
+
+    return 0;
+}
+
+int framing_data_src_case(void)
+{
+    uint8_t enc[COBS_ENCODE_MAX(128)];
+    struct msg_builder bld;
+    struct data_src *data;
+    uint8_t val[40] = {0};
+    int ret;
+
+    msg_builder_init(&bld, 0);
+    proto_header_set_dst_id(msg_builder_get_header(&bld), 0xC0DB0000);
+    msg_builder_append(&bld, 1, val, sizeof(val));
+    data = msg_builder_finalize(&bld);
+
+    /* framing_encode_data_src start */
+    for (uint8_t mode = FRAMING_COBS; mode <= FRAMING_SLIP; mode++) {
+        ret = framing_encode_data_src(data, mode, CSUM_TYPE_CRC16, enc, sizeof(enc));
+        if (ret < 0) {
+            printf("framing_encode_data_src failed\n");
+            return -1;
+        }
+
+        ret = (mode == FRAMING_COBS) ? cobs_decode(enc, ret - 1, enc, sizeof(enc))
+                                     : slip_decode(enc, ret - 1, enc, sizeof(enc));
+        if (ut_common_compile_ret(ret, data->header.len)
+            || ut_common_compile_ret(proto_frame_check_checksum(enc, ret, CSUM_TYPE_CRC16), ERR_SUCCESS)
+            || ut_common_compile_uint32(proto_get_be32(enc + PROTO_WIRE_OFF_DST_ID), 0xC0DB0000)) {
+            printf("framing_encode_data_src decode failed\n");
+            return -1;
+        }
+    }
+    /* framing_encode_data_src end */
+
+    msg_data_src_deinit(data);
+
+    return 0;
+}
+
+int main()
+{
+    int ret;
+
+    ret = framing_vector_case();
+    if (ret) {
+        printf("framing_vector_case failed\n");
+        return -1;
+    } else {
+        printf("framing_vector_case success\n");
+    }
+
+    ret = framing_roundtrip_case();
+    if (ret) {
+        printf("framing_roundtrip_case failed\n");
+        return -1;
+    } else {
+        printf("framing_roundtrip_case success\n");
+    }
+
+    ret = framing_data_src_case();
+    if (ret) {
+        printf("framing_data_src_case failed\n");
+        return -1;
+    } else {
+        printf("framing_data_src_case success\n");
+    }
+
+    return 0;
+}
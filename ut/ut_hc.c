@@ -0,0 +1,129 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "../src/hc.h"
+#include "../src/proto.h"
+#include "../src/errno.h"
+#include "../src/csum.h"
+
+#include "ut_common.h"
+
+#define UT_HC_PAYLOAD_LEN 24
+
+static int hc_roundtrip(struct hc_link *tx, struct hc_link *rx, const uint8_t *frame, uint16_t len)
+{
+    uint8_t pkt[HC_HDR_MAX + UT_HC_PAYLOAD_LEN];
+    uint8_t out[PROTO_HEADER_WIRE_SIZE + UT_HC_PAYLOAD_LEN];
+    int hlen;
+    int ret;
+
+    hlen = hc_compress(tx, frame, pkt, sizeof(pkt));
+    if (hlen < 0) {
+        return hlen;
+    }
+    memcpy(pkt + hlen, frame + PROTO_HEADER_WIRE_SIZE, len - PROTO_HEADER_WIRE_SIZE);
+
+    ret = hc_decompress(rx, pkt, hlen + len - PROTO_HEADER_WIRE_SIZE, out, sizeof(out));
+    if (ret != len || memcmp(out, frame, len)) {
+        return -1;
+    }
+
+    return hlen;
+}
+
+int hc_compress_case(void)
+{
+    uint8_t frame[PROTO_HEADER_WIRE_SIZE + UT_HC_PAYLOAD_LEN];
+    struct proto_header header;
+    struct hc_link *tx, *rx;
+    uint8_t pkt[HC_HDR_MAX];
+    uint8_t out[PROTO_HEADER_WIRE_SIZE];
+    int ret;
+
+    tx = hc_link_init();
+    rx = hc_link_init();
+    if (tx == NULL || rx == NULL) {
+        return -1;
+    }
+
+    proto_header_reset(&header);
+    proto_header_set_src_id(&header, 0x11);
+    proto_header_set_dst_id(&header, 0x22);
+    header.len = sizeof(frame);
+    proto_header_encode(&header, frame, sizeof(frame));
+    for (int i = PROTO_HEADER_WIRE_SIZE; i < (int)sizeof(frame); i++) {
+        frame[i] = (uint8_t)i;
+    }
+    proto_frame_set_checksum(frame, sizeof(frame), CSUM_TYPE_CRC16);
+
+    /* hc_compress start: IR first, CO with only the checksum after */
+    ret = hc_roundtrip(tx, rx, frame, sizeof(frame));
+    if (ut_common_compile_ret(ret, 1 + PROTO_HEADER_WIRE_SIZE)) {
+        printf("hc_compress IR failed\n");
+        return -1;
+    }
+
+    ret = hc_roundtrip(tx, rx, frame, sizeof(frame));
+    if (ut_common_compile_ret(ret, 4)) {
+        printf("hc_compress CO failed\n");
+        return -1;
+    }
+
+    frame[PROTO_WIRE_OFF_HOP_LIMIT]--;
+    frame[PROTO_WIRE_OFF_HEART_RATE + 1]++;
+    proto_frame_set_checksum(frame, sizeof(frame), CSUM_TYPE_CRC16);
+    ret = hc_roundtrip(tx, rx, frame, sizeof(frame));
+    if (ut_common_compile_ret(ret, 7)) {
+        printf("hc_compress CO delta failed\n");
+        return -1;
+    }
+
+    for (int i = 2; i < HC_REFRESH_INTERVAL; i++) {
+        hc_roundtrip(tx, rx, frame, sizeof(frame));
+    }
+    ret = hc_roundtrip(tx, rx, frame, sizeof(frame));
+    if (ut_common_compile_ret(ret, 1 + PROTO_HEADER_WIRE_SIZE)
+        || ut_common_compile_uint32(tx->stats.ir_tx, 2)) {
+        printf("hc_compress refresh failed\n");
+        return -1;
+    }
+    /* hc_compress end */
+
+    /* hc_decompress start: a CO packet without context is refused */
+    hc_link_reset(rx);
+    ret = hc_compress(tx, frame, pkt, sizeof(pkt));
+    ret = hc_decompress(rx, pkt, ret, out, sizeof(out));
+    if (ut_common_compile_ret(ret, -ERR_NOT_FOUND) || ut_common_compile_uint32(rx->stats.rx_no_ctx, 1)) {
+        printf("hc_decompress no context failed\n");
+        return -2;
+    }
+
+    ret = hc_compress(tx, frame, pkt, 3);
+    if (ut_common_compile_ret(ret, -ERR_OUT_OF_RANGE)) {
+        printf("hc_compress size failed\n");
+        return -2;
+    }
+    /* hc_decompress end */
+
+    hc_link_deinit(tx);
+    hc_link_deinit(rx);
+
+    return 0;
+}
+
+int main()
+{
+    int ret;
+
+    ret = hc_compress_case();
+    if (ret) {
+        printf("hc_compress_case failed\n");
+        return -1;
+    } else {
+        printf("hc_compress_case success\n");
+    }
+
+    return 0;
+}
@@ -0,0 +1,469 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "../src/intf.h"
+#include "../src/proto.h"
+#include "../src/errno.h"
+#include "../src/buff.h"
+#include "../src/csum.h"
+
+#include "ut_common.h"
+
+#define UT_INTF_FRAME_MAX 1024
+#define UT_INTF_WIRE_CNT 2048
+#define UT_INTF_PAYLOAD 200
+#define UT_INTF_LARGE_LEN (1024 * 1024)
+#define UT_INTF_BATCH 8
+
+/* loopback link, frames queue up on xmit() and come back on recv() */
+static uint8_t ut_intf_wire[UT_INTF_WIRE_CNT][UT_INTF_FRAME_MAX];
+static uint16_t ut_intf_wire_len[UT_INTF_WIRE_CNT];
+static uint32_t ut_intf_wire_head;
+static uint32_t ut_intf_wire_tail;
+static uint8_t ut_intf_recv_no_cnt;     // recv() reports 0 bytes, like a driver that cannot tell
+static uint32_t ut_intf_recv_calls;
+
+static int ut_intf_init(struct interface *intf)
+{
+    return 0;
+}
+
+static void ut_intf_deinit(struct interface *intf)
+{
+}
+
+static int ut_intf_xmit(struct interface *intf, uint8_t *pkt, void *arg)
+{
+    uint16_t len = proto_frame_get_len(pkt);
+
+    if (len > UT_INTF_FRAME_MAX || ut_intf_wire_tail - ut_intf_wire_head == UT_INTF_WIRE_CNT) {
+        return -1;
+    }
+
+    ut_intf_wire_len[ut_intf_wire_tail % UT_INTF_WIRE_CNT] = len;
+    memcpy(ut_intf_wire[ut_intf_wire_tail++ % UT_INTF_WIRE_CNT], pkt, len);
+
+    return 0;
+}
+
+static int ut_intf_recv(struct interface *intf, uint8_t *pkt, void *arg)
+{
+    uint16_t len;
+
+    ut_intf_recv_calls++;
+    if (ut_intf_wire_head == ut_intf_wire_tail) {
+        return -1;
+    }
+
+    len = ut_intf_wire_len[ut_intf_wire_head % UT_INTF_WIRE_CNT];
+    memcpy(pkt, ut_intf_wire[ut_intf_wire_head++ % UT_INTF_WIRE_CNT], len);
+
+    return ut_intf_recv_no_cnt ? 0 : len;
+}
+
+static uint8_t *ut_intf_large_msg;
+static uint32_t ut_intf_large_len;
+
+static int ut_intf_large(struct interface *intf, uint8_t *msg, uint32_t len, void *arg)
+{
+    ut_intf_large_msg = msg;
+    ut_intf_large_len = len;
+
+    return 0;
+}
+
+static struct interface_ops ut_intf_ops = {
+    .init = ut_intf_init,
+    .deinit = ut_intf_deinit,
+    .xmit = ut_intf_xmit,
+    .recv = ut_intf_recv,
+};
+
+/* The frame last put on the wire, checked as its receiver would. */
+static int ut_intf_wire_check(uint8_t csum_type, uint8_t hop_limit)
+{
+    uint8_t *frame = ut_intf_wire[(ut_intf_wire_tail - 1) % UT_INTF_WIRE_CNT];
+
+    if (frame[PROTO_WIRE_OFF_HOP_LIMIT] != hop_limit) {
+        return -ERR_FAIL;
+    }
+
+    return proto_frame_check_checksum(frame, proto_frame_get_len(frame), csum_type);
+}
+
+static struct msg_buff *ut_intf_local_msg(uint16_t payload)
+{
+    struct msg_buff *msg = msg_buff_alloc(sizeof(struct data_src) + payload);
+    struct data_src *data = (struct data_src *)msg->data;
+
+    data->blocks[0].type = 0x11;
+    data->blocks[0].len = payload - sizeof(struct proto_block);
+    memset(data->blocks[0].data, 0xA5, data->blocks[0].len);
+    proto_header_set_hop_limit(&data->header, 8);
+    proto_header_set_src_id(&data->header, 0x01020304);
+
+    return msg;
+}
+
+int intf_fwd_case(void)
+{
+    struct interface_config cfg[2];
+    struct interface_ctrl_block *icb;
+    struct interface *rx_intf, *tx_intf;
+    struct msg_buff *msg, *rx;
+    struct data_src *data;
+
+    memset(cfg, 0, sizeof(cfg));
+    cfg[0].csum_type = CSUM_TYPE_CRC16;
+    cfg[1].csum_type = CSUM_TYPE_CRC32C;
+    icb = intf_ctrl_blk_init();
+    if (ut_common_compile_ret(intf_register(icb, &cfg[0], &ut_intf_ops), 0)
+        || ut_common_compile_ret(intf_register(icb, &cfg[1], &ut_intf_ops), 0)) {
+        printf("intf_register failed\n");
+        return -1;
+    }
+    rx_intf = icb->if_ctrl_head;
+    tx_intf = icb->if_ctrl_tail;
+
+    /* local start: a frame without a received checksum is summed in full */
+    msg = ut_intf_local_msg(UT_INTF_PAYLOAD);
+    if (ut_common_compile_uint8(msg_buff_get_csum_type(msg), CSUM_TYPE_AUTO)
+        || ut_common_compile_ret(intf_xmit(rx_intf, msg), 0)
+        || ut_common_compile_ret(ut_intf_wire_check(CSUM_TYPE_CRC16, 8), ERR_SUCCESS)) {
+        printf("intf_xmit local failed\n");
+        return -2;
+    }
+    msg_buff_deinit(msg);
+    /* local end */
+
+    /* recv start: the checksum the frame came with is marked good */
+    rx = msg_buff_alloc(UT_INTF_FRAME_MAX);
+    if (ut_common_compile_ret(intf_recv(rx_intf, rx), 0)
+        || ut_common_compile_uint8(msg_buff_get_csum_type(rx), CSUM_TYPE_CRC16)) {
+        printf("intf_recv csum type failed\n");
+        return -3;
+    }
+    /* recv end */
+
+    /* same type start: the hop limit patch is what goes out */
+    if (ut_common_compile_ret(msg_buff_dec_hop_limit(rx, CSUM_TYPE_CRC16), ERR_SUCCESS)
+        || ut_common_compile_ret(intf_xmit(rx_intf, rx), 0)
+        || ut_common_compile_ret(ut_intf_wire_check(CSUM_TYPE_CRC16, 7), ERR_SUCCESS)) {
+        printf("intf_xmit forward same type failed\n");
+        return -4;
+    }
+
+    /* not summed again: a payload edit left marked goes out with the stale checksum */
+    data = (struct data_src *)rx->data;
+    data->blocks[0].data[0] ^= 1;
+    if (ut_common_compile_ret(intf_xmit(rx_intf, rx), 0)
+        || ut_common_compile_ret(ut_intf_wire_check(CSUM_TYPE_CRC16, 7), -ERR_FAIL)) {
+        printf("intf_xmit forward carry failed\n");
+        return -4;
+    }
+    msg_buff_set_csum_type(rx, CSUM_TYPE_AUTO);
+    if (ut_common_compile_ret(intf_xmit(rx_intf, rx), 0)
+        || ut_common_compile_ret(ut_intf_wire_check(CSUM_TYPE_CRC16, 7), ERR_SUCCESS)) {
+        printf("intf_xmit forward resum failed\n");
+        return -4;
+    }
+    /* same type end */
+
+    /* other type start: the egress checksum is summed in full */
+    ut_intf_wire_head = ut_intf_wire_tail - 1;
+    if (ut_common_compile_ret(intf_recv(rx_intf, rx), 0)
+        || ut_common_compile_ret(msg_buff_dec_hop_limit(rx, CSUM_TYPE_CRC32C), ERR_SUCCESS)
+        || ut_common_compile_uint8(msg_buff_get_csum_type(rx), CSUM_TYPE_CRC32C)
+        || ut_common_compile_ret(intf_xmit(tx_intf, rx), 0)
+        || ut_common_compile_ret(ut_intf_wire_check(CSUM_TYPE_CRC32C, 6), ERR_SUCCESS)) {
+        printf("intf_xmit forward other type failed\n");
+        return -5;
+    }
+    /* other type end */
+
+    /* bad checksum start: the mark is dropped with the frame */
+    ut_intf_wire[(ut_intf_wire_tail - 1) % UT_INTF_WIRE_CNT][PROTO_HEADER_WIRE_SIZE] ^= 1;
+    ut_intf_wire_head = ut_intf_wire_tail - 1;
+    if (ut_common_compile_ret(intf_recv(tx_intf, rx), -1)
+        || ut_common_compile_uint8(msg_buff_get_csum_type(rx), CSUM_TYPE_AUTO)) {
+        printf("intf_recv bad checksum failed\n");
+        return -6;
+    }
+    /* bad checksum end */
+
+    msg_buff_deinit(rx);
+    intf_ctrl_blk_deinit(icb);
+
+    return 0;
+}
+
+int intf_batch_case(void)
+{
+    struct interface_config cfg;
+    struct interface_ctrl_block *icb;
+    struct msg_buff *rx[UT_INTF_BATCH];
+    struct msg_buff *msg;
+    struct interface *intf;
+    uint64_t ts;
+
+    memset(&cfg, 0, sizeof(cfg));
+    cfg.csum_type = CSUM_TYPE_INET16;
+    icb = intf_ctrl_blk_init();
+    if (ut_common_compile_ret(intf_register(icb, &cfg, &ut_intf_ops), 0)) {
+        printf("intf_register failed\n");
+        return -1;
+    }
+    intf = icb->if_ctrl_head;
+
+    ut_intf_wire_head = ut_intf_wire_tail = 0;
+    msg = ut_intf_local_msg(UT_INTF_PAYLOAD);
+    for (int i = 0; i < 4; i++) {
+        intf_xmit(intf, msg);
+    }
+    msg_buff_deinit(msg);
+    ut_intf_wire[1][PROTO_HEADER_WIRE_SIZE] ^= 1;
+    for (int i = 0; i < UT_INTF_BATCH; i++) {
+        rx[i] = msg_buff_alloc(UT_INTF_FRAME_MAX);
+    }
+
+    /* intf_recv_batch start: one clock reading for the batch, live again after it */
+    ut_intf_recv_calls = 0;
+    if (ut_common_compile_ret(intf_recv_batch(intf, rx, UT_INTF_BATCH), 3)
+        || rx[0]->timestamp != rx[1]->timestamp || rx[1]->timestamp != rx[2]->timestamp) {
+        printf("intf_recv_batch failed\n");
+        return -1;
+    }
+
+    ts = rx[2]->timestamp;
+    while (tstamp_now_ns() == ts) {
+    }
+    if (tstamp_cached_ns() <= ts) {
+        printf("intf_recv_batch invalidate failed\n");
+        return -1;
+    }
+
+    /* past the dropped frame, up to the first empty poll and no further */
+    if (ut_common_compile_uint32(ut_intf_recv_calls, 5)
+        || ut_common_compile_ret(intf_recv_batch(intf, rx, UT_INTF_BATCH), 0)
+        || ut_common_compile_uint32(ut_intf_recv_calls, 6)
+        || ut_common_compile_ret(intf_recv(intf, rx[0]), 2)) {
+        printf("intf_recv_batch idle failed\n");
+        return -1;
+    }
+    /* intf_recv_batch end */
+
+    for (int i = 0; i < UT_INTF_BATCH; i++) {
+        msg_buff_deinit(rx[i]);
+    }
+    intf_ctrl_blk_deinit(icb);
+
+    return 0;
+}
+
+/* Receive every frame on the wire, returns what the last intf_recv() did. */
+static int ut_intf_recv_all(struct interface *intf, struct msg_buff *rx)
+{
+    int ret = -1;
+
+    while (ut_intf_wire_head != ut_intf_wire_tail) {
+        ret = intf_recv(intf, rx);
+        if (ret < 0) {
+            break;
+        }
+    }
+
+    return ret;
+}
+
+int intf_large_case(void)
+{
+    struct interface_config cfg;
+    struct interface_ctrl_block *icb;
+    struct proto_header header;
+    struct interface *intf;
+    struct msg_buff *msg, *rx;
+    struct data_src *data;
+    uint8_t *payload;
+
+    memset(&cfg, 0, sizeof(cfg));
+    cfg.csum_type = CSUM_TYPE_CRC32C;
+    cfg.mtu = UT_INTF_FRAME_MAX;
+    icb = intf_ctrl_blk_init();
+    if (ut_common_compile_ret(intf_register(icb, &cfg, &ut_intf_ops), 0)) {
+        printf("intf_register failed\n");
+        return -1;
+    }
+    intf = icb->if_ctrl_head;
+
+    payload = malloc(UT_INTF_LARGE_LEN);
+    for (uint32_t i = 0; i < UT_INTF_LARGE_LEN; i++) {
+        payload[i] = (uint8_t)(i * 31 + (i >> 8));
+    }
+    proto_header_reset(&header);
+    proto_header_set_src_id(&header, 0x01020304);
+    rx = msg_buff_alloc(UT_INTF_FRAME_MAX);
+
+    /* no handler start: a message beyond PROTO_HEADER_LEN_MAX is dropped */
+    ut_intf_wire_head = ut_intf_wire_tail = 0;
+    if (ut_common_compile_ret(intf_xmit_large(intf, &header, payload, PROTO_HEADER_LEN_MAX + 1), 0)
+        || ut_common_compile_ret(ut_intf_recv_all(intf, rx), -1)) {
+        printf("intf_recv large without handler failed\n");
+        return -2;
+    }
+    /* no handler end */
+
+    /* round trip start: 1 MB out in fragments, back whole through the handler */
+    ut_intf_wire_head = ut_intf_wire_tail = 0;
+    if (ut_common_compile_ret(intf_set_large_handler(intf, ut_intf_large, NULL), 0)
+        || ut_common_compile_ret(intf_xmit_large(intf, &header, payload, UT_INTF_LARGE_LEN), 0)
+        || ut_common_compile_ret(ut_intf_recv_all(intf, rx), 1)
+        || ut_intf_large_msg == NULL
+        || ut_common_compile_uint32(ut_intf_large_len, sizeof(struct proto_header) + UT_INTF_LARGE_LEN)
+        || ut_common_compile_uint32(((struct proto_header *)ut_intf_large_msg)->src_id, 0x01020304)
+        || memcmp(ut_intf_large_msg + sizeof(struct proto_header), payload, UT_INTF_LARGE_LEN) != 0) {
+        printf("intf_recv large round trip failed\n");
+        return -3;
+    }
+    free(ut_intf_large_msg);
+    /* round trip end */
+
+    /* reassembled start: a message within a msg_buff is delivered in it once validated */
+    cfg.mtu = 256;
+    msg = ut_intf_local_msg(600);
+    if (ut_common_compile_ret(intf_xmit(intf, msg), 0)
+        || ut_common_compile_ret(ut_intf_recv_all(intf, rx), 0)
+        || memcmp(((struct data_src *)rx->data)->blocks, ((struct data_src *)msg->data)->blocks, 600) != 0) {
+        printf("intf_recv reassembled failed\n");
+        return -4;
+    }
+    msg_buff_deinit(rx);
+
+    /* blocks that do not tile the payload only show once reassembled */
+    data = (struct data_src *)msg->data;
+    data->blocks[0].len += 8;
+    rx = msg_buff_alloc(UT_INTF_FRAME_MAX);
+    if (ut_common_compile_ret(intf_xmit(intf, msg), 0) || ut_common_compile_ret(ut_intf_recv_all(intf, rx), -1)) {
+        printf("intf_recv reassembled malformed failed\n");
+        return -4;
+    }
+    /* reassembled end */
+
+    /* frag_mem_max start: what the peer cannot reassemble is not sent */
+    cfg.frag_mem_max = sizeof(struct proto_header) + 4096;
+    if (ut_common_compile_ret(intf_unregister(icb, intf->info.intf_id), 0)
+        || ut_common_compile_ret(intf_register(icb, &cfg, &ut_intf_ops), 0)) {
+        printf("intf_register frag_mem_max failed\n");
+        return -5;
+    }
+    intf = icb->if_ctrl_head;
+    ut_intf_wire_head = ut_intf_wire_tail = 0;
+    if (ut_common_compile_ret(intf_xmit_large(intf, &header, payload, 4097), -1)
+        || ut_common_compile_uint32(ut_intf_wire_tail, 0)
+        || ut_common_compile_ret(intf_xmit_large(intf, &header, payload, 4096), 0)) {
+        printf("intf_xmit_large frag_mem_max failed\n");
+        return -5;
+    }
+    /* frag_mem_max end */
+
+    msg_buff_deinit(msg);
+    msg_buff_deinit(rx);
+    free(payload);
+    intf_ctrl_blk_deinit(icb);
+
+    return 0;
+}
+
+int intf_rx_bound_case(void)
+{
+    struct interface_config cfg;
+    struct interface_ctrl_block *icb;
+    struct interface *intf;
+    struct msg_buff *msg, *rx;
+    uint8_t *frame;
+
+    memset(&cfg, 0, sizeof(cfg));
+    cfg.csum_type = CSUM_TYPE_CRC16;
+    icb = intf_ctrl_blk_init();
+    if (ut_common_compile_ret(intf_register(icb, &cfg, &ut_intf_ops), 0)) {
+        printf("intf_register failed\n");
+        return -1;
+    }
+    intf = icb->if_ctrl_head;
+
+    ut_intf_wire_head = ut_intf_wire_tail = 0;
+    msg = ut_intf_local_msg(32);
+    intf_xmit(intf, msg);
+    msg_buff_deinit(msg);
+    frame = ut_intf_wire[0];
+    rx = msg_buff_alloc(64);
+
+    /* rx bound start: a wire len past the received bytes or the buffer is dropped unread */
+    frame[PROTO_WIRE_OFF_LEN] = 4000 >> 8;
+    frame[PROTO_WIRE_OFF_LEN + 1] = 4000 & 0xFF;
+    if (ut_common_compile_ret(intf_recv(intf, rx), -1)) {
+        printf("intf_recv len past the received bytes failed\n");
+        return -2;
+    }
+
+    ut_intf_wire_head = 0;
+    ut_intf_recv_no_cnt = 1;
+    if (ut_common_compile_ret(intf_recv(intf, rx), -1)) {
+        printf("intf_recv len past the rx buffer failed\n");
+        return -2;
+    }
+
+    cfg.csum_type = CSUM_TYPE_NONE;
+    ut_intf_wire_head = 0;
+    if (ut_common_compile_ret(intf_recv(intf, rx), -1)) {
+        printf("intf_recv len past the rx buffer without checksum failed\n");
+        return -2;
+    }
+    ut_intf_recv_no_cnt = 0;
+    /* rx bound end */
+
+    msg_buff_deinit(rx);
+    intf_ctrl_blk_deinit(icb);
+
+    return 0;
+}
+
+int main()
+{
+    int ret;
+
+    ret = intf_fwd_case();
+    if (ret) {
+        printf("intf_fwd_case failed\n");
+        return -1;
+    } else {
+        printf("intf_fwd_case success\n");
+    }
+
+    ret = intf_batch_case();
+    if (ret) {
+        printf("intf_batch_case failed\n");
+        return -1;
+    } else {
+        printf("intf_batch_case success\n");
+    }
+
+    ret = intf_large_case();
+    if (ret) {
+        printf("intf_large_case failed\n");
+        return -1;
+    } else {
+        printf("intf_large_case success\n");
+    }
+
+    ret = intf_rx_bound_case();
+    if (ret) {
+        printf("intf_rx_bound_case failed\n");
+        return -1;
+    } else {
+        printf("intf_rx_bound_case success\n");
+    }
+
+    return 0;
+}
@@ -0,0 +1,201 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "../src/lz.h"
+#include "../src/proto.h"
+#include "../src/errno.h"
+#include "../src/buff.h"
+
+#include "ut_common.h"
+
+#define UT_LZ_LEN 600
+
+/* telemetry-like payload: one field changes per 24 byte record */
+static void lz_fill_telemetry(uint8_t *buf, uint32_t len, uint32_t seed)
+{
+    for (uint32_t i = 0; i < len; i++) {
+        buf[i] = (i % 24 == 23) ? (uint8_t)(seed + i / 24) : "temp=21.5;hum=40;ok=1;n="[i % 24];
+    }
+}
+
+static struct data_src *lz_build(const uint8_t *val, uint16_t len)
+{
+    struct msg_builder bld;
+
+    msg_builder_init(&bld, 0);
+    proto_header_set_dst_id(msg_builder_get_header(&bld), 0x1234);
+    msg_builder_append(&bld, 7, val, len);
+
+    return msg_builder_finalize(&bld);
+}
+
+int lz_roundtrip_case(void)
+{
+    static uint8_t src[UT_LZ_LEN], enc[UT_LZ_LEN], dec[UT_LZ_LEN];
+    struct lz_ctx *tx, *rx;
+    int plain, dict, ret;
+
+    tx = lz_ctx_init();
+    rx = lz_ctx_init();
+
+    /* lz_compress start */
+    lz_fill_telemetry(src, sizeof(src), 1);
+    plain = lz_compress(tx, src, sizeof(src), enc, sizeof(enc), 0);
+    if (plain <= 0 || plain >= UT_LZ_LEN / 2) {
+        printf("lz_compress ratio failed\n");
+        return -1;
+    }
+
+    ret = lz_decompress(rx, enc, plain, dec, sizeof(dec), 0);
+    if (ut_common_compile_ret(ret, sizeof(src)) || memcmp(src, dec, sizeof(src))) {
+        printf("lz_decompress failed\n");
+        return -1;
+    }
+    /* lz_compress end */
+
+    /* dictionary start: trained alike on both ends, small records compress better */
+    lz_fill_telemetry(src, 96, 2);
+    plain = lz_compress(tx, src, 96, enc, sizeof(enc), 0);
+    lz_fill_telemetry(dec, 256, 9);
+    lz_dict_train(tx, dec, 256);
+    lz_dict_train(rx, dec, 256);
+    dict = lz_compress(tx, src, 96, enc, sizeof(enc), 1);
+    if (dict <= 0 || dict >= plain) {
+        printf("lz_compress dictionary ratio failed\n");
+        return -2;
+    }
+
+    ret = lz_decompress(rx, enc, dict, dec, sizeof(dec), 1);
+    if (ut_common_compile_ret(ret, 96) || memcmp(src, dec, 96)) {
+        printf("lz_decompress dictionary failed\n");
+        return -2;
+    }
+    /* dictionary end */
+
+    /* corruption start: one literal then a match reaching before the output */
+    enc[0] = 0x10;
+    enc[1] = 'a';
+    enc[2] = 0x05;
+    enc[3] = 0x00;
+    ret = lz_decompress(rx, enc, 4, dec, sizeof(dec), 0);
+    if (ut_common_compile_ret(ret, -ERR_FAIL)) {
+        printf("lz_decompress -ERR_FAIL failed\n");
+        return -3;
+    }
+
+    ret = lz_compress(tx, src, sizeof(src), enc, 8, 0);
+    if (ut_common_compile_ret(ret, -ERR_OUT_OF_RANGE)) {
+        printf("lz_compress -ERR_OUT_OF_RANGE failed\n");
+        return -3;
+    }
+    /* corruption end */
+
+    lz_ctx_deinit(tx);
+    lz_ctx_deinit(rx);
+
+    return 0;
+}
+
+int lz_adaptive_case(void)
+{
+    static uint8_t val[UT_LZ_LEN];
+    struct data_src *data, *lz_data;
+    struct proto_frame_desc desc;
+    struct lz_ctx *ctx;
+    uint64_t mask;
+    int ret;
+
+    ctx = lz_ctx_init();
+
+    /* lz_data_src_compress start */
+    lz_fill_telemetry(val, sizeof(val), 3);
+    data = lz_build(val, sizeof(val));
+    ret = lz_data_src_compress(ctx, data, &lz_data);
+    if (ut_common_compile_ret(ret, 1) || !(lz_data->header.earmark & PROTO_EARMARK_LZ)
+        || lz_data->header.len >= data->header.len
+        || ut_common_compile_uint16(proto_get_be16((uint8_t *)lz_data->blocks),
+                                    data->header.len - sizeof(struct data_src))) {
+        printf("lz_data_src_compress failed\n");
+        return -1;
+    }
+
+    /* the opaque payload still passes batch validation */
+    desc.header = lz_data->header;
+    desc.frame = (uint8_t *)lz_data;
+    desc.len = lz_data->header.len;
+    if (ut_common_compile_ret(proto_frame_validate_batch(&desc, 1, &mask), 1)) {
+        printf("lz validate failed\n");
+        return -1;
+    }
+
+    ret = lz_data_src_decompress(ctx, &lz_data);
+    if (ut_common_compile_ret(ret, ERR_SUCCESS) || lz_data->header.earmark != data->header.earmark
+        || ut_common_compile_uint16(lz_data->header.len, data->header.len)
+        || memcmp(lz_data->blocks, data->blocks, data->header.len - sizeof(struct data_src))) {
+        printf("lz_data_src_decompress failed\n");
+        return -1;
+    }
+    msg_data_src_deinit(lz_data);
+    msg_data_src_deinit(data);
+    /* lz_data_src_compress end */
+
+    /* small start */
+    data = lz_build(val, 8);
+    if (ut_common_compile_ret(lz_data_src_compress(ctx, data, &lz_data), 0)
+        || ut_common_compile_uint32(ctx->stats.skip_small, 1)) {
+        printf("lz skip_small failed\n");
+        return -2;
+    }
+    msg_data_src_deinit(data);
+    /* small end */
+
+    /* poor ratio start: random payloads back off */
+    srand(5);
+    for (uint32_t i = 0; i < sizeof(val); i++) {
+        val[i] = rand();
+    }
+    data = lz_build(val, sizeof(val));
+    if (ut_common_compile_ret(lz_data_src_compress(ctx, data, &lz_data), 0)
+        || ut_common_compile_uint32(ctx->stats.skip_poor, 1)) {
+        printf("lz skip_poor failed\n");
+        return -3;
+    }
+
+    if (ut_common_compile_ret(lz_data_src_compress(ctx, data, &lz_data), 0)
+        || ut_common_compile_uint32(ctx->stats.skip_backoff, 1)
+        || ut_common_compile_uint32(ctx->stats.skip_poor, 1)) {
+        printf("lz skip_backoff failed\n");
+        return -3;
+    }
+    msg_data_src_deinit(data);
+    /* poor ratio end */
+
+    lz_ctx_deinit(ctx);
+
+    return 0;
+}
+
+int main()
+{
+    int ret;
+
+    ret = lz_roundtrip_case();
+    if (ret) {
+        printf("lz_roundtrip_case failed\n");
+        return -1;
+    } else {
+        printf("lz_roundtrip_case success\n");
+    }
+
+    ret = lz_adaptive_case();
+    if (ret) {
+        printf("lz_adaptive_case failed\n");
+        return -1;
+    } else {
+        printf("lz_adaptive_case success\n");
+    }
+
+    return 0;
+}
@@ -0,0 +1,227 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "../src/pipe.h"
+#include "../src/sched.h"
+#include "../src/disp.h"
+#include "../src/proto.h"
+#include "../src/errno.h"
+#include "../src/buff.h"
+
+#include "ut_common.h"
+
+#define UT_PIPE_TYPE_A 0x0010
+#define UT_PIPE_TYPE_B 0x1234
+
+static uint32_t ut_pipe_hits[2];
+
+static int ut_pipe_handler(struct msg_buff *msg, const struct proto_block_ref *blk, void *arg)
+{
+    int i = (int)(intptr_t)arg;
+
+    if (blk->data[0] != (uint8_t)blk->type) {
+        return -1;
+    }
+    ut_pipe_hits[i]++;
+
+    return 0;
+}
+
+static struct msg_buff *ut_pipe_msg(void)
+{
+    struct msg_builder bld;
+    struct msg_buff *buff;
+    uint8_t val;
+
+    msg_builder_init(&bld, 0);
+    val = (uint8_t)UT_PIPE_TYPE_A;
+    msg_builder_append(&bld, UT_PIPE_TYPE_A, &val, 1);
+    val = (uint8_t)UT_PIPE_TYPE_B;
+    msg_builder_append(&bld, UT_PIPE_TYPE_B, &val, 1);
+    msg_builder_append(&bld, UT_PIPE_TYPE_A, &val, 1);
+    msg_builder_append(&bld, 0x7777, &val, 1);
+
+    buff = msg_buff_init();
+    msg_buff_bind_data(buff, msg_builder_finalize(&bld), 0);
+
+    return buff;
+}
+
+int pipe_create_case(void)
+{
+    struct pipe_ctrl_block *pcb;
+    struct pipe *pipe[2];
+
+    pcb = pipe_ctrl_block_init();
+    if (pcb == NULL) {
+        return -1;
+    }
+
+    /* pipe_create start: ids follow the tail, queues sized from config.h */
+    pipe[0] = pipe_create(pcb);
+    pipe[1] = pipe_create(pcb);
+    if (pipe[0] == NULL || pipe[1] == NULL || ut_common_compile_uint16(pipe[0]->id, 0)
+        || ut_common_compile_uint16(pipe[1]->id, 1) || ut_common_compile_uint8(pcb->pipe_cnt, 2)
+        || ut_common_compile_uint8(pipe[0]->rx_queue_cnt, PIPE_RXQ_CNT)
+        || ut_common_compile_uint8(pipe[0]->tx_queue_cnt, PIPE_TXQ_CNT)
+        || pipe_ctrl_blk_find_pipe(pcb, 1) != pipe[1]) {
+        printf("pipe_create failed\n");
+        return -1;
+    }
+    /* pipe_create end */
+
+    pipe_ctrl_block_deinit(pcb);
+
+    return 0;
+}
+
+int pipe_disp_case(void)
+{
+    struct pipe_ctrl_block *pcb;
+    struct msg_buff *buff;
+    struct pipe *pipe;
+
+    pcb = pipe_ctrl_block_init();
+    pipe = pipe_create(pcb);
+    if (pipe == NULL) {
+        return -1;
+    }
+
+    buff = ut_pipe_msg();
+
+    /* pipe_register_blk_handler start: the table comes with the first handler */
+    if (ut_common_compile_ret(pipe_dispatch_msg_buff(pipe, buff), -1) || pipe->disp != NULL) {
+        printf("pipe_dispatch_msg_buff without table failed\n");
+        return -1;
+    }
+
+    if (ut_common_compile_ret(pipe_register_blk_handler(pipe, UT_PIPE_TYPE_A, ut_pipe_handler, (void *)0), 0)
+        || ut_common_compile_ret(pipe_register_blk_handler(pipe, UT_PIPE_TYPE_B, ut_pipe_handler, (void *)1), 0)
+        || ut_common_compile_ret(pipe_register_blk_handler(pipe, UT_PIPE_TYPE_B, ut_pipe_handler, (void *)1), -1)
+        || ut_common_compile_ret(pipe_register_blk_handler(pipe, 0x0001, NULL, NULL), -1)) {
+        printf("pipe_register_blk_handler failed\n");
+        return -1;
+    }
+    /* pipe_register_blk_handler end */
+
+    /* pipe_dispatch_msg_buff start: every block once, unknown types counted */
+    if (ut_common_compile_ret(pipe_dispatch_msg_buff(pipe, buff), 4)
+        || ut_common_compile_uint32(ut_pipe_hits[0], 1) || ut_common_compile_uint32(ut_pipe_hits[1], 1)
+        || ut_common_compile_uint32(pipe->disp->stats.errors, 1)
+        || ut_common_compile_uint32(pipe->disp->stats.unknown, 1)) {
+        printf("pipe_dispatch_msg_buff failed\n");
+        return -2;
+    }
+    /* pipe_dispatch_msg_buff end */
+
+    msg_buff_deinit(buff);
+    pipe_ctrl_block_deinit(pcb);
+
+    return 0;
+}
+
+static struct msg_buff *ut_pipe_prio_msg(uint8_t prio)
+{
+    struct msg_buff *buff = msg_buff_alloc(32);
+
+    proto_header_set_priority(&((struct data_src *)buff->data)->header, prio);
+
+    return buff;
+}
+
+int pipe_sched_case(void)
+{
+    struct pipe_ctrl_block *pcb;
+    struct msg_buff *buff;
+    struct pipe *pipe;
+
+    pcb = pipe_ctrl_block_init();
+    pipe = pipe_create(pcb);
+    if (pipe == NULL || pipe->tx_sched == NULL) {
+        return -1;
+    }
+
+    /* pipe_tx_msg_buff start: priorities past the last tx queue share it */
+    if (ut_common_compile_ret(pipe_tx_msg_buff(pipe, ut_pipe_prio_msg(PROTO_PRIO_LOW)), 0)
+        || ut_common_compile_ret(pipe_tx_msg_buff(pipe, ut_pipe_prio_msg(PROTO_PRIO_LOW)), 0)
+        || ut_common_compile_ret(pipe_tx_msg_buff(pipe, ut_pipe_prio_msg(PROTO_PRIO_LEVEL4)), 0)
+        || ut_common_compile_ret(msg_queue_get_count(pipe->tx_queue[0]), 2)
+        || ut_common_compile_ret(msg_queue_get_count(pipe->tx_queue[PIPE_TXQ_CNT - 1]), 1)) {
+        printf("pipe_tx_msg_buff failed\n");
+        return -1;
+    }
+    /* pipe_tx_msg_buff end */
+
+    /* pipe_tx_next_msg_buff start: the strict top queue goes first */
+    buff = pipe_tx_next_msg_buff(pipe);
+    if (buff == NULL
+        || ut_common_compile_uint8(((struct data_src *)buff->data)->header.priority, PROTO_PRIO_LEVEL4)) {
+        printf("pipe_tx_next_msg_buff strict failed\n");
+        return -2;
+    }
+    msg_buff_deinit(buff);
+
+    for (int i = 0; i < 2; i++) {
+        buff = pipe_tx_next_msg_buff(pipe);
+        if (buff == NULL || ut_common_compile_uint8(((struct data_src *)buff->data)->header.priority, PROTO_PRIO_LOW)) {
+            printf("pipe_tx_next_msg_buff drr failed\n");
+            return -2;
+        }
+        msg_buff_deinit(buff);
+    }
+
+    if (pipe_tx_next_msg_buff(pipe) != NULL || ut_common_compile_uint32(pipe->tx_sched->active, 0)) {
+        printf("pipe_tx_next_msg_buff empty failed\n");
+        return -2;
+    }
+    /* pipe_tx_next_msg_buff end */
+
+    /* rx queues start: queued by priority, left over ones freed with the pipe */
+    pipe_add_msg_buff(pipe, ut_pipe_prio_msg(PROTO_PRIO_LEVEL4));
+    pipe_add_msg_buff(pipe, ut_pipe_prio_msg(PROTO_PRIO_LOW));
+    if (ut_common_compile_ret(pipe_get_msg_buff_by_qid(pipe, &buff, PIPE_RXQ_CNT - 1), 0)
+        || ut_common_compile_uint8(((struct data_src *)buff->data)->header.priority, PROTO_PRIO_LEVEL4)
+        || ut_common_compile_ret(pipe_get_msg_buff_by_qid(pipe, &buff, PIPE_RXQ_CNT), -1)) {
+        printf("pipe_get_msg_buff_by_qid failed\n");
+        return -3;
+    }
+    msg_buff_deinit(buff);
+    /* rx queues end */
+
+    pipe_ctrl_block_deinit(pcb);
+
+    return 0;
+}
+
+int main()
+{
+    int ret;
+
+    ret = pipe_create_case();
+    if (ret) {
+        printf("pipe_create_case failed\n");
+        return -1;
+    } else {
+        printf("pipe_create_case success\n");
+    }
+
+    ret = pipe_disp_case();
+    if (ret) {
+        printf("pipe_disp_case failed\n");
+        return -1;
+    } else {
+        printf("pipe_disp_case success\n");
+    }
+
+    ret = pipe_sched_case();
+    if (ret) {
+        printf("pipe_sched_case failed\n");
+        return -1;
+    } else {
+        printf("pipe_sched_case success\n");
+    }
+
+    return 0;
+}
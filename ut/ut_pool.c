@@ -0,0 +1,208 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "../src/pool.h"
+#include "../src/errno.h"
+#include "../src/buff.h"
+
+#include "ut_common.h"
+
+#define UT_POOL_OBJ_CNT 100
+
+struct ut_pool_arg {
+    struct pool *pool;
+    void **obj;
+};
+
+static void *pool_free_thread(void *arg)
+{
+    struct ut_pool_arg *a = (struct ut_pool_arg *)arg;
+
+    for (int i = 0; i < UT_POOL_OBJ_CNT; i++) {
+        pool_free(a->pool, a->obj[i]);
+    }
+
+    return NULL;
+}
+
+int pool_class_case(void)
+{
+    struct pool_stats stats;
+    struct pool *pool;
+    void *obj, *heap;
+
+    pool = pool_init();
+    if (pool == NULL) {
+        printf("pool_init failed\n");
+        return -1;
+    }
+
+    /* pool_alloc start: power of two classes */
+    const uint32_t sizes[] = {1, 32, 33, 200, 1500, 65536};
+    const uint32_t cls[] = {32, 32, 64, 256, 2048, 65536};
+    for (unsigned int i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+        obj = pool_alloc(pool, sizes[i]);
+        if (obj == NULL || ut_common_compile_uint32(pool_obj_size(pool, obj), cls[i])) {
+            printf("pool_alloc %u failed\n", sizes[i]);
+            return -1;
+        }
+        memset(obj, 0xA5, sizes[i]);
+        pool_free(pool, obj);
+    }
+
+    if (pool_alloc(pool, 65537) != NULL) {
+        printf("pool_alloc too large failed\n");
+        return -1;
+    }
+    /* pool_alloc end */
+
+    /* pool_free start: foreign memory is left to the caller */
+    heap = malloc(64);
+    if (ut_common_compile_ret(pool_free(pool, heap), -ERR_NOT_FOUND)
+        || ut_common_compile_uint32(pool_obj_size(pool, heap), 0)) {
+        printf("pool_free -ERR_NOT_FOUND failed\n");
+        return -2;
+    }
+    free(heap);
+    /* pool_free end */
+
+    /* magazine start: one depot refill serves POOL_MAG_BATCH allocations */
+    pool_get_stats(pool, &stats);
+    if (ut_common_compile_uint32(stats.threads, 1) || ut_common_compile_uint32(stats.cls[0].in_use, 0)
+        || ut_common_compile_uint32(stats.cls[0].refills, POOL_MAG_BATCH)) {
+        printf("pool_get_stats failed\n");
+        return -3;
+    }
+    /* magazine end */
+
+    pool_deinit(pool);
+
+    return 0;
+}
+
+int pool_thread_case(void)
+{
+    static void *obj[UT_POOL_OBJ_CNT];
+    struct ut_pool_arg arg;
+    struct pool_stats stats;
+    struct pool *pool;
+    pthread_t thread;
+
+    pool = pool_init();
+
+    /* cross thread free start: returned to the depot in batches */
+    for (int i = 0; i < UT_POOL_OBJ_CNT; i++) {
+        obj[i] = pool_alloc(pool, 100);
+    }
+
+    pool_get_stats(pool, &stats);
+    if (ut_common_compile_uint32(stats.cls[2].in_use, UT_POOL_OBJ_CNT)
+        || ut_common_compile_uint32(stats.bytes_in_use, UT_POOL_OBJ_CNT * 128)) {
+        printf("pool_get_stats in_use failed\n");
+        return -1;
+    }
+
+    arg.pool = pool;
+    arg.obj = obj;
+    pthread_create(&thread, NULL, pool_free_thread, &arg);
+    pthread_join(thread, NULL);
+
+    pool_get_stats(pool, &stats);
+    if (ut_common_compile_uint32(stats.threads, 1) || ut_common_compile_uint32(stats.cls[2].in_use, 0)
+        || stats.cls[2].flushes != UT_POOL_OBJ_CNT || stats.cls[2].capacity < UT_POOL_OBJ_CNT) {
+        printf("pool thread exit failed\n");
+        return -2;
+    }
+    /* cross thread free end */
+
+    pool_deinit(pool);
+
+    return 0;
+}
+
+int pool_data_src_case(void)
+{
+    struct pool_stats before, stats;
+    struct data_src *data;
+    int ret;
+
+    msg_data_src_get_pool_stats(&before);
+
+    /* msg_data_src_init start */
+    data = msg_data_src_init(100, NULL);
+    msg_data_src_get_pool_stats(&stats);
+    if (data == NULL || ut_common_compile_uint32(stats.cls[2].in_use, before.cls[2].in_use + 1)) {
+        printf("msg_data_src_init pool failed\n");
+        return -1;
+    }
+    /* msg_data_src_init end */
+
+    /* expand and truncate start: grows within the class, moves up a class, shrinks in place */
+    ret = msg_data_src_expand(&data, 28);
+    msg_data_src_get_pool_stats(&stats);
+    if (ut_common_compile_ret(ret, ERR_SUCCESS) || ut_common_compile_uint32(stats.cls[2].in_use, before.cls[2].in_use + 1)) {
+        printf("msg_data_src_expand in place failed\n");
+        return -2;
+    }
+
+    ret = msg_data_src_expand(&data, 1000);
+    msg_data_src_get_pool_stats(&stats);
+    if (ut_common_compile_ret(ret, ERR_SUCCESS) || ut_common_compile_uint16(data->header.len, 1128)
+        || ut_common_compile_uint32(stats.cls[2].in_use, before.cls[2].in_use)
+        || ut_common_compile_uint32(stats.cls[6].in_use, before.cls[6].in_use + 1)) {
+        printf("msg_data_src_expand move failed\n");
+        return -2;
+    }
+
+    ret = msg_data_src_truncate(&data, 1028);
+    msg_data_src_get_pool_stats(&stats);
+    if (ut_common_compile_ret(ret, ERR_SUCCESS) || ut_common_compile_uint16(data->header.len, 100)
+        || ut_common_compile_uint32(stats.cls[6].in_use, before.cls[6].in_use + 1)) {
+        printf("msg_data_src_truncate failed\n");
+        return -2;
+    }
+    /* expand and truncate end */
+
+    msg_data_src_deinit(data);
+    msg_data_src_get_pool_stats(&stats);
+    if (ut_common_compile_uint32(stats.cls[6].in_use, before.cls[6].in_use)) {
+        printf("msg_data_src_deinit pool failed\n");
+        return -3;
+    }
+
+    return 0;
+}
+
+int main()
+{
+    int ret;
+
+    ret = pool_class_case();
+    if (ret) {
+        printf("pool_class_case failed\n");
+        return -1;
+    } else {
+        printf("pool_class_case success\n");
+    }
+
+    ret = pool_thread_case();
+    if (ret) {
+        printf("pool_thread_case failed\n");
+        return -1;
+    } else {
+        printf("pool_thread_case success\n");
+    }
+
+    ret = pool_data_src_case();
+    if (ret) {
+        printf("pool_data_src_case failed\n");
+        return -1;
+    } else {
+        printf("pool_data_src_case success\n");
+    }
+
+    return 0;
+}
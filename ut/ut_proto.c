@@ -1,6 +1,7 @@
 #include <stdint.h>
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 
 #include "../src/proto.h"
 #include "../src/errno.h"
@@ -184,6 +185,163 @@ int proto_block_case(void)
     return 0;
 }
 
+int proto_codec_case(void)
+{
+    const uint8_t expect[PROTO_HEADER_WIRE_SIZE] = {
+        0x10, 0x6A, 0x00, 0x3C, 0x11, 0x22, 0x33, 0x44,
+        0xA1, 0xB2, 0xC3, 0xD4, 0x00, 0x14, 0xBE, 0xEF,
+    };
+    struct proto_frame_desc desc[4];
+    struct proto_header header;
+    struct proto_header out;
+    uint8_t buf[64];
+    uint32_t used;
+    int ret;
+
+    proto_header_reset(&header);
+    proto_header_set_hop_limit(&header, 0x10);
+    header.earmark = 3;
+    proto_header_set_cfg(&header, 1);
+    proto_header_set_priority(&header, 2);
+    proto_header_set_src_id(&header, 0x11223344);
+    proto_header_set_dst_id(&header, 0xA1B2C3D4);
+    proto_header_set_len(&header, 20);
+    proto_header_set_checksum(&header, 0xBEEF);
+
+    /* proto_header_encode */
+    ret = proto_header_encode(&header, buf, PROTO_HEADER_WIRE_SIZE - 1);
+    if (ut_common_compile_ret(ret, -ERR_OUT_OF_RANGE)) {
+        printf("proto_header_encode -ERR_OUT_OF_RANGE failed\n");
+        return -1;
+    }
+
+    ret = proto_header_encode(&header, buf, sizeof(buf));
+    if (ut_common_compile_ret(ret, ERR_SUCCESS)) {
+        printf("proto_header_encode ERR_SUCCESS failed\n");
+        return -1;
+    }
+
+    if (memcmp(buf, expect, sizeof(expect))) {
+        printf("proto_header_encode layout failed\n");
+        return -1;
+    }
+
+    /* proto_header_decode */
+    ret = proto_header_decode(&out, buf, sizeof(buf));
+    if (ut_common_compile_ret(ret, ERR_SUCCESS)) {
+        printf("proto_header_decode ERR_SUCCESS failed\n");
+        return -2;
+    }
+
+    if (ut_common_compile_uint8(out.earmark, 3) || ut_common_compile_uint8(out.cfg_hdr, 1)
+        || ut_common_compile_uint8(out.priority, 2) || ut_common_compile_uint32(out.dst_id, 0xA1B2C3D4)
+        || ut_common_compile_uint16(out.len, 20) || ut_common_compile_uint16(out.checksum, 0xBEEF)) {
+        printf("proto_header_decode val failed\n");
+        return -2;
+    }
+
+    /* proto_frame_decode_batch: two 20 byte frames and a truncated third one */
+    memset(buf + PROTO_HEADER_WIRE_SIZE, 0xAA, 4);
+    memcpy(buf + 20, buf, 20);
+    buf[20] = 0x0F;
+    memcpy(buf + 40, buf, PROTO_HEADER_WIRE_SIZE);
+
+    ret = proto_frame_decode_batch(buf, 50, desc, 4, &used);
+    if (ut_common_compile_ret(ret, 2) || ut_common_compile_uint32(used, 40)) {
+        printf("proto_frame_decode_batch cnt failed\n");
+        return -3;
+    }
+
+    if (ut_common_compile_uint8(desc[1].header.hop_limit, 0x0F)
+        || ut_common_compile_uint32(desc[1].header.src_id, 0x11223344)
+        || ut_common_compile_uint8(desc[1].header.earmark, 3)
+        || desc[1].frame != buf + 20 || ut_common_compile_uint16(desc[1].len, 20)) {
+        printf("proto_frame_decode_batch val failed\n");
+        return -3;
+    }
+
+    ret = proto_frame_decode_batch(buf, 50, desc, 1, &used);
+    if (ut_common_compile_ret(ret, 1) || ut_common_compile_uint32(used, 20)) {
+        printf("proto_frame_decode_batch desc_cnt failed\n");
+        return -3;
+    }
+
+    return 0;
+}
+
+#define UT_VALIDATE_CNT 70
+#define UT_VALIDATE_LEN 28
+
+int proto_validate_case(void)
+{
+    static uint8_t buf[UT_VALIDATE_CNT * UT_VALIDATE_LEN];
+    struct proto_frame_desc desc[UT_VALIDATE_CNT];
+    const int bad[] = {3, 9, 17, 30, 41, 66};
+    struct proto_header header;
+    struct proto_block block;
+    uint64_t mask[2], expect[2];
+    uint8_t *frame;
+    int ret;
+
+    proto_header_reset(&header);
+    proto_header_set_len(&header, UT_VALIDATE_LEN);
+    for (int i = 0; i < UT_VALIDATE_CNT; i++) {
+        frame = buf + i * UT_VALIDATE_LEN;
+        proto_header_encode(&header, frame, UT_VALIDATE_LEN);
+        block.type = 1;
+        block.len = 3;
+        memcpy(frame + PROTO_HEADER_WIRE_SIZE, &block, sizeof(block));
+        block.type = 2;
+        block.len = 1;
+        memcpy(frame + PROTO_HEADER_WIRE_SIZE + 7, &block, sizeof(block));
+    }
+
+    ret = proto_frame_decode_batch(buf, sizeof(buf), desc, UT_VALIDATE_CNT, NULL);
+    if (ut_common_compile_ret(ret, UT_VALIDATE_CNT)) {
+        printf("proto_frame_decode_batch cnt failed\n");
+        return -1;
+    }
+
+    /* one defect per bad frame */
+    desc[3].len = UT_VALIDATE_LEN - 1;
+    desc[9].header.hop_limit = PROTO_HEADER_HOP_LIMIT_MAX + 1;
+    desc[17].header.priority = PROTO_HEADER_PRIORITY_MAX + 1;
+    desc[30].header.cfg_hdr = 2;
+    block.len = 2;
+    memcpy(buf + 41 * UT_VALIDATE_LEN + PROTO_HEADER_WIRE_SIZE + 7, &block, sizeof(block));
+    block.len = 0;
+    memcpy(buf + 66 * UT_VALIDATE_LEN + PROTO_HEADER_WIRE_SIZE, &block, sizeof(block));
+
+    /* a compact payload that tiles passes */
+    frame = buf + 50 * UT_VALIDATE_LEN + PROTO_HEADER_WIRE_SIZE;
+    frame[0] = 0x01;
+    frame[1] = UT_VALIDATE_LEN - PROTO_HEADER_WIRE_SIZE - 2;
+    desc[50].header.cfg_hdr = PROTO_HEADER_CFG_COMPACT;
+
+    /* proto_frame_validate_batch start */
+    expect[0] = ~0ULL;
+    expect[1] = (1ULL << (UT_VALIDATE_CNT - 64)) - 1;
+    for (unsigned int i = 0; i < sizeof(bad) / sizeof(bad[0]); i++) {
+        expect[bad[i] / 64] &= ~(1ULL << (bad[i] % 64));
+    }
+
+    ret = proto_frame_validate_batch(desc, UT_VALIDATE_CNT, mask);
+    if (ut_common_compile_ret(ret, UT_VALIDATE_CNT - 6) || mask[0] != expect[0] || mask[1] != expect[1]) {
+        printf("proto_frame_validate_batch mask failed\n");
+        return -1;
+    }
+
+    /* a partial batch takes the non-vector tail */
+    ret = proto_frame_validate_batch(desc + 1, 5, mask);
+    if (ut_common_compile_ret(ret, 4) || mask[0] != 0x1B) {
+        printf("proto_frame_validate_batch tail failed\n");
+        return -2;
+    }
+    /* proto_frame_validate_batch end */
+
+    return 0;
+}
+
 int main()
 {
     int ret;
@@ -204,5 +362,21 @@ int main()
         printf("proto_block_case success\n");
     }
 
+    ret = proto_codec_case();
+    if (ret) {
+        printf("proto_codec_case failed\n");
+        return -1;
+    } else {
+        printf("proto_codec_case success\n");
+    }
+
+    ret = proto_validate_case();
+    if (ret) {
+        printf("proto_validate_case failed\n");
+        return -1;
+    } else {
+        printf("proto_validate_case success\n");
+    }
+
     return 0;
 }
@@ -0,0 +1,201 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "../src/sched.h"
+#include "../src/proto.h"
+#include "../src/errno.h"
+#include "../src/buff.h"
+
+#include "ut_common.h"
+
+#define UT_SCHED_LEVEL_CNT 3
+
+static struct msg_queue *ut_sched_queue[UT_SCHED_LEVEL_CNT];
+
+static struct msg_buff *ut_sched_msg(uint16_t size, uint8_t prio)
+{
+    struct msg_buff *buff = msg_buff_alloc(size);
+
+    proto_header_set_priority(&((struct data_src *)buff->data)->header, prio);
+
+    return buff;
+}
+
+static void ut_sched_fill(struct sched *sched, int cnt, uint16_t size, uint8_t prio)
+{
+    for (int i = 0; i < cnt; i++) {
+        sched_enqueue(sched, ut_sched_msg(size, prio));
+    }
+}
+
+static int ut_sched_drain(struct sched *sched)
+{
+    struct msg_buff *buff;
+    int cnt = 0;
+
+    while ((buff = sched_dequeue(sched)) != NULL) {
+        msg_buff_deinit(buff);
+        cnt++;
+    }
+
+    return cnt;
+}
+
+int sched_strict_case(void)
+{
+    struct msg_buff *buff;
+    struct sched *sched;
+
+    for (int i = 0; i < UT_SCHED_LEVEL_CNT; i++) {
+        ut_sched_queue[i] = msg_queue_init(i);
+    }
+
+    /* msg_buff_select_queue start: priorities past the last queue land in it */
+    sched = sched_init(ut_sched_queue, 2, NULL);
+    buff = ut_sched_msg(32, PROTO_PRIO_LEVEL4);
+    if (ut_common_compile_uint8(msg_buff_select_queue(buff, 2), 1)
+        || ut_common_compile_ret(sched_enqueue(sched, buff), ERR_SUCCESS)
+        || ut_common_compile_ret(msg_queue_get_count(ut_sched_queue[1]), 1)
+        || ut_common_compile_uint32(sched->active, 0x2)) {
+        printf("msg_buff_select_queue failed\n");
+        return -1;
+    }
+    ut_sched_drain(sched);
+    sched_deinit(sched);
+    /* msg_buff_select_queue end */
+
+    /* strict start: the top level jumps the lower ones */
+    sched = sched_init(ut_sched_queue, UT_SCHED_LEVEL_CNT, NULL);
+    ut_sched_fill(sched, 4, 32, PROTO_PRIO_LOW);
+    ut_sched_fill(sched, 4, 32, PROTO_PRIO_LEVEL1);
+    ut_sched_fill(sched, 3, 32, PROTO_PRIO_LEVEL4);
+
+    for (int i = 0; i < 3; i++) {
+        buff = sched_dequeue(sched);
+        if (buff == NULL || ut_common_compile_uint8(((struct data_src *)buff->data)->header.priority, PROTO_PRIO_LEVEL4)) {
+            printf("sched_dequeue strict failed\n");
+            return -2;
+        }
+        msg_buff_deinit(buff);
+    }
+
+    if (ut_common_compile_uint32(sched->active, 0x3) || ut_common_compile_uint32(sched->stats.tx_cnt[2], 3)
+        || ut_common_compile_uint32(sched->stats.tx_bytes[2], 96)) {
+        printf("sched_dequeue strict idle failed\n");
+        return -2;
+    }
+    /* strict end */
+
+    /* below strict start: the lower levels are served once it drains */
+    if (ut_common_compile_ret(ut_sched_drain(sched), 8) || ut_common_compile_uint32(sched->active, 0)
+        || ut_common_compile_uint32(sched->stats.tx_cnt[0], 4) || ut_common_compile_uint32(sched->stats.tx_cnt[1], 4)
+        || sched_dequeue(sched) != NULL) {
+        printf("sched_dequeue below strict failed\n");
+        return -3;
+    }
+    /* below strict end */
+
+    sched_deinit(sched);
+    for (int i = 0; i < UT_SCHED_LEVEL_CNT; i++) {
+        msg_queue_deinit(ut_sched_queue[i]);
+    }
+
+    return 0;
+}
+
+int sched_drr_case(void)
+{
+    struct sched_cfg cfg;
+    struct msg_buff *buff;
+    struct sched *sched;
+    int low = 0;
+
+    for (int i = 0; i < UT_SCHED_LEVEL_CNT; i++) {
+        ut_sched_queue[i] = msg_queue_init(i);
+    }
+
+    memset(&cfg, 0, sizeof(cfg));
+    cfg.strict_cnt = UT_SCHED_LEVEL_CNT + 1;
+    if (sched_init(ut_sched_queue, UT_SCHED_LEVEL_CNT, &cfg) != NULL) {
+        printf("sched_init strict_cnt failed\n");
+        return -1;
+    }
+
+    /* quantum start: bandwidth shared 3:1 by quantum */
+    cfg.strict_cnt = 1;
+    cfg.quantum[0] = 100;
+    cfg.quantum[1] = 300;
+    sched = sched_init(ut_sched_queue, UT_SCHED_LEVEL_CNT, &cfg);
+    ut_sched_fill(sched, 30, 100, PROTO_PRIO_LOW);
+    ut_sched_fill(sched, 30, 100, PROTO_PRIO_LEVEL1);
+
+    for (int i = 0; i < 20; i++) {
+        msg_buff_deinit(sched_dequeue(sched));
+    }
+
+    if (ut_common_compile_uint32(sched->stats.tx_cnt[1], 15) || ut_common_compile_uint32(sched->stats.tx_cnt[0], 5)) {
+        printf("sched_dequeue drr share failed\n");
+        return -2;
+    }
+    /* quantum end */
+
+    /* starvation start: a quantum below the message size still gets through */
+    ut_sched_drain(sched);
+    if (ut_common_compile_ret(sched_set_quantum(sched, 0, 10), ERR_SUCCESS)
+        || ut_common_compile_ret(sched_set_quantum(sched, UT_SCHED_LEVEL_CNT, 10), -ERR_INVALID_ARG)) {
+        printf("sched_set_quantum failed\n");
+        return -3;
+    }
+    ut_sched_fill(sched, 2, 100, PROTO_PRIO_LOW);
+    ut_sched_fill(sched, 40, 100, PROTO_PRIO_LEVEL1);
+
+    for (int i = 0; i < 42; i++) {
+        buff = sched_dequeue(sched);
+        if (buff == NULL) {
+            printf("sched_dequeue starvation failed\n");
+            return -3;
+        }
+        if (((struct data_src *)buff->data)->header.priority == PROTO_PRIO_LOW && i < 40) {
+            low++;
+        }
+        msg_buff_deinit(buff);
+    }
+
+    if (low == 0 || sched->active != 0) {
+        printf("sched_dequeue starvation order failed\n");
+        return -3;
+    }
+    /* starvation end */
+
+    sched_deinit(sched);
+    for (int i = 0; i < UT_SCHED_LEVEL_CNT; i++) {
+        msg_queue_deinit(ut_sched_queue[i]);
+    }
+
+    return 0;
+}
+
+int main()
+{
+    int ret;
+
+    ret = sched_strict_case();
+    if (ret) {
+        printf("sched_strict_case failed\n");
+        return -1;
+    } else {
+        printf("sched_strict_case success\n");
+    }
+
+    ret = sched_drr_case();
+    if (ret) {
+        printf("sched_drr_case failed\n");
+        return -1;
+    } else {
+        printf("sched_drr_case success\n");
+    }
+
+    return 0;
+}
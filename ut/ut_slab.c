@@ -0,0 +1,106 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "../src/slab.h"
+#include "../src/errno.h"
+
+#include "ut_common.h"
+
+#define UT_SLAB_OBJ_SIZE 100
+
+int slab_alloc_case(void)
+{
+    struct slab_cache *cache;
+    struct slab_stats stats;
+    uint8_t *obj[1000];
+    uint8_t *heap;
+    uint32_t per_chunk;
+
+    /* slab_cache_init start */
+    cache = slab_cache_init(UT_SLAB_OBJ_SIZE);
+    if (cache == NULL || ut_common_compile_uint32(cache->obj_size, 112)) {
+        printf("slab_cache_init failed\n");
+        return -1;
+    }
+    per_chunk = cache->obj_per_chunk;
+
+    if (slab_cache_init(2) != NULL || slab_cache_init(SLAB_CHUNK_SIZE + 1) != NULL) {
+        printf("slab_cache_init -ERR_INVALID_ARG failed\n");
+        return -1;
+    }
+    /* slab_cache_init end */
+
+    /* slab_alloc start: objects never overlap across chunks */
+    for (int i = 0; i < 1000; i++) {
+        obj[i] = (uint8_t *)slab_alloc(cache);
+        if (obj[i] == NULL || ((uintptr_t)obj[i] & (SLAB_OBJ_ALIGN - 1))) {
+            printf("slab_alloc failed\n");
+            return -2;
+        }
+        memset(obj[i], i, UT_SLAB_OBJ_SIZE);
+    }
+
+    for (int i = 0; i < 1000; i++) {
+        if (ut_common_compile_uint8(obj[i][0], (uint8_t)i) || ut_common_compile_uint8(obj[i][99], (uint8_t)i)) {
+            printf("slab_alloc overlap failed\n");
+            return -2;
+        }
+    }
+
+    slab_get_stats(cache, &stats);
+    if (ut_common_compile_uint32(stats.in_use, 1000)
+        || ut_common_compile_uint32(stats.chunks, (1000 + per_chunk - 1) / per_chunk)) {
+        printf("slab_get_stats failed\n");
+        return -2;
+    }
+    /* slab_alloc end */
+
+    /* slab_owns start */
+    heap = (uint8_t *)malloc(UT_SLAB_OBJ_SIZE);
+    if (!slab_owns(cache, obj[0]) || !slab_owns(cache, obj[999] + 50) || slab_owns(cache, heap)
+        || slab_owns(cache, NULL)) {
+        printf("slab_owns failed\n");
+        return -3;
+    }
+    free(heap);
+    /* slab_owns end */
+
+    /* slab_free start: LIFO reuse */
+    slab_free(cache, obj[10]);
+    slab_free(cache, obj[20]);
+    if (slab_alloc(cache) != obj[20] || slab_alloc(cache) != obj[10]) {
+        printf("slab_free reuse failed\n");
+        return -4;
+    }
+
+    for (int i = 0; i < 1000; i++) {
+        slab_free(cache, obj[i]);
+    }
+    slab_get_stats(cache, &stats);
+    if (ut_common_compile_uint32(stats.in_use, 0) || stats.allocs != stats.frees) {
+        printf("slab_free stats failed\n");
+        return -4;
+    }
+    /* slab_free end */
+
+    slab_cache_deinit(cache);
+
+    return 0;
+}
+
+int main()
+{
+    int ret;
+
+    ret = slab_alloc_case();
+    if (ret) {
+        printf("slab_alloc_case failed\n");
+        return -1;
+    } else {
+        printf("slab_alloc_case success\n");
+    }
+
+    return 0;
+}
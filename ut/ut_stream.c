@@ -0,0 +1,151 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "../src/stream.h"
+#include "../src/proto.h"
+#include "../src/errno.h"
+#include "../src/csum.h"
+#include "../src/buff.h"
+
+#include "ut_common.h"
+
+#define UT_STREAM_FRAME_CNT 40
+#define UT_STREAM_MAX_LEN 256
+#define UT_STREAM_GARBAGE 300
+
+static uint8_t ut_stream_buf[UT_STREAM_FRAME_CNT * UT_STREAM_MAX_LEN + 2 * UT_STREAM_GARBAGE];
+static uint32_t ut_stream_off[UT_STREAM_FRAME_CNT];
+static uint16_t ut_stream_len[UT_STREAM_FRAME_CNT];
+static int ut_stream_seen;
+static int ut_stream_bad;
+
+static int ut_stream_emit(const uint8_t *frame, uint16_t len, void *arg)
+{
+    int skip = (int)(intptr_t)arg;
+
+    /* the corrupted frame never comes out */
+    if (ut_stream_seen == skip) {
+        ut_stream_seen++;
+    }
+
+    if (ut_stream_seen >= UT_STREAM_FRAME_CNT || len != ut_stream_len[ut_stream_seen]
+        || memcmp(frame, ut_stream_buf + ut_stream_off[ut_stream_seen], len)) {
+        ut_stream_bad++;
+    }
+    ut_stream_seen++;
+
+    return 0;
+}
+
+static uint32_t ut_stream_build(uint32_t off, uint32_t seed)
+{
+    struct msg_builder bld;
+    struct data_src *data;
+    uint8_t val[64];
+
+    for (int i = 0; i < UT_STREAM_FRAME_CNT; i++) {
+        msg_builder_init(&bld, 0);
+        proto_header_set_src_id(msg_builder_get_header(&bld), i);
+        memset(val, i, sizeof(val));
+        msg_builder_append(&bld, 1, val, 1 + (i * 7 + seed) % 60);
+        msg_builder_append(&bld, 2, val, 1 + i % 5);
+        data = msg_builder_finalize(&bld);
+
+        ut_stream_off[i] = off;
+        ut_stream_len[i] = data->header.len;
+        memcpy(ut_stream_buf + off, data, data->header.len);
+        proto_header_encode(&data->header, ut_stream_buf + off, data->header.len);
+        proto_frame_set_checksum(ut_stream_buf + off, data->header.len, CSUM_TYPE_CRC16);
+        off += data->header.len;
+        msg_data_src_deinit(data);
+    }
+
+    return off;
+}
+
+int stream_dec_case(void)
+{
+    struct stream_dec *dec;
+    uint32_t len, off;
+    int ret;
+
+    /* stream_dec_feed start: one chunk of clean frames, nothing is copied */
+    len = ut_stream_build(0, 0);
+    dec = stream_dec_init(UT_STREAM_MAX_LEN, CSUM_TYPE_CRC16, ut_stream_emit, (void *)(intptr_t)-1);
+    if (dec == NULL) {
+        return -1;
+    }
+
+    ret = stream_dec_feed(dec, ut_stream_buf, len);
+    if (ut_common_compile_ret(ret, UT_STREAM_FRAME_CNT) || ut_stream_bad
+        || ut_common_compile_uint32(dec->stats.copied, 0)) {
+        printf("stream_dec_feed clean failed\n");
+        return -1;
+    }
+    /* stream_dec_feed end */
+
+    /* resync start: garbage, a corrupted frame and odd chunk sizes */
+    srand(7);
+    for (int i = 0; i < UT_STREAM_GARBAGE; i++) {
+        ut_stream_buf[i] = rand();
+    }
+    len = ut_stream_build(UT_STREAM_GARBAGE, 3);
+    ut_stream_buf[ut_stream_off[11] + PROTO_HEADER_WIRE_SIZE + 6] ^= 0x40;
+    for (int i = 0; i < UT_STREAM_GARBAGE; i++) {
+        ut_stream_buf[len++] = rand();
+    }
+
+    stream_dec_reset(dec);
+    dec->arg = (void *)(intptr_t)11;
+    ut_stream_seen = 0;
+    for (off = 0; off < len; off += ret) {
+        ret = 1 + rand() % 97;
+        ret = (off + ret > len) ? (int)(len - off) : ret;
+        stream_dec_feed(dec, ut_stream_buf + off, ret);
+    }
+
+    if (ut_common_compile_ret(ut_stream_seen, UT_STREAM_FRAME_CNT) || ut_stream_bad
+        || ut_common_compile_uint32(dec->stats.frames, 2 * UT_STREAM_FRAME_CNT - 1)
+        || dec->stats.resyncs < 1 || dec->stats.csum_errors < 1) {
+        printf("stream_dec_feed resync failed\n");
+        return -2;
+    }
+    /* resync end */
+
+    /* stream_find_header start */
+    memset(ut_stream_buf, 0xFF, 100);
+    memcpy(ut_stream_buf + 77, ut_stream_buf + ut_stream_off[0], PROTO_HEADER_WIRE_SIZE);
+    ret = stream_find_header(ut_stream_buf, 100, UT_STREAM_MAX_LEN);
+    if (ut_common_compile_ret(ret, 77)) {
+        printf("stream_find_header failed\n");
+        return -3;
+    }
+
+    ret = stream_find_header(ut_stream_buf, 92, UT_STREAM_MAX_LEN);
+    if (ut_common_compile_ret(ret, -ERR_NOT_FOUND)) {
+        printf("stream_find_header -ERR_NOT_FOUND failed\n");
+        return -3;
+    }
+    /* stream_find_header end */
+
+    stream_dec_deinit(dec);
+
+    return 0;
+}
+
+int main()
+{
+    int ret;
+
+    ret = stream_dec_case();
+    if (ret) {
+        printf("stream_dec_case failed\n");
+        return -1;
+    } else {
+        printf("stream_dec_case success\n");
+    }
+
+    return 0;
+}
@@ -0,0 +1,150 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "../src/tstamp.h"
+#include "../src/errno.h"
+#include "../src/buff.h"
+
+#include "ut_common.h"
+
+int tstamp_cache_case(void)
+{
+    uint64_t t0, t1;
+
+    /* tstamp_cached_ns start: live until the first refresh, then frozen */
+    t0 = tstamp_cached_ns();
+    t1 = tstamp_now_ns();
+    if (t0 == 0 || t1 < t0) {
+        printf("tstamp_cached_ns live failed\n");
+        return -1;
+    }
+
+    t0 = tstamp_refresh();
+    t1 = tstamp_now_ns();
+    while (tstamp_now_ns() == t1) {
+    }
+    if (tstamp_cached_ns() != t0) {
+        printf("tstamp_cached_ns frozen failed\n");
+        return -1;
+    }
+
+    if (tstamp_refresh() <= t0) {
+        printf("tstamp_refresh failed\n");
+        return -1;
+    }
+
+    t0 = tstamp_cached_ns();
+    tstamp_invalidate();
+    while (tstamp_now_ns() == t0) {
+    }
+    if (tstamp_cached_ns() <= t0) {
+        printf("tstamp_invalidate failed\n");
+        return -1;
+    }
+    /* tstamp_cached_ns end */
+
+    return 0;
+}
+
+int tstamp_sojourn_case(void)
+{
+    struct tstamp_sojourn sojourn;
+
+    tstamp_sojourn_reset(&sojourn);
+
+    /* tstamp_sojourn_record start */
+    for (int i = 0; i < 99; i++) {
+        tstamp_sojourn_record(&sojourn, 1000);
+    }
+    tstamp_sojourn_record(&sojourn, 5000000);
+
+    if (ut_common_compile_uint32(sojourn.cnt, 100) || ut_common_compile_uint32(sojourn.max_ns, 5000000)
+        || ut_common_compile_uint32(sojourn.hist[9], 99) || ut_common_compile_uint32(sojourn.hist[22], 1)) {
+        printf("tstamp_sojourn_record failed\n");
+        return -1;
+    }
+    /* tstamp_sojourn_record end */
+
+    /* tstamp_sojourn_percentile start: bucket upper bounds */
+    if (ut_common_compile_uint32(tstamp_sojourn_percentile(&sojourn, 50), 1024)
+        || ut_common_compile_uint32(tstamp_sojourn_percentile(&sojourn, 99), 1024)
+        || ut_common_compile_uint32(tstamp_sojourn_percentile(&sojourn, 100), 1 << 23)) {
+        printf("tstamp_sojourn_percentile failed\n");
+        return -2;
+    }
+    /* tstamp_sojourn_percentile end */
+
+    return 0;
+}
+
+int tstamp_queue_case(void)
+{
+    struct msg_queue *queue;
+    struct msg_buff *buff;
+    uint64_t t0;
+
+    queue = msg_queue_init(1);
+
+    /* msg_buff stamps start: bind and enqueue use the cached clock */
+    t0 = tstamp_refresh();
+    buff = msg_buff_alloc(32);
+    if (buff->timestamp != t0) {
+        printf("msg_buff_set_time_now failed\n");
+        return -1;
+    }
+    msg_queue_enqueue(queue, buff);
+    if (buff->enq_ns != t0) {
+        printf("msg_queue_enqueue enq_ns failed\n");
+        return -1;
+    }
+    /* msg_buff stamps end */
+
+    /* sojourn start: recorded at dequeue against the consumer's reading */
+    while (tstamp_now_ns() - t0 < 100000) {
+    }
+    tstamp_refresh();
+    buff = msg_queue_dequeue(queue);
+    if (ut_common_compile_uint32(queue->stats.sojourn.cnt, 1) || queue->stats.sojourn.last_ns < 100000) {
+        printf("msg_queue_dequeue sojourn failed\n");
+        return -2;
+    }
+    msg_buff_deinit(buff);
+    /* sojourn end */
+
+    msg_queue_deinit(queue);
+
+    return 0;
+}
+
+int main()
+{
+    int ret;
+
+    ret = tstamp_cache_case();
+    if (ret) {
+        printf("tstamp_cache_case failed\n");
+        return -1;
+    } else {
+        printf("tstamp_cache_case success\n");
+    }
+
+    ret = tstamp_sojourn_case();
+    if (ret) {
+        printf("tstamp_sojourn_case failed\n");
+        return -1;
+    } else {
+        printf("tstamp_sojourn_case success\n");
+    }
+
+    ret = tstamp_queue_case();
+    if (ret) {
+        printf("tstamp_queue_case failed\n");
+        return -1;
+    } else {
+        printf("tstamp_queue_case success\n");
+    }
+
+    return 0;
+}